@@ -0,0 +1,23 @@
+#pragma once
+
+#include "tensor.h"
+#include <functional>
+#include <vector>
+
+using CheckpointFunction =
+    std::function<std::vector<Tensor *>(const std::vector<Tensor *> &)>;
+
+// activation checkpointing: runs fn(inputs) and keeps none of what it
+// computes on the way. the outputs hang off one CHECKPOINT node over
+// `inputs`, and everything else fn allocated goes back to the pool. the
+// backward pass runs fn again from the random state of the forward pass, so
+// dropout draws the same masks, backpropagates through the recomputed graph
+// and frees it too. a region costs one more forward pass and holds only its
+// inputs and outputs until the backward pass.
+//
+// fn has to compute the same thing from the same inputs and random state,
+// and may not keep tensors it allocates other than its outputs. parameters
+// it captures are leaves and get their gradients as usual, a tensor computed
+// outside that needs a gradient has to be passed in `inputs`
+std::vector<Tensor *> checkpoint(const CheckpointFunction &fn,
+                                 const std::vector<Tensor *> &inputs);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "fusion.h"
+#include <cstdint>
+#include <string>
+
+// specialized kernels for fused programs. the program, shape and strides are
+// baked into Metal source as constants, so the compiler can fold the index
+// arithmetic and unroll the code that __fused_elementwise__ interprets.
+// generated kernels keep its bindings (inputs 0-7, output 8), the metadata
+// and code buffers are bound but not read.
+
+// everything a generated kernel depends on, two programs with the same
+// signature share a kernel
+std::string fused_signature(const FusedProgram &program,
+                            const FusedLayout &layout);
+// FNV-1a, names the kernel and its cache files
+uint64_t fused_hash(const std::string &signature);
+std::string fused_kernel_name(uint64_t hash);
+std::string generate_fused_source(const std::string &name,
+                                  const FusedProgram &program,
+                                  const FusedLayout &layout);
+// $ACTX_KERNEL_CACHE, or ~/.cache/actx/kernels
+std::string kernel_cache_dir();
@@ -0,0 +1,248 @@
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine.h needs C++20, compile the including file with -std=c++20"
+#endif
+
+#include "tensor.h"
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// coroutines over the async stream for C++ callers. an op returns once its
+// kernel is committed, co_await suspends the coroutine until the kernel has
+// completed instead of blocking the thread, so one thread can drive many
+// requests while the GPU works on all of them:
+//
+//   using namespace actx::async;
+//   Task<std::vector<float>> infer(Tensor *x, Tensor *w) {
+//     Tensor *y = co_await mul_async(x, w);
+//     co_return co_await read(y);
+//   }
+//   Scheduler scheduler;
+//   scheduler.spawn(infer(a, w));
+//   scheduler.spawn(infer(b, w));
+//   scheduler.run();
+//
+// coroutines are only resumed by Scheduler::run() on the thread calling it,
+// completion handlers just queue them, the tensor runtime is not thread safe
+namespace actx {
+namespace async {
+
+template <typename T> class Task;
+
+// runs ready coroutines on the calling thread until every spawned task is done
+class Scheduler {
+private:
+  std::mutex _lock;
+  std::condition_variable _wake;
+  std::deque<std::coroutine_handle<>> _queue;
+  std::vector<Task<void>> _tasks;
+  static inline thread_local Scheduler *_current = nullptr;
+
+  bool _idle() const;
+  template <typename Done> void _drive(Done done);
+
+public:
+  // the scheduler running on this thread, awaiting outside run() throws
+  static Scheduler &current() {
+    if (!_current)
+      throw std::logic_error("co_await on a tensor outside Scheduler::run()");
+    return *_current;
+  }
+  // thread safe, called from Metal completion threads
+  void post(std::coroutine_handle<> handle) {
+    {
+      std::lock_guard<std::mutex> guard(_lock);
+      _queue.push_back(handle);
+    }
+    _wake.notify_one();
+  }
+  // starts `task` on the next run()
+  void spawn(Task<void> task);
+  // returns once the spawned tasks are done, rethrows the first failure
+  void run();
+  // runs `task` and the spawned tasks until `task` is done
+  template <typename T> T run(Task<T> task);
+};
+
+template <typename T> struct TaskResult {
+  std::optional<T> value;
+  void return_value(T result) { value.emplace(std::move(result)); }
+  T take() { return std::move(*value); }
+};
+
+template <> struct TaskResult<void> {
+  void return_void() {}
+  void take() {}
+};
+
+// a lazy coroutine, it starts when awaited or run by a Scheduler and resumes
+// its awaiter when it finishes
+template <typename T> class Task {
+public:
+  struct promise_type : TaskResult<T> {
+    std::exception_ptr error;
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct Final {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<>
+      await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        std::coroutine_handle<> next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    Final final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  Task(Task &&other) noexcept : _handle(std::exchange(other._handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (_handle)
+        _handle.destroy();
+      _handle = std::exchange(other._handle, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() {
+    if (_handle)
+      _handle.destroy();
+  }
+
+  bool done() const { return !_handle || _handle.done(); }
+  std::coroutine_handle<> handle() const { return _handle; }
+  T result() {
+    if (_handle.promise().error)
+      std::rethrow_exception(_handle.promise().error);
+    return _handle.promise().take();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) {
+    _handle.promise().continuation = awaiter;
+    return _handle;
+  }
+  T await_resume() { return result(); }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+  std::coroutine_handle<promise_type> _handle;
+};
+
+inline bool Scheduler::_idle() const {
+  for (const Task<void> &task : _tasks) {
+    if (!task.done())
+      return false;
+  }
+  return true;
+}
+
+template <typename Done> void Scheduler::_drive(Done done) {
+  Scheduler *previous = std::exchange(_current, this);
+  try {
+    while (true) {
+      std::unique_lock<std::mutex> guard(_lock);
+      _wake.wait(guard, [&] { return !_queue.empty() || done(); });
+      if (_queue.empty())
+        break;
+      std::coroutine_handle<> handle = _queue.front();
+      _queue.pop_front();
+      guard.unlock();
+      handle.resume();
+    }
+  } catch (...) {
+    _current = previous;
+    throw;
+  }
+  _current = previous;
+}
+
+inline void Scheduler::spawn(Task<void> task) {
+  post(task.handle());
+  _tasks.push_back(std::move(task));
+}
+
+inline void Scheduler::run() {
+  _drive([this] { return _idle(); });
+  std::vector<Task<void>> tasks = std::move(_tasks);
+  _tasks.clear();
+  for (Task<void> &task : tasks) {
+    task.result();
+  }
+}
+
+template <typename T> T Scheduler::run(Task<T> task) {
+  post(task.handle());
+  _drive([&task] { return task.done(); });
+  return task.result();
+}
+
+// suspends until the kernels writing `tensor` have completed, values
+// recorded in lazy mode are launched first
+struct Ready {
+  const Tensor *tensor;
+
+  bool await_ready() const {
+    return tensor->ready().wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+  void await_suspend(std::coroutine_handle<> handle) const {
+    Scheduler *scheduler = &Scheduler::current();
+    tensor->on_ready([scheduler, handle] { scheduler->post(handle); });
+  }
+  void await_resume() const {}
+};
+
+inline Ready ready(const Tensor *tensor) { return {tensor}; }
+
+// runs `op` and resumes with its result once it can be read
+template <typename Op> Task<Tensor *> launch(Op op) {
+  Tensor *result = op();
+  co_await ready(result);
+  co_return result;
+}
+
+inline Task<Tensor *> add_async(Tensor *a, Tensor *b) {
+  return launch([a, b] { return a->add(b); });
+}
+inline Task<Tensor *> sub_async(Tensor *a, Tensor *b) {
+  return launch([a, b] { return a->sub(b); });
+}
+inline Task<Tensor *> mul_async(Tensor *a, Tensor *b) {
+  return launch([a, b] { return a->mul(b); });
+}
+inline Task<Tensor *> div_async(Tensor *a, Tensor *b) {
+  return launch([a, b] { return a->div(b); });
+}
+
+// the values of `tensor` in row major order, views are made dense on the
+// device first so the copy back never waits
+inline Task<std::vector<float>> read(Tensor *tensor) {
+  Tensor *dense = tensor->contiguous();
+  co_await ready(dense);
+  std::vector<float> values(dense->size);
+  for (size_t i = 0; i < dense->size; i++) {
+    values[i] = dense->_get_element(i);
+  }
+  co_return values;
+}
+
+} // namespace async
+} // namespace actx
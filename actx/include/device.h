@@ -2,6 +2,7 @@
 
 #include "device_type.h"
 #include "memory.h"
+#include "random.h"
 #include "tensor.h"
 #include <string>
 
@@ -16,7 +17,15 @@ public:
   virtual void mul(const Tensor *a, const Tensor *b, Tensor *result) = 0;
   virtual void div(const Tensor *a, const Tensor *b, Tensor *result) = 0;
   virtual void matmul(const Tensor *a, const Tensor *b, Tensor *result) = 0;
-  virtual void pow(const Tensor *a, const Tensor *b, Tensor *result) = 0;
+  virtual void pow(const Tensor *a, float exponent, Tensor *result) = 0;
+
+  // scalar operands, `reflected` computes b - a and b / a
+  virtual void add_scalar(const Tensor *a, float b, Tensor *result) = 0;
+  virtual void sub_scalar(const Tensor *a, float b, bool reflected,
+                          Tensor *result) = 0;
+  virtual void mul_scalar(const Tensor *a, float b, Tensor *result) = 0;
+  virtual void div_scalar(const Tensor *a, float b, bool reflected,
+                          Tensor *result) = 0;
 
   // Comparison operators
   virtual void logical_e(const Tensor *a, const Tensor *b, Tensor *result) = 0;
@@ -56,7 +65,79 @@ public:
   virtual void ones(Tensor *a) = 0;
   virtual void zeros(Tensor *a) = 0;
   virtual void eye(Tensor *a) = 0;
-  virtual void full(Tensor *n, Tensor *result) = 0;
+  virtual void full(float n, Tensor *result) = 0;
+
+  // type conversion
+  virtual void cast(const Tensor *input, Tensor *output, RoundingMode rounding,
+                    bool saturate) = 0;
+
+  // layout
+  virtual void contiguous(const Tensor *input, Tensor *output) = 0;
+  // writes input into the layout of output, both have the same shape
+  virtual void copy(const Tensor *input, Tensor *output) = 0;
+
+  // reductions
+  virtual void sum_to(const Tensor *input, Tensor *output) = 0;
+
+  // activations. relu writes one bit per element into `mask` (int32 words,
+  // may be null) for the backward pass, leaky relu is relu with a negative
+  // slope
+  virtual void relu(const Tensor *input, float negative_slope, Tensor *mask,
+                    Tensor *output) = 0;
+  virtual void sigmoid(const Tensor *input, Tensor *output) = 0;
+  virtual void gelu(const Tensor *input, Tensor *output) = 0;
+  virtual void silu(const Tensor *input, Tensor *output) = 0;
+  // grad * activation'(saved) over dense tensors, `saved` is the result of
+  // the activation or, for GELU and SiLU, its input
+  virtual void activation_grad(const Tensor *grad, const Tensor *saved,
+                               Activation activation, Tensor *result) = 0;
+  // grad where the relu mask is set, negative_slope * grad elsewhere
+  virtual void mask_grad(const Tensor *grad, const Tensor *mask,
+                         float negative_slope, Tensor *result) = 0;
+  // zeroes every element whose number from `state` is below p and scales
+  // the others by 1 / (1 - p), dense operands
+  virtual void dropout(const Tensor *input, float p, RandomState state,
+                       Tensor *output) = 0;
+
+  // fused linear layer: result = activation(x @ weight^T + bias), `pre`
+  // receives the value before the activation when given. bias may be null
+  virtual void linear(const Tensor *x, const Tensor *weight,
+                      const Tensor *bias, Activation activation, Tensor *pre,
+                      Tensor *result) = 0;
+  // the gradients of a linear layer, `saved` is its result (its `pre` for
+  // GELU and SiLU) and the activation derivative is applied to `grad` on
+  // the fly
+  virtual void linear_grad_input(const Tensor *grad, const Tensor *saved,
+                                 const Tensor *weight, Activation activation,
+                                 Tensor *result) = 0;
+  virtual void linear_grad_weight(const Tensor *grad, const Tensor *saved,
+                                  const Tensor *x, Activation activation,
+                                  Tensor *result) = 0;
+  virtual void linear_grad_bias(const Tensor *grad, const Tensor *saved,
+                                Activation activation, Tensor *result) = 0;
+
+  // normalization of x as a [rows, cols] matrix, cols is its last dim.
+  // layer norm (per_row) normalizes every row, batch norm every column.
+  // mean and rstd receive one statistic per row or column. in training they
+  // come from x and update the running stats when given, otherwise they are
+  // read from the running stats. weight, bias and the running stats may be
+  // null
+  virtual void normalize(const Tensor *x, const Tensor *weight,
+                         const Tensor *bias, Tensor *running_mean,
+                         Tensor *running_var, bool per_row, bool training,
+                         float eps, float momentum, Tensor *mean, Tensor *rstd,
+                         Tensor *result) = 0;
+  // the gradients of normalize, `sums` is scratch space for two values per
+  // row or column. grad_weight and grad_bias may be null
+  virtual void normalize_backward(const Tensor *grad, const Tensor *x,
+                                  const Tensor *weight, const Tensor *mean,
+                                  const Tensor *rstd, bool per_row,
+                                  bool training, Tensor *sums,
+                                  Tensor *grad_weight, Tensor *grad_bias,
+                                  Tensor *grad_input) = 0;
+
+  // blocks until every queued kernel has completed
+  virtual void sync() = 0;
 
   // TODO: modify this to have a numpy like behaviour
   bool all();
@@ -4,16 +4,53 @@
 #include "op_register.h"
 #include "op_types.h"
 #include "tensor.h"
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <vector>
 
+// how an elementwise call is executed, cheapest first. everything but STRIDED
+// needs a contiguous result and operands that can be indexed linearly
+enum class DispatchPath {
+  CONTIGUOUS, // all operands have the result's shape
+  SCALAR,     // one operand is a single element
+  ROW,        // one operand is a row broadcast over the leading dims
+  STRIDED,    // general broadcast / view indexing
+};
+
+struct DispatchStats {
+  std::atomic<uint64_t> contiguous{0};
+  std::atomic<uint64_t> scalar{0};
+  std::atomic<uint64_t> row{0};
+  std::atomic<uint64_t> strided{0};
+};
+
 class Dispatcher {
 private:
   std::unique_ptr<OpRegister> _register = std::make_unique<OpRegister>();
+  DispatchStats _stats;
+
+  void _count(DispatchPath path);
 
 public:
-  void call(OPType op, DeviceType device, std::vector<Tensor *> inputs);
+  void call(OPType op, DeviceType device, std::vector<Tensor *> inputs,
+            OpAttributes attributes = {});
   Operation *get(OPType op, DeviceType device);
   void init_register();
+  // throws when a tensor the backward pass of `node` reads was written in
+  // place after the node was recorded
+  void check_versions(const OpNode *node) const;
+  // the inputs and outputs whose values the backward pass of `node` reads,
+  // every op declares them. the others are not needed after the forward
+  // pass and may be overwritten
+  std::vector<Tensor *> saved_tensors(const OpNode *node) const;
+
+  // picks the kernel variant for a binary op and counts it in stats()
+  DispatchPath classify(const Tensor *a, const Tensor *b,
+                        const Tensor *result);
+  // unary ops only distinguish CONTIGUOUS and STRIDED
+  DispatchPath classify(const Tensor *input, const Tensor *output);
+  const DispatchStats &stats() const { return _stats; }
+  void reset_stats();
 };
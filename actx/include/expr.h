@@ -0,0 +1,257 @@
+#pragma once
+
+#include "fusion.h"
+#include "tensor.h"
+#include "utility.h"
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+// expression templates for C++ callers. operators on expressions build a
+// tree whose type encodes the ops, nothing runs until it is assigned to a
+// tensor, then the whole tree is one __fused_elementwise__ launch (or a
+// generated kernel with codegen) without intermediate tensors:
+//
+//   using namespace actx::expr;
+//   Tensor *y = of(a) * b + c;          // evaluates
+//   auto e = tanh(of(a) * 0.5f) + 1;    // still an expression
+//   assign(out, e);                     // writes into an existing tensor
+//
+// raw Tensor pointers cannot carry operators, wrap one operand with of().
+// shapes are broadcast when a node is built and mismatches throw there.
+// expressions record no gradients, tensors that require grad are rejected.
+namespace actx {
+namespace expr {
+
+struct ExprBase {};
+
+template <typename T>
+constexpr bool is_expr = std::is_base_of_v<ExprBase, std::decay_t<T>>;
+
+// registers already emitted for a leaf, so a tensor used twice loads once
+struct Context {
+  FusedProgram program;
+  std::vector<int> loaded;
+
+  int emit(FusedOp op, int a, int b = 0, float scalar = 0.0f) {
+    program.code.push_back({static_cast<int>(op), a, b, scalar});
+    return program.code.size() - 1;
+  }
+};
+
+// runs a program built from an expression into `output`
+void launch(const FusedProgram &program, Tensor *output);
+
+template <typename E> class Expr;
+template <typename E> Tensor *eval(const Expr<E> &e);
+
+template <typename E> class Expr : public ExprBase {
+public:
+  const E &self() const { return static_cast<const E &>(*this); }
+  operator Tensor *() const { return eval(*this); }
+};
+
+class Leaf : public Expr<Leaf> {
+public:
+  static constexpr int size = 1;
+  const Tensor *tensor;
+  std::vector<int> shape;
+
+  explicit Leaf(const Tensor *tensor) : tensor(tensor), shape(tensor->dims) {
+    if (tensor->dtype != DType::float32) {
+      throw std::invalid_argument("expressions only support float32 tensors");
+    }
+    if (tensor->requires_grad) {
+      throw std::invalid_argument(
+          "expressions do not record gradients, use the Tensor methods");
+    }
+  }
+
+  int emit(Context &context) const {
+    std::vector<Tensor *> &inputs = context.program.inputs;
+    int slot = 0;
+    while (slot < inputs.size() && inputs[slot] != tensor)
+      slot++;
+    if (slot == inputs.size()) {
+      inputs.push_back(const_cast<Tensor *>(tensor));
+      context.loaded.push_back(context.emit(FusedOp::LOAD, slot));
+    }
+    return context.loaded[slot];
+  }
+};
+
+template <FusedOp Op, typename A> class Unary : public Expr<Unary<Op, A>> {
+public:
+  static constexpr int size = A::size + 1;
+  A a;
+  std::vector<int> shape;
+
+  explicit Unary(const A &a) : a(a), shape(a.shape) {}
+
+  int emit(Context &context) const {
+    return context.emit(Op, a.emit(context));
+  }
+};
+
+template <FusedOp Op, typename A, typename B>
+class Binary : public Expr<Binary<Op, A, B>> {
+public:
+  static constexpr int size = A::size + B::size + 1;
+  A a;
+  B b;
+  std::vector<int> shape;
+
+  Binary(const A &a, const B &b)
+      : a(a), b(b), shape(compute_broadcast_shape(a.shape, b.shape)) {}
+
+  int emit(Context &context) const {
+    int left = a.emit(context);
+    return context.emit(Op, left, b.emit(context));
+  }
+};
+
+template <FusedOp Op, typename A>
+class WithScalar : public Expr<WithScalar<Op, A>> {
+public:
+  static constexpr int size = A::size + 1;
+  A a;
+  float scalar;
+  std::vector<int> shape;
+
+  WithScalar(const A &a, float scalar) : a(a), scalar(scalar), shape(a.shape) {}
+
+  int emit(Context &context) const {
+    return context.emit(Op, a.emit(context), 0, scalar);
+  }
+};
+
+// picks the same special cases as MPS::pow
+template <typename A> class Pow : public Expr<Pow<A>> {
+public:
+  static constexpr int size = A::size + 1;
+  A a;
+  float exponent;
+  std::vector<int> shape;
+
+  Pow(const A &a, float exponent) : a(a), exponent(exponent), shape(a.shape) {}
+
+  int emit(Context &context) const {
+    int base = a.emit(context);
+    if (exponent == 0.5f)
+      return context.emit(FusedOp::SQRT, base);
+    if (exponent == std::trunc(exponent) && std::fabs(exponent) <= 16)
+      return context.emit(FusedOp::POW_INT, base, 0, exponent);
+    return context.emit(FusedOp::POW_SCALAR, base, 0, exponent);
+  }
+};
+
+inline Leaf of(const Tensor *tensor) { return Leaf(tensor); }
+
+inline Leaf operand(const Tensor *tensor) { return Leaf(tensor); }
+template <typename E, std::enable_if_t<is_expr<E>, int> = 0>
+const E &operand(const E &e) {
+  return e;
+}
+template <typename T>
+using operand_t = std::decay_t<decltype(operand(std::declval<T>()))>;
+
+// an expression and another expression or a tensor
+template <typename A, typename B>
+using enable_binary =
+    std::enable_if_t<(is_expr<A> || is_expr<B>) &&
+                         !std::is_arithmetic_v<A> && !std::is_arithmetic_v<B>,
+                     int>;
+template <typename A, typename S>
+using enable_scalar =
+    std::enable_if_t<is_expr<A> && std::is_arithmetic_v<S>, int>;
+template <typename A>
+using enable_unary = std::enable_if_t<
+    is_expr<A> || std::is_convertible_v<A, const Tensor *>, int>;
+
+#define ACTX_EXPR_BINARY(NAME, OP)                                             \
+  template <typename A, typename B, enable_binary<A, B> = 0>                   \
+  auto NAME(const A &a, const B &b) {                                          \
+    return Binary<FusedOp::OP, operand_t<A>, operand_t<B>>(operand(a),         \
+                                                           operand(b));        \
+  }
+
+ACTX_EXPR_BINARY(operator+, ADD)
+ACTX_EXPR_BINARY(operator-, SUB)
+ACTX_EXPR_BINARY(operator*, MUL)
+ACTX_EXPR_BINARY(operator/, DIV)
+ACTX_EXPR_BINARY(atan2, ATAN2)
+#undef ACTX_EXPR_BINARY
+
+// expression op scalar and scalar op expression
+#define ACTX_EXPR_SCALAR(NAME, OP, REFLECTED_OP)                               \
+  template <typename A, typename S, enable_scalar<A, S> = 0>                   \
+  auto NAME(const A &a, S s) {                                                 \
+    return WithScalar<FusedOp::OP, A>(a, static_cast<float>(s));               \
+  }                                                                            \
+  template <typename S, typename A, enable_scalar<A, S> = 0>                   \
+  auto NAME(S s, const A &a) {                                                 \
+    return WithScalar<FusedOp::REFLECTED_OP, A>(a, static_cast<float>(s));     \
+  }
+
+ACTX_EXPR_SCALAR(operator+, ADD_SCALAR, ADD_SCALAR)
+ACTX_EXPR_SCALAR(operator-, SUB_SCALAR, RSUB_SCALAR)
+ACTX_EXPR_SCALAR(operator*, MUL_SCALAR, MUL_SCALAR)
+ACTX_EXPR_SCALAR(operator/, DIV_SCALAR, RDIV_SCALAR)
+#undef ACTX_EXPR_SCALAR
+
+#define ACTX_EXPR_UNARY(NAME, OP)                                              \
+  template <typename A, enable_unary<A> = 0> auto NAME(const A &a) {           \
+    return Unary<FusedOp::OP, operand_t<A>>(operand(a));                       \
+  }
+
+ACTX_EXPR_UNARY(sqrt, SQRT)
+ACTX_EXPR_UNARY(exp, EXP)
+ACTX_EXPR_UNARY(log, LOG)
+ACTX_EXPR_UNARY(log10, LOG10)
+ACTX_EXPR_UNARY(log2, LOG2)
+ACTX_EXPR_UNARY(sin, SIN)
+ACTX_EXPR_UNARY(cos, COS)
+ACTX_EXPR_UNARY(tan, TAN)
+ACTX_EXPR_UNARY(asin, ASIN)
+ACTX_EXPR_UNARY(acos, ACOS)
+ACTX_EXPR_UNARY(atan, ATAN)
+ACTX_EXPR_UNARY(sinh, SINH)
+ACTX_EXPR_UNARY(cosh, COSH)
+ACTX_EXPR_UNARY(tanh, TANH)
+ACTX_EXPR_UNARY(asinh, ASINH)
+ACTX_EXPR_UNARY(acosh, ACOSH)
+ACTX_EXPR_UNARY(atanh, ATANH)
+#undef ACTX_EXPR_UNARY
+
+template <typename A, std::enable_if_t<is_expr<A>, int> = 0>
+auto operator-(const A &a) {
+  return Unary<FusedOp::NEG, A>(a);
+}
+
+template <typename A, typename S, enable_unary<A> = 0,
+          std::enable_if_t<std::is_arithmetic_v<S>, int> = 0>
+auto pow(const A &a, S exponent) {
+  return Pow<operand_t<A>>(operand(a), static_cast<float>(exponent));
+}
+
+template <typename E> void assign(Tensor *output, const Expr<E> &e) {
+  static_assert(E::size <= Fuser::MAX_INSTRUCTIONS,
+                "expression is too long for one fused kernel");
+  if (output->dims != e.self().shape) {
+    throw std::invalid_argument(
+        "expression shape does not match the output tensor");
+  }
+  Context context;
+  e.self().emit(context);
+  launch(context.program, output);
+}
+
+template <typename E> Tensor *eval(const Expr<E> &e) {
+  Tensor *output = new Tensor(e.self().shape);
+  assign(output, e);
+  return output;
+}
+
+} // namespace expr
+} // namespace actx
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "memory.h"
+#include "tensor.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// opcodes of __fused_elementwise__, keep in sync with kernels/fused.metal
+enum class FusedOp : int {
+  LOAD, // a is the input slot
+  NEG,
+  SQRT,
+  EXP,
+  LOG,
+  LOG10,
+  LOG2,
+  SIN,
+  COS,
+  TAN,
+  ASIN,
+  ACOS,
+  ATAN,
+  SINH,
+  COSH,
+  TANH,
+  ASINH,
+  ACOSH,
+  ATANH,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  ATAN2,
+  LOGICAL_E,
+  LOGICAL_NE,
+  LOGICAL_GT,
+  LOGICAL_GTE,
+  LOGICAL_LT,
+  LOGICAL_LTE,
+  ADD_SCALAR,
+  SUB_SCALAR,
+  RSUB_SCALAR,
+  MUL_SCALAR,
+  DIV_SCALAR,
+  RDIV_SCALAR,
+  POW_SCALAR,
+  POW_INT,
+  CONST, // the scalar, for buffers filled with one value and folded code
+};
+
+// instruction i writes register i, `a` and `b` name earlier registers
+struct FusedInstruction {
+  int op;
+  int a;
+  int b;
+  float scalar;
+};
+
+// an elementwise expression over tensors that are already computed, every
+// input is broadcast to the shape of the tensor the program computes
+struct FusedProgram {
+  std::vector<Tensor *> inputs;
+  std::vector<FusedInstruction> code;
+};
+
+// where a program's operands live, after broadcasting every input to the
+// output shape and coalescing all operands together
+struct FusedLayout {
+  int size;
+  std::vector<int> dims;
+  std::vector<int> output_strides;
+  std::vector<std::vector<int>> input_strides;
+};
+
+FusedLayout fused_layout(const FusedProgram &program, const Tensor *output);
+
+// the value an instruction computes from its operand registers, with the
+// semantics of the kernel
+float evaluate_fused(const FusedInstruction &instruction, float a, float b);
+
+// rewrites a program before it runs: instructions on constants are folded,
+// a constant operand turns a binary op into its scalar form, identities (x +
+// 0, x * 1, x / 1, x ** 1, --x) disappear, identical instructions are computed
+// once, and code and inputs the result does not need are dropped
+void simplify(FusedProgram &program);
+
+// elements first .. first + count - 1 of a buffer, filled with `value`
+struct ConstantRange {
+  int first;
+  int count;
+  float value;
+};
+
+struct PendingTensor {
+  Tensor *tensor;
+  FusedProgram program;
+  // the tensor was deleted before it ran, `tensor` is a copy owned here
+  bool owned = false;
+  // a later program computes it in registers, it only runs when it is read
+  bool inlined = false;
+};
+
+// lazy mode: elementwise kernels are recorded instead of launched. a pending
+// tensor that feeds another elementwise op is inlined into its consumer, so
+// a chain like (a * b + c).tanh() becomes one kernel that keeps intermediates
+// in registers. tensors are computed when they are read, or before any other
+// kernel reads or writes their buffers or the buffers they depend on. an
+// inlined tensor is not computed by flush, and is dropped once it is deleted
+class Fuser {
+private:
+  bool _enabled = false;
+  bool _codegen = false;
+  std::vector<PendingTensor> _pending;
+  // the part of a buffer filled with one value by ones, zeros, full or fill
+  std::unordered_map<const Memory *, ConstantRange> _constants;
+  uint64_t _launches = 0;
+  uint64_t _fused_ops = 0;
+
+  PendingTensor *_find(const Tensor *tensor);
+  bool _touches_pending(const Memory *memory) const;
+  int _append(FusedProgram &program, const Tensor *input,
+              std::unordered_map<const Tensor *, int> &registers);
+  void _run(PendingTensor pending);
+
+public:
+  static constexpr int MAX_INPUTS = 8;
+  static constexpr int MAX_INSTRUCTIONS = 32;
+  static constexpr int MAX_RANK = 8;
+
+  bool enabled() const { return _enabled; }
+  void set_enabled(bool enabled) { _enabled = enabled; }
+  // run programs as generated, specialized kernels instead of the
+  // interpreter, see codegen.h
+  bool codegen() const { return _codegen; }
+  void set_codegen(bool codegen) { _codegen = codegen; }
+
+  // records `kernel` instead of launching it, false when it has to run now
+  bool record(const std::string &kernel, std::vector<const Tensor *> inputs,
+              Tensor *output, float scalar = 0.0f);
+  bool is_pending(const Tensor *tensor) const;
+  // computes the pending tensor stored in `memory`, if any
+  void materialize(const Memory *memory);
+  // computes every pending tensor stored in or reading one of `buffers`
+  // (memory data pointers), called before a kernel binds them
+  void flush_buffers(const std::vector<const void *> &buffers);
+  // computes the pending tensors, the inlined ones too when `inlined`
+  void flush(bool inlined = false);
+  // called when `tensor` is deleted, pending programs may still refer to it
+  void release(const Tensor *tensor);
+  // called when `memory` goes back to the pool, what is pending in it is
+  // never read
+  void discard(const Memory *memory);
+
+  // programs read a tensor that lies in elements first .. first + count - 1
+  // of `memory`, filled with `value`, as a constant instead of loading it.
+  // anything that writes the buffer has to forget it
+  void set_constant(const Memory *memory, int first, int count, float value) {
+    _constants[memory] = {first, count, value};
+  }
+  void forget_constant(const Memory *memory) { _constants.erase(memory); }
+  void forget_constants() { _constants.clear(); }
+
+  uint64_t launches() const { return _launches; }
+  uint64_t fused_ops() const { return _fused_ops; }
+  void reset_stats();
+};
+
+// enables lazy mode for its lifetime
+class LazyMode {
+private:
+  bool _previous;
+
+public:
+  LazyMode();
+  ~LazyMode();
+};
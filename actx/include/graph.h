@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+
+struct GraphCommands;
+
+// records every kernel the eager code launches, with its resolved pipeline,
+// metadata and buffers, and replays them as one command buffer. replay skips
+// the caller, the dispatcher, shape inference and allocation, so the captured
+// code has to launch the same ops on the same shapes every step: host reads
+// and writes, and branches on values, are not replayed.
+//
+// tensors created while capturing keep their buffers, so a step is run again
+// by writing new values into the captured inputs and calling replay(), the
+// captured outputs then hold the new results
+class Graph {
+private:
+  GraphCommands *_commands;
+  bool _capturing = false;
+
+public:
+  Graph();
+  ~Graph();
+  Graph(const Graph &) = delete;
+  Graph &operator=(const Graph &) = delete;
+
+  // the kernels launched between begin() and end() run as usual and are
+  // recorded, a new capture replaces the previous one
+  void begin();
+  void end();
+  void replay();
+  bool capturing() const { return _capturing; }
+  // number of recorded kernel launches and buffer copies
+  size_t size() const;
+};
+
+// captures into `graph` for its lifetime
+class GraphCapture {
+private:
+  Graph &_graph;
+
+public:
+  explicit GraphCapture(Graph &graph);
+  ~GraphCapture();
+};
@@ -0,0 +1,6 @@
+#pragma once
+#include <Python.h>
+PyObject *createGraphModule(PyObject *parent);
+// actx.capture(), a Graph that captures inside its `with` block
+PyObject *PyGraph_capture(PyObject *self, PyObject *args);
+extern PyTypeObject PyGraphType;
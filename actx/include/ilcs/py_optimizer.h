@@ -0,0 +1,6 @@
+#pragma once
+#include <Python.h>
+PyObject *createOptimModule(PyObject *parent);
+extern PyTypeObject PySGDType;
+extern PyTypeObject PyAdamType;
+extern PyTypeObject PyAdamWType;
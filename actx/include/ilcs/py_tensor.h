@@ -2,3 +2,8 @@
 #include <Python.h>
 PyObject *createTensorModule(PyObject *parent);
 extern PyTypeObject PyTensorType;
+class Tensor;
+// the native tensor of a Tensor object, NULL with a TypeError otherwise
+Tensor *PyTensor_AsTensor(PyObject *object);
+// a new Tensor object owning `tensor`
+PyObject *PyTensor_FromTensor(Tensor *tensor);
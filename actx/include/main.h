@@ -1,6 +1,7 @@
 #pragma once
 
 #include "dispatcher.h"
+#include "fusion.h"
 #include "memory_pool.h"
 #include "mps.h"
 #include <spdlog/spdlog.h>
@@ -8,4 +9,5 @@
 extern std::unique_ptr<MemoryPool> pool;
 extern std::unique_ptr<Dispatcher> dispatcher;
 extern std::unique_ptr<MPS> mps;
+extern std::unique_ptr<Fuser> fuser;
 extern std::shared_ptr<spdlog::logger> logger;
@@ -17,7 +17,12 @@ public:
   DeviceType device;
   DType dtype;
   Storage *storage;
+  // bumped by every write through the dispatcher or the host, the backward
+  // pass compares it with the version a node saw
+  int version = 0;
   Memory(DeviceType type, size_t bytesize, DType dtype);
+  // wraps a buffer that was allocated elsewhere, e.g. placed in an arena
+  Memory(Storage *storage, size_t bytesize, DType dtype);
   static void copy(Memory *src, Memory *dest);
   static void copy_from_vector(std::vector<type_variant> src,
                                std::shared_ptr<Memory> dest);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "memory.h"
+#include "op_types.h"
+#include "tensor.h"
+#include "types.h"
+#include <climits>
+#include <functional>
+#include <string>
+#include <vector>
+
+// an allocation made while tracing, `first` and `last` are the steps (op
+// calls, copies and host reads) that requested and last used it
+struct TracedAllocation {
+  size_t bytes;
+  DType dtype;
+  int first;
+  int last;
+  // still needed after the traced region, e.g. the loss or a gradient
+  bool persistent = false;
+};
+
+// an elementwise op whose freshly allocated output may be written over an
+// input of the same layout, valid when that input dies at `step`
+struct InplaceCandidate {
+  int input;
+  int output;
+  int step;
+};
+
+struct AllocationTrace {
+  std::vector<TracedAllocation> allocations;
+  std::vector<InplaceCandidate> inplace;
+  int steps = 0;
+};
+
+// where every traced allocation lives in one arena
+struct MemoryPlan {
+  std::vector<size_t> offsets;
+  size_t arena_bytes = 0;
+  // what the pool holds after the traced region, it never reuses blocks
+  // that are still referenced
+  size_t naive_bytes = 0;
+  // the most bytes live at any step, a lower bound for the arena
+  size_t live_peak_bytes = 0;
+  int inplace_reuses = 0;
+
+  std::string report() const;
+};
+
+// lifetimes are intervals over the steps. intermediates are placed greedily,
+// largest first, into the best fitting gap left by the allocations whose
+// lifetimes overlap theirs. an in-place candidate puts the output into its
+// input's block, so the two never need room at the same time
+MemoryPlan plan_memory(const AllocationTrace &trace, size_t alignment = 256);
+
+// elementwise ops that read element i of an input only to write element i
+// of their output
+bool is_inplace_safe(OPType op);
+
+struct ArenaStorage;
+
+// static-graph training: trace() runs one step eagerly and records every
+// allocation, run() replays the step with each allocation served from one
+// planned arena. the step must make the same allocations in the same order
+// each time (reset grads inside it), a mismatch throws. the tensors it
+// returns stay valid until the next run(). lazy mode defers kernels past the
+// ops that record their uses, so it cannot be planned
+class MemoryPlanner {
+private:
+  AllocationTrace _trace;
+  MemoryPlan _plan;
+  ArenaStorage *_arena = nullptr;
+  std::vector<Memory *> _memories;
+  bool _ready = false;
+
+public:
+  using Step = std::function<std::vector<Tensor *>()>;
+
+  ~MemoryPlanner();
+  std::vector<Tensor *> trace(const Step &step);
+  std::vector<Tensor *> run(const Step &step);
+  const AllocationTrace &allocations() const { return _trace; }
+  const MemoryPlan &plan() const { return _plan; }
+};
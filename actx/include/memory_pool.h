@@ -1,9 +1,12 @@
 #pragma once
 
 #include "memory.h"
+#include "memory_planner.h"
 #include "types.h"
 #include <memory>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 struct MemoryComparator {
   bool operator()(const Memory *a, const Memory *b) const {
     return a->bytesize < b->bytesize;
@@ -15,8 +18,47 @@ private:
   std::multiset<Memory *, MemoryComparator> used_pool;
   size_t _compute_pool_size(size_t requested_size);
 
+  // memory planner, see memory_planner.h
+  AllocationTrace *_trace = nullptr;
+  std::unordered_map<const Memory *, int> _traced;
+  const std::vector<Memory *> *_planned = nullptr;
+  const AllocationTrace *_replay_trace = nullptr;
+  size_t _next_planned = 0;
+  void _record_allocation(Memory *memory, size_t bytes);
+
+  // open regions, see begin_region
+  std::vector<std::vector<Memory *>> _regions;
+  Memory *_record_region(Memory *memory);
+
 public:
   Memory *request_memory(DeviceType device, size_t length, DType dtype);
   Memory *find_suitable_block(DeviceType device, DType dtype, size_t requested);
   void return_memory(Memory *memory);
+  // held by a tensor, not in the available pool
+  bool in_use(const Memory *memory) const;
+
+  // collects the memory requested until the matching end_region, so a
+  // caller can return what a region left behind. regions nest, a request is
+  // recorded in every open one
+  void begin_region();
+  std::vector<Memory *> end_region();
+  // returns the memory a region requested, except `keep`. nested regions may
+  // have returned some of it already
+  void return_region(const std::vector<Memory *> &requested,
+                     const std::unordered_set<const Memory *> &keep);
+
+  // records allocations and their uses into `trace`
+  void begin_trace(AllocationTrace *trace);
+  void end_trace();
+  bool tracing() const { return _trace != nullptr; }
+  int traced_index(const Memory *memory) const;
+  // one step that reads or writes `memories`
+  void trace_use(const std::vector<const Memory *> &memories);
+  // a dispatcher call, the result is the last tensor
+  void trace_op(OPType op, const std::vector<Tensor *> &tensors);
+  // serves the n-th request with planned[n] instead of allocating
+  void begin_replay(const std::vector<Memory *> *planned,
+                    const AllocationTrace *trace);
+  // the number of requests that were served
+  size_t end_replay();
 };
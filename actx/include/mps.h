@@ -1,8 +1,16 @@
 #pragma once
 
 #include "device.h"
+#include "fusion.h"
 #include "storage.h"
 #include "types.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <sys/types.h>
 #include <unordered_map>
@@ -11,6 +19,48 @@
 #ifdef __OBJC__
 #import <Foundation/Foundation.h>
 #include <Metal/Metal.h>
+
+// an argument of a dispatch, a buffer or `size` bytes copied with setBytes.
+// bytes are only referenced until the launch is encoded
+struct KernelBinding {
+  int index;
+  id<MTLBuffer> buffer;
+  size_t offset;
+  const void *bytes;
+  size_t size;
+};
+
+// one dispatch as the encoder sees it
+struct KernelLaunch {
+  static constexpr int MAX_BINDINGS = 32;
+  id<MTLComputePipelineState> pipeline;
+  KernelBinding bindings[MAX_BINDINGS];
+  int count = 0;
+  MTLSize groups;
+  MTLSize threads;
+
+  void buffer(int index, id<MTLBuffer> buffer, size_t offset = 0) {
+    bindings[count++] = {index, buffer, offset, nullptr, 0};
+  }
+  void bytes(int index, const void *bytes, size_t size) {
+    bindings[count++] = {index, nil, 0, bytes, size};
+  }
+};
+
+// a launch or buffer copy recorded by graph capture. bytes bindings are
+// copied into `data`, their offset points into it. a copy has no pipeline and
+// moves `size` bytes from `source` to `destination`
+struct CapturedCommand {
+  id<MTLComputePipelineState> pipeline;
+  std::vector<KernelBinding> bindings;
+  std::vector<uint8_t> data;
+  MTLSize groups;
+  MTLSize threads;
+  id<MTLBuffer> source;
+  id<MTLBuffer> destination;
+  size_t size = 0;
+};
+
 class MPS : Device {
 private:
   id<MTLDevice> device;
@@ -20,23 +70,95 @@ private:
 
   std::unordered_map<std::string, id<MTLComputePipelineState>> pipelines;
   std::string name = "mps";
+  std::vector<CapturedCommand> *_capture = nullptr;
+
+  // command buffers are committed without waiting. the queue runs them in
+  // order, so a buffer is ready once the last command buffer binding it (by
+  // contents pointer) has completed
+  // set by the command buffer's completed handler, on a Metal thread
+  struct Completion {
+    std::mutex lock;
+    bool done = false;
+    std::vector<std::function<void()>> callbacks;
+    std::promise<void> promise;
+    std::shared_future<void> future = promise.get_future().share();
+  };
+  struct InFlight {
+    uint64_t ticket;
+    id<MTLCommandBuffer> commands;
+    std::shared_ptr<Completion> completion;
+  };
+  std::deque<InFlight> _in_flight;
+  std::unordered_map<const void *, uint64_t> _last_use;
+  uint64_t _submitted = 0;
+  uint64_t _completed = 0;
+  bool _async = true;
+
+  void _commit(id<MTLCommandBuffer> commandBuffer,
+               const std::vector<id<MTLBuffer>> &buffers);
+  void _wait(uint64_t ticket);
+  // the completion of the last command buffer using `buffers`, null when
+  // they are ready
+  std::shared_ptr<Completion>
+  _completion(const std::vector<const void *> &buffers);
+
+  id<MTLComputePipelineState> _pipeline(const std::string &func);
+  void _encode(id<MTLComputeCommandEncoder> encoder,
+               const KernelBinding *bindings, int count, const uint8_t *data);
+  // encodes, commits and waits for one launch, recording it while capturing
+  void _launch(const KernelLaunch &launch);
+
+  // binds `operands` to slots 0..n-1, the metadata to slot n and the
+  // scalars, when given, to slot n + 1, for kernels that take several
+  // tensors and a grid of their own
+  void _dispatch_tensors(const std::string &func,
+                         const std::vector<const Tensor *> &operands,
+                         const void *meta, size_t meta_size, MTLSize groups,
+                         MTLSize threads, const float *scalars = nullptr,
+                         size_t scalars_size = 0);
+
+  id<MTLLibrary> _load_cached_library(const std::string &name,
+                                      const std::string &source);
+  std::string _jit_kernel(const FusedProgram &program,
+                          const FusedLayout &layout);
 
 public:
   MPS();
   void _init_pipeline(std::string metal_function_name);
   std::pair<size_t, size_t> compute_threads(size_t N, size_t maxTPG);
 
+  // metadata is copied into the command stream with setBytes, so it may live
+  // on the caller's stack. a scalar operand is bound right after it
   void execute_kernel_nullary(std::string func, id<MTLBuffer> A,
-                              id<MTLBuffer> meta, int N);
+                              const void *meta, size_t meta_size, int N,
+                              int offset = 0,
+                              std::optional<float> scalar = std::nullopt);
   void execute_kernel_unary(std::string func, id<MTLBuffer> input,
-                            id<MTLBuffer> output, id<MTLBuffer> metadata,
-                            int N);
+                            id<MTLBuffer> output, const void *metadata,
+                            size_t metadata_size, int N, int offset_input = 0,
+                            int offset_output = 0,
+                            std::optional<float> scalar = std::nullopt);
+  // dispatches `groups` threadgroups of a fixed size, for kernels that share
+  // threadgroup memory
+  void execute_kernel_tiled(std::string func, id<MTLBuffer> input,
+                            id<MTLBuffer> output, const void *metadata,
+                            size_t metadata_size, int groups,
+                            int threads_per_group, int offset_input = 0,
+                            int offset_output = 0);
   void execute_kernel_binary(std::string func, id<MTLBuffer> A, id<MTLBuffer> B,
-                             id<MTLBuffer> result, id<MTLBuffer> meta, int N,
-                             int offset_a = 0, int offset_b = 0,
-                             int offset_result = 0);
+                             id<MTLBuffer> result, const void *meta,
+                             size_t meta_size, int N, int offset_a = 0,
+                             int offset_b = 0, int offset_result = 0);
+  // inputs are bound to slots 0-7, the output to 8, then metadata and code
+  void execute_kernel_fused(std::string func,
+                            const std::vector<id<MTLBuffer>> &inputs,
+                            const std::vector<int> &offsets,
+                            id<MTLBuffer> output, const void *meta,
+                            size_t meta_size, const void *code,
+                            size_t code_size, int N);
 
-  void initiate_dispatch_nullary(std::string kernel_method, Tensor *input);
+  void initiate_dispatch_nullary(std::string kernel_method, Tensor *input,
+                                 std::optional<float> scalar = std::nullopt);
 
   void initiate_dispatch_unary(std::string kernel_method, const Tensor *input,
                                Tensor *output);
@@ -44,7 +166,51 @@ public:
   void initiate_dispatch_binary(std::string kernel_method, const Tensor *a,
                                 const Tensor *b, Tensor *result);
 
+  // runs __scalar_<op>_contiguous__ or __scalar_<op>_strided__
+  void initiate_dispatch_scalar(std::string op, const Tensor *input,
+                                float scalar, Tensor *output);
+
+  // one __multi_tensor_apply__ launch of `groups` threadgroups, tensors[k][t]
+  // is bound to slot t of list k, see multi_tensor.h for the metadata
+  void execute_kernel_multi_tensor(
+      const std::vector<std::vector<const Tensor *>> &tensors, const int *meta,
+      size_t meta_size, const float *scalars, size_t scalars_size, int groups,
+      int threads_per_group);
+
+  // runs a program recorded in lazy mode as one __fused_elementwise__ launch,
+  // or as a generated kernel when codegen is enabled
+  void fused_elementwise(const FusedProgram &program, Tensor *output);
+
+  // graph capture: while capturing, every launch and buffer copy is also
+  // appended to `commands`, replay() encodes them into one command buffer
+  void begin_capture(std::vector<CapturedCommand> *commands);
+  void end_capture();
+  bool capturing() const { return _capture != nullptr; }
+  void capture_copy(id<MTLBuffer> source, id<MTLBuffer> destination,
+                    size_t size);
+  void replay(const std::vector<CapturedCommand> &commands);
+
+  // async stream: launches return once committed. host reads and writes of
+  // a buffer wait for the kernels using it, sync() waits for everything
+  void sync() override;
+  void wait_for(const std::vector<const void *> &buffers);
+  // completes when the kernels using `buffers` have, never blocks
+  std::shared_future<void> ready(const std::vector<const void *> &buffers);
+  // calls `callback` once the kernels using `buffers` have completed, right
+  // away when they already have, otherwise on a Metal completion thread
+  void on_ready(const std::vector<const void *> &buffers,
+                std::function<void()> callback);
+  // false waits for every launch to complete, as before the async stream
+  void set_async(bool async);
+  bool async() const { return _async; }
+
   void createEmptyBuffer(int bytesize, DType type, Storage *storage);
+  // planned memory: buffers placed at fixed offsets of one heap, buffers
+  // whose lifetimes do not overlap may share bytes
+  id<MTLHeap> create_arena(size_t bytesize);
+  size_t arena_alignment(size_t bytesize);
+  void create_placed_buffer(id<MTLHeap> arena, size_t offset,
+                            size_t bytesize, Storage *storage);
   id<MTLBuffer> clone(id<MTLBuffer> buffer);
   void copy_vector_to_buffer(void *ptr, Memory &memory, int buffer_size);
 
@@ -54,13 +220,32 @@ public:
   void sub(const Tensor *a, const Tensor *b, Tensor *result) override;
   void mul(const Tensor *a, const Tensor *b, Tensor *result) override;
   void div(const Tensor *a, const Tensor *b, Tensor *result) override;
-  void pow(const Tensor *a, const Tensor *b, Tensor *result) override;
+  void pow(const Tensor *a, float exponent, Tensor *result) override;
+
+  // scalar operands
+  void add_scalar(const Tensor *a, float b, Tensor *result) override;
+  void sub_scalar(const Tensor *a, float b, bool reflected,
+                  Tensor *result) override;
+  void mul_scalar(const Tensor *a, float b, Tensor *result) override;
+  void div_scalar(const Tensor *a, float b, bool reflected,
+                  Tensor *result) override;
 
   // init kernels
   void ones(Tensor *a) override;
   void zeros(Tensor *a) override;
   void eye(Tensor *a) override;
-  void full(Tensor *n, Tensor *result) override;
+  void full(float n, Tensor *result) override;
+
+  // type conversion
+  void cast(const Tensor *input, Tensor *output, RoundingMode rounding,
+            bool saturate) override;
+
+  // layout
+  void contiguous(const Tensor *input, Tensor *output) override;
+  void copy(const Tensor *input, Tensor *output) override;
+
+  // reductions
+  void sum_to(const Tensor *input, Tensor *output) override;
 
   // comparison
   void logical_e(const Tensor *a, const Tensor *b, Tensor *result) override;
@@ -94,6 +279,42 @@ public:
   void acosh(const Tensor *input, Tensor *output) override;
   void atanh(const Tensor *input, Tensor *output) override;
 
+  // activations
+  void relu(const Tensor *input, float negative_slope, Tensor *mask,
+            Tensor *output) override;
+  void sigmoid(const Tensor *input, Tensor *output) override;
+  void gelu(const Tensor *input, Tensor *output) override;
+  void silu(const Tensor *input, Tensor *output) override;
+  void activation_grad(const Tensor *grad, const Tensor *saved,
+                       Activation activation, Tensor *result) override;
+  void mask_grad(const Tensor *grad, const Tensor *mask, float negative_slope,
+                 Tensor *result) override;
+  void dropout(const Tensor *input, float p, RandomState state,
+               Tensor *output) override;
+
+  // fused linear layer
+  void linear(const Tensor *x, const Tensor *weight, const Tensor *bias,
+              Activation activation, Tensor *pre, Tensor *result) override;
+  void linear_grad_input(const Tensor *grad, const Tensor *saved,
+                         const Tensor *weight, Activation activation,
+                         Tensor *result) override;
+  void linear_grad_weight(const Tensor *grad, const Tensor *saved,
+                          const Tensor *x, Activation activation,
+                          Tensor *result) override;
+  void linear_grad_bias(const Tensor *grad, const Tensor *saved,
+                        Activation activation, Tensor *result) override;
+
+  // batch norm and layer norm
+  void normalize(const Tensor *x, const Tensor *weight, const Tensor *bias,
+                 Tensor *running_mean, Tensor *running_var, bool per_row,
+                 bool training, float eps, float momentum, Tensor *mean,
+                 Tensor *rstd, Tensor *result) override;
+  void normalize_backward(const Tensor *grad, const Tensor *x,
+                          const Tensor *weight, const Tensor *mean,
+                          const Tensor *rstd, bool per_row, bool training,
+                          Tensor *sums, Tensor *grad_weight, Tensor *grad_bias,
+                          Tensor *grad_input) override;
+
   // not implemented
   void matmul(const Tensor *a, const Tensor *b, Tensor *result) override;
 };
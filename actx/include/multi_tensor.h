@@ -0,0 +1,61 @@
+#pragma once
+
+#include "tensor.h"
+#include <vector>
+
+// ops of __multi_tensor_apply__, keep in sync with kernels/multi_tensor.metal.
+// list k holds the k-th operand of every tensor, s the scalars
+enum class MultiTensorOp : int {
+  SCALE, // x *= s0
+  FILL,  // x = s0
+  AXPY,  // x += s0 * y
+  // x: params, y: grads, z: momentum buffers
+  // s: lr, momentum, weight_decay, nesterov
+  SGD,
+  // x: params, y: grads, z: exp_avg, w: exp_avg_sq
+  // s: lr, beta1, beta2, eps, weight_decay, bias_correction1,
+  //    bias_correction2, decoupled (AdamW)
+  ADAM,
+  // out[first_chunk + chunk] = sum of x * x over the chunk
+  SUM_SQUARES,
+  // x *= s0 / (norm + s1) when that is below 1, norm is out[0]
+  CLIP,
+};
+
+// how many tensor lists and scalars `op` reads
+int multi_tensor_depth(MultiTensorOp op);
+int multi_tensor_scalars(MultiTensorOp op);
+
+// what one __multi_tensor_apply__ launch takes, the metadata has to fit in
+// setBytes
+struct MultiTensorLimits {
+  static constexpr int MAX_LISTS = 4;
+  static constexpr int MAX_TENSORS = 6;
+  static constexpr int MAX_CHUNKS = 320;
+  static constexpr int CHUNK_SIZE = 4096;
+  static constexpr int THREADS = 256;
+};
+
+// runs `op` over many small tensors in as few launches as possible, instead
+// of one dispatch (and one command buffer) per tensor. lists[k][i] is operand
+// k of tensor i, the operands of a tensor have the same size. tensors are cut
+// into chunks of at most CHUNK_SIZE elements, each chunk is one threadgroup,
+// so a launch is balanced whatever the mix of sizes. a launch binds up to
+// MAX_TENSORS tensors per list and MAX_CHUNKS chunks, then the next starts.
+// operands must be dense float32, they are updated in place without
+// recording gradients. SUM_SQUARES and CLIP take an extra operand, they run
+// through the functions below
+void multi_tensor_apply(MultiTensorOp op,
+                        const std::vector<std::vector<Tensor *>> &lists,
+                        const std::vector<float> &scalars);
+
+// the l2 norm of all `tensors` together as a 1-element tensor, nothing is
+// read back. every chunk writes the sum of its squares to one partial, a
+// single buffer for all tensors, then the partials are added on the device
+Tensor *multi_tensor_l2_norm(const std::vector<Tensor *> &tensors);
+
+// scales every tensor by max_norm / (norm + eps) when that is below 1, with
+// `norm` a 1-element tensor read by the kernel, so the decision does not
+// wait for the host. when nothing is clipped the chunks are not even read
+void multi_tensor_clip(const std::vector<Tensor *> &tensors, Tensor *norm,
+                       float max_norm, float eps = 1e-6f);
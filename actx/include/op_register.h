@@ -5,7 +5,14 @@
 #include "tensor.h"
 #include <functional>
 
-using TensorOperation = std::function<void(std::vector<Tensor *>)>;
+// non tensor arguments of an op (rounding modes, flags, axes, scalars)
+struct OpAttributes {
+  std::vector<int> ints;
+  std::vector<float> floats;
+};
+
+using TensorOperation =
+    std::function<void(std::vector<Tensor *>, OpAttributes)>;
 
 struct Operation {
   TensorOperation func;
@@ -38,4 +38,31 @@ enum class OPType {
   ACOSH,
   ATANH,
   CLONE,
+  CAST,
+  PERMUTE,
+  RESHAPE,
+  EXPAND,
+  SUM_TO,
+  CONTIGUOUS,
+  ADD_SCALAR,
+  SUB_SCALAR,
+  MUL_SCALAR,
+  DIV_SCALAR,
+  LINEAR,
+  LINEAR_GRAD_INPUT,
+  LINEAR_GRAD_WEIGHT,
+  LINEAR_GRAD_BIAS,
+  LAYER_NORM,
+  BATCH_NORM,
+  NORM_BACKWARD,
+  RELU,
+  LEAKY_RELU,
+  SIGMOID,
+  GELU,
+  SILU,
+  ACTIVATION_GRAD,
+  MASK_GRAD,
+  DROPOUT,
+  CHECKPOINT,
+  COPY,
 };
@@ -9,4 +9,21 @@ struct OpNode {
   OPType type;
   std::vector<Tensor *> inputs;
   std::vector<Tensor *> outputs;
+  OpAttributes attributes;
+  // storage versions of the inputs and outputs when the node was recorded,
+  // empty for nodes that are never checked
+  std::vector<int> input_versions;
+  std::vector<int> output_versions;
 };
+
+// remembers the storage versions the node sees. `written` is the storage its
+// op is writing, the node's outputs see it one version later
+inline void record_versions(OpNode *node, const Memory *written = nullptr) {
+  node->input_versions.clear();
+  node->output_versions.clear();
+  for (const Tensor *input : node->inputs)
+    node->input_versions.push_back(input->memory->version);
+  for (const Tensor *output : node->outputs)
+    node->output_versions.push_back(output->memory->version +
+                                    (output->memory == written));
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "tensor.h"
+#include <functional>
+#include <vector>
+
+// optimizers update their parameters in place with one multi_tensor_apply
+// pass (multi_tensor.h): the weight decay, the moments, the bias correction
+// and the step are computed per element in registers, so every parameter,
+// gradient and state buffer is read and written once per step. state
+// buffers come from the pool and are created on the first step. parameters
+// must be dense float32, the ones without a gradient are skipped
+class Optimizer {
+protected:
+  std::vector<Tensor *> _params;
+
+  // the parameters that have a gradient, with the gradients
+  void _collect(const std::vector<Tensor *> &grads,
+                std::vector<Tensor *> &params,
+                std::vector<Tensor *> &used_grads,
+                std::vector<int> &indexes) const;
+
+public:
+  float lr;
+
+  Optimizer(std::vector<Tensor *> params, float lr);
+  virtual ~Optimizer() = default;
+
+  // updates with the gradients stored on the parameters
+  void step() { step({}); }
+  // updates with `grads[i]` as the gradient of parameter i, empty uses the
+  // stored ones
+  virtual void step(const std::vector<Tensor *> &grads) = 0;
+  // fills the stored gradients with zeros in one launch, the buffers stay
+  // and the next backward pass accumulates into them. `set_to_none` drops
+  // them instead, the next pass allocates again
+  void zero_grad(bool set_to_none = false);
+  const std::vector<Tensor *> &params() const { return _params; }
+};
+
+// p -= lr * (g + weight_decay * p), with momentum the direction is
+// buf = momentum * buf + g, or g + momentum * buf with nesterov
+class SGD : public Optimizer {
+private:
+  std::vector<Tensor *> _momentum_buffers;
+
+public:
+  float momentum;
+  float weight_decay;
+  bool nesterov;
+
+  SGD(std::vector<Tensor *> params, float lr = 0.01f, float momentum = 0.0f,
+      float weight_decay = 0.0f, bool nesterov = false);
+  using Optimizer::step;
+  void step(const std::vector<Tensor *> &grads) override;
+};
+
+// weight_decay is added to the gradient (L2), as in
+// Model.l2_combined_gradient of examples/mlp
+class Adam : public Optimizer {
+protected:
+  std::vector<Tensor *> _exp_avg;
+  std::vector<Tensor *> _exp_avg_sq;
+  bool _decoupled = false;
+
+public:
+  float beta1;
+  float beta2;
+  float eps;
+  float weight_decay;
+  int steps = 0;
+
+  Adam(std::vector<Tensor *> params, float lr = 1e-3f, float beta1 = 0.9f,
+       float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 0.0f);
+  using Optimizer::step;
+  void step(const std::vector<Tensor *> &grads) override;
+};
+
+// Adam with decoupled weight decay, p *= 1 - lr * weight_decay
+class AdamW : public Adam {
+public:
+  AdamW(std::vector<Tensor *> params, float lr = 1e-3f, float beta1 = 0.9f,
+        float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 1e-2f);
+};
+
+// scales the stored gradients of `params` in place so that their global l2
+// norm is at most max_norm, with two multi_tensor_apply passes and no
+// temporary per gradient: the first sums the squares of every chunk, the
+// second rescales by max_norm / (norm + eps), only when that is below 1 and
+// decided on the device. returns the norm before clipping as a 1-element
+// tensor, reading it is the only wait. parameters without a gradient are
+// skipped, the gradients must be dense float32
+Tensor *clip_grad_norm(const std::vector<Tensor *> &params, float max_norm,
+                       float eps = 1e-6f);
+
+// the loss of micro-batch i
+using MicroBatchLoss = std::function<Tensor *(int)>;
+
+// gradient accumulation: runs loss(i) and its backward pass for the
+// micro-batches i = 0 .. micro_batches - 1, one after the other. the
+// gradients of the leaves add up in place in their buffers (see
+// Tensor::accumulate_grad), already scaled by 1 / micro_batches since the
+// backward pass is seeded with it, so they end up as the gradients of the
+// mean loss without another pass. after each backward pass the memory the
+// micro-batch requested goes back to the pool, except the gradients of
+// `params` and of the leaves its graph reads, so the peak is the one of a
+// single micro-batch. returns the mean of the summed losses as a 1-element
+// tensor.
+//
+// the gradients add to the ones already stored, zero_grad first. leaves
+// that only a checkpointed function reads are not in the graph, they have
+// to be in `params`. loss(i) may not keep tensors it allocates. when loss(i)
+// or its backward pass throws, the memory of that micro-batch goes back to
+// the pool the same way and the exception propagates, the gradients of the
+// micro-batches before it (and possibly part of its own) are already added
+Tensor *accumulate_gradients(const std::vector<Tensor *> &params,
+                             int micro_batches, const MicroBatchLoss &loss);
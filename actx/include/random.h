@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// the random stream of device kernels. numbers are a hash of (seed,
+// counter), a kernel that draws n of them is handed the counters
+// [offset, offset + n) and the offset moves past them, so nothing is kept on
+// the device and restoring a saved state draws the same numbers again
+struct RandomState {
+  uint32_t seed;
+  uint64_t offset;
+};
+
+void manual_seed(uint32_t seed);
+RandomState get_rng_state();
+void set_rng_state(RandomState state);
+// reserves `count` numbers, returns the state to draw them from
+RandomState next_random(uint64_t count);
@@ -3,8 +3,11 @@
 #include "memory.h"
 #include "op_types.h"
 #include "types.h"
+#include <functional>
+#include <future>
 #include <sys/types.h>
 #include <tuple>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -22,6 +25,13 @@ private:
   std::variant<void *, float *, int *> data_ptr;
   void _compte_stride();
   int _compute_offset(std::vector<int> indexes) const;
+  int _compute_offset(int flat_index) const;
+  bool _compute_contiguity() const;
+  int _normalize_dim(int dim, int rank) const;
+  std::vector<int> _infer_shape(std::vector<int> shape) const;
+  std::vector<int> _compute_view_stride(const std::vector<int> &shape) const;
+  Tensor *make_view(std::vector<int> dims, std::vector<int> stride,
+                    int offset_elements, OPType op, std::vector<int> params);
   void reinterpret_pointer(void *ptr);
   int _compute_broadcast_index(int flat_index,
                                const std::vector<int> &source_shape,
@@ -31,17 +41,23 @@ private:
   Tensor *execute_broadcastable_operation(OPType op, Tensor *other,
                                           bool inplace);
   Tensor *execute_binary_operation(OPType op, Tensor *other);
+  Tensor *execute_scalar_operation(OPType op, float scalar, bool inplace,
+                                   bool reflected = false);
 
   // TODO: change default devicetype to cpu
   static Tensor *execute_init_operation(OPType op, std::vector<int> shape,
                                         DType dtype, bool requires_grad,
                                         DeviceType device);
-  std::vector<OpNode *> topo_sort();
+  // the nodes the roots depend on, every node after the ones it reads
+  static std::vector<OpNode *> topo_sort(const std::vector<Tensor *> &roots);
 
 public:
   int ndim;
   Tensor *grad = nullptr;
   OpNode *node = nullptr;
+  // the graph before each in-place write, as the storage version the write
+  // started from and the alias that kept the node of that time
+  std::vector<std::pair<int, Tensor *>> overwritten;
   std::vector<int> dims;
   std::vector<int> stride;
   bool requires_grad;
@@ -60,12 +76,15 @@ public:
   Tensor(std::vector<float> &values, std::vector<int> dims,
          DType dtype = DType::float32, bool requires_grad = false,
          DeviceType device = DeviceType::MPS);
+  ~Tensor();
   // template <typename T>
   // Tensor(std::vector<T> &values, std::vector<int> dims,
   //        DType dtype = DType::float32, bool requires_grad = false);
   //
   //
   // FIX: template type
+  // `offset` is a physical offset (already multiplied by the strides)
+  // relative to the first element of the tensor
   float _get_element(int offset) const;
   int offset() const;
 
@@ -92,15 +111,50 @@ public:
   static Tensor *zeros_like(Tensor *a);
   static Tensor *full_like(Tensor *a, float n);
   static Tensor *clone(Tensor *other);
+  // in-place, writes through views
+  Tensor *fill(float value);
+  // in-place, writes `source` broadcast to the shape of this tensor. a source
+  // sharing memory with it is copied out first, so overlapping views work
+  Tensor *assign(Tensor *source);
 
-  // arithmetic operators
+  // type conversion, writes into `out` when given instead of allocating
+  Tensor *to(DType dtype, RoundingMode rounding = RoundingMode::TRUNCATE,
+             bool saturate = false, Tensor *out = nullptr);
+
+  // arithmetic operators. an in-place op is recorded like any other, nodes
+  // that read the tensor before still send their gradient to its old value.
+  // leaves and views that require grad can not be written in place
   Tensor *negate(bool inplace = false);
   Tensor *add(Tensor *other, bool inplace = false);
   Tensor *sub(Tensor *other, bool inplace = false);
   Tensor *mul(Tensor *other, bool inplace = false);
   Tensor *div(Tensor *other, bool inplace = false);
+  // scalar operands are passed to the kernels by value
+  Tensor *add(float other, bool inplace = false);
+  Tensor *sub(float other, bool inplace = false);
+  Tensor *mul(float other, bool inplace = false);
+  Tensor *div(float other, bool inplace = false);
+  // other - this and other / this
+  Tensor *rsub(float other);
+  Tensor *rdiv(float other);
   Tensor *pow(float exp, bool inplace = false);
   Tensor *matmul(Tensor *other) const;
+  // activation(this @ weight^T + bias) in one kernel, weight is [out, in]
+  // and the last dim of `this` is `in`. float32 only
+  Tensor *linear(Tensor *weight, Tensor *bias = nullptr,
+                 Activation activation = Activation::NONE);
+  // normalizes over the last dim, then scales by weight and shifts by bias,
+  // both [C] and optional. float32 only
+  Tensor *layer_norm(Tensor *weight = nullptr, Tensor *bias = nullptr,
+                     float eps = 1e-5f);
+  // normalizes every feature (the last dim) over all the other dims. in
+  // training the batch statistics are used and blended into running_mean
+  // and running_var with `momentum`, otherwise the running ones are used.
+  // without running stats the batch statistics are always used
+  Tensor *batch_norm(Tensor *running_mean = nullptr,
+                     Tensor *running_var = nullptr, Tensor *weight = nullptr,
+                     Tensor *bias = nullptr, bool training = true,
+                     float momentum = 0.1f, float eps = 1e-5f);
 
   // Comparison operators
   Tensor *logical_e(Tensor *other);
@@ -134,6 +188,19 @@ public:
   Tensor *acosh(bool inplace = false);
   Tensor *asinh(bool inplace = false);
 
+  // activations, float32 only. the backward pass of relu and leaky_relu
+  // reads a mask of one bit per element, sigmoid and tanh their result,
+  // gelu (tanh approximation) and silu their input
+  Tensor *relu(bool inplace = false);
+  Tensor *leaky_relu(float negative_slope = 0.01f, bool inplace = false);
+  Tensor *sigmoid(bool inplace = false);
+  Tensor *gelu();
+  Tensor *silu();
+  // zeroes elements with probability p and scales the others by
+  // 1 / (1 - p), the identity outside training. the mask is drawn from the
+  // random stream (random.h) and drawn again for the backward pass
+  Tensor *dropout(float p = 0.5f, bool training = true);
+
   // not implemented
   static Tensor *rand(std::vector<int> shape, DType dtype);
   static Tensor *randn(std::vector<int> shape, DType dtype = DType::float32);
@@ -149,11 +216,37 @@ public:
   bool any();
 
   // Utility methods
-  Tensor transpose() const;
+  // views share the memory of `this`, only dims, stride and offset differ
+  Tensor *transpose(int dim0 = 0, int dim1 = 1);
+  Tensor *permute(std::vector<int> order);
+  Tensor *view(std::vector<int> shape);
+  Tensor *reshape(std::vector<int> shape);
+  Tensor *expand(std::vector<int> shape);
+  Tensor *squeeze();
+  Tensor *squeeze(int dim);
+  Tensor *unsqueeze(int dim);
   Tensor *view(std::vector<Slice> &slices) const;
+  // returns `this` when the layout is already row major, a dense copy otherwise
+  Tensor *contiguous();
+  // sums the broadcast dimensions away so the result has `shape`
+  Tensor *sum_to(std::vector<int> shape);
 
+  // seeds the backward pass with implicit ones, no tensor is filled
   void backward();
-  void detach();
+  // backpropagates grads[i] from roots[i], a node shared by several roots
+  // runs once, after all of them. a null gradient stands for ones
+  static void backward(const std::vector<Tensor *> &roots,
+                       const std::vector<Tensor *> &grads);
+  // adds `grad` into this->grad. the buffer is made once, or taken from
+  // `grad` when it is `owned` (dense and made for this call), then written
+  // in place by every later backward pass until it is set to none.
+  // `subtract` adds -grad
+  void accumulate_grad(Tensor *grad, bool owned = false, bool subtract = false);
+  // the leaves the graph of `roots` reads, tensors without a node of their
+  // own. a root that is a leaf is one too
+  static std::vector<Tensor *> graph_leaves(const std::vector<Tensor *> &roots);
+  // a tensor over the same memory and layout without a node or gradient
+  Tensor *detach();
   // Input/Output
 
   void print(int dim = 0, int offset = 0) const;
@@ -163,18 +256,19 @@ public:
                       std::string &builder) const;
   // getters & setters
   std::vector<int> strides();
+  // computes the values of a tensor recorded in lazy mode and waits for the
+  // kernels writing it, before the host reads its buffer
+  void materialize() const;
+  // the same without blocking, completes when the values can be read
+  std::shared_future<void> ready() const;
+  // calls `callback` once the values can be read, possibly on another thread
+  void on_ready(std::function<void()> callback) const;
   template <typename... Args> void setElement(float value, Args... indexes);
   template <typename... Args> double getElement(Args... indexes) const {
     std::vector<int> indices = {indexes...};
     this->throw_out_of_bound(indices);
-    int offset = this->_compute_offset(indices);
-    if (std::holds_alternative<int *>(this->data_ptr)) {
-      return std::get<int *>(this->data_ptr)[offset];
-    } else if (std::holds_alternative<float *>(this->data_ptr)) {
-      return std::get<float *>(this->data_ptr)[offset];
-    } else if (std::holds_alternative<void *>(this->data_ptr)) {
-      // return std::get<void *>(this->data_ptr)[offset];
-    }
-    return -1;
+    this->materialize();
+    int offset = this->_compute_offset(indices) + this->offset_elements;
+    return load_element(this->memory->data_ptr, this->dtype, offset);
   }
 };
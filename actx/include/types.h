@@ -3,4 +3,24 @@
 #include <variant>
 using type_variant =
     std::variant<int8_t, int16_t, int32_t, int64_t, _Float16, float>;
-enum class DType { int8, int16, int32, int64, float16, float32 };
+enum class DType {
+  int8,
+  int16,
+  int32,
+  int64,
+  float16,
+  float32,
+  uint8,
+  bfloat16
+};
+
+// rounding applied when a floating point value is cast to an integer dtype
+enum class RoundingMode { TRUNCATE, NEAREST_EVEN, FLOOR, CEIL };
+
+// applied in the epilogue of fused kernels, GELU is the tanh approximation
+// and SILU is x * sigmoid(x). keep in sync with
+// kernels/activation_functions.metal
+enum class Activation { NONE, RELU, SIGMOID, TANH, GELU, SILU };
+
+// reads element `index` of a raw buffer holding `dtype` values
+double load_element(const void *data, DType dtype, int index);
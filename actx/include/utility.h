@@ -43,6 +43,20 @@ int __randint(int min, int max, int seed = -1);
 int __poisson(float mean, int seed = -1);
 int __bernoulli(float p, int seed = -1);
 std::vector<int> compute_broadcast_shape(const Tensor *a, const Tensor *b);
+std::vector<int> compute_broadcast_shape(const std::vector<int> &a,
+                                         const std::vector<int> &b);
 int getDTypeSize(DType type);
 std::string getDeviceName(DeviceType device);
 std::string getTypeName(DType dtype);
+std::string getTypeCode(DType dtype);
+bool isFloatingDType(DType dtype);
+// drops dims of length 1 and merges neighbouring dims that are laid out
+// contiguously with each other, so kernels index over as few dims as possible
+void coalesce_dims(std::vector<int> &dims, std::vector<int> &strides);
+// same for several operands iterated over one shape, a dim is only merged
+// when it can be merged in every operand
+void coalesce_dims(std::vector<int> &dims,
+                   std::vector<std::vector<int> *> strides);
+// strides of `t` when broadcast to `shape`, broadcast dims get a stride of 0
+std::vector<int> broadcast_strides(const Tensor *t,
+                                   const std::vector<int> &shape);
@@ -0,0 +1,147 @@
+#include "checkpoint.h"
+#include "main.h"
+#include "opnode.h"
+#include "random.h"
+#include <stdexcept>
+#include <unordered_set>
+
+struct CheckpointNode : OpNode {
+  CheckpointFunction fn;
+  // where fn started drawing random numbers
+  RandomState random;
+};
+
+// the inputs as leaves over the same memory, so the graph fn builds stops at
+// them. they keep requires_grad and collect the gradients of the region
+static std::vector<Tensor *> detached(const std::vector<Tensor *> &inputs) {
+  std::vector<Tensor *> leaves;
+  for (Tensor *input : inputs) {
+    Tensor *leaf = input->detach();
+    leaf->requires_grad = input->requires_grad;
+    leaves.push_back(leaf);
+  }
+  return leaves;
+}
+
+// fn over `leaves` inside a pool region, the memory it requested is in
+// `requested`
+static std::vector<Tensor *> run_region(const CheckpointFunction &fn,
+                                        const std::vector<Tensor *> &leaves,
+                                        std::vector<Memory *> &requested) {
+  pool->begin_region();
+  std::vector<Tensor *> outputs;
+  try {
+    outputs = fn(leaves);
+  } catch (...) {
+    pool->return_region(pool->end_region(), {});
+    throw;
+  }
+  requested = pool->end_region();
+  return outputs;
+}
+
+// what a backward pass through the region leaves behind, the gradients of
+// the inputs and of the parameters fn read. the recomputed graph and its
+// gradients go back to the pool
+static std::unordered_set<const Memory *>
+kept_gradients(const OpNode *node, const std::vector<Tensor *> &leaves,
+               const std::vector<Tensor *> &roots) {
+  std::unordered_set<const Memory *> keep;
+  std::unordered_set<const Tensor *> aliases(leaves.begin(), leaves.end());
+  for (const Tensor *leaf : Tensor::graph_leaves(roots)) {
+    if (leaf->grad && !aliases.count(leaf))
+      keep.insert(leaf->grad->memory);
+  }
+  for (const Tensor *input : node->inputs) {
+    if (input->grad)
+      keep.insert(input->grad->memory);
+  }
+  return keep;
+}
+
+static void checkpoint_backward(OpNode *base) {
+  CheckpointNode *node = static_cast<CheckpointNode *>(base);
+  std::vector<Tensor *> leaves = detached(node->inputs);
+  // the region draws the numbers of the forward pass again, the stream
+  // continues where it is now
+  RandomState current = get_rng_state();
+  set_rng_state(node->random);
+  std::vector<Memory *> requested;
+  std::vector<Tensor *> outputs;
+  try {
+    outputs = run_region(node->fn, leaves, requested);
+  } catch (...) {
+    set_rng_state(current);
+    throw;
+  }
+  set_rng_state(current);
+  if (outputs.size() != node->outputs.size()) {
+    pool->return_region(requested, kept_gradients(node, leaves, {}));
+    throw std::logic_error(
+        "the checkpointed function returned a different number of tensors");
+  }
+
+  // the gradients of the outputs seed the recomputed graph, they are no
+  // longer needed outside and may be accumulated into
+  std::vector<Tensor *> roots, grads;
+  for (int k = 0; k < outputs.size(); k++) {
+    if (node->outputs[k]->grad && outputs[k]->requires_grad) {
+      roots.push_back(outputs[k]);
+      grads.push_back(node->outputs[k]->grad);
+    }
+  }
+  pool->begin_region();
+  try {
+    Tensor::backward(roots, grads);
+  } catch (...) {
+    // what the parameters collected before the error stays
+    std::vector<Memory *> backward = pool->end_region();
+    requested.insert(requested.end(), backward.begin(), backward.end());
+    pool->return_region(requested, kept_gradients(node, leaves, roots));
+    throw;
+  }
+  for (int i = 0; i < node->inputs.size(); i++) {
+    Tensor *input = node->inputs[i];
+    Tensor *grad = leaves[i]->grad;
+    if (input->requires_grad)
+      input->accumulate_grad(grad, true);
+  }
+  std::vector<Memory *> backward = pool->end_region();
+  requested.insert(requested.end(), backward.begin(), backward.end());
+
+  pool->return_region(requested, kept_gradients(node, leaves, roots));
+}
+
+// CHECKPOINT nodes are made here instead of by the dispatcher, only the
+// backward pass is used
+static Operation checkpoint_operation = {nullptr, checkpoint_backward};
+
+std::vector<Tensor *> checkpoint(const CheckpointFunction &fn,
+                                 const std::vector<Tensor *> &inputs) {
+  RandomState random = get_rng_state();
+  std::vector<Tensor *> leaves = detached(inputs);
+  std::vector<Memory *> requested;
+  std::vector<Tensor *> outputs = run_region(fn, leaves, requested);
+
+  std::unordered_set<const Memory *> keep;
+  bool requires_grad = false;
+  for (const Tensor *output : outputs) {
+    keep.insert(output->memory);
+    requires_grad = requires_grad || output->requires_grad;
+  }
+  pool->return_region(requested, keep);
+  if (!requires_grad)
+    return outputs;
+
+  CheckpointNode *node = new CheckpointNode;
+  node->op = &checkpoint_operation;
+  node->type = OPType::CHECKPOINT;
+  node->inputs = inputs;
+  node->outputs = outputs;
+  node->fn = fn;
+  node->random = random;
+  record_versions(node);
+  for (Tensor *output : outputs)
+    output->node = node;
+  return outputs;
+}
@@ -0,0 +1,222 @@
+#include "codegen.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+static uint32_t float_bits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+std::string fused_signature(const FusedProgram &program,
+                            const FusedLayout &layout) {
+  std::ostringstream signature;
+  signature << "n" << layout.size << ";d";
+  for (int dim : layout.dims)
+    signature << dim << ",";
+  for (const std::vector<int> &strides : layout.input_strides) {
+    signature << ";i";
+    for (int stride : strides)
+      signature << stride << ",";
+  }
+  signature << ";c";
+  for (const FusedInstruction &instruction : program.code) {
+    signature << instruction.op << ":" << instruction.a << ":"
+              << instruction.b << ":" << float_bits(instruction.scalar)
+              << ",";
+  }
+  return signature.str();
+}
+
+uint64_t fused_hash(const std::string &signature) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : signature) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string fused_kernel_name(uint64_t hash) {
+  std::ostringstream name;
+  name << "__fused_" << std::hex << hash << "__";
+  return name.str();
+}
+
+// the exact scalar, printing it in decimal could round
+static std::string float_literal(float value) {
+  return "as_type<float>(" + std::to_string(float_bits(value)) + "u)";
+}
+
+// same semantics as apply() in kernels/fused.metal
+static std::string expression(const FusedInstruction &instruction) {
+  std::string a = "r" + std::to_string(instruction.a);
+  std::string b = "r" + std::to_string(instruction.b);
+  std::string s = float_literal(instruction.scalar);
+  switch (static_cast<FusedOp>(instruction.op)) {
+  case FusedOp::NEG:
+    return "-" + a;
+  case FusedOp::SQRT:
+    return "sqrt(" + a + ")";
+  case FusedOp::EXP:
+    return "exp(" + a + ")";
+  case FusedOp::LOG:
+    return "log(" + a + ")";
+  case FusedOp::LOG10:
+    return "log10(" + a + ")";
+  case FusedOp::LOG2:
+    return "log2(" + a + ")";
+  case FusedOp::SIN:
+    return "sin(" + a + ")";
+  case FusedOp::COS:
+    return "cos(" + a + ")";
+  case FusedOp::TAN:
+    return "tan(" + a + ")";
+  case FusedOp::ASIN:
+    return "asin(" + a + ")";
+  case FusedOp::ACOS:
+    return "acos(" + a + ")";
+  case FusedOp::ATAN:
+    return "atan(" + a + ")";
+  case FusedOp::SINH:
+    return "sinh(" + a + ")";
+  case FusedOp::COSH:
+    return "cosh(" + a + ")";
+  case FusedOp::TANH:
+    return "tanh(" + a + ")";
+  case FusedOp::ASINH:
+    return "asinh(" + a + ")";
+  case FusedOp::ACOSH:
+    return "acosh(" + a + ")";
+  case FusedOp::ATANH:
+    return "atanh(" + a + ")";
+  case FusedOp::ADD:
+    return a + " + " + b;
+  case FusedOp::SUB:
+    return a + " - " + b;
+  case FusedOp::MUL:
+    return a + " * " + b;
+  case FusedOp::DIV:
+    return a + " / " + b;
+  case FusedOp::ATAN2:
+    return "atan2(" + b + ", " + a + ")";
+  case FusedOp::LOGICAL_E:
+    return "(float)(fabs(" + a + " - " + b + ") < 1e-5 || (" + a +
+           " == INFINITY && " + b + " == INFINITY))";
+  case FusedOp::LOGICAL_NE:
+    return "fabs(" + a + " - " + b + ") > 1e-5 ? 1.0f : 0.0f";
+  case FusedOp::LOGICAL_GT:
+    return "(float)(" + a + " > " + b + ")";
+  case FusedOp::LOGICAL_GTE:
+    return "(float)(" + a + " >= " + b + ")";
+  case FusedOp::LOGICAL_LT:
+    return "(float)(" + a + " < " + b + ")";
+  case FusedOp::LOGICAL_LTE:
+    return "(float)(" + a + " <= " + b + ")";
+  case FusedOp::ADD_SCALAR:
+    return a + " + " + s;
+  case FusedOp::SUB_SCALAR:
+    return a + " - " + s;
+  case FusedOp::RSUB_SCALAR:
+    return s + " - " + a;
+  case FusedOp::MUL_SCALAR:
+    return a + " * " + s;
+  case FusedOp::DIV_SCALAR:
+    return a + " / " + s;
+  case FusedOp::RDIV_SCALAR:
+    return s + " / " + a;
+  case FusedOp::POW_SCALAR:
+    return "pow(" + a + ", " + s + ")";
+  case FusedOp::POW_INT:
+    // the exponent is a constant, the loop unrolls
+    return "pow_int(" + a + ", " +
+           std::to_string(static_cast<int>(instruction.scalar)) + ")";
+  case FusedOp::CONST:
+    return s;
+  default:
+    throw std::invalid_argument("no expression for fused op " +
+                                std::to_string(instruction.op));
+  }
+}
+
+std::string generate_fused_source(const std::string &name,
+                                  const FusedProgram &program,
+                                  const FusedLayout &layout) {
+  std::ostringstream source;
+  source << "#include <metal_stdlib>\n"
+            "using namespace metal;\n\n"
+            "inline float pow_int(float x, int n) {\n"
+            "  float base = n < 0 ? 1.0f / x : x;\n"
+            "  float result = 1.0f;\n"
+            "  for (n = abs(n); n > 0; n >>= 1) {\n"
+            "    if (n & 1)\n"
+            "      result *= base;\n"
+            "    base *= base;\n"
+            "  }\n"
+            "  return result;\n"
+            "}\n\n";
+
+  source << "kernel void " << name << "(\n";
+  for (int i = 0; i < program.inputs.size(); i++) {
+    source << "    device const float *in" << i << " [[buffer(" << i
+           << ")]],\n";
+  }
+  source << "    device float *output [[buffer(" << Fuser::MAX_INPUTS
+         << ")]],\n"
+         << "    uint tid [[thread_position_in_grid]]) {\n"
+         << "  if (tid >= " << layout.size << ")\n"
+         << "    return;\n";
+
+  // coordinates, innermost dim first
+  int rank = layout.dims.size();
+  if (rank > 0)
+    source << "  uint rest = tid;\n";
+  for (int d = rank - 1; d >= 0; d--) {
+    if (d == 0) {
+      source << "  uint c0 = rest;\n";
+    } else {
+      source << "  uint c" << d << " = rest % " << layout.dims[d] << ";\n"
+             << "  rest /= " << layout.dims[d] << ";\n";
+    }
+  }
+
+  for (int i = 0; i < program.inputs.size(); i++) {
+    std::string index;
+    for (int d = 0; d < rank; d++) {
+      int stride = layout.input_strides[i][d];
+      if (stride == 0)
+        continue;
+      index += index.empty() ? "" : " + ";
+      index += "c" + std::to_string(d);
+      if (stride != 1)
+        index += " * " + std::to_string(stride);
+    }
+    source << "  int index" << i << " = " << (index.empty() ? "0" : index)
+           << ";\n";
+  }
+
+  for (int pc = 0; pc < program.code.size(); pc++) {
+    const FusedInstruction &instruction = program.code[pc];
+    source << "  float r" << pc << " = ";
+    if (instruction.op == static_cast<int>(FusedOp::LOAD)) {
+      source << "in" << instruction.a << "[index" << instruction.a << "]";
+    } else {
+      source << expression(instruction);
+    }
+    source << ";\n";
+  }
+  // fused outputs are contiguous
+  source << "  output[tid] = r" << program.code.size() - 1 << ";\n"
+         << "}\n";
+  return source.str();
+}
+
+std::string kernel_cache_dir() {
+  const char *dir = std::getenv("ACTX_KERNEL_CACHE");
+  if (dir && *dir)
+    return dir;
+  const char *home = std::getenv("HOME");
+  return std::string(home ? home : "/tmp") + "/.cache/actx/kernels";
+}
@@ -3,17 +3,20 @@
 #include "main.h"
 #include "op_types.h"
 #include "opnode.h"
+#include "random.h"
 #include "tensor.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <optional>
 #include <stdexcept>
 #include <stdio.h>
+#include <string>
 
 #define REGISTER_OP(OP, DEVICE, FUNC_PRE, FUNC_POST, BACKWARD)                 \
   this->_register->register_op(                                                \
       OPType::OP, DeviceType::DEVICE,                                          \
-      [this](std::vector<Tensor *> inputs) -> void {                           \
+      [this](std::vector<Tensor *> inputs, OpAttributes attributes) -> void {  \
         Tensor *a, *b, *result;                                                \
         a = b = result = nullptr;                                              \
         FUNC_PRE;                                                              \
@@ -22,6 +25,7 @@
           result->node->op =                                                   \
               this->_register->get(OPType::OP, DeviceType::DEVICE);            \
           result->node->type = OPType::OP;                                     \
+          result->node->attributes = attributes;                               \
         }                                                                      \
         FUNC_POST;                                                             \
       },                                                                       \
@@ -31,19 +35,436 @@
         BACKWARD;                                                              \
       })
 
+// POW, e * a^(e - 1) * g. the common exponents skip the pow kernel, and
+// 0.5 and -1 read the result instead of the input, like sqrt and 1 / a
+static Tensor *pow_grad(OpNode *node) {
+  Tensor *a = node->inputs[0];
+  Tensor *out = node->outputs[0];
+  float exponent = node->attributes.floats[0];
+  if (exponent == 2.0f)
+    return a->mul(out->grad)->mul(2.0f);
+  if (exponent == 0.5f)
+    return out->grad->div(out)->mul(0.5f);
+  if (exponent == -1.0f)
+    return out->grad->mul(out)->mul(out)->negate();
+  return a->pow(exponent - 1)->mul(exponent)->mul(out->grad);
+}
+
+// RELU and LEAKY_RELU, inputs: x, [mask], result with floats
+// {negative_slope}. the backward pass reads the mask, one bit per element,
+// instead of the input
+static void rectify(std::vector<Tensor *> &inputs, OpAttributes &attributes) {
+  Tensor *x = inputs[0];
+  Tensor *mask = inputs.size() > 2 ? inputs[1] : nullptr;
+  Tensor *result = inputs.back();
+  result->node->inputs = {x};
+  result->node->outputs = {result};
+  if (mask)
+    result->node->outputs.push_back(mask);
+  mps->relu(x, attributes.floats[0], mask, result);
+}
+
+static void rectify_backward(OpNode *node) {
+  Tensor *a = node->inputs[0];
+  Tensor *out = node->outputs[0];
+  if (!a->requires_grad || !out->grad || node->outputs.size() < 2)
+    return;
+  Tensor *dx = new Tensor(out->dims, DType::float32, false, out->device);
+  dispatcher->call(OPType::MASK_GRAD, out->device,
+                   {out->grad->contiguous(), node->outputs[1], dx},
+                   {{}, {node->attributes.floats[0]}});
+  a->accumulate_grad(dx, true);
+}
+
+// SIGMOID, TANH, GELU and SILU, the derivative is computed from the result
+// or, for GELU and SILU, from the input
+static void activation_backward(OpNode *node, Activation activation) {
+  Tensor *a = node->inputs[0];
+  Tensor *out = node->outputs[0];
+  if (!a->requires_grad || !out->grad)
+    return;
+  bool from_input =
+      activation == Activation::GELU || activation == Activation::SILU;
+  Tensor *saved = (from_input ? a : out)->contiguous();
+  Tensor *dx = new Tensor(out->dims, DType::float32, false, out->device);
+  dispatcher->call(OPType::ACTIVATION_GRAD, out->device,
+                   {out->grad->contiguous(), saved, dx},
+                   {{static_cast<int>(activation)}, {}});
+  a->accumulate_grad(dx, true);
+}
+
+// the random state of a DROPOUT call, ints {seed, offset low, offset high}
+static RandomState random_state(const OpAttributes &attributes) {
+  uint64_t low = static_cast<uint32_t>(attributes.ints[1]);
+  uint64_t high = static_cast<uint32_t>(attributes.ints[2]);
+  return {static_cast<uint32_t>(attributes.ints[0]), high << 32 | low};
+}
+
+// the same state drops the same elements of the gradient
+static void dropout_backward(OpNode *node) {
+  Tensor *a = node->inputs[0];
+  Tensor *out = node->outputs[0];
+  if (!a->requires_grad || !out->grad)
+    return;
+  Tensor *dx = new Tensor(out->dims, DType::float32, false, out->device);
+  dispatcher->call(OPType::DROPOUT, out->device, {out->grad->contiguous(), dx},
+                   node->attributes);
+  a->accumulate_grad(dx, true);
+}
+
+// LAYER_NORM and BATCH_NORM, inputs: x, [weight], [bias], [running_mean,
+// running_var], mean, rstd, result with ints {has_weight, has_bias,
+// has_running, training} and floats {eps, momentum}
+static void normalize(std::vector<Tensor *> &inputs, OpAttributes &attributes,
+                      bool per_row) {
+  std::vector<int> &ints = attributes.ints;
+  int i = 1;
+  Tensor *x = inputs[0];
+  Tensor *weight = ints[0] ? inputs[i++] : nullptr;
+  Tensor *bias = ints[1] ? inputs[i++] : nullptr;
+  Tensor *running_mean = ints[2] ? inputs[i++] : nullptr;
+  Tensor *running_var = ints[2] ? inputs[i++] : nullptr;
+  Tensor *mean = inputs[i++];
+  Tensor *rstd = inputs[i++];
+  Tensor *result = inputs[i];
+  result->node->inputs = {x};
+  if (weight)
+    result->node->inputs.push_back(weight);
+  if (bias)
+    result->node->inputs.push_back(bias);
+  result->node->outputs = {result, mean, rstd};
+  mps->normalize(x, weight, bias, running_mean, running_var, per_row,
+                 ints[3] != 0, attributes.floats[0], attributes.floats[1],
+                 mean, rstd, result);
+}
+
+// the backward of normalize, the statistics are the extra outputs
+static void normalize_backward(OpNode *node, bool per_row) {
+  std::vector<int> &ints = node->attributes.ints;
+  Tensor *x = node->inputs[0];
+  Tensor *weight = ints[0] ? node->inputs[1] : nullptr;
+  Tensor *bias = ints[1] ? node->inputs.back() : nullptr;
+  Tensor *out = node->outputs[0];
+  bool weight_grad = weight && weight->requires_grad;
+  bool bias_grad = bias && bias->requires_grad;
+  if (!out->grad || !(x->requires_grad || weight_grad || bias_grad))
+    return;
+  int cols = x->dims.back();
+  int groups = per_row ? x->size / cols : cols;
+  Tensor *sums = new Tensor({groups, 2}, DType::float32, false, x->device);
+  Tensor *dx = new Tensor(x->dims, x->dtype, false, x->device);
+  Tensor *dw = nullptr;
+  Tensor *db = nullptr;
+  if (weight_grad)
+    dw = new Tensor(weight->dims, weight->dtype, false, x->device);
+  if (bias_grad)
+    db = new Tensor(bias->dims, bias->dtype, false, x->device);
+  std::vector<Tensor *> inputs = {out->grad->contiguous(), x};
+  if (weight)
+    inputs.push_back(weight);
+  inputs.insert(inputs.end(), {node->outputs[1], node->outputs[2], sums});
+  if (dw)
+    inputs.push_back(dw);
+  if (db)
+    inputs.push_back(db);
+  inputs.push_back(dx);
+  dispatcher->call(OPType::NORM_BACKWARD, x->device, inputs,
+                   {{per_row, ints[3], weight != nullptr, dw != nullptr,
+                     db != nullptr},
+                    {}});
+  if (x->requires_grad)
+    x->accumulate_grad(dx, true);
+  if (dw)
+    weight->accumulate_grad(dw, true);
+  if (db)
+    bias->accumulate_grad(db, true);
+}
+
+// an in-place op on a tensor in the graph. the graph up to the write moves
+// to an alias over the same memory, which the op reads instead, so the
+// tensor can become the op's result
+static void rebase_inplace(std::vector<Tensor *> &inputs) {
+  Tensor *result = inputs.back();
+  OpNode *node = result->node;
+  if (!node || node->type == OPType::NO_OP) {
+    throw std::runtime_error(
+        "a leaf tensor that requires grad is used in an in-place operation");
+  }
+  if (node->type == OPType::PERMUTE || node->type == OPType::RESHAPE ||
+      node->type == OPType::EXPAND) {
+    throw std::runtime_error("a view of a tensor that requires grad is used "
+                             "in an in-place operation");
+  }
+  Tensor *previous = result->detach();
+  previous->requires_grad = true;
+  previous->node = node;
+  std::replace(node->outputs.begin(), node->outputs.end(), result, previous);
+  std::replace(inputs.begin(), inputs.end() - 1, result, previous);
+  result->overwritten.push_back({result->memory->version, previous});
+  result->node = nullptr;
+}
+
 void Dispatcher::call(OPType op, DeviceType device,
-                      std::vector<Tensor *> inputs) {
+                      std::vector<Tensor *> inputs, OpAttributes attributes) {
   Operation *operation = this->_register->get(op, device);
   if (operation == nullptr) {
     throw std::logic_error("operation not found");
   }
-  operation->func(inputs);
+  if (inputs.empty()) {
+    operation->func(inputs, attributes);
+    return;
+  }
+  Tensor *result = inputs.back();
+  bool inplace = std::find(inputs.begin(), inputs.end() - 1, result) !=
+                 inputs.end() - 1;
+  if (inplace && result->requires_grad)
+    rebase_inplace(inputs);
+  pool->trace_op(op, inputs);
+  OpNode *node = result->node;
+  operation->func(inputs, attributes);
+  if (inplace && !result->requires_grad) {
+    // a tensor without grad stays out of the graph when written in place,
+    // the gradients accumulated by the backward pass are such tensors
+    result->node = nullptr;
+  } else if (result->node != node) {
+    record_versions(result->node, result->memory);
+  }
+  result->memory->version++;
+
+  // lazy programs read what was filled with one value as a constant, only
+  // the elements of a view like x[:2] are. any other op may have overwritten
+  // its result
+  std::optional<float> fill;
+  if (op == OPType::ONES_INIT) {
+    fill = 1.0f;
+  } else if (op == OPType::ZEROES_INIT) {
+    fill = 0.0f;
+  } else if (op == OPType::FULL_INIT) {
+    fill = attributes.floats[0];
+  }
+  if (fill && result->dtype == DType::float32 && result->is_contigous) {
+    fuser->set_constant(result->memory, result->offset(),
+                        static_cast<int>(result->size), *fill);
+  } else {
+    fuser->forget_constant(result->memory);
+  }
+}
+
+// the inputs and outputs of `node` whose values its backward pass reads,
+// the others may be written in place before it runs. a formula that reads
+// something else has to be declared here
+static void saved_flags(const OpNode *node, std::vector<bool> &inputs,
+                        std::vector<bool> &outputs) {
+  inputs.assign(node->inputs.size(), false);
+  outputs.assign(node->outputs.size(), false);
+  auto needs_grad = [node](int i) { return node->inputs[i]->requires_grad; };
+  switch (node->type) {
+  case OPType::NO_OP:
+  case OPType::NEGATE:
+  case OPType::ADD:
+  case OPType::SUB:
+  case OPType::ADD_SCALAR:
+  case OPType::SUB_SCALAR:
+  case OPType::MUL_SCALAR:
+  case OPType::CLONE:
+  case OPType::CAST:
+  case OPType::CONTIGUOUS:
+  case OPType::COPY:
+  case OPType::SUM_TO:
+  case OPType::DROPOUT:
+  case OPType::LINEAR_GRAD_INPUT:
+  case OPType::LINEAR_GRAD_WEIGHT:
+  case OPType::LINEAR_GRAD_BIAS:
+  case OPType::NORM_BACKWARD:
+  case OPType::ACTIVATION_GRAD:
+  case OPType::MASK_GRAD:
+    return;
+  case OPType::PERMUTE:
+  case OPType::RESHAPE:
+  case OPType::EXPAND:
+    // nothing is read, but the gradient would go to the value after the
+    // write, while the view may have been read before it
+    inputs[0] = needs_grad(0);
+    return;
+  case OPType::MUL:
+    inputs[0] = needs_grad(1);
+    inputs[1] = needs_grad(0);
+    return;
+  case OPType::DIV:
+    inputs[1] = true;
+    outputs[0] = needs_grad(1);
+    return;
+  case OPType::DIV_SCALAR:
+    // see its backward, 0 / a has no gradient to read out from
+    outputs[0] =
+        node->attributes.ints[0] != 0 && node->attributes.floats[0] != 0.0f;
+    return;
+  case OPType::POW: {
+    // see pow_grad
+    float exponent = node->attributes.floats[0];
+    outputs[0] = exponent == 0.5f || exponent == -1.0f;
+    inputs[0] = !outputs[0];
+    return;
+  }
+  case OPType::EXP:
+  case OPType::SQRT:
+  case OPType::SIGMOID:
+  case OPType::TAN:
+  case OPType::TANH:
+    outputs[0] = true;
+    return;
+  case OPType::LOG:
+  case OPType::LOG10:
+  case OPType::LOG2:
+  case OPType::SIN:
+  case OPType::COS:
+  case OPType::ASIN:
+  case OPType::ACOS:
+  case OPType::ATAN:
+  case OPType::ATAN2:
+  case OPType::SINH:
+  case OPType::COSH:
+  case OPType::ASINH:
+  case OPType::ACOSH:
+  case OPType::ATANH:
+  case OPType::GELU:
+  case OPType::SILU:
+    // a function of the inputs only
+    inputs.assign(inputs.size(), true);
+    return;
+  case OPType::RELU:
+  case OPType::LEAKY_RELU:
+    // only the mask
+    for (int i = 1; i < outputs.size(); i++)
+      outputs[i] = true;
+    return;
+  case OPType::LINEAR:
+    inputs[0] = needs_grad(1);
+    inputs[1] = needs_grad(0);
+    if (static_cast<Activation>(node->attributes.ints[0]) != Activation::NONE)
+      outputs.back() = true;
+    return;
+  case OPType::LAYER_NORM:
+  case OPType::BATCH_NORM:
+    // x, weight, mean and rstd
+    inputs.assign(inputs.size(), true);
+    if (node->attributes.ints[1])
+      inputs.back() = false;
+    for (int i = 1; i < outputs.size(); i++)
+      outputs[i] = true;
+    return;
+  case OPType::CHECKPOINT:
+    // recomputed from the inputs
+    inputs.assign(inputs.size(), true);
+    return;
+  default:
+    inputs.assign(inputs.size(), true);
+    outputs.assign(outputs.size(), true);
+  }
+}
+
+void Dispatcher::check_versions(const OpNode *node) const {
+  if (node->input_versions.size() != node->inputs.size() ||
+      node->output_versions.size() != node->outputs.size())
+    return;
+  std::vector<bool> inputs, outputs;
+  saved_flags(node, inputs, outputs);
+  auto check = [](const Tensor *tensor, int saved) {
+    if (tensor->memory->version == saved)
+      return;
+    throw std::runtime_error(
+        "a tensor needed for the gradient was modified by an in-place "
+        "operation, it is at version " +
+        std::to_string(tensor->memory->version) + " instead of " +
+        std::to_string(saved));
+  };
+  for (int i = 0; i < inputs.size(); i++) {
+    if (inputs[i])
+      check(node->inputs[i], node->input_versions[i]);
+  }
+  for (int i = 0; i < outputs.size(); i++) {
+    if (outputs[i])
+      check(node->outputs[i], node->output_versions[i]);
+  }
+}
+
+std::vector<Tensor *> Dispatcher::saved_tensors(const OpNode *node) const {
+  std::vector<bool> inputs, outputs;
+  saved_flags(node, inputs, outputs);
+  std::vector<Tensor *> saved;
+  for (int i = 0; i < inputs.size(); i++) {
+    if (inputs[i])
+      saved.push_back(node->inputs[i]);
+  }
+  for (int i = 0; i < outputs.size(); i++) {
+    if (outputs[i])
+      saved.push_back(node->outputs[i]);
+  }
+  return saved;
 }
 
 Operation *Dispatcher::get(OPType op, DeviceType device) {
   return this->_register->get(op, device);
 }
 
+void Dispatcher::_count(DispatchPath path) {
+  switch (path) {
+  case DispatchPath::CONTIGUOUS:
+    _stats.contiguous++;
+    break;
+  case DispatchPath::SCALAR:
+    _stats.scalar++;
+    break;
+  case DispatchPath::ROW:
+    _stats.row++;
+    break;
+  case DispatchPath::STRIDED:
+    _stats.strided++;
+    break;
+  }
+}
+
+DispatchPath Dispatcher::classify(const Tensor *a, const Tensor *b,
+                                  const Tensor *result) {
+  DispatchPath path = DispatchPath::STRIDED;
+  int n = result->size;
+  if (result->is_contigous && a->is_contigous && b->is_contigous) {
+    int cols = result->dims.back();
+    // a contiguous operand of the result's size broadcasts to the same
+    // layout, leading dims of size 1 do not move any element
+    bool a_full = a->size == n;
+    bool b_full = b->size == n;
+    bool a_row = a->size == cols && a->dims.back() == cols;
+    bool b_row = b->size == cols && b->dims.back() == cols;
+    if (a_full && b_full) {
+      path = DispatchPath::CONTIGUOUS;
+    } else if ((a_full && b->size == 1) || (b_full && a->size == 1)) {
+      path = DispatchPath::SCALAR;
+    } else if ((a_full && b_row) || (b_full && a_row)) {
+      path = DispatchPath::ROW;
+    }
+  }
+  _count(path);
+  return path;
+}
+
+DispatchPath Dispatcher::classify(const Tensor *input, const Tensor *output) {
+  DispatchPath path = DispatchPath::STRIDED;
+  if (input->is_contigous && output->is_contigous &&
+      input->size == output->size) {
+    path = DispatchPath::CONTIGUOUS;
+  }
+  _count(path);
+  return path;
+}
+
+void Dispatcher::reset_stats() {
+  _stats.contiguous = 0;
+  _stats.scalar = 0;
+  _stats.row = 0;
+  _stats.strided = 0;
+}
+
 void Dispatcher::init_register() {
   REGISTER_OP(NEGATE, MPS, ({
                 assert(inputs.size() == 2);
@@ -60,12 +481,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(out->grad->negate(false), true);
-                  } else {
-                    a->grad = out->grad->negate(false);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->grad, false, true);
                 }
               });
 
@@ -86,20 +502,10 @@ void Dispatcher::init_register() {
                 b = node->inputs[1];
                 out = node->outputs[0];
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(out->grad, true);
-                  } else {
-                    a->grad = Tensor::clone(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->grad);
                 }
                 if (b->requires_grad) {
-                  if (b->grad) {
-                    b->grad = b->grad->add(out->grad);
-                  } else {
-                    b->grad = Tensor::clone(out->grad);
-                    b->grad->requires_grad = false;
-                  }
+                  b->accumulate_grad(out->grad);
                 }
               }));
   REGISTER_OP(SUB, MPS, ({
@@ -119,20 +525,10 @@ void Dispatcher::init_register() {
                 b = node->inputs[1];
                 out = node->outputs[0];
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(out->grad, true);
-                  } else {
-                    a->grad = Tensor::clone(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->grad);
                 }
                 if (b->requires_grad) {
-                  if (b->grad) {
-                    b->grad = b->grad->add(out->grad->negate(false), true);
-                  } else {
-                    b->grad = out->grad->negate(false);
-                    b->grad->requires_grad = false;
-                  }
+                  b->accumulate_grad(out->grad, false, true);
                 }
               });
   REGISTER_OP(MUL, MPS, ({
@@ -152,20 +548,10 @@ void Dispatcher::init_register() {
                 b = node->inputs[1];
                 out = node->outputs[0];
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(b->mul(out->grad), true);
-                  } else {
-                    a->grad = b->mul(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(b->mul(out->grad), true);
                 }
                 if (b->requires_grad) {
-                  if (b->grad) {
-                    b->grad = b->grad->add(a->mul(out->grad), true);
-                  } else {
-                    b->grad = a->mul(out->grad);
-                    b->grad->requires_grad = false;
-                  }
+                  b->accumulate_grad(a->mul(out->grad), true);
                 }
               }));
 
@@ -185,56 +571,121 @@ void Dispatcher::init_register() {
                 a = node->inputs[0];
                 b = node->inputs[1];
                 out = node->outputs[0];
+                // g / b is the gradient of a and -a / b^2 * g = -(g / b) * out
+                // the one of b, so a can be divided in place
+                Tensor *grad = out->grad->div(b);
+                Tensor *b_grad =
+                    b->requires_grad ? grad->mul(out)->negate() : nullptr;
+                if (a->requires_grad)
+                  a->accumulate_grad(grad, true);
+                if (b_grad)
+                  b->accumulate_grad(b_grad, true);
+              }));
+  // the exponent is passed by value in attributes.floats[0]
+  REGISTER_OP(POW, MPS, ({
+                assert(inputs.size() == 2 && attributes.floats.size() == 1);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->pow(a, attributes.floats[0], result);
+              }),
+              ({
+                assert(node->inputs.size() == 1 && node->outputs.size() == 1);
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad)
+                  a->accumulate_grad(pow_grad(node), true);
+              }));
+
+  // scalar operands: attributes.floats[0] is the scalar, attributes.ints[0]
+  // is set when the scalar is the left operand of sub/div
+  REGISTER_OP(ADD_SCALAR, MPS, ({
+                assert(inputs.size() == 2 && attributes.floats.size() == 1);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->add_scalar(a, attributes.floats[0], result);
+              }),
+              ({
+                a = node->inputs[0];
+                out = node->outputs[0];
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(out->grad->div(b, false), true);
-                  } else {
-                    a->grad = Tensor::clone(out->grad)->div(b, false);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->grad);
                 }
-                if (b->requires_grad) {
-                  if (b->grad) {
-                    b->grad = b->grad->add(a->div(b->pow(2.0f, false), false)
-                                               ->mul(out->grad, false)
-                                               ->negate(false),
-                                           true);
+              }));
+  REGISTER_OP(SUB_SCALAR, MPS, ({
+                assert(inputs.size() == 2 && attributes.floats.size() == 1);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->sub_scalar(a, attributes.floats[0],
+                                attributes.ints[0] != 0, result);
+              }),
+              ({
+                a = node->inputs[0];
+                out = node->outputs[0];
+                // s - a passes -g on
+                if (a->requires_grad)
+                  a->accumulate_grad(out->grad, false,
+                                     node->attributes.ints[0] != 0);
+              }));
+  REGISTER_OP(MUL_SCALAR, MPS, ({
+                assert(inputs.size() == 2 && attributes.floats.size() == 1);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->mul_scalar(a, attributes.floats[0], result);
+              }),
+              ({
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad) {
+                  Tensor *grad = out->grad->mul(node->attributes.floats[0]);
+                  a->accumulate_grad(grad, true);
+                }
+              }));
+  REGISTER_OP(DIV_SCALAR, MPS, ({
+                assert(inputs.size() == 2 && attributes.floats.size() == 1);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->div_scalar(a, attributes.floats[0],
+                                attributes.ints[0] != 0, result);
+              }),
+              ({
+                a = node->inputs[0];
+                out = node->outputs[0];
+                float scalar = node->attributes.floats[0];
+                if (a->requires_grad) {
+                  // d(a / s) = 1 / s, d(s / a) = -s / a^2 = -out^2 / s,
+                  // which is 0 for s = 0 and not 0 / 0
+                  bool reflected = node->attributes.ints[0];
+                  Tensor *grad;
+                  if (!reflected) {
+                    grad = out->grad->div(scalar);
+                  } else if (scalar == 0.0f) {
+                    grad = Tensor::zeros(a->dims, a->dtype, false, a->device);
                   } else {
-                    b->grad = a->div(b->pow(2.0f, false), false)
-                                  ->mul(out->grad, false)
-                                  ->negate(false);
-                    b->grad->requires_grad = false;
+                    grad = out->grad->mul(out)->mul(out)->div(-scalar);
                   }
+                  a->accumulate_grad(grad, true);
                 }
               }));
-  REGISTER_OP(
-      POW, MPS, ({
-        assert(inputs.size() == 3);
-        a = inputs[0];
-        b = inputs[1];
-        result = inputs[2];
-        assert(b->size == 1);
-      }),
-      ({
-        result->node->inputs = {a, b};
-        result->node->outputs = {result};
-        mps->pow(a, b, result);
-      }),
-      ({
-        assert(node->inputs.size() == 2 && node->outputs.size() == 1);
-        a = node->inputs[0];
-        b = node->inputs[1];
-        out = node->outputs[0];
-        if (a->requires_grad) {
-          if (a->grad) {
-            a->grad = a->grad->add(
-                b->mul(a->pow(b->_get_element(0) - 1))->mul(out->grad), true);
-          } else {
-            a->grad = b->mul(a->pow(b->_get_element(0) - 1))->mul(out->grad);
-            a->grad->requires_grad = false;
-          }
-        }
-      }));
 
   // comparison;
   REGISTER_OP(LOGICAL_E, MPS, ({
@@ -362,16 +813,9 @@ void Dispatcher::init_register() {
         out = node->outputs[0];
         assert(node->inputs.size() == 1 && node->outputs.size() == 1);
 
+        // 0.5 / sqrt(a) from the result, so sqrt can run in place
         if (a->requires_grad) {
-          if (a->grad) {
-            a->grad = a->grad->add(
-                a->pow(-0.5f)->div(Tensor::full_like(a, 2.0f))->mul(out->grad),
-                true);
-          } else {
-            a->grad =
-                a->pow(-0.5f)->div(Tensor::full_like(a, 2.0f))->mul(out->grad);
-            a->grad->requires_grad = false;
-          }
+          a->accumulate_grad(out->grad->div(out)->mul(0.5f), true);
         }
       });
 
@@ -389,14 +833,9 @@ void Dispatcher::init_register() {
                 a = node->inputs[0];
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
-
+                // the result is the derivative, so exp can run in place
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(a->exp()->mul(out->grad), true);
-                  } else {
-                    a->grad = a->exp()->mul(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->mul(out->grad), true);
                 }
               });
 
@@ -415,13 +854,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad = a->grad->add(
-                        Tensor::ones_like(a)->div(a)->mul(out->grad), true);
-                  } else {
-                    a->grad = Tensor::ones_like(a)->div(a)->mul(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(out->grad->div(a), true);
                 }
               });
   REGISTER_OP(LOG10, MPS, ({
@@ -439,18 +872,8 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad =
-                        a->grad->add(Tensor::full_like(a, 1.0f / (float)log(10))
-                                         ->div(a)
-                                         ->mul(out->grad),
-                                     true);
-                  } else {
-                    a->grad = Tensor::full_like(a, 1.0f / (float)log(10))
-                                  ->div(a)
-                                  ->mul(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(
+                      a->rdiv(1.0f / (float)log(10))->mul(out->grad), true);
                 }
               });
 
@@ -469,18 +892,8 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  if (a->grad) {
-                    a->grad =
-                        a->grad->add(Tensor::full_like(a, 1.0f / (float)log(2))
-                                         ->div(a)
-                                         ->mul(out->grad),
-                                     true);
-                  } else {
-                    a->grad = Tensor::full_like(a, 1.0f / (float)log(2))
-                                  ->div(a)
-                                  ->mul(out->grad);
-                    a->grad->requires_grad = false;
-                  }
+                  a->accumulate_grad(
+                      a->rdiv(1.0f / (float)log(2))->mul(out->grad), true);
                 }
               });
 
@@ -500,7 +913,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad)
-                  a->grad = a->cos()->mul(out->grad);
+                  a->accumulate_grad(a->cos()->mul(out->grad), true);
               });
 
   REGISTER_OP(COS, MPS, ({
@@ -518,7 +931,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad)
-                  a->grad = a->sin()->negate()->mul(out->grad);
+                  a->accumulate_grad(a->sin()->negate()->mul(out->grad), true);
               });
   REGISTER_OP(TAN, MPS, ({
                 assert(inputs.size() == 2);
@@ -534,8 +947,11 @@ void Dispatcher::init_register() {
                 a = node->inputs[0];
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
-                if (a->requires_grad)
-                  a->grad = a->cos()->pow(-2.0f)->mul(out->grad);
+                // 1 + tan^2 from the result, so tan can run in place
+                if (a->requires_grad) {
+                  Tensor *grad = out->mul(out)->add(1.0f);
+                  a->accumulate_grad(grad->mul(out->grad), true);
+                }
               });
   REGISTER_OP(
       ASIN, MPS, ({
@@ -553,8 +969,8 @@ void Dispatcher::init_register() {
         out = node->outputs[0];
         assert(node->inputs.size() == 1 && node->outputs.size() == 1);
         if (a->requires_grad) {
-          Tensor *ones = Tensor::ones_like(a);
-          a->grad = ones->div(ones->sub(a->pow(2.0f))->sqrt())->mul(out->grad);
+          a->accumulate_grad(
+              a->pow(2.0f)->rsub(1.0f)->pow(-0.5f)->mul(out->grad), true);
         }
       });
   REGISTER_OP(ACOS, MPS, ({
@@ -572,10 +988,8 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  Tensor *ones = Tensor::ones_like(a);
-                  a->grad = ones->div(ones->sub(a->pow(2.0f))->sqrt())
-                                ->negate()
-                                ->mul(out->grad);
+                  Tensor *grad = a->pow(2.0f)->rsub(1.0f)->pow(-0.5f)->negate();
+                  a->accumulate_grad(grad->mul(out->grad), true);
                 }
               });
   REGISTER_OP(ATAN, MPS, ({
@@ -593,8 +1007,8 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  Tensor *ones = Tensor::ones_like(a);
-                  a->grad = ones->div(ones->add(a->pow(2.0f)))->mul(out->grad);
+                  Tensor *denominator = a->pow(2.0f)->add(1.0f);
+                  a->accumulate_grad(out->grad->div(denominator), true);
                 }
               });
   REGISTER_OP(ATAN2, MPS, ({
@@ -618,10 +1032,11 @@ void Dispatcher::init_register() {
                   denominator = a->pow(2.0f)->add(b->pow(2.0f));
                 }
                 if (a->requires_grad) {
-                  a->grad = b->div(denominator)->negate()->mul(out->grad);
+                  a->accumulate_grad(
+                      b->div(denominator)->negate()->mul(out->grad), true);
                 }
                 if (b->requires_grad) {
-                  b->grad = a->div(denominator)->mul(out->grad);
+                  b->accumulate_grad(a->div(denominator)->mul(out->grad), true);
                 }
               });
 
@@ -641,7 +1056,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad)
-                  a->grad = a->cosh()->mul(out->grad);
+                  a->accumulate_grad(a->cosh()->mul(out->grad), true);
               });
 
   REGISTER_OP(COSH, MPS, ({
@@ -659,7 +1074,7 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad)
-                  a->grad = a->sinh()->mul(out->grad);
+                  a->accumulate_grad(a->sinh()->mul(out->grad), true);
               });
   REGISTER_OP(TANH, MPS, ({
                 assert(inputs.size() == 2);
@@ -675,8 +1090,13 @@ void Dispatcher::init_register() {
                 a = node->inputs[0];
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
-                if (a->requires_grad)
-                  a->grad = a->cosh()->pow(-2.0f)->mul(out->grad);
+                // 1 - tanh^2 from the result, in one kernel for float32
+                if (out->dtype == DType::float32) {
+                  activation_backward(node, Activation::TANH);
+                } else if (a->requires_grad) {
+                  Tensor *grad = out->mul(out)->rsub(1.0f);
+                  a->accumulate_grad(grad->mul(out->grad), true);
+                }
               });
   REGISTER_OP(
       ASINH, MPS, ({
@@ -694,8 +1114,8 @@ void Dispatcher::init_register() {
         out = node->outputs[0];
         assert(node->inputs.size() == 1 && node->outputs.size() == 1);
         if (a->requires_grad) {
-          Tensor *ones = Tensor::ones_like(a);
-          a->grad = ones->div(a->pow(2.0f)->add(ones)->sqrt())->mul(out->grad);
+          a->accumulate_grad(
+              a->pow(2.0f)->add(1.0f)->pow(-0.5f)->mul(out->grad), true);
         }
       });
   REGISTER_OP(
@@ -714,8 +1134,8 @@ void Dispatcher::init_register() {
         out = node->outputs[0];
         assert(node->inputs.size() == 1 && node->outputs.size() == 1);
         if (a->requires_grad) {
-          Tensor *ones = Tensor::ones_like(a);
-          a->grad = ones->div(a->pow(2.0f)->sub(ones)->sqrt())->mul(out->grad);
+          a->accumulate_grad(
+              a->pow(2.0f)->sub(1.0f)->pow(-0.5f)->mul(out->grad), true);
         }
       });
   REGISTER_OP(ATANH, MPS, ({
@@ -733,8 +1153,8 @@ void Dispatcher::init_register() {
                 out = node->outputs[0];
                 assert(node->inputs.size() == 1 && node->outputs.size() == 1);
                 if (a->requires_grad) {
-                  Tensor *ones = Tensor::ones_like(a);
-                  a->grad = ones->div(ones->sub(a->pow(2.0f)))->mul(out->grad);
+                  Tensor *denominator = a->pow(2.0f)->rsub(1.0f);
+                  a->accumulate_grad(out->grad->div(denominator), true);
                 }
               });
   // initalisations;
@@ -756,11 +1176,10 @@ void Dispatcher::init_register() {
               ({ mps->eye(a); }), {});
 
   REGISTER_OP(FULL_INIT, MPS, ({
-                assert(inputs.size() == 2);
+                assert(inputs.size() == 1 && attributes.floats.size() == 1);
                 a = inputs[0];
-                b = inputs[1];
               }),
-              ({ mps->full(a, b); }), {});
+              ({ mps->full(attributes.floats[0], a); }), {});
   REGISTER_OP(CLONE, MPS, ({
                 throw std::logic_error(
                     "method not supposed to be called through dispatcher");
@@ -769,7 +1188,320 @@ void Dispatcher::init_register() {
                 a = node->inputs[0];
                 out = node->outputs[0];
                 if (a->requires_grad) {
-                  a->grad = Tensor::clone(out->grad);
+                  a->accumulate_grad(out->grad);
+                }
+              });
+  REGISTER_OP(CAST, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->cast(a, result,
+                          static_cast<RoundingMode>(attributes.ints[0]),
+                          attributes.ints[1] != 0);
+              }),
+              {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                assert(node->inputs.size() == 1 && node->outputs.size() == 1);
+                // gradient flows back in the dtype of the input
+                if (a->requires_grad && out->grad) {
+                  Tensor *grad = out->grad->to(a->dtype);
+                  a->accumulate_grad(grad, true);
                 }
               });
+  // views are created directly by the tensor methods, only their backward
+  // goes through the register
+  REGISTER_OP(PERMUTE, MPS, ({
+                throw std::logic_error(
+                    "method not supposed to be called through dispatcher");
+              }),
+              ({}), {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad && out->grad) {
+                  std::vector<int> &order = node->attributes.ints;
+                  std::vector<int> inverse(order.size());
+                  for (int i = 0; i < order.size(); i++)
+                    inverse[order[i]] = i;
+                  a->accumulate_grad(out->grad->permute(inverse));
+                }
+              });
+  REGISTER_OP(RESHAPE, MPS, ({
+                throw std::logic_error(
+                    "method not supposed to be called through dispatcher");
+              }),
+              ({}), {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad && out->grad) {
+                  a->accumulate_grad(out->grad->reshape(a->dims));
+                }
+              });
+  REGISTER_OP(EXPAND, MPS, ({
+                throw std::logic_error(
+                    "method not supposed to be called through dispatcher");
+              }),
+              ({}), {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad && out->grad) {
+                  a->accumulate_grad(out->grad->sum_to(a->dims));
+                }
+              });
+  REGISTER_OP(CONTIGUOUS, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->contiguous(a, result);
+              }),
+              {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad && out->grad) {
+                  a->accumulate_grad(out->grad);
+                }
+              });
+  // writes b into the layout of the result, which is the last input too.
+  // the value it had gets no gradient
+  REGISTER_OP(COPY, MPS, ({
+                assert(inputs.size() == 3);
+                a = inputs[0];
+                b = inputs[1];
+                result = inputs[2];
+              }),
+              ({
+                result->node->inputs = {a, b};
+                result->node->outputs = {result};
+                mps->copy(b, result);
+              }),
+              {
+                b = node->inputs[1];
+                out = node->outputs[0];
+                if (b->requires_grad && out->grad) {
+                  b->accumulate_grad(out->grad);
+                }
+              });
+  REGISTER_OP(SUM_TO, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->sum_to(a, result);
+              }),
+              {
+                a = node->inputs[0];
+                out = node->outputs[0];
+                if (a->requires_grad && out->grad) {
+                  a->accumulate_grad(out->grad->expand(a->dims));
+                }
+              });
+  // inputs: x, weight, [bias], [pre], result with ints {activation,
+  // has_bias, save_pre}. `pre` keeps the value before a GELU or SiLU, the
+  // other activations take their derivative from the result
+  REGISTER_OP(LINEAR, MPS, ({
+                a = inputs[0];
+                b = inputs[1];
+                result = inputs.back();
+              }),
+              ({
+                bool has_bias = attributes.ints[1] != 0;
+                bool save_pre = attributes.ints[2] != 0;
+                Tensor *bias = has_bias ? inputs[2] : nullptr;
+                Tensor *pre = save_pre ? inputs[2 + has_bias] : nullptr;
+                result->node->inputs = {a, b};
+                if (bias)
+                  result->node->inputs.push_back(bias);
+                result->node->outputs = {result};
+                if (pre)
+                  result->node->outputs.push_back(pre);
+                mps->linear(a, b, bias,
+                            static_cast<Activation>(attributes.ints[0]), pre,
+                            result);
+              }),
+              {
+                a = node->inputs[0];
+                b = node->inputs[1];
+                out = node->outputs[0];
+                Tensor *bias =
+                    node->inputs.size() > 2 ? node->inputs[2] : nullptr;
+                if (!out->grad)
+                  return;
+                Tensor *grad = out->grad->contiguous();
+                Tensor *saved =
+                    node->outputs.size() > 1 ? node->outputs[1] : out;
+                int N = b->dims[0];
+                int K = b->dims[1];
+                OpAttributes activation;
+                activation.ints = {node->attributes.ints[0]};
+                if (a->requires_grad) {
+                  Tensor *dx =
+                      new Tensor({static_cast<int>(grad->size / N), K},
+                                 a->dtype, false, a->device);
+                  dispatcher->call(OPType::LINEAR_GRAD_INPUT, a->device,
+                                   {grad, saved, b, dx}, activation);
+                  a->accumulate_grad(dx->view(a->dims), true);
+                }
+                if (b->requires_grad) {
+                  Tensor *dw = new Tensor(b->dims, b->dtype, false, b->device);
+                  dispatcher->call(OPType::LINEAR_GRAD_WEIGHT, b->device,
+                                   {grad, saved, a, dw}, activation);
+                  b->accumulate_grad(dw, true);
+                }
+                if (bias && bias->requires_grad) {
+                  Tensor *db =
+                      new Tensor(bias->dims, bias->dtype, false, bias->device);
+                  dispatcher->call(OPType::LINEAR_GRAD_BIAS, bias->device,
+                                   {grad, saved, db}, activation);
+                  bias->accumulate_grad(db, true);
+                }
+              });
+  // the gradient GEMMs of LINEAR, the activation derivative is applied as
+  // the gradient is loaded. inputs: grad, saved, operand, result
+  REGISTER_OP(LINEAR_GRAD_INPUT, MPS, ({ result = inputs.back(); }),
+              ({
+                result->node->inputs = {inputs[0], inputs[1], inputs[2]};
+                result->node->outputs = {result};
+                mps->linear_grad_input(
+                    inputs[0], inputs[1], inputs[2],
+                    static_cast<Activation>(attributes.ints[0]), result);
+              }),
+              {});
+  REGISTER_OP(LINEAR_GRAD_WEIGHT, MPS, ({ result = inputs.back(); }),
+              ({
+                result->node->inputs = {inputs[0], inputs[1], inputs[2]};
+                result->node->outputs = {result};
+                mps->linear_grad_weight(
+                    inputs[0], inputs[1], inputs[2],
+                    static_cast<Activation>(attributes.ints[0]), result);
+              }),
+              {});
+  REGISTER_OP(LINEAR_GRAD_BIAS, MPS, ({ result = inputs.back(); }),
+              ({
+                result->node->inputs = {inputs[0], inputs[1]};
+                result->node->outputs = {result};
+                mps->linear_grad_bias(
+                    inputs[0], inputs[1],
+                    static_cast<Activation>(attributes.ints[0]), result);
+              }),
+              {});
+  REGISTER_OP(LAYER_NORM, MPS, ({
+                a = inputs[0];
+                result = inputs.back();
+              }),
+              ({ normalize(inputs, attributes, true); }),
+              { normalize_backward(node, true); });
+  REGISTER_OP(BATCH_NORM, MPS, ({
+                a = inputs[0];
+                result = inputs.back();
+              }),
+              ({ normalize(inputs, attributes, false); }),
+              { normalize_backward(node, false); });
+  // inputs: grad, x, [weight], mean, rstd, sums, [grad_weight], [grad_bias],
+  // grad_input with ints {per_row, training, has_weight, has_grad_weight,
+  // has_grad_bias}
+  REGISTER_OP(NORM_BACKWARD, MPS, ({ result = inputs.back(); }),
+              ({
+                std::vector<int> &ints = attributes.ints;
+                int i = 2;
+                Tensor *weight = ints[2] ? inputs[i++] : nullptr;
+                Tensor *mean = inputs[i++];
+                Tensor *rstd = inputs[i++];
+                Tensor *sums = inputs[i++];
+                Tensor *dw = ints[3] ? inputs[i++] : nullptr;
+                Tensor *db = ints[4] ? inputs[i++] : nullptr;
+                result->node->inputs = {inputs[0], inputs[1]};
+                result->node->outputs = {result};
+                mps->normalize_backward(inputs[0], inputs[1], weight, mean,
+                                        rstd, ints[0] != 0, ints[1] != 0,
+                                        sums, dw, db, result);
+              }),
+              {});
+  REGISTER_OP(RELU, MPS, ({
+                a = inputs[0];
+                result = inputs.back();
+              }),
+              ({ rectify(inputs, attributes); }),
+              { rectify_backward(node); });
+  REGISTER_OP(LEAKY_RELU, MPS, ({
+                a = inputs[0];
+                result = inputs.back();
+              }),
+              ({ rectify(inputs, attributes); }),
+              { rectify_backward(node); });
+  REGISTER_OP(SIGMOID, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->sigmoid(a, result);
+              }),
+              { activation_backward(node, Activation::SIGMOID); });
+  REGISTER_OP(GELU, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->gelu(a, result);
+              }),
+              { activation_backward(node, Activation::GELU); });
+  REGISTER_OP(SILU, MPS, ({
+                assert(inputs.size() == 2);
+                a = inputs[0];
+                result = inputs[1];
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->silu(a, result);
+              }),
+              { activation_backward(node, Activation::SILU); });
+  // inputs: grad, saved, result with ints {activation}
+  REGISTER_OP(ACTIVATION_GRAD, MPS, ({ result = inputs.back(); }),
+              ({
+                result->node->inputs = {inputs[0], inputs[1]};
+                result->node->outputs = {result};
+                mps->activation_grad(
+                    inputs[0], inputs[1],
+                    static_cast<Activation>(attributes.ints[0]), result);
+              }),
+              {});
+  // inputs: grad, mask, result with floats {negative_slope}
+  REGISTER_OP(MASK_GRAD, MPS, ({ result = inputs.back(); }),
+              ({
+                result->node->inputs = {inputs[0], inputs[1]};
+                result->node->outputs = {result};
+                mps->mask_grad(inputs[0], inputs[1], attributes.floats[0],
+                               result);
+              }),
+              {});
+  // inputs: x, result with ints {seed, offset low, offset high} and floats
+  // {p}, dense operands
+  REGISTER_OP(DROPOUT, MPS, ({
+                a = inputs[0];
+                result = inputs.back();
+              }),
+              ({
+                result->node->inputs = {a};
+                result->node->outputs = {result};
+                mps->dropout(a, attributes.floats[0], random_state(attributes),
+                             result);
+              }),
+              { dropout_backward(node); });
 }
@@ -0,0 +1,39 @@
+#include "expr.h"
+#include "main.h"
+
+namespace actx {
+namespace expr {
+
+void launch(const FusedProgram &program, Tensor *output) {
+  if (output->dtype != DType::float32 || !output->is_contigous ||
+      output->offset() != 0) {
+    throw std::invalid_argument(
+        "expressions are assigned to dense float32 tensors");
+  }
+  if (program.inputs.size() > Fuser::MAX_INPUTS) {
+    throw std::invalid_argument("expression reads more than " +
+                                std::to_string(Fuser::MAX_INPUTS) +
+                                " tensors");
+  }
+  // every element is read before it is written, so the output may be an
+  // input, but only if both see the element at the same place
+  std::vector<const void *> buffers = {output->memory->data_ptr};
+  for (const Tensor *input : program.inputs) {
+    if (input->memory == output->memory &&
+        (input->offset() != 0 || input->dims != output->dims ||
+         input->stride != output->stride)) {
+      throw std::invalid_argument(
+          "expression reads its output through a different layout");
+    }
+    buffers.push_back(input->memory->data_ptr);
+  }
+  // tensors recorded in lazy mode are computed first
+  fuser->flush_buffers(buffers);
+  fuser->forget_constant(output->memory);
+  FusedProgram simplified = program;
+  simplify(simplified);
+  mps->fused_elementwise(simplified, output);
+}
+
+} // namespace expr
+} // namespace actx
@@ -0,0 +1,599 @@
+#include "fusion.h"
+#include "main.h"
+#include "types.h"
+#include "utility.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+// kernels that can be recorded, keyed by the name MPS would launch
+static const std::unordered_map<std::string, FusedOp> fusable_kernels = {
+    {"__neg__", FusedOp::NEG},
+    {"__sqrt__", FusedOp::SQRT},
+    {"__exp__", FusedOp::EXP},
+    {"__log__", FusedOp::LOG},
+    {"__log10__", FusedOp::LOG10},
+    {"__log2__", FusedOp::LOG2},
+    {"__sin__", FusedOp::SIN},
+    {"__cos__", FusedOp::COS},
+    {"__tan__", FusedOp::TAN},
+    {"__asin__", FusedOp::ASIN},
+    {"__acos__", FusedOp::ACOS},
+    {"__atan__", FusedOp::ATAN},
+    {"__sinh__", FusedOp::SINH},
+    {"__cosh__", FusedOp::COSH},
+    {"__tanh__", FusedOp::TANH},
+    {"__asinh__", FusedOp::ASINH},
+    {"__acosh__", FusedOp::ACOSH},
+    {"__atanh__", FusedOp::ATANH},
+    {"__add__", FusedOp::ADD},
+    {"__sub__", FusedOp::SUB},
+    {"__mul__", FusedOp::MUL},
+    {"__div__", FusedOp::DIV},
+    {"__atan2__", FusedOp::ATAN2},
+    {"logical_e", FusedOp::LOGICAL_E},
+    {"logical_ne", FusedOp::LOGICAL_NE},
+    {"logical_gt", FusedOp::LOGICAL_GT},
+    {"logical_gte", FusedOp::LOGICAL_GTE},
+    {"logical_lt", FusedOp::LOGICAL_LT},
+    {"logical_lte", FusedOp::LOGICAL_LTE},
+    {"__scalar_add__", FusedOp::ADD_SCALAR},
+    {"__scalar_sub__", FusedOp::SUB_SCALAR},
+    {"__scalar_rsub__", FusedOp::RSUB_SCALAR},
+    {"__scalar_mul__", FusedOp::MUL_SCALAR},
+    {"__scalar_div__", FusedOp::DIV_SCALAR},
+    {"__scalar_rdiv__", FusedOp::RDIV_SCALAR},
+    {"__scalar_pow__", FusedOp::POW_SCALAR},
+    {"__scalar_pow_square__", FusedOp::POW_INT},
+    {"__scalar_pow_sqrt__", FusedOp::SQRT},
+    {"__scalar_pow_reciprocal__", FusedOp::POW_INT},
+    {"__scalar_pow_int__", FusedOp::POW_INT},
+};
+
+FusedLayout fused_layout(const FusedProgram &program, const Tensor *output) {
+  FusedLayout layout;
+  layout.size = output->size;
+  layout.dims = output->dims;
+  layout.output_strides = output->stride;
+  for (const Tensor *input : program.inputs) {
+    layout.input_strides.push_back(broadcast_strides(input, layout.dims));
+  }
+  std::vector<std::vector<int> *> strides = {&layout.output_strides};
+  for (std::vector<int> &input_strides : layout.input_strides) {
+    strides.push_back(&input_strides);
+  }
+  coalesce_dims(layout.dims, strides);
+  return layout;
+}
+
+float evaluate_fused(const FusedInstruction &instruction, float a, float b) {
+  float s = instruction.scalar;
+  switch (static_cast<FusedOp>(instruction.op)) {
+  case FusedOp::NEG:
+    return -a;
+  case FusedOp::SQRT:
+    return std::sqrt(a);
+  case FusedOp::EXP:
+    return std::exp(a);
+  case FusedOp::LOG:
+    return std::log(a);
+  case FusedOp::LOG10:
+    return std::log10(a);
+  case FusedOp::LOG2:
+    return std::log2(a);
+  case FusedOp::SIN:
+    return std::sin(a);
+  case FusedOp::COS:
+    return std::cos(a);
+  case FusedOp::TAN:
+    return std::tan(a);
+  case FusedOp::ASIN:
+    return std::asin(a);
+  case FusedOp::ACOS:
+    return std::acos(a);
+  case FusedOp::ATAN:
+    return std::atan(a);
+  case FusedOp::SINH:
+    return std::sinh(a);
+  case FusedOp::COSH:
+    return std::cosh(a);
+  case FusedOp::TANH:
+    return std::tanh(a);
+  case FusedOp::ASINH:
+    return std::asinh(a);
+  case FusedOp::ACOSH:
+    return std::acosh(a);
+  case FusedOp::ATANH:
+    return std::atanh(a);
+  case FusedOp::ADD:
+    return a + b;
+  case FusedOp::SUB:
+    return a - b;
+  case FusedOp::MUL:
+    return a * b;
+  case FusedOp::DIV:
+    return a / b;
+  case FusedOp::ATAN2:
+    return std::atan2(b, a);
+  case FusedOp::LOGICAL_E:
+    return std::fabs(a - b) < 1e-5 || (a == INFINITY && b == INFINITY);
+  case FusedOp::LOGICAL_NE:
+    return std::fabs(a - b) > 1e-5 ? 1.0f : 0.0f;
+  case FusedOp::LOGICAL_GT:
+    return a > b;
+  case FusedOp::LOGICAL_GTE:
+    return a >= b;
+  case FusedOp::LOGICAL_LT:
+    return a < b;
+  case FusedOp::LOGICAL_LTE:
+    return a <= b;
+  case FusedOp::ADD_SCALAR:
+    return a + s;
+  case FusedOp::SUB_SCALAR:
+    return a - s;
+  case FusedOp::RSUB_SCALAR:
+    return s - a;
+  case FusedOp::MUL_SCALAR:
+    return a * s;
+  case FusedOp::DIV_SCALAR:
+    return a / s;
+  case FusedOp::RDIV_SCALAR:
+    return s / a;
+  case FusedOp::POW_SCALAR:
+    return std::pow(a, s);
+  case FusedOp::POW_INT: {
+    int n = static_cast<int>(s);
+    float base = n < 0 ? 1.0f / a : a;
+    float result = 1.0f;
+    for (n = std::abs(n); n > 0; n >>= 1) {
+      if (n & 1)
+        result *= base;
+      base *= base;
+    }
+    return result;
+  }
+  case FusedOp::CONST:
+    return s;
+  default:
+    throw std::invalid_argument("cannot evaluate fused op " +
+                                std::to_string(instruction.op));
+  }
+}
+
+static bool is_binary(FusedOp op) {
+  return op >= FusedOp::ADD && op <= FusedOp::LOGICAL_LTE;
+}
+
+static bool is_commutative(FusedOp op) {
+  return op == FusedOp::ADD || op == FusedOp::MUL ||
+         op == FusedOp::LOGICAL_E || op == FusedOp::LOGICAL_NE;
+}
+
+// the scalar form of `op` with a constant right (or left) operand
+static bool scalar_form(FusedOp op, bool constant_left, FusedOp &result) {
+  switch (op) {
+  case FusedOp::ADD:
+    result = FusedOp::ADD_SCALAR;
+    return true;
+  case FusedOp::MUL:
+    result = FusedOp::MUL_SCALAR;
+    return true;
+  case FusedOp::SUB:
+    result = constant_left ? FusedOp::RSUB_SCALAR : FusedOp::SUB_SCALAR;
+    return true;
+  case FusedOp::DIV:
+    result = constant_left ? FusedOp::RDIV_SCALAR : FusedOp::DIV_SCALAR;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// x + 0, x - 0, x * 1, x / 1, x ** 1
+static bool is_identity(FusedOp op, float scalar) {
+  switch (op) {
+  case FusedOp::ADD_SCALAR:
+  case FusedOp::SUB_SCALAR:
+    return scalar == 0.0f;
+  case FusedOp::MUL_SCALAR:
+  case FusedOp::DIV_SCALAR:
+  case FusedOp::POW_SCALAR:
+  case FusedOp::POW_INT:
+    return scalar == 1.0f;
+  default:
+    return false;
+  }
+}
+
+void simplify(FusedProgram &program) {
+  std::vector<FusedInstruction> code;
+  // the register of `code` each original instruction ended up in
+  std::vector<int> value(program.code.size());
+  std::map<std::tuple<int, int, int, uint32_t>, int> emitted;
+
+  auto op_of = [&code](int r) { return static_cast<FusedOp>(code[r].op); };
+  auto emit = [&](FusedInstruction instruction) {
+    FusedOp op = static_cast<FusedOp>(instruction.op);
+    // operands an op does not read must not tell identical code apart
+    if (op == FusedOp::LOAD || op == FusedOp::CONST || !is_binary(op))
+      instruction.b = 0;
+    if (op == FusedOp::CONST)
+      instruction.a = 0;
+    if (op == FusedOp::LOAD || is_binary(op))
+      instruction.scalar = 0.0f;
+    if (is_commutative(op) && instruction.b < instruction.a)
+      std::swap(instruction.a, instruction.b);
+    uint32_t bits;
+    std::memcpy(&bits, &instruction.scalar, sizeof(bits));
+    auto key = std::make_tuple(instruction.op, instruction.a, instruction.b,
+                               bits);
+    auto known = emitted.find(key);
+    if (known != emitted.end())
+      return known->second;
+    code.push_back(instruction);
+    emitted[key] = code.size() - 1;
+    return static_cast<int>(code.size() - 1);
+  };
+  auto constant = [&](float scalar) {
+    return emit({static_cast<int>(FusedOp::CONST), 0, 0, scalar});
+  };
+
+  for (int i = 0; i < program.code.size(); i++) {
+    FusedInstruction instruction = program.code[i];
+    FusedOp op = static_cast<FusedOp>(instruction.op);
+    if (op == FusedOp::LOAD || op == FusedOp::CONST) {
+      value[i] = emit(instruction);
+      continue;
+    }
+    instruction.a = value[instruction.a];
+    instruction.b = is_binary(op) ? value[instruction.b] : 0;
+    bool constant_a = op_of(instruction.a) == FusedOp::CONST;
+    bool constant_b = is_binary(op) && op_of(instruction.b) == FusedOp::CONST;
+
+    if (constant_a && (constant_b || !is_binary(op))) {
+      value[i] = constant(evaluate_fused(instruction,
+                                         code[instruction.a].scalar,
+                                         code[instruction.b].scalar));
+      continue;
+    }
+    FusedOp scalar_op;
+    if ((constant_a || constant_b) && scalar_form(op, constant_a, scalar_op)) {
+      int constant_register = constant_a ? instruction.a : instruction.b;
+      instruction = {static_cast<int>(scalar_op),
+                     constant_a ? instruction.b : instruction.a, 0,
+                     code[constant_register].scalar};
+      op = scalar_op;
+    }
+    if (op == FusedOp::MUL_SCALAR && instruction.scalar == -1.0f) {
+      instruction = {static_cast<int>(FusedOp::NEG), instruction.a, 0, 0.0f};
+      op = FusedOp::NEG;
+    }
+    if (is_identity(op, instruction.scalar)) {
+      value[i] = instruction.a;
+      continue;
+    }
+    if (op == FusedOp::NEG && op_of(instruction.a) == FusedOp::NEG) {
+      value[i] = code[instruction.a].a;
+      continue;
+    }
+    value[i] = emit(instruction);
+  }
+
+  // keep what the result reads, it becomes the last instruction
+  int result = program.code.empty() ? -1 : value.back();
+  std::vector<bool> live(code.size(), false);
+  if (result >= 0)
+    live[result] = true;
+  for (int r = result; r >= 0; r--) {
+    if (!live[r])
+      continue;
+    FusedOp op = op_of(r);
+    if (op == FusedOp::LOAD || op == FusedOp::CONST)
+      continue;
+    live[code[r].a] = true;
+    if (is_binary(op))
+      live[code[r].b] = true;
+  }
+  std::vector<int> remap(code.size(), -1);
+  std::vector<int> slots(program.inputs.size(), -1);
+  std::vector<Tensor *> inputs;
+  std::vector<FusedInstruction> simplified;
+  for (int r = 0; r <= result; r++) {
+    if (!live[r])
+      continue;
+    FusedInstruction instruction = code[r];
+    FusedOp op = op_of(r);
+    if (op == FusedOp::LOAD) {
+      if (slots[instruction.a] < 0) {
+        slots[instruction.a] = inputs.size();
+        inputs.push_back(program.inputs[instruction.a]);
+      }
+      instruction.a = slots[instruction.a];
+    } else if (op != FusedOp::CONST) {
+      instruction.a = remap[instruction.a];
+      instruction.b = is_binary(op) ? remap[instruction.b] : 0;
+    }
+    remap[r] = simplified.size();
+    simplified.push_back(instruction);
+  }
+  program.inputs = inputs;
+  program.code = simplified;
+}
+
+PendingTensor *Fuser::_find(const Tensor *tensor) {
+  for (PendingTensor &pending : _pending) {
+    if (pending.tensor == tensor)
+      return &pending;
+  }
+  return nullptr;
+}
+
+bool Fuser::is_pending(const Tensor *tensor) const {
+  return std::any_of(
+      _pending.begin(), _pending.end(),
+      [tensor](const PendingTensor &p) { return p.tensor == tensor; });
+}
+
+bool Fuser::_touches_pending(const Memory *memory) const {
+  for (const PendingTensor &pending : _pending) {
+    if (pending.tensor->memory == memory)
+      return true;
+    for (const Tensor *input : pending.program.inputs) {
+      if (input->memory == memory)
+        return true;
+    }
+  }
+  return false;
+}
+
+// whether every element `tensor` reads lies in `range`
+static bool within(const Tensor *tensor, const ConstantRange &range) {
+  int low = tensor->offset();
+  int high = low;
+  for (int d = 0; d < tensor->dims.size(); d++) {
+    int extent = (tensor->dims[d] - 1) * tensor->stride[d];
+    if (extent > 0) {
+      high += extent;
+    } else {
+      low += extent;
+    }
+  }
+  return low >= range.first && high < range.first + range.count;
+}
+
+// appends the code computing `input` and returns its register. a pending
+// input is inlined, anything else is loaded from memory
+int Fuser::_append(FusedProgram &program, const Tensor *input,
+                   std::unordered_map<const Tensor *, int> &registers) {
+  auto known = registers.find(input);
+  if (known != registers.end())
+    return known->second;
+
+  PendingTensor *pending = _find(input);
+  if (pending) {
+    // copied, inlining may materialize (and erase) other pending tensors
+    const FusedProgram source = pending->program;
+    std::vector<int> remap(source.code.size());
+    for (int i = 0; i < source.code.size(); i++) {
+      FusedInstruction instruction = source.code[i];
+      if (instruction.op == static_cast<int>(FusedOp::LOAD)) {
+        instruction.a = _append(program, source.inputs[instruction.a],
+                                registers);
+        remap[i] = instruction.a;
+        continue;
+      }
+      instruction.a = remap[instruction.a];
+      instruction.b = remap[instruction.b];
+      remap[i] = program.code.size();
+      program.code.push_back(instruction);
+    }
+    registers[input] = remap.back();
+    return remap.back();
+  }
+
+  auto constant = _constants.find(input->memory);
+  if (constant != _constants.end() && within(input, constant->second)) {
+    registers[input] = program.code.size();
+    program.code.push_back(
+        {static_cast<int>(FusedOp::CONST), 0, 0, constant->second.value});
+    return registers[input];
+  }
+
+  // a view into a pending tensor has to see its values
+  materialize(input->memory);
+  auto slot = std::find(program.inputs.begin(), program.inputs.end(), input);
+  int index = slot - program.inputs.begin();
+  if (slot == program.inputs.end()) {
+    program.inputs.push_back(const_cast<Tensor *>(input));
+  }
+  registers[input] = program.code.size();
+  program.code.push_back({static_cast<int>(FusedOp::LOAD), index, 0, 0.0f});
+  return registers[input];
+}
+
+bool Fuser::record(const std::string &kernel,
+                   std::vector<const Tensor *> inputs, Tensor *output,
+                   float scalar) {
+  if (!_enabled)
+    return false;
+  auto op = fusable_kernels.find(kernel);
+  if (op == fusable_kernels.end())
+    return false;
+  // only fresh, dense float outputs are deferred. in-place ops and writes
+  // into buffers a pending tensor reads run now, after flushing
+  if (output->dtype != DType::float32 || !output->is_contigous ||
+      output->offset() != 0 || output->dims.size() > MAX_RANK ||
+      _touches_pending(output->memory)) {
+    return false;
+  }
+  for (const Tensor *input : inputs) {
+    if (input->dtype != DType::float32 || input->memory == output->memory)
+      return false;
+  }
+
+  if (kernel == "__scalar_pow_square__") {
+    scalar = 2.0f;
+  } else if (kernel == "__scalar_pow_reciprocal__") {
+    scalar = -1.0f;
+  }
+  FusedProgram program;
+  std::unordered_map<const Tensor *, int> registers;
+  std::vector<int> operands;
+  for (const Tensor *input : inputs) {
+    operands.push_back(_append(program, input, registers));
+  }
+  program.code.push_back({static_cast<int>(op->second), operands[0],
+                          operands.size() > 1 ? operands[1] : 0, scalar});
+  simplify(program);
+  if (program.inputs.size() > MAX_INPUTS ||
+      program.code.size() > MAX_INSTRUCTIONS) {
+    return false;
+  }
+  for (const Tensor *input : inputs) {
+    PendingTensor *pending = _find(input);
+    if (pending)
+      pending->inlined = true;
+  }
+  _pending.push_back({output, program});
+  return true;
+}
+
+void Fuser::_run(PendingTensor pending) {
+  int ops = std::count_if(pending.program.code.begin(),
+                          pending.program.code.end(),
+                          [](const FusedInstruction &instruction) {
+                            return instruction.op !=
+                                       static_cast<int>(FusedOp::LOAD) &&
+                                   instruction.op !=
+                                       static_cast<int>(FusedOp::CONST);
+                          });
+  mps->fused_elementwise(pending.program, pending.tensor);
+  _launches++;
+  _fused_ops += ops;
+  if (pending.owned)
+    delete pending.tensor;
+}
+
+void Fuser::materialize(const Memory *memory) {
+  if (_pending.empty())
+    return;
+  auto it =
+      std::find_if(_pending.begin(), _pending.end(),
+                   [memory](const PendingTensor &p) {
+                     return p.tensor->memory == memory;
+                   });
+  if (it == _pending.end())
+    return;
+  PendingTensor pending = *it;
+  _pending.erase(it);
+  _run(pending);
+}
+
+void Fuser::flush_buffers(const std::vector<const void *> &buffers) {
+  if (_pending.empty())
+    return;
+  auto bound = [&buffers](const Tensor *tensor) {
+    return std::find(buffers.begin(), buffers.end(),
+                     tensor->memory->data_ptr) != buffers.end();
+  };
+  std::vector<PendingTensor> ready;
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    bool touched = bound(it->tensor) ||
+                   std::any_of(it->program.inputs.begin(),
+                               it->program.inputs.end(), bound);
+    if (touched) {
+      ready.push_back(*it);
+      it = _pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (PendingTensor &pending : ready) {
+    _run(pending);
+  }
+}
+
+void Fuser::flush(bool inlined) {
+  // inlined tensors wait until they are read, the programs that use them
+  // compute them again in registers
+  std::vector<PendingTensor> ready;
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    if (inlined || !it->inlined) {
+      ready.push_back(*it);
+      it = _pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (PendingTensor &pending : ready) {
+    _run(pending);
+  }
+}
+
+void Fuser::release(const Tensor *tensor) {
+  if (_pending.empty())
+    return;
+  // programs loading the tensor run while it is still alive
+  std::vector<PendingTensor> ready;
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    auto &inputs = it->program.inputs;
+    if (std::find(inputs.begin(), inputs.end(), tensor) != inputs.end()) {
+      ready.push_back(*it);
+      it = _pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (PendingTensor &pending : ready) {
+    _run(pending);
+  }
+  // a deleted tensor that was inlined can no longer be read. any other keeps
+  // its buffer, another tensor over the same memory may still read it
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    if (it->tensor != tensor) {
+      ++it;
+    } else if (it->inlined) {
+      it = _pending.erase(it);
+    } else {
+      it->tensor = new Tensor(*tensor);
+      it->owned = true;
+      ++it;
+    }
+  }
+}
+
+void Fuser::discard(const Memory *memory) {
+  std::vector<Tensor *> owned;
+  for (auto it = _pending.begin(); it != _pending.end();) {
+    if (it->tensor->memory != memory) {
+      ++it;
+      continue;
+    }
+    if (it->owned)
+      owned.push_back(it->tensor);
+    it = _pending.erase(it);
+  }
+  // deleting releases them, which looks at what is still pending
+  for (Tensor *tensor : owned)
+    delete tensor;
+}
+
+void Fuser::reset_stats() {
+  _launches = 0;
+  _fused_ops = 0;
+}
+
+LazyMode::LazyMode() {
+  _previous = fuser->enabled();
+  fuser->set_enabled(true);
+}
+
+LazyMode::~LazyMode() {
+  fuser->set_enabled(_previous);
+  if (!_previous)
+    fuser->flush();
+}
@@ -0,0 +1,60 @@
+#include "graph.h"
+#include "main.h"
+#include <stdexcept>
+#include <vector>
+
+struct GraphCommands {
+  std::vector<CapturedCommand> commands;
+};
+
+Graph::Graph() : _commands(new GraphCommands) {}
+
+Graph::~Graph() {
+  if (_capturing)
+    mps->end_capture();
+  delete _commands;
+}
+
+void Graph::begin() {
+  if (mps->capturing()) {
+    throw std::logic_error("a graph is already being captured");
+  }
+  // ops recorded in lazy mode before the capture are not part of it, not
+  // even the intermediates that would only run when read
+  fuser->flush(true);
+  _commands->commands.clear();
+  mps->begin_capture(&_commands->commands);
+  _capturing = true;
+}
+
+void Graph::end() {
+  if (!_capturing) {
+    throw std::logic_error("the graph is not being captured");
+  }
+  // pending lazy ops were issued inside the capture, they launch now.
+  // intermediates inlined into them are not captured
+  fuser->flush();
+  mps->end_capture();
+  _capturing = false;
+  logger->info("captured {} commands", _commands->commands.size());
+}
+
+void Graph::replay() {
+  if (_capturing) {
+    throw std::logic_error("end() the capture before replaying it");
+  }
+  // pending lazy ops may read or write the inputs, and the replayed kernels
+  // may overwrite buffers that were filled with one value since the capture
+  fuser->flush(true);
+  fuser->forget_constants();
+  mps->replay(_commands->commands);
+}
+
+size_t Graph::size() const { return _commands->commands.size(); }
+
+GraphCapture::GraphCapture(Graph &graph) : _graph(graph) { _graph.begin(); }
+
+GraphCapture::~GraphCapture() {
+  if (_graph.capturing())
+    _graph.end();
+}
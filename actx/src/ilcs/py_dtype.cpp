@@ -8,11 +8,23 @@ PyObject *createDtypeModule(PyObject *parent) {
     return NULL;
   }
   PyModule_AddIntConstant(dtype, "i8", static_cast<int>(DType::int8));
+  PyModule_AddIntConstant(dtype, "u8", static_cast<int>(DType::uint8));
   PyModule_AddIntConstant(dtype, "i16", static_cast<int>(DType::int16));
   PyModule_AddIntConstant(dtype, "i32", static_cast<int>(DType::int32));
   PyModule_AddIntConstant(dtype, "i64", static_cast<int>(DType::int64));
   PyModule_AddIntConstant(dtype, "f16", static_cast<int>(DType::float16));
+  PyModule_AddIntConstant(dtype, "bf16", static_cast<int>(DType::bfloat16));
   PyModule_AddIntConstant(dtype, "f32", static_cast<int>(DType::float32));
 
+  // rounding modes accepted by Tensor.to()
+  PyModule_AddIntConstant(dtype, "ROUND_TRUNCATE",
+                          static_cast<int>(RoundingMode::TRUNCATE));
+  PyModule_AddIntConstant(dtype, "ROUND_NEAREST_EVEN",
+                          static_cast<int>(RoundingMode::NEAREST_EVEN));
+  PyModule_AddIntConstant(dtype, "ROUND_FLOOR",
+                          static_cast<int>(RoundingMode::FLOOR));
+  PyModule_AddIntConstant(dtype, "ROUND_CEIL",
+                          static_cast<int>(RoundingMode::CEIL));
+
   return dtype;
 }
@@ -1,14 +1,91 @@
 
 #include "device_type.h"
 #include "ilcs/py_devices.h"
+#include "ilcs/py_graph.h"
+#include "ilcs/py_optimizer.h"
 #include "ilcs/py_tensor.h"
 #include "ilcs/py_types.h"
+#include "main.h"
 #include "tensor.h"
 #include <Python.h>
 #include <unordered_map>
 #include <vector>
 
-static PyMethodDef MyMethods[] = {{NULL, NULL, 0, NULL}};
+// number of elementwise kernel launches per dispatch path
+static PyObject *PyDispatchStats(PyObject *self, PyObject *args) {
+  const DispatchStats &stats = dispatcher->stats();
+  return Py_BuildValue("{s:K,s:K,s:K,s:K}", "contiguous",
+                       (unsigned long long)stats.contiguous.load(), "scalar",
+                       (unsigned long long)stats.scalar.load(), "row",
+                       (unsigned long long)stats.row.load(), "strided",
+                       (unsigned long long)stats.strided.load());
+}
+
+static PyObject *PyResetDispatchStats(PyObject *self, PyObject *args) {
+  dispatcher->reset_stats();
+  Py_RETURN_NONE;
+}
+
+static PyObject *PySetLazy(PyObject *self, PyObject *args) {
+  int enabled;
+  if (!PyArg_ParseTuple(args, "p", &enabled)) {
+    return NULL;
+  }
+  fuser->set_enabled(enabled);
+  if (!enabled) {
+    fuser->flush();
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyIsLazy(PyObject *self, PyObject *args) {
+  return PyBool_FromLong(fuser->enabled());
+}
+
+static PyObject *PySetCodegen(PyObject *self, PyObject *args) {
+  int enabled;
+  if (!PyArg_ParseTuple(args, "p", &enabled)) {
+    return NULL;
+  }
+  fuser->set_codegen(enabled);
+  Py_RETURN_NONE;
+}
+
+static PyObject *PySync(PyObject *self, PyObject *args) {
+  try {
+    mps->sync();
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *PySetAsync(PyObject *self, PyObject *args) {
+  int enabled;
+  if (!PyArg_ParseTuple(args, "p", &enabled)) {
+    return NULL;
+  }
+  mps->set_async(enabled);
+  Py_RETURN_NONE;
+}
+
+static PyMethodDef MyMethods[] = {
+    {"dispatch_stats", PyDispatchStats, METH_NOARGS,
+     "Kernel launches per dispatch path."},
+    {"reset_dispatch_stats", PyResetDispatchStats, METH_NOARGS,
+     "Reset the dispatch path counters."},
+    {"set_lazy", PySetLazy, METH_VARARGS,
+     "Record elementwise ops and fuse them until a value is read."},
+    {"is_lazy", PyIsLazy, METH_NOARGS, "Whether lazy mode is enabled."},
+    {"set_codegen", PySetCodegen, METH_VARARGS,
+     "Run fused ops as generated kernels, cached in $ACTX_KERNEL_CACHE."},
+    {"sync", PySync, METH_NOARGS, "Wait for every queued kernel."},
+    {"set_async", PySetAsync, METH_VARARGS,
+     "Return from ops once their kernels are queued (the default)."},
+    {"capture", PyGraph_capture, METH_NOARGS,
+     "A Graph that records the kernels launched in its with block."},
+    {NULL, NULL, 0, NULL}};
 static struct PyModuleDef extension = {PyModuleDef_HEAD_INIT, "extension",
                                        "Wrapper module", -1, MyMethods};
 
@@ -21,6 +98,8 @@ PyMODINIT_FUNC PyInit_extension(void) {
   std::unordered_map<std::string, PyObject *> submodules = {
       {"devices", createDevicesModule(module)},
       {"dtype", createDtypeModule(module)},
+      {"graph", createGraphModule(module)},
+      {"optim", createOptimModule(module)},
       {"tensor", createTensorModule(module)},
   };
   for (const auto &submodule : submodules) {
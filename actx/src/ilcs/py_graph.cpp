@@ -0,0 +1,109 @@
+#include "ilcs/py_graph.h"
+#include "graph.h"
+#include <exception>
+
+typedef struct {
+  PyObject_HEAD Graph *graph;
+} PyGraphObject;
+
+static void PyGraph_dealloc(PyGraphObject *self) {
+  delete self->graph;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyGraph_new(PyTypeObject *type, PyObject *args,
+                             PyObject *kwargs) {
+  PyGraphObject *self = (PyGraphObject *)type->tp_alloc(type, 0);
+  if (self == NULL)
+    return NULL;
+  self->graph = new Graph();
+  return (PyObject *)self;
+}
+
+// runs a Graph method, C++ errors become RuntimeError
+template <typename F> static bool call_graph(F fn) {
+  try {
+    fn();
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return false;
+  }
+  return true;
+}
+
+static PyObject *PyGraph_enter(PyGraphObject *self, PyObject *args) {
+  if (!call_graph([&] { self->graph->begin(); }))
+    return NULL;
+  Py_INCREF(self);
+  return (PyObject *)self;
+}
+
+static PyObject *PyGraph_exit(PyGraphObject *self, PyObject *args) {
+  if (self->graph->capturing() &&
+      !call_graph([&] { self->graph->end(); }))
+    return NULL;
+  // exceptions raised inside the block propagate
+  Py_RETURN_FALSE;
+}
+
+static PyObject *PyGraph_replay(PyGraphObject *self, PyObject *args) {
+  if (!call_graph([&] { self->graph->replay(); }))
+    return NULL;
+  Py_RETURN_NONE;
+}
+
+static Py_ssize_t PyGraph_len(PyGraphObject *self) {
+  return self->graph->size();
+}
+
+static PyMethodDef PyGraph_methods[] = {
+    {"__enter__", (PyCFunction)PyGraph_enter, METH_NOARGS,
+     "Start capturing the launched kernels."},
+    {"__exit__", (PyCFunction)PyGraph_exit, METH_VARARGS,
+     "Stop capturing."},
+    {"replay", (PyCFunction)PyGraph_replay, METH_NOARGS,
+     "Run the captured kernels again as one command buffer."},
+    {NULL}};
+
+static PySequenceMethods PyGraph_as_sequence = {
+    .sq_length = (lenfunc)PyGraph_len,
+};
+
+PyTypeObject PyGraphType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "extension.graph.Graph",
+    .tp_basicsize = sizeof(PyGraphObject),
+    .tp_dealloc = (destructor)PyGraph_dealloc,
+    .tp_as_sequence = &PyGraph_as_sequence,
+    .tp_doc = "Kernels captured once and replayed without the dispatcher.",
+    .tp_methods = PyGraph_methods,
+    .tp_new = PyGraph_new,
+};
+
+PyObject *PyGraph_capture(PyObject *self, PyObject *args) {
+  return PyObject_CallNoArgs((PyObject *)&PyGraphType);
+}
+
+static struct PyModuleDef graphmodule = {PyModuleDef_HEAD_INIT,
+                                         "extension.graph", NULL, -1, NULL};
+
+PyObject *createGraphModule(PyObject *parent) {
+  PyObject *graph = PyModule_Create(&graphmodule);
+  if (graph == NULL) {
+    Py_DECREF(parent);
+    return NULL;
+  }
+  if (PyType_Ready(&PyGraphType) < 0) {
+    Py_DECREF(graph);
+    Py_DECREF(parent);
+    return NULL;
+  }
+
+  Py_INCREF((PyObject *)&PyGraphType);
+  if (PyModule_AddObject(graph, "Graph", (PyObject *)&PyGraphType) < 0) {
+    Py_DECREF((PyObject *)&PyGraphType);
+    Py_DECREF(graph);
+    Py_DECREF(parent);
+    return NULL;
+  }
+  return graph;
+}
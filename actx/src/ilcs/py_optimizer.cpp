@@ -0,0 +1,339 @@
+#include "ilcs/py_optimizer.h"
+#include "ilcs/py_tensor.h"
+#include "optimizer.h"
+#include <exception>
+#include <vector>
+
+typedef struct {
+  PyObject_HEAD Optimizer *optimizer;
+  // keeps the parameter tensors alive
+  PyObject *params;
+} PyOptimizerObject;
+
+static void PyOptimizer_dealloc(PyOptimizerObject *self) {
+  delete self->optimizer;
+  Py_XDECREF(self->params);
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *PyOptimizer_new(PyTypeObject *type, PyObject *args,
+                                 PyObject *kwargs) {
+  PyOptimizerObject *self = (PyOptimizerObject *)type->tp_alloc(type, 0);
+  if (self == NULL)
+    return NULL;
+  self->optimizer = nullptr;
+  self->params = nullptr;
+  return (PyObject *)self;
+}
+
+// the optimizer, NULL with a RuntimeError when __init__ failed
+static Optimizer *optimizer_of(PyOptimizerObject *self) {
+  if (!self->optimizer)
+    PyErr_SetString(PyExc_RuntimeError, "the optimizer is not initialized");
+  return self->optimizer;
+}
+
+// the native tensors of a sequence of Tensors
+static bool to_tensors(PyObject *sequence, std::vector<Tensor *> &tensors) {
+  PyObject *items = PySequence_Fast(sequence, "expected a list of Tensors");
+  if (items == NULL)
+    return false;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(items);
+  for (Py_ssize_t i = 0; i < n; i++) {
+    Tensor *tensor = PyTensor_AsTensor(PySequence_Fast_GET_ITEM(items, i));
+    if (tensor == NULL) {
+      Py_DECREF(items);
+      return false;
+    }
+    tensors.push_back(tensor);
+  }
+  Py_DECREF(items);
+  return true;
+}
+
+// builds the optimizer with `make`, c++ errors become ValueError
+template <typename F>
+static int init_optimizer(PyOptimizerObject *self, PyObject *params, F make) {
+  std::vector<Tensor *> tensors;
+  if (!to_tensors(params, tensors))
+    return -1;
+  try {
+    Optimizer *optimizer = make(tensors);
+    delete self->optimizer;
+    self->optimizer = optimizer;
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return -1;
+  }
+  PyObject *kept = PySequence_Tuple(params);
+  if (kept == NULL)
+    return -1;
+  Py_XSETREF(self->params, kept);
+  return 0;
+}
+
+static int PySGD_init(PyOptimizerObject *self, PyObject *args,
+                      PyObject *kwargs) {
+  PyObject *params;
+  float lr = 0.01f, momentum = 0.0f, weight_decay = 0.0f;
+  int nesterov = 0;
+  static const char *keywords[] = {"params", "lr", "momentum", "weight_decay",
+                                   "nesterov", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|fffp", (char **)keywords,
+                                   &params, &lr, &momentum, &weight_decay,
+                                   &nesterov))
+    return -1;
+  return init_optimizer(self, params, [&](std::vector<Tensor *> tensors) {
+    return new SGD(tensors, lr, momentum, weight_decay, nesterov);
+  });
+}
+
+template <typename T>
+static int init_adam(PyOptimizerObject *self, PyObject *args, PyObject *kwargs,
+                     float weight_decay) {
+  PyObject *params;
+  float lr = 1e-3f, beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+  static const char *keywords[] = {
+      "params", "lr", "beta_1", "beta_2", "epsilon", "weight_decay", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|fffff", (char **)keywords,
+                                   &params, &lr, &beta1, &beta2, &eps,
+                                   &weight_decay))
+    return -1;
+  return init_optimizer(self, params, [&](std::vector<Tensor *> tensors) {
+    return new T(tensors, lr, beta1, beta2, eps, weight_decay);
+  });
+}
+
+static int PyAdam_init(PyOptimizerObject *self, PyObject *args,
+                       PyObject *kwargs) {
+  return init_adam<Adam>(self, args, kwargs, 0.0f);
+}
+
+static int PyAdamW_init(PyOptimizerObject *self, PyObject *args,
+                        PyObject *kwargs) {
+  return init_adam<AdamW>(self, args, kwargs, 1e-2f);
+}
+
+static PyObject *PyOptimizer_step(PyOptimizerObject *self, PyObject *args,
+                                  PyObject *kwargs) {
+  PyObject *grads = Py_None;
+  static const char *keywords[] = {"grads", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O", (char **)keywords,
+                                   &grads))
+    return NULL;
+  Optimizer *optimizer = optimizer_of(self);
+  std::vector<Tensor *> tensors;
+  if (!optimizer || (grads != Py_None && !to_tensors(grads, tensors)))
+    return NULL;
+  try {
+    optimizer->step(tensors);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyOptimizer_zero_grad(PyOptimizerObject *self,
+                                       PyObject *args, PyObject *kwargs) {
+  int set_to_none = 0;
+  static const char *keywords[] = {"set_to_none", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|p", (char **)keywords,
+                                   &set_to_none))
+    return NULL;
+  Optimizer *optimizer = optimizer_of(self);
+  if (!optimizer)
+    return NULL;
+  try {
+    optimizer->zero_grad(set_to_none);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject *PyOptimizer_get_lr(PyOptimizerObject *self, void *closure) {
+  Optimizer *optimizer = optimizer_of(self);
+  if (!optimizer)
+    return NULL;
+  return PyFloat_FromDouble(optimizer->lr);
+}
+
+static int PyOptimizer_set_lr(PyOptimizerObject *self, PyObject *value,
+                              void *closure) {
+  Optimizer *optimizer = optimizer_of(self);
+  if (!optimizer)
+    return -1;
+  double lr = PyFloat_AsDouble(value);
+  if (lr == -1.0 && PyErr_Occurred())
+    return -1;
+  optimizer->lr = lr;
+  return 0;
+}
+
+static PyMethodDef PyOptimizer_methods[] = {
+    {"step", (PyCFunction)PyOptimizer_step, METH_VARARGS | METH_KEYWORDS,
+     "Update the parameters in place, with `grads` or their stored "
+     "gradients."},
+    {"zero_grad", (PyCFunction)PyOptimizer_zero_grad,
+     METH_VARARGS | METH_KEYWORDS,
+     "Fill the stored gradients with zeros in place, the buffers are reused "
+     "by the next backward pass. With `set_to_none` they are dropped "
+     "instead."},
+    {NULL}};
+
+static PyGetSetDef PyOptimizer_getset[] = {
+    {"lr", (getter)PyOptimizer_get_lr, (setter)PyOptimizer_set_lr,
+     "Learning rate.", NULL},
+    {NULL}};
+
+PyTypeObject PySGDType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "extension.optim.SGD",
+    .tp_basicsize = sizeof(PyOptimizerObject),
+    .tp_dealloc = (destructor)PyOptimizer_dealloc,
+    .tp_doc = "SGD with momentum, one fused pass over all parameters.",
+    .tp_methods = PyOptimizer_methods,
+    .tp_getset = PyOptimizer_getset,
+    .tp_init = (initproc)PySGD_init,
+    .tp_new = PyOptimizer_new,
+};
+
+PyTypeObject PyAdamType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "extension.optim.Adam",
+    .tp_basicsize = sizeof(PyOptimizerObject),
+    .tp_dealloc = (destructor)PyOptimizer_dealloc,
+    .tp_doc = "Adam with L2 weight decay, one fused pass over all parameters.",
+    .tp_methods = PyOptimizer_methods,
+    .tp_getset = PyOptimizer_getset,
+    .tp_init = (initproc)PyAdam_init,
+    .tp_new = PyOptimizer_new,
+};
+
+PyTypeObject PyAdamWType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "extension.optim.AdamW",
+    .tp_basicsize = sizeof(PyOptimizerObject),
+    .tp_dealloc = (destructor)PyOptimizer_dealloc,
+    .tp_doc = "Adam with decoupled weight decay, one fused pass over all "
+              "parameters.",
+    .tp_methods = PyOptimizer_methods,
+    .tp_getset = PyOptimizer_getset,
+    .tp_init = (initproc)PyAdamW_init,
+    .tp_new = PyOptimizer_new,
+};
+
+static PyObject *PyOptim_clip_grad_norm(PyObject *module, PyObject *args,
+                                        PyObject *kwargs) {
+  PyObject *params;
+  float max_norm, eps = 1e-6f;
+  static const char *keywords[] = {"params", "max_norm", "eps", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Of|f", (char **)keywords,
+                                   &params, &max_norm, &eps))
+    return NULL;
+  std::vector<Tensor *> tensors;
+  if (!to_tensors(params, tensors))
+    return NULL;
+  Tensor *norm;
+  try {
+    norm = clip_grad_norm(tensors, max_norm, eps);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
+  return PyTensor_FromTensor(norm);
+}
+
+// thrown through accumulate_gradients when `loss` raised, the python error
+// is already set
+struct PythonError {};
+
+static PyObject *PyOptim_accumulate_gradients(PyObject *module, PyObject *args,
+                                              PyObject *kwargs) {
+  PyObject *params, *loss;
+  int micro_batches;
+  static const char *keywords[] = {"params", "micro_batches", "loss", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OiO", (char **)keywords,
+                                   &params, &micro_batches, &loss))
+    return NULL;
+  if (!PyCallable_Check(loss)) {
+    PyErr_SetString(PyExc_TypeError, "loss must be callable");
+    return NULL;
+  }
+  std::vector<Tensor *> tensors;
+  if (!to_tensors(params, tensors))
+    return NULL;
+  // the returned Tensors own the native losses, they live until the end
+  std::vector<PyObject *> values;
+  auto release = [&values] {
+    for (PyObject *value : values)
+      Py_DECREF(value);
+  };
+  Tensor *total;
+  try {
+    total = accumulate_gradients(tensors, micro_batches, [&](int i) {
+      PyObject *value = PyObject_CallFunction(loss, "i", i);
+      if (value == NULL)
+        throw PythonError();
+      values.push_back(value);
+      Tensor *tensor = PyTensor_AsTensor(value);
+      if (tensor == NULL)
+        throw PythonError();
+      return tensor;
+    });
+  } catch (const PythonError &) {
+    release();
+    return NULL;
+  } catch (const std::exception &e) {
+    release();
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
+  release();
+  return PyTensor_FromTensor(total);
+}
+
+static PyMethodDef optim_methods[] = {
+    {"clip_grad_norm", (PyCFunction)PyOptim_clip_grad_norm,
+     METH_VARARGS | METH_KEYWORDS,
+     "Scale the stored gradients of `params` in place so their global l2 "
+     "norm is at most `max_norm`, returns the norm before clipping as a "
+     "1-element Tensor."},
+    {"accumulate_gradients", (PyCFunction)PyOptim_accumulate_gradients,
+     METH_VARARGS | METH_KEYWORDS,
+     "Run `loss(i)` and its backward pass for each of `micro_batches` "
+     "micro-batches, adding the gradients scaled by 1 / micro_batches into "
+     "the stored ones in place. The memory of each micro-batch is returned "
+     "to the pool except the gradients of `params`. Returns the mean loss "
+     "as a 1-element Tensor."},
+    {NULL}};
+
+static struct PyModuleDef optimmodule = {
+    PyModuleDef_HEAD_INIT, "extension.optim", NULL, -1, optim_methods};
+
+PyObject *createOptimModule(PyObject *parent) {
+  PyObject *optim = PyModule_Create(&optimmodule);
+  if (optim == NULL) {
+    Py_DECREF(parent);
+    return NULL;
+  }
+  struct {
+    const char *name;
+    PyTypeObject *type;
+  } types[] = {
+      {"SGD", &PySGDType}, {"Adam", &PyAdamType}, {"AdamW", &PyAdamWType}};
+  for (const auto &entry : types) {
+    if (PyType_Ready(entry.type) < 0) {
+      Py_DECREF(optim);
+      Py_DECREF(parent);
+      return NULL;
+    }
+    Py_INCREF((PyObject *)entry.type);
+    if (PyModule_AddObject(optim, entry.name, (PyObject *)entry.type) < 0) {
+      Py_DECREF((PyObject *)entry.type);
+      Py_DECREF(optim);
+      Py_DECREF(parent);
+      return NULL;
+    }
+  }
+  return optim;
+}
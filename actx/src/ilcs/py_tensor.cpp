@@ -1,10 +1,13 @@
 #include "ilcs/py_tensor.h"
 #include "floatobject.h"
 #include "longobject.h"
+#include "main.h"
 #include "numpy/ndarrayobject.h"
 #include "object.h"
+#include "random.h"
 #include "tensor.h"
 #include "types.h"
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <numpy/arrayobject.h>
@@ -102,18 +105,50 @@ static int PyTensor_init(PyTensorObject *self, PyObject *args,
        */
 
       PyArrayObject *array = (PyArrayObject *)first;
-      if (PyArray_TYPE(array) != NPY_FLOAT32) {
-        PyErr_SetString(PyExc_TypeError, "expected np.float32 array");
-        return -1;
-      }
       int ndim = PyArray_NDIM(array);
       npy_intp *np_shape = PyArray_SHAPE(array);
       std::vector<int> shape;
-      std::vector<float> values;
       shape.reserve(ndim);
       for (int i = 0; i < ndim; ++i) {
         shape.push_back((int)np_shape[i]);
       }
+      if (PyArray_TYPE(array) != NPY_FLOAT32) {
+        // other numpy dtypes are copied bit for bit into a tensor of the
+        // matching dtype, use Tensor.to() to convert afterwards
+        DType dtype;
+        switch (PyArray_TYPE(array)) {
+        case NPY_INT8:
+          dtype = DType::int8;
+          break;
+        case NPY_UINT8:
+          dtype = DType::uint8;
+          break;
+        case NPY_INT16:
+          dtype = DType::int16;
+          break;
+        case NPY_INT32:
+          dtype = DType::int32;
+          break;
+        case NPY_INT64:
+          dtype = DType::int64;
+          break;
+        case NPY_FLOAT16:
+          dtype = DType::float16;
+          break;
+        default:
+          PyErr_SetString(PyExc_TypeError, "unsupported numpy dtype");
+          return -1;
+        }
+        PyArrayObject *contiguous = PyArray_GETCONTIGUOUS(array);
+        Tensor *tensor = Tensor::empty(shape, dtype, requires_grad);
+        mps->wait_for({tensor->memory->data_ptr});
+        std::memcpy(tensor->memory->data_ptr, PyArray_DATA(contiguous),
+                    PyArray_NBYTES(contiguous));
+        Py_DECREF(contiguous);
+        self->inner->_native_obj = tensor;
+        return 0;
+      }
+      std::vector<float> values;
       int size = PyArray_SIZE(array);
       float *array_data = (float *)PyArray_DATA(array);
       values.assign(array_data, array_data + size);
@@ -168,66 +203,115 @@ static int PyTensor_set_requires_grad(PyTensorObject *self, PyObject *value,
 // ────────────────────────────────────────────
 // Helper Methods
 // ────────────────────────────────────────────
+// wraps the tensor returned by `fn`, c++ exceptions become python errors
+template <typename F> static PyObject *wrap_tensor_result(F fn) {
+  PyTensorObject *t = PyObject_New(PyTensorObject, &PyTensorType);
+  if (t == NULL) {
+    return NULL;
+  }
+  t->inner = new TensorStruct;
+  try {
+    t->inner->_native_obj = fn();
+  } catch (const std::out_of_range &e) {
+    PyErr_SetString(PyExc_IndexError, e.what());
+    return NULL;
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  return (PyObject *)t;
+}
+
+Tensor *PyTensor_AsTensor(PyObject *object) {
+  if (!PyObject_TypeCheck(object, &PyTensorType)) {
+    PyErr_SetString(PyExc_TypeError, "expected a Tensor");
+    return NULL;
+  }
+  return ((PyTensorObject *)object)->inner->_native_obj;
+}
+
+PyObject *PyTensor_FromTensor(Tensor *tensor) {
+  return wrap_tensor_result([&] { return tensor; });
+}
+
+// None or a Tensor, false with a TypeError otherwise
+static bool optional_tensor(PyObject *object, Tensor **tensor) {
+  *tensor = object == Py_None ? nullptr : PyTensor_AsTensor(object);
+  return object == Py_None || *tensor != NULL;
+}
+
+// python ints and floats are passed to the scalar overloads by value instead
+// of being wrapped in a 1-element tensor
+static bool is_scalar(PyObject *obj) {
+  return PyFloat_Check(obj) || PyLong_Check(obj);
+}
+
+// x op 2.0 and 2.0 op x, `op` gets the tensor, the scalar and whether the
+// scalar was the left operand
+template <typename F>
+static PyObject *scalar_operation(PyObject *a, PyObject *b, F op) {
+  bool reflected = !PyObject_TypeCheck(a, &PyTensorType);
+  Tensor *tensor = ((PyTensorObject *)(reflected ? b : a))->inner->_native_obj;
+  float value = (float)PyFloat_AsDouble(reflected ? a : b);
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+  return wrap_tensor_result([&] { return op(tensor, value, reflected); });
+}
+
+// x op= 2.0
+template <typename F>
+static PyObject *scalar_inplace_operation(PyObject *a, PyObject *b, F op) {
+  float value = (float)PyFloat_AsDouble(b);
+  if (PyErr_Occurred()) {
+    return NULL;
+  }
+  try {
+    op(((PyTensorObject *)a)->inner->_native_obj, value);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_INCREF(a);
+  return a;
+}
+
 Tensor *compute_hoist(PyObject *a, PyObject *b) {
-  if (PyObject_TypeCheck(a, &PyTensorType)) {
-    if (PyFloat_Check(b)) {
-      double val = PyFloat_AsDouble(b);
-      std::vector<int> shape = {1};
-      std::vector<float> values = {(float)val};
-      return new Tensor(
-          values, shape, DType::float32,
-          ((PyTensorObject *)a)->inner->_native_obj->requires_grad);
-    }
-    // } else if (PyLong_Check(b)) {
-    //   long val = PyLong_AsLong(b);
-    //   std::vector<int> shape = {1};
-    //   std::vector<int> values = {(int)val};
-    //   return new Tensor(
-    //       values, shape, DType::int32,
-    //       ((PyTensorObject *)a)->inner->_native_obj->requires_grad);
-    // }
-    else if (PyObject_TypeCheck(b, &PyTensorType)) {
-      return ((PyTensorObject *)b)->inner->_native_obj;
-    } else {
-      PyErr_SetString(
-          PyExc_TypeError,
-          "Invalid argument type, Expected int, float or Tensor object");
-      return NULL;
-    }
-  } else if (PyObject_TypeCheck(b, &PyTensorType)) {
-    if (PyFloat_Check(a)) {
-      double val = PyFloat_AsDouble(a);
-      std::vector<int> shape = {1};
-      std::vector<float> values = {(float)val};
-      return new Tensor(
-          values, shape, DType::float32,
-          ((PyTensorObject *)b)->inner->_native_obj->requires_grad);
-    }
-    // else if (PyLong_Check(a)) {
-    //   long val = PyLong_AsLong(a);
-    //   std::vector<int> shape = {1};
-    //   std::vector<int> values = {(int)val};
-    //   return new Tensor(
-    //       values, shape, DType::int32,
-    //       ((PyTensorObject *)b)->inner->_native_obj->requires_grad);
-    // }
-    else {
-      PyErr_SetString(
-          PyExc_TypeError,
-          "Invalid argument type, Expected int, float or Tensor object");
-      return NULL;
-    }
-  } else {
-    PyErr_SetString(
-        PyExc_TypeError,
-        "Invalid argument type, Expected int, float or Tensor object");
+  if (PyObject_TypeCheck(a, &PyTensorType) &&
+      PyObject_TypeCheck(b, &PyTensorType)) {
+    return ((PyTensorObject *)b)->inner->_native_obj;
+  }
+  PyErr_SetString(
+      PyExc_TypeError,
+      "Invalid argument type, Expected int, float or Tensor object");
+  return NULL;
+}
+
+// x op= y
+template <typename F>
+static PyObject *tensor_inplace_operation(PyObject *a, PyObject *b, F op) {
+  Tensor *other = compute_hoist(a, b);
+  if (!other) {
     return NULL;
   }
+  try {
+    op(((PyTensorObject *)a)->inner->_native_obj, other);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_INCREF(a);
+  return a;
 }
+
 // ────────────────────────────────────────────
 // Arithemetic operators
 // ────────────────────────────────────────────
 static PyObject *PyTensor_add(PyObject *a, PyObject *b) {
+  if (is_scalar(a) || is_scalar(b)) {
+    return scalar_operation(
+        a, b, [](Tensor *t, float v, bool) { return t->add(v); });
+  }
   Tensor *other = compute_hoist(a, b);
   if (other == NULL) {
     return NULL;
@@ -244,24 +328,20 @@ static PyObject *PyTensor_add(PyObject *a, PyObject *b) {
 }
 
 static PyObject *PyTensor_add_inplace(PyObject *a, PyObject *b) {
-  Tensor *other = compute_hoist(a, b);
-  if (!other) {
-    return NULL;
+  if (is_scalar(b)) {
+    return scalar_inplace_operation(
+        a, b, [](Tensor *t, float v) { t->add(v, true); });
   }
-  Tensor *out = ((PyTensorObject *)a)->inner->_native_obj->add(other, true);
-  if (!out) {
-    PyErr_SetString(
-        PyExc_RuntimeError,
-        "in-place operation is not allowed on a tensor that requires "
-        "gradient. "
-        "Please detach the tensor or clone it before proceeding.");
-    return NULL;
-  }
-  Py_INCREF(a);
-  return (PyObject *)a;
+  return tensor_inplace_operation(
+      a, b, [](Tensor *t, Tensor *other) { t->add(other, true); });
 }
 
 static PyObject *PyTensor_sub(PyObject *a, PyObject *b) {
+  if (is_scalar(a) || is_scalar(b)) {
+    return scalar_operation(a, b, [](Tensor *t, float v, bool reflected) {
+      return reflected ? t->rsub(v) : t->sub(v);
+    });
+  }
   Tensor *other = compute_hoist(a, b);
   if (other == NULL) {
     return NULL;
@@ -278,24 +358,20 @@ static PyObject *PyTensor_sub(PyObject *a, PyObject *b) {
 }
 
 static PyObject *PyTensor_sub_inplace(PyObject *a, PyObject *b) {
-  Tensor *other = compute_hoist(a, b);
-  if (!other) {
-    return NULL;
+  if (is_scalar(b)) {
+    return scalar_inplace_operation(
+        a, b, [](Tensor *t, float v) { t->sub(v, true); });
   }
-  Tensor *out = ((PyTensorObject *)a)->inner->_native_obj->sub(other, true);
-  if (!out) {
-    PyErr_SetString(
-        PyExc_RuntimeError,
-        "in-place operation is not allowed on a tensor that requires "
-        "gradient. "
-        "Please detach the tensor or clone it before proceeding.");
-    return NULL;
-  }
-  Py_INCREF(a);
-  return (PyObject *)a;
+  return tensor_inplace_operation(
+      a, b, [](Tensor *t, Tensor *other) { t->sub(other, true); });
 }
 
 static PyObject *PyTensor_div(PyObject *a, PyObject *b) {
+  if (is_scalar(a) || is_scalar(b)) {
+    return scalar_operation(a, b, [](Tensor *t, float v, bool reflected) {
+      return reflected ? t->rdiv(v) : t->div(v);
+    });
+  }
   Tensor *other = compute_hoist(a, b);
   if (other == NULL) {
     return NULL;
@@ -312,24 +388,19 @@ static PyObject *PyTensor_div(PyObject *a, PyObject *b) {
 }
 
 static PyObject *PyTensor_div_inplace(PyObject *a, PyObject *b) {
-  Tensor *other = compute_hoist(a, b);
-  if (!other) {
-    return NULL;
-  }
-  Tensor *out = ((PyTensorObject *)a)->inner->_native_obj->div(other, true);
-  if (!out) {
-    PyErr_SetString(
-        PyExc_RuntimeError,
-        "in-place operation is not allowed on a tensor that requires "
-        "gradient. "
-        "Please detach the tensor or clone it before proceeding.");
-    return NULL;
+  if (is_scalar(b)) {
+    return scalar_inplace_operation(
+        a, b, [](Tensor *t, float v) { t->div(v, true); });
   }
-  Py_INCREF(a);
-  return (PyObject *)a;
+  return tensor_inplace_operation(
+      a, b, [](Tensor *t, Tensor *other) { t->div(other, true); });
 }
 
 static PyObject *PyTensor_mul(PyObject *a, PyObject *b) {
+  if (is_scalar(a) || is_scalar(b)) {
+    return scalar_operation(
+        a, b, [](Tensor *t, float v, bool) { return t->mul(v); });
+  }
   Tensor *other = compute_hoist(a, b);
   if (other == NULL) {
     return NULL;
@@ -346,21 +417,20 @@ static PyObject *PyTensor_mul(PyObject *a, PyObject *b) {
 }
 
 static PyObject *PyTensor_mul_inplace(PyObject *a, PyObject *b) {
-  Tensor *other = compute_hoist(a, b);
-  if (!other) {
-    return NULL;
+  if (is_scalar(b)) {
+    return scalar_inplace_operation(
+        a, b, [](Tensor *t, float v) { t->mul(v, true); });
   }
-  Tensor *out = ((PyTensorObject *)a)->inner->_native_obj->mul(other, true);
-  if (!out) {
-    PyErr_SetString(
-        PyExc_RuntimeError,
-        "in-place operation is not allowed on a tensor that requires "
-        "gradient. "
-        "Please detach the tensor or clone it before proceeding.");
-    return NULL;
+  return tensor_inplace_operation(
+      a, b, [](Tensor *t, Tensor *other) { t->mul(other, true); });
+}
+static PyObject *PyTensor_pow(PyObject *a, PyObject *b, PyObject *mod) {
+  if (!PyObject_TypeCheck(a, &PyTensorType) || !is_scalar(b) ||
+      mod != Py_None) {
+    Py_RETURN_NOTIMPLEMENTED;
   }
-  Py_INCREF(a);
-  return (PyObject *)a;
+  return scalar_operation(
+      a, b, [](Tensor *t, float v, bool) { return t->pow(v); });
 }
 // ────────────────────────────────────────────
 // other dunder methods
@@ -377,11 +447,6 @@ static Py_ssize_t PyTensor_len(PyObject *self) {
   return (Py_ssize_t)((PyTensorObject *)self)->inner->_native_obj->dims[0];
 }
 
-int PyTensor_setitem(PyObject *self, PyObject *key, PyObject *value) {
-  // called as tensor[key] = value or del tensor[key] (if value is null) or
-  // tensor.__setitem__(key, value);
-  return -1;
-}
 static PyObject *PyTensor_getitem(PyTensorObject *self, PyObject *item) {
   // called as tensor[item], or tensor.__getitem__(item);
   PyTensorObject *view = PyObject_New(PyTensorObject, &PyTensorType);
@@ -392,6 +457,11 @@ static PyObject *PyTensor_getitem(PyTensorObject *self, PyObject *item) {
   Py_ssize_t start, stop, step, slicelength;
   if (PyTuple_Check(item)) {
     Py_ssize_t ndim = PyTuple_GET_SIZE(item);
+    if (ndim > self->inner->_native_obj->ndim) {
+      PyErr_SetString(PyExc_IndexError, "too many indices for tensor.");
+      Py_DECREF((PyObject *)view);
+      return NULL;
+    }
     for (Py_ssize_t i = 0; i < ndim; i++) {
       Slice s;
       PyObject *item_i = PyTuple_GET_ITEM(item, i);
@@ -402,8 +472,8 @@ static PyObject *PyTensor_getitem(PyTensorObject *self, PyObject *item) {
         return NULL;
       }
 
-      if (PySlice_GetIndicesEx(item_i, self->inner->_native_obj->size, &start,
-                               &stop, &step, &slicelength) < 0) {
+      if (PySlice_GetIndicesEx(item_i, self->inner->_native_obj->dims[i],
+                               &start, &stop, &step, &slicelength) < 0) {
         Py_DECREF((PyObject *)view);
         return NULL;
       }
@@ -418,7 +488,7 @@ static PyObject *PyTensor_getitem(PyTensorObject *self, PyObject *item) {
     return (PyObject *)view;
   } else if (PySlice_Check(item)) {
     Slice s;
-    if (PySlice_GetIndicesEx(item, self->inner->_native_obj->size, &start,
+    if (PySlice_GetIndicesEx(item, self->inner->_native_obj->dims[0], &start,
                              &stop, &step, &slicelength) < 0) {
       Py_DECREF((PyObject *)view);
       return NULL;
@@ -438,10 +508,361 @@ static PyObject *PyTensor_getitem(PyTensorObject *self, PyObject *item) {
   return NULL;
 }
 
+int PyTensor_setitem(PyObject *self, PyObject *key, PyObject *value) {
+  // called as tensor[key] = value or del tensor[key] (if value is null) or
+  // tensor.__setitem__(key, value);
+  if (value == NULL) {
+    PyErr_SetString(PyExc_TypeError, "tensor elements can not be deleted.");
+    return -1;
+  }
+  PyObject *view = PyTensor_getitem((PyTensorObject *)self, key);
+  if (view == NULL) {
+    return -1;
+  }
+  Tensor *target = ((PyTensorObject *)view)->inner->_native_obj;
+  int status = 0;
+  try {
+    if (PyFloat_Check(value) || PyLong_Check(value)) {
+      target->fill((float)PyFloat_AsDouble(value));
+    } else if (PyObject_TypeCheck(value, &PyTensorType)) {
+      target->assign(((PyTensorObject *)value)->inner->_native_obj);
+    } else {
+      PyErr_SetString(PyExc_TypeError, "Expected int, float or Tensor object");
+      status = -1;
+    }
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    status = -1;
+  }
+  Py_DECREF(view);
+  return status;
+}
+
+// accepts either f(a, b, c) or f((a, b, c)) / f([a, b, c])
+static bool parse_int_args(PyObject *args, std::vector<int> &values) {
+  PyObject *sequence = args;
+  if (PyTuple_Size(args) == 1 &&
+      (PyTuple_Check(PyTuple_GetItem(args, 0)) ||
+       PyList_Check(PyTuple_GetItem(args, 0)))) {
+    sequence = PyTuple_GetItem(args, 0);
+  }
+  PyObject *fast = PySequence_Fast(sequence, "expected a sequence of ints");
+  if (fast == NULL)
+    return false;
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(fast);
+  for (Py_ssize_t i = 0; i < n; ++i) {
+    PyObject *item = PySequence_Fast_GET_ITEM(fast, i);
+    if (!PyLong_Check(item)) {
+      Py_DECREF(fast);
+      PyErr_SetString(PyExc_TypeError, "dims must be integers");
+      return false;
+    }
+    values.push_back(static_cast<int>(PyLong_AsLong(item)));
+  }
+  Py_DECREF(fast);
+  return true;
+}
+
+static PyObject *PyTensor_to(PyTensorObject *self, PyObject *args,
+                             PyObject *kwds) {
+  int dtype = static_cast<int>(DType::float32);
+  int rounding = static_cast<int>(RoundingMode::TRUNCATE);
+  int saturate = 0;
+  static const char *keywords[] = {"dtype", "rounding", "saturate", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "i|ip", (char **)keywords,
+                                   &dtype, &rounding, &saturate)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] {
+    return tensor->to(static_cast<DType>(dtype),
+                      static_cast<RoundingMode>(rounding), saturate == 1);
+  });
+}
+
+static PyObject *PyTensor_transpose(PyTensorObject *self, PyObject *args) {
+  int dim0 = 0, dim1 = 1;
+  if (!PyArg_ParseTuple(args, "|ii", &dim0, &dim1)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->transpose(dim0, dim1); });
+}
+
+static PyObject *PyTensor_permute(PyTensorObject *self, PyObject *args) {
+  std::vector<int> order;
+  if (!parse_int_args(args, order)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->permute(order); });
+}
+
+static PyObject *PyTensor_reshape(PyTensorObject *self, PyObject *args) {
+  std::vector<int> shape;
+  if (!parse_int_args(args, shape)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->reshape(shape); });
+}
+
+static PyObject *PyTensor_expand(PyTensorObject *self, PyObject *args) {
+  std::vector<int> shape;
+  if (!parse_int_args(args, shape)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->expand(shape); });
+}
+
+static PyObject *PyTensor_contiguous(PyTensorObject *self,
+                                     PyObject *Py_UNUSED(ignored)) {
+  Tensor *tensor = self->inner->_native_obj;
+  Tensor *result;
+  try {
+    result = tensor->contiguous();
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  // already contiguous, hand back the same python object
+  if (result == tensor) {
+    Py_INCREF(self);
+    return (PyObject *)self;
+  }
+  return wrap_tensor_result([&] { return result; });
+}
+
+static PyObject *PyTensor_squeeze(PyTensorObject *self, PyObject *args) {
+  PyObject *dim = Py_None;
+  if (!PyArg_ParseTuple(args, "|O", &dim)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  if (dim == Py_None) {
+    return wrap_tensor_result([&] { return tensor->squeeze(); });
+  }
+  if (!PyLong_Check(dim)) {
+    PyErr_SetString(PyExc_TypeError, "dim must be an integer");
+    return NULL;
+  }
+  int d = static_cast<int>(PyLong_AsLong(dim));
+  return wrap_tensor_result([&] { return tensor->squeeze(d); });
+}
+
+static PyObject *PyTensor_unsqueeze(PyTensorObject *self, PyObject *args) {
+  int dim;
+  if (!PyArg_ParseTuple(args, "i", &dim)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->unsqueeze(dim); });
+}
+
+static PyObject *PyTensor_linear(PyTensorObject *self, PyObject *args,
+                                 PyObject *kwds) {
+  PyObject *weight, *bias = Py_None;
+  int activation = static_cast<int>(Activation::NONE);
+  static const char *keywords[] = {"weight", "bias", "activation", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|Oi", (char **)keywords,
+                                   &weight, &bias, &activation)) {
+    return NULL;
+  }
+  if (activation < static_cast<int>(Activation::NONE) ||
+      activation > static_cast<int>(Activation::SILU)) {
+    PyErr_SetString(PyExc_ValueError, "unknown activation");
+    return NULL;
+  }
+  Tensor *w = PyTensor_AsTensor(weight);
+  Tensor *b;
+  if (w == NULL || !optional_tensor(bias, &b)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] {
+    return tensor->linear(w, b, static_cast<Activation>(activation));
+  });
+}
+
+// runs the activation `fn`, in place the same python object is returned
+template <typename F>
+static PyObject *activation_result(PyTensorObject *self, int inplace, F fn) {
+  Tensor *tensor = self->inner->_native_obj;
+  if (!inplace) {
+    return wrap_tensor_result([&] { return fn(tensor, false); });
+  }
+  try {
+    fn(tensor, true);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  Py_INCREF(self);
+  return (PyObject *)self;
+}
+
+static PyObject *PyTensor_relu(PyTensorObject *self, PyObject *args,
+                               PyObject *kwds) {
+  int inplace = 0;
+  static const char *keywords[] = {"inplace", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", (char **)keywords,
+                                   &inplace)) {
+    return NULL;
+  }
+  return activation_result(self, inplace, [](Tensor *tensor, bool inplace) {
+    return tensor->relu(inplace);
+  });
+}
+
+static PyObject *PyTensor_leaky_relu(PyTensorObject *self, PyObject *args,
+                                     PyObject *kwds) {
+  float negative_slope = 0.01f;
+  int inplace = 0;
+  static const char *keywords[] = {"negative_slope", "inplace", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|fp", (char **)keywords,
+                                   &negative_slope, &inplace)) {
+    return NULL;
+  }
+  return activation_result(self, inplace, [&](Tensor *tensor, bool inplace) {
+    return tensor->leaky_relu(negative_slope, inplace);
+  });
+}
+
+static PyObject *PyTensor_sigmoid(PyTensorObject *self, PyObject *args,
+                                  PyObject *kwds) {
+  int inplace = 0;
+  static const char *keywords[] = {"inplace", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", (char **)keywords,
+                                   &inplace)) {
+    return NULL;
+  }
+  return activation_result(self, inplace, [](Tensor *tensor, bool inplace) {
+    return tensor->sigmoid(inplace);
+  });
+}
+
+static PyObject *PyTensor_gelu(PyTensorObject *self,
+                               PyObject *Py_UNUSED(ignored)) {
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->gelu(); });
+}
+
+static PyObject *PyTensor_silu(PyTensorObject *self,
+                               PyObject *Py_UNUSED(ignored)) {
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->silu(); });
+}
+
+static PyObject *PyTensor_dropout(PyTensorObject *self, PyObject *args,
+                                  PyObject *kwds) {
+  float p = 0.5f;
+  int training = 1;
+  static const char *keywords[] = {"p", "training", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|fp", (char **)keywords, &p,
+                                   &training)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  Tensor *result;
+  try {
+    result = tensor->dropout(p, training);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+  // the identity is the same python object
+  if (result == tensor) {
+    Py_INCREF(self);
+    return (PyObject *)self;
+  }
+  return wrap_tensor_result([&] { return result; });
+}
+
+static PyObject *PyTensor_layer_norm(PyTensorObject *self, PyObject *args,
+                                     PyObject *kwds) {
+  PyObject *weight = Py_None, *bias = Py_None;
+  float eps = 1e-5f;
+  static const char *keywords[] = {"weight", "bias", "eps", NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOf", (char **)keywords,
+                                   &weight, &bias, &eps)) {
+    return NULL;
+  }
+  Tensor *w, *b;
+  if (!optional_tensor(weight, &w) || !optional_tensor(bias, &b)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] { return tensor->layer_norm(w, b, eps); });
+}
+
+static PyObject *PyTensor_batch_norm(PyTensorObject *self, PyObject *args,
+                                     PyObject *kwds) {
+  PyObject *running_mean = Py_None, *running_var = Py_None;
+  PyObject *weight = Py_None, *bias = Py_None;
+  int training = 1;
+  float momentum = 0.1f, eps = 1e-5f;
+  static const char *keywords[] = {"running_mean", "running_var", "weight",
+                                   "bias",         "training",    "momentum",
+                                   "eps",          NULL};
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OOOOpff", (char **)keywords,
+                                   &running_mean, &running_var, &weight,
+                                   &bias, &training, &momentum, &eps)) {
+    return NULL;
+  }
+  Tensor *mean, *var, *w, *b;
+  if (!optional_tensor(running_mean, &mean) ||
+      !optional_tensor(running_var, &var) || !optional_tensor(weight, &w) ||
+      !optional_tensor(bias, &b)) {
+    return NULL;
+  }
+  Tensor *tensor = self->inner->_native_obj;
+  return wrap_tensor_result([&] {
+    return tensor->batch_norm(mean, var, w, b, training == 1, momentum, eps);
+  });
+}
+
 static PyMethodDef PyTensor_methods[] = {
     {"print", (PyCFunction)PyTensor_print, METH_NOARGS, "Print the tensor"},
     {"print_buffer", (PyCFunction)PyTensor_print_buffer, METH_NOARGS,
      "Print the Tensor Buffer"},
+    {"to", (PyCFunction)PyTensor_to, METH_VARARGS | METH_KEYWORDS,
+     "Cast the tensor to another dtype."},
+    {"transpose", (PyCFunction)PyTensor_transpose, METH_VARARGS,
+     "Swap two dimensions without copying."},
+    {"permute", (PyCFunction)PyTensor_permute, METH_VARARGS,
+     "Reorder the dimensions without copying."},
+    {"reshape", (PyCFunction)PyTensor_reshape, METH_VARARGS,
+     "View the tensor with a new shape."},
+    {"expand", (PyCFunction)PyTensor_expand, METH_VARARGS,
+     "Broadcast dims of length 1 without copying."},
+    {"contiguous", (PyCFunction)PyTensor_contiguous, METH_NOARGS,
+     "Return a row major copy unless the tensor already is row major."},
+    {"squeeze", (PyCFunction)PyTensor_squeeze, METH_VARARGS,
+     "Remove dims of length 1."},
+    {"unsqueeze", (PyCFunction)PyTensor_unsqueeze, METH_VARARGS,
+     "Insert a dim of length 1."},
+    {"linear", (PyCFunction)PyTensor_linear, METH_VARARGS | METH_KEYWORDS,
+     "activation(self @ weight^T + bias) in one fused kernel."},
+    {"relu", (PyCFunction)PyTensor_relu, METH_VARARGS | METH_KEYWORDS,
+     "max(x, 0), the backward pass keeps one bit per element."},
+    {"leaky_relu", (PyCFunction)PyTensor_leaky_relu,
+     METH_VARARGS | METH_KEYWORDS,
+     "x where x > 0, negative_slope * x elsewhere."},
+    {"sigmoid", (PyCFunction)PyTensor_sigmoid, METH_VARARGS | METH_KEYWORDS,
+     "1 / (1 + exp(-x)), the backward pass reuses the result."},
+    {"gelu", (PyCFunction)PyTensor_gelu, METH_NOARGS,
+     "GELU with the tanh approximation."},
+    {"silu", (PyCFunction)PyTensor_silu, METH_NOARGS, "x * sigmoid(x)."},
+    {"dropout", (PyCFunction)PyTensor_dropout, METH_VARARGS | METH_KEYWORDS,
+     "Zero elements with probability p and scale the others by 1 / (1 - p), "
+     "the identity when not training."},
+    {"layer_norm", (PyCFunction)PyTensor_layer_norm,
+     METH_VARARGS | METH_KEYWORDS,
+     "Normalize over the last dim, then scale and shift."},
+    {"batch_norm", (PyCFunction)PyTensor_batch_norm,
+     METH_VARARGS | METH_KEYWORDS,
+     "Normalize every feature of the last dim over the batch."},
     {NULL}};
 
 static PyGetSetDef PyTensor_getsets[] = {
@@ -461,6 +882,7 @@ static PyNumberMethods PyTensor_as_number = {
     .nb_add = PyTensor_add,
     .nb_subtract = PyTensor_sub,
     .nb_multiply = PyTensor_mul,
+    .nb_power = PyTensor_pow,
     .nb_inplace_add = (binaryfunc)PyTensor_add_inplace,
     .nb_inplace_subtract = (binaryfunc)PyTensor_sub_inplace,
     .nb_inplace_multiply = (binaryfunc)PyTensor_mul_inplace,
@@ -614,6 +1036,15 @@ static PyObject *PyTensor_Eye(PyObject *self, PyObject *args, PyObject *kwds) {
   return (PyObject *)t;
 }
 
+static PyObject *PyTensor_manual_seed(PyObject *self, PyObject *args) {
+  unsigned int seed;
+  if (!PyArg_ParseTuple(args, "I", &seed)) {
+    return NULL;
+  }
+  manual_seed(seed);
+  Py_RETURN_NONE;
+}
+
 static PyMethodDef TensorModuleMethods[] = {
     {"ones", (PyCFunction)PyTensor_Ones, METH_VARARGS | METH_KEYWORDS,
      "Create a Tensor filled with ones."},
@@ -621,6 +1052,8 @@ static PyMethodDef TensorModuleMethods[] = {
      "Create a Tensor filled with zeros."},
     {"eye", (PyCFunction)PyTensor_Eye, METH_VARARGS | METH_KEYWORDS,
      "Create an identity tensor."},
+    {"manual_seed", (PyCFunction)PyTensor_manual_seed, METH_VARARGS,
+     "Restart the random stream of dropout from `seed`."},
     {NULL, NULL, 0, NULL}};
 
 static struct PyModuleDef tensormodule = {
@@ -646,5 +1079,14 @@ PyObject *createTensorModule(PyObject *parent) {
     Py_DECREF(parent);
     return NULL;
   }
+
+  // activations accepted by Tensor.linear()
+  PyModule_AddIntConstant(tensor, "NONE", static_cast<int>(Activation::NONE));
+  PyModule_AddIntConstant(tensor, "RELU", static_cast<int>(Activation::RELU));
+  PyModule_AddIntConstant(tensor, "SIGMOID",
+                          static_cast<int>(Activation::SIGMOID));
+  PyModule_AddIntConstant(tensor, "TANH", static_cast<int>(Activation::TANH));
+  PyModule_AddIntConstant(tensor, "GELU", static_cast<int>(Activation::GELU));
+  PyModule_AddIntConstant(tensor, "SILU", static_cast<int>(Activation::SILU));
   return tensor;
 }
@@ -0,0 +1,64 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// activations shared by the fused kernels, included by the files that use
+// them. GELU is the tanh approximation
+
+// keep in sync with Activation in types.h
+enum Activation : int { NONE, RELU, SIGMOID, TANH, GELU, SILU };
+
+constant float GELU_SCALE = 0.7978845608f; // sqrt(2 / pi)
+constant float GELU_CUBIC = 0.044715f;
+
+inline float gelu_tanh(float z) {
+  return tanh(GELU_SCALE * (z + GELU_CUBIC * z * z * z));
+}
+
+inline float sigmoid(float z) { return 1.0f / (1.0f + exp(-z)); }
+
+inline float activate(int activation, float z) {
+  switch (activation) {
+  case RELU:
+    return max(z, 0.0f);
+  case SIGMOID:
+    return sigmoid(z);
+  case TANH:
+    return tanh(z);
+  case GELU:
+    return 0.5f * z * (1.0f + gelu_tanh(z));
+  case SILU:
+    return z * sigmoid(z);
+  default:
+    return z;
+  }
+}
+
+// whether the derivative needs the value before the activation, the others
+// are computed from the result
+inline bool needs_input(int activation) {
+  return activation == GELU || activation == SILU;
+}
+
+// the derivative from what the forward pass saved, see needs_input
+inline float derivative(int activation, float saved) {
+  switch (activation) {
+  case RELU:
+    return saved > 0.0f ? 1.0f : 0.0f;
+  case SIGMOID:
+    return saved * (1.0f - saved);
+  case TANH:
+    return 1.0f - saved * saved;
+  case GELU: {
+    float z = saved;
+    float t = gelu_tanh(z);
+    float inner = GELU_SCALE * (1.0f + 3.0f * GELU_CUBIC * z * z);
+    return 0.5f * (1.0f + t) + 0.5f * z * (1.0f - t * t) * inner;
+  }
+  case SILU: {
+    float s = sigmoid(saved);
+    return s * (1.0f + saved * (1.0f - s));
+  }
+  default:
+    return 1.0f;
+  }
+}
@@ -0,0 +1,98 @@
+#include "./activation_functions.metal"
+#include "./broadcast.metal"
+#include <metal_stdlib>
+using namespace metal;
+
+// activations with their own backward kernels. relu and leaky relu keep one
+// bit per element for the backward pass, sigmoid and tanh their result,
+// gelu and silu read their input again.
+
+// relu, or leaky relu with a negative slope. the backward pass only needs
+// the sign of the input, a simdgroup of 32 threads packs it into one mask
+// word with simd_ballot. this needs simdgroups aligned with the grid: a
+// single threadgroup or threadgroups of a multiple of 32 threads.
+//
+// scalars: [negative_slope, has_mask]
+kernel void __relu__(device float *input [[buffer(0)]],
+                     device float *output [[buffer(1)]],
+                     device uint *mask [[buffer(2)]],
+                     constant int *metadata [[buffer(3)]],
+                     constant float *scalars [[buffer(4)]],
+                     uint tid [[thread_position_in_grid]],
+                     uint lane [[thread_index_in_simdgroup]]) {
+  bool inside = (int)tid < metadata[0];
+  float value = 0.0f;
+  if (inside)
+    value = input[unary_input_index(tid, metadata)];
+  bool positive = value > 0.0f;
+  // every thread of the simdgroup takes part in the ballot
+  uint bits = uint(ulong(simd_ballot(positive)));
+  if (!inside)
+    return;
+  if (scalars[1] != 0.0f && lane == 0)
+    mask[tid / 32] = bits;
+  output[unary_output_index(tid, metadata)] =
+      positive ? value : scalars[0] * value;
+}
+
+kernel void __sigmoid__(device float *input [[buffer(0)]],
+                        device float *output [[buffer(1)]],
+                        constant int *metadata [[buffer(2)]],
+                        uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = activate(SIGMOID, input[i]);
+}
+
+kernel void __gelu__(device float *input [[buffer(0)]],
+                     device float *output [[buffer(1)]],
+                     constant int *metadata [[buffer(2)]],
+                     uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = activate(GELU, input[i]);
+}
+
+kernel void __silu__(device float *input [[buffer(0)]],
+                     device float *output [[buffer(1)]],
+                     constant int *metadata [[buffer(2)]],
+                     uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = activate(SILU, input[i]);
+}
+
+// grad * activation'(saved), see needs_input. every operand is dense
+//
+// metadata: [size, activation]
+kernel void __activation_grad__(device const float *grad [[buffer(0)]],
+                                device const float *saved [[buffer(1)]],
+                                device float *result [[buffer(2)]],
+                                constant int *metadata [[buffer(3)]],
+                                uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  result[tid] = grad[tid] * derivative(metadata[1], saved[tid]);
+}
+
+// the backward pass of __relu__, grad where the input was positive and
+// negative_slope * grad elsewhere
+//
+// metadata: [size], scalars: [negative_slope]
+kernel void __mask_grad__(device const float *grad [[buffer(0)]],
+                          device const uint *mask [[buffer(1)]],
+                          device float *result [[buffer(2)]],
+                          constant int *metadata [[buffer(3)]],
+                          constant float *scalars [[buffer(4)]],
+                          uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  bool positive = (mask[tid / 32] >> (tid % 32)) & 1u;
+  result[tid] = positive ? grad[tid] : scalars[0] * grad[tid];
+}
@@ -19,11 +19,13 @@ kernel void __add__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] + B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] + B[bi];
 }
 
 kernel void __sub__(device const float *A [[buffer(0)]],
@@ -41,12 +43,14 @@ kernel void __sub__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
 
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] - B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] - B[bi];
 }
 kernel void __div__(device const float *A [[buffer(0)]],
                     device const float *B [[buffer(1)]],
@@ -63,12 +67,14 @@ kernel void __div__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
 
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] / B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] / B[bi];
 }
 
 kernel void __mul__(device const float *A [[buffer(0)]],
@@ -86,11 +92,13 @@ kernel void __mul__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] * B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] * B[bi];
 }
 
 // FIX: matmul algorithm to match n dimensional tensors
@@ -109,11 +117,13 @@ kernel void __matmul__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] * B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] * B[bi];
 }
 
 kernel void __neg__(device float *input [[buffer(0)]],
@@ -123,7 +133,9 @@ kernel void __neg__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = input[tid] * -1.0f;
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = input[i] * -1.0f;
 }
 
 /*
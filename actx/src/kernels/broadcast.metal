@@ -18,3 +18,29 @@ inline int compute_broadcast_index(uint tid, constant int *source_shape,
   }
   return source_index;
 }
+
+// physical index of the tid-th element (in row major order) of a tensor with
+// the given shape and strides, used to write through views
+inline int compute_strided_index(uint tid, constant int *shape,
+                                 constant int *stride, int rank) {
+  int index = 0;
+  for (int i = rank - 1; i >= 0; --i) {
+    index += (tid % shape[i]) * stride[i];
+    tid /= shape[i];
+  }
+  return index;
+}
+
+// unary metadata:
+// [N, input_rank, output_rank, input_shape, input_stride, output_shape,
+//  output_stride]
+inline int unary_input_index(uint tid, constant int *metadata) {
+  int rank = metadata[1];
+  return compute_strided_index(tid, metadata + 3, metadata + 3 + rank, rank);
+}
+
+inline int unary_output_index(uint tid, constant int *metadata) {
+  constant int *shape = metadata + 3 + metadata[1] * 2;
+  int rank = metadata[2];
+  return compute_strided_index(tid, shape, shape + rank, rank);
+}
@@ -0,0 +1,185 @@
+#include "./broadcast.metal"
+#include <metal_stdlib>
+using namespace metal;
+
+// bfloat16 is carried around as its raw bits (upper half of a float32) so the
+// kernels do not depend on the metal 3.1 bfloat type
+struct bfloat16_t {
+  ushort bits;
+};
+
+// rounding modes, keep in sync with RoundingMode in types.h
+constant int ROUND_TRUNCATE = 0;
+constant int ROUND_NEAREST_EVEN = 1;
+constant int ROUND_FLOOR = 2;
+constant int ROUND_CEIL = 3;
+
+template <typename T> struct is_float_like : false_type {};
+template <> struct is_float_like<half> : true_type {};
+template <> struct is_float_like<float> : true_type {};
+template <> struct is_float_like<bfloat16_t> : true_type {};
+
+// storage -> compute conversions
+template <typename T> inline float to_float(T value) { return float(value); }
+template <> inline float to_float(bfloat16_t value) {
+  return as_type<float>(uint(value.bits) << 16);
+}
+
+template <typename T> inline T from_float(float value) { return T(value); }
+template <> inline bfloat16_t from_float(float value) {
+  bfloat16_t result;
+  if (isnan(value)) {
+    result.bits = 0x7fc0;
+    return result;
+  }
+  // round to nearest even on the 16 dropped mantissa bits
+  uint bits = as_type<uint>(value);
+  bits += 0x7fff + ((bits >> 16) & 1);
+  result.bits = ushort(bits >> 16);
+  return result;
+}
+
+// representable range of each destination type
+template <typename T> inline long int_lo();
+template <typename T> inline long int_hi();
+template <> inline long int_lo<char>() { return -128; }
+template <> inline long int_hi<char>() { return 127; }
+template <> inline long int_lo<uchar>() { return 0; }
+template <> inline long int_hi<uchar>() { return 255; }
+template <> inline long int_lo<short>() { return -32768; }
+template <> inline long int_hi<short>() { return 32767; }
+template <> inline long int_lo<int>() { return -2147483648L; }
+template <> inline long int_hi<int>() { return 2147483647L; }
+template <> inline long int_lo<long>() { return -9223372036854775807L - 1; }
+template <> inline long int_hi<long>() { return 9223372036854775807L; }
+
+template <typename T> inline float float_hi();
+template <> inline float float_hi<half>() { return 65504.0f; }
+template <> inline float float_hi<bfloat16_t>() { return 3.38953139e38f; }
+template <> inline float float_hi<float>() { return FLT_MAX; }
+
+inline float round_with_mode(float value, int mode) {
+  if (mode == ROUND_NEAREST_EVEN)
+    return rint(value);
+  if (mode == ROUND_FLOOR)
+    return floor(value);
+  if (mode == ROUND_CEIL)
+    return ceil(value);
+  return trunc(value);
+}
+
+// integer -> integer: widening is exact, narrowing either wraps (like a c
+// cast / numpy astype) or clamps to the destination range
+template <typename Src, typename Dst, bool SrcFloat = is_float_like<Src>::value,
+          bool DstFloat = is_float_like<Dst>::value>
+struct caster {
+  static inline Dst apply(Src value, int mode, bool saturate) {
+    long x = long(value);
+    if (saturate) {
+      x = x < int_lo<Dst>() ? int_lo<Dst>() : x;
+      x = x > int_hi<Dst>() ? int_hi<Dst>() : x;
+    }
+    return Dst(x);
+  }
+};
+
+// anything -> floating point: saturation keeps finite values finite when the
+// destination is narrower (e.g. 70000 -> half is +inf otherwise)
+template <typename Src, typename Dst, bool SrcFloat>
+struct caster<Src, Dst, SrcFloat, true> {
+  static inline Dst apply(Src value, int mode, bool saturate) {
+    float x = to_float(value);
+    if (saturate && !isnan(x)) {
+      x = clamp(x, -float_hi<Dst>(), float_hi<Dst>());
+    }
+    return from_float<Dst>(x);
+  }
+};
+
+// floating point -> integer: round with the requested mode, then clamp
+// (nan -> 0) or wrap
+template <typename Src, typename Dst> struct caster<Src, Dst, true, false> {
+  static inline Dst apply(Src value, int mode, bool saturate) {
+    float x = round_with_mode(to_float(value), mode);
+    if (saturate) {
+      if (isnan(x))
+        return Dst(0);
+      if (x <= float(int_lo<Dst>()))
+        return Dst(int_lo<Dst>());
+      if (x >= float(int_hi<Dst>()))
+        return Dst(int_hi<Dst>());
+    }
+    return Dst(long(x));
+  }
+};
+
+template <typename Src, typename Dst>
+kernel void __cast__(device const Src *input [[buffer(0)]],
+                     device Dst *output [[buffer(1)]],
+                     constant int *metadata [[buffer(2)]],
+                     uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  int mode = metadata[1];
+  bool saturate = metadata[2] != 0;
+  // rank 0 marks contiguous input and output, otherwise the metadata carries
+  // [rank, shape, input_stride, output_stride]
+  int rank = metadata[3];
+
+  // every thread converts a run of 4 consecutive elements; adjacent threads
+  // touch adjacent runs so loads and stores stay coalesced even for 1 byte
+  // source types
+  int base = (int)tid * 4;
+  if (base >= N)
+    return;
+  if (rank > 0) {
+    constant int *shape = metadata + 4;
+    constant int *input_stride = shape + rank;
+    constant int *output_stride = input_stride + rank;
+    for (int i = base; i < min(base + 4, N); i++) {
+      int in = compute_strided_index(i, shape, input_stride, rank);
+      int out = compute_strided_index(i, shape, output_stride, rank);
+      output[out] = caster<Src, Dst>::apply(input[in], mode, saturate);
+    }
+    return;
+  }
+  if (base + 4 <= N) {
+    Src v0 = input[base];
+    Src v1 = input[base + 1];
+    Src v2 = input[base + 2];
+    Src v3 = input[base + 3];
+    output[base] = caster<Src, Dst>::apply(v0, mode, saturate);
+    output[base + 1] = caster<Src, Dst>::apply(v1, mode, saturate);
+    output[base + 2] = caster<Src, Dst>::apply(v2, mode, saturate);
+    output[base + 3] = caster<Src, Dst>::apply(v3, mode, saturate);
+    return;
+  }
+  for (int i = base; i < N; i++) {
+    output[i] = caster<Src, Dst>::apply(input[i], mode, saturate);
+  }
+}
+
+#define INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, DST_CODE, DST_TYPE)               \
+  template [[host_name("__cast_" #SRC_CODE "_" #DST_CODE "__")]] kernel void   \
+  __cast__<SRC_TYPE, DST_TYPE>(device const SRC_TYPE *input [[buffer(0)]],     \
+                               device DST_TYPE *output [[buffer(1)]],          \
+                               constant int *metadata [[buffer(2)]],           \
+                               uint tid [[thread_position_in_grid]]);
+
+#define INSTANTIATE_CAST_FROM(SRC_CODE, SRC_TYPE)                              \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, i8, char)                               \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, u8, uchar)                              \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, i16, short)                             \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, i32, int)                               \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, i64, long)                              \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, f16, half)                              \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, bf16, bfloat16_t)                       \
+  INSTANTIATE_CAST(SRC_CODE, SRC_TYPE, f32, float)
+
+INSTANTIATE_CAST_FROM(i8, char)
+INSTANTIATE_CAST_FROM(u8, uchar)
+INSTANTIATE_CAST_FROM(i16, short)
+INSTANTIATE_CAST_FROM(i32, int)
+INSTANTIATE_CAST_FROM(i64, long)
+INSTANTIATE_CAST_FROM(f16, half)
+INSTANTIATE_CAST_FROM(bf16, bfloat16_t)
+INSTANTIATE_CAST_FROM(f32, float)
@@ -18,12 +18,14 @@ kernel void logical_e(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
   float epsilon = 1e-5;
-  C[tid] =
+  C[ri] =
       fabs(A[ai] - B[bi]) < epsilon || (A[ai] == INFINITY && B[bi] == INFINITY)
           ? 1.0
           : 0.0;
@@ -45,12 +47,14 @@ kernel void logical_ne(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
   float epsilon = 1e-5;
-  C[tid] = fabs(A[ai] - B[bi]) > epsilon ? 1.0 : 0.0;
+  C[ri] = fabs(A[ai] - B[bi]) > epsilon ? 1.0 : 0.0;
 }
 
 kernel void logical_gt(device const float *A [[buffer(0)]],
@@ -69,11 +73,13 @@ kernel void logical_gt(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] > B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] > B[bi];
 }
 
 kernel void logical_gte(device const float *A [[buffer(0)]],
@@ -92,11 +98,13 @@ kernel void logical_gte(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] >= B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] >= B[bi];
 }
 
 kernel void logical_lt(device const float *A [[buffer(0)]],
@@ -115,11 +123,13 @@ kernel void logical_lt(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] < B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] < B[bi];
 }
 
 kernel void logical_lte(device const float *A [[buffer(0)]],
@@ -138,9 +148,11 @@ kernel void logical_lte(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = A[ai] <= B[bi];
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = A[ai] <= B[bi];
 }
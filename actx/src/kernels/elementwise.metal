@@ -0,0 +1,248 @@
+#include "./activation_functions.metal"
+#include <metal_stdlib>
+using namespace metal;
+
+// fast paths for unary and binary ops whose operands need no index
+// arithmetic, picked by Dispatcher::classify. every thread handles 4
+// consecutive outputs; loads stay scalar since view offsets do not have to be
+// 16 byte aligned
+//
+// params: [N, cols, flag]
+//   unary:      input and output both have N elements in row major order
+//   contiguous: A, B and C all have N elements in row major order
+//   scalar:     one operand is a single element, flag = 1 when it is A
+//   row:        one operand is a row of `cols` elements repeated over C,
+//               flag = 1 when it is A
+
+struct add_op {
+  static float apply(float a, float b) { return a + b; }
+};
+struct sub_op {
+  static float apply(float a, float b) { return a - b; }
+};
+struct mul_op {
+  static float apply(float a, float b) { return a * b; }
+};
+struct div_op {
+  static float apply(float a, float b) { return a / b; }
+};
+// matches __atan2__, which takes the second operand as y
+struct atan2_op {
+  static float apply(float a, float b) { return atan2(b, a); }
+};
+struct logical_e_op {
+  static float apply(float a, float b) {
+    return fabs(a - b) < 1e-5 || (a == INFINITY && b == INFINITY);
+  }
+};
+struct logical_ne_op {
+  static float apply(float a, float b) {
+    return fabs(a - b) > 1e-5 ? 1.0 : 0.0;
+  }
+};
+struct logical_gt_op {
+  static float apply(float a, float b) { return a > b; }
+};
+struct logical_gte_op {
+  static float apply(float a, float b) { return a >= b; }
+};
+struct logical_lt_op {
+  static float apply(float a, float b) { return a < b; }
+};
+struct logical_lte_op {
+  static float apply(float a, float b) { return a <= b; }
+};
+
+template <typename Op>
+kernel void __binary_contiguous__(device const float *A [[buffer(0)]],
+                                  device const float *B [[buffer(1)]],
+                                  device float *C [[buffer(2)]],
+                                  constant int *params [[buffer(3)]],
+                                  uint tid [[thread_position_in_grid]]) {
+  int N = params[0];
+  int start = (int)tid * 4;
+  int end = min(start + 4, N);
+  for (int i = start; i < end; i++)
+    C[i] = Op::apply(A[i], B[i]);
+}
+
+template <typename Op>
+kernel void __binary_scalar__(device const float *A [[buffer(0)]],
+                              device const float *B [[buffer(1)]],
+                              device float *C [[buffer(2)]],
+                              constant int *params [[buffer(3)]],
+                              uint tid [[thread_position_in_grid]]) {
+  int N = params[0];
+  bool scalar_first = params[2];
+  int start = (int)tid * 4;
+  int end = min(start + 4, N);
+  if (scalar_first) {
+    float s = A[0];
+    for (int i = start; i < end; i++)
+      C[i] = Op::apply(s, B[i]);
+  } else {
+    float s = B[0];
+    for (int i = start; i < end; i++)
+      C[i] = Op::apply(A[i], s);
+  }
+}
+
+template <typename Op>
+kernel void __binary_row__(device const float *A [[buffer(0)]],
+                           device const float *B [[buffer(1)]],
+                           device float *C [[buffer(2)]],
+                           constant int *params [[buffer(3)]],
+                           uint tid [[thread_position_in_grid]]) {
+  int N = params[0];
+  int cols = params[1];
+  bool row_first = params[2];
+  int start = (int)tid * 4;
+  int end = min(start + 4, N);
+  if (row_first) {
+    for (int i = start; i < end; i++)
+      C[i] = Op::apply(A[i % cols], B[i]);
+  } else {
+    for (int i = start; i < end; i++)
+      C[i] = Op::apply(A[i], B[i % cols]);
+  }
+}
+
+// the host derives the fast path names from the general kernel name, e.g.
+// __add__ -> __add_row__ and logical_e -> logical_e_row
+#define INSTANTIATE_BINARY(PREFIX, SUFFIX, OP)                                 \
+  template [[host_name(PREFIX "_contiguous" SUFFIX)]] kernel void              \
+  __binary_contiguous__<OP>(device const float *A [[buffer(0)]],               \
+                            device const float *B [[buffer(1)]],               \
+                            device float *C [[buffer(2)]],                     \
+                            constant int *params [[buffer(3)]],                \
+                            uint tid [[thread_position_in_grid]]);             \
+  template [[host_name(PREFIX "_scalar" SUFFIX)]] kernel void                  \
+  __binary_scalar__<OP>(device const float *A [[buffer(0)]],                   \
+                        device const float *B [[buffer(1)]],                   \
+                        device float *C [[buffer(2)]],                         \
+                        constant int *params [[buffer(3)]],                    \
+                        uint tid [[thread_position_in_grid]]);                 \
+  template [[host_name(PREFIX "_row" SUFFIX)]] kernel void                     \
+  __binary_row__<OP>(device const float *A [[buffer(0)]],                      \
+                     device const float *B [[buffer(1)]],                      \
+                     device float *C [[buffer(2)]],                            \
+                     constant int *params [[buffer(3)]],                       \
+                     uint tid [[thread_position_in_grid]]);
+
+INSTANTIATE_BINARY("__add", "__", add_op)
+INSTANTIATE_BINARY("__sub", "__", sub_op)
+INSTANTIATE_BINARY("__mul", "__", mul_op)
+INSTANTIATE_BINARY("__div", "__", div_op)
+INSTANTIATE_BINARY("__atan2", "__", atan2_op)
+INSTANTIATE_BINARY("logical_e", "", logical_e_op)
+INSTANTIATE_BINARY("logical_ne", "", logical_ne_op)
+INSTANTIATE_BINARY("logical_gt", "", logical_gt_op)
+INSTANTIATE_BINARY("logical_gte", "", logical_gte_op)
+INSTANTIATE_BINARY("logical_lt", "", logical_lt_op)
+INSTANTIATE_BINARY("logical_lte", "", logical_lte_op)
+
+struct neg_op {
+  static float apply(float x) { return x * -1.0f; }
+};
+struct sqrt_op {
+  static float apply(float x) { return sqrt(x); }
+};
+struct exp_op {
+  static float apply(float x) { return exp(x); }
+};
+struct log_op {
+  static float apply(float x) { return log(x); }
+};
+struct log10_op {
+  static float apply(float x) { return log10(x); }
+};
+struct log2_op {
+  static float apply(float x) { return log2(x); }
+};
+struct sin_op {
+  static float apply(float x) { return sin(x); }
+};
+struct cos_op {
+  static float apply(float x) { return cos(x); }
+};
+struct tan_op {
+  static float apply(float x) { return tan(x); }
+};
+struct asin_op {
+  static float apply(float x) { return asin(x); }
+};
+struct acos_op {
+  static float apply(float x) { return acos(x); }
+};
+struct atan_op {
+  static float apply(float x) { return atan(x); }
+};
+struct sinh_op {
+  static float apply(float x) { return sinh(x); }
+};
+struct cosh_op {
+  static float apply(float x) { return cosh(x); }
+};
+struct tanh_op {
+  static float apply(float x) { return tanh(x); }
+};
+struct asinh_op {
+  static float apply(float x) { return asinh(x); }
+};
+struct acosh_op {
+  static float apply(float x) { return acosh(x); }
+};
+struct atanh_op {
+  static float apply(float x) { return atanh(x); }
+};
+struct sigmoid_op {
+  static float apply(float x) { return activate(SIGMOID, x); }
+};
+struct gelu_op {
+  static float apply(float x) { return activate(GELU, x); }
+};
+struct silu_op {
+  static float apply(float x) { return activate(SILU, x); }
+};
+
+template <typename Op>
+kernel void __unary_contiguous__(device const float *input [[buffer(0)]],
+                                 device float *output [[buffer(1)]],
+                                 constant int *params [[buffer(2)]],
+                                 uint tid [[thread_position_in_grid]]) {
+  int N = params[0];
+  int start = (int)tid * 4;
+  int end = min(start + 4, N);
+  for (int i = start; i < end; i++)
+    output[i] = Op::apply(input[i]);
+}
+
+// __exp__ -> __exp_contiguous__, the strided kernels live with their ops
+#define INSTANTIATE_UNARY(NAME, OP)                                            \
+  template [[host_name("__" #NAME "_contiguous__")]] kernel void               \
+  __unary_contiguous__<OP>(device const float *input [[buffer(0)]],            \
+                           device float *output [[buffer(1)]],                 \
+                           constant int *params [[buffer(2)]],                 \
+                           uint tid [[thread_position_in_grid]]);
+
+INSTANTIATE_UNARY(neg, neg_op)
+INSTANTIATE_UNARY(sqrt, sqrt_op)
+INSTANTIATE_UNARY(exp, exp_op)
+INSTANTIATE_UNARY(log, log_op)
+INSTANTIATE_UNARY(log10, log10_op)
+INSTANTIATE_UNARY(log2, log2_op)
+INSTANTIATE_UNARY(sin, sin_op)
+INSTANTIATE_UNARY(cos, cos_op)
+INSTANTIATE_UNARY(tan, tan_op)
+INSTANTIATE_UNARY(asin, asin_op)
+INSTANTIATE_UNARY(acos, acos_op)
+INSTANTIATE_UNARY(atan, atan_op)
+INSTANTIATE_UNARY(sinh, sinh_op)
+INSTANTIATE_UNARY(cosh, cosh_op)
+INSTANTIATE_UNARY(tanh, tanh_op)
+INSTANTIATE_UNARY(asinh, asinh_op)
+INSTANTIATE_UNARY(acosh, acosh_op)
+INSTANTIATE_UNARY(atanh, atanh_op)
+INSTANTIATE_UNARY(sigmoid, sigmoid_op)
+INSTANTIATE_UNARY(gelu, gelu_op)
+INSTANTIATE_UNARY(silu, silu_op)
@@ -0,0 +1,229 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// lazy mode runs a whole chain of elementwise ops as one kernel. the chain is
+// a register program built by the Fuser (fusion.h), every thread computes
+// one output element and keeps the intermediates in registers.
+//
+// metadata: [N, rank, n_inputs, n_code, dims, output_strides,
+//            input_strides (n_inputs * rank)]
+// inputs are broadcast to dims (stride 0), the output is contiguous
+
+// keep in sync with FusedOp in fusion.h
+enum FusedOp : int {
+  LOAD,
+  NEG,
+  SQRT,
+  EXP,
+  LOG,
+  LOG10,
+  LOG2,
+  SIN,
+  COS,
+  TAN,
+  ASIN,
+  ACOS,
+  ATAN,
+  SINH,
+  COSH,
+  TANH,
+  ASINH,
+  ACOSH,
+  ATANH,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  ATAN2,
+  LOGICAL_E,
+  LOGICAL_NE,
+  LOGICAL_GT,
+  LOGICAL_GTE,
+  LOGICAL_LT,
+  LOGICAL_LTE,
+  ADD_SCALAR,
+  SUB_SCALAR,
+  RSUB_SCALAR,
+  MUL_SCALAR,
+  DIV_SCALAR,
+  RDIV_SCALAR,
+  POW_SCALAR,
+  POW_INT,
+  CONST,
+};
+
+struct FusedInstruction {
+  int op;
+  int a;
+  int b;
+  float scalar;
+};
+
+constant int MAX_INPUTS = 8;
+constant int MAX_INSTRUCTIONS = 32;
+
+inline float pow_int(float x, int n) {
+  float base = n < 0 ? 1.0f / x : x;
+  float result = 1.0f;
+  for (n = abs(n); n > 0; n >>= 1) {
+    if (n & 1)
+      result *= base;
+    base *= base;
+  }
+  return result;
+}
+
+inline float apply(FusedInstruction ins, float a, float b) {
+  switch (ins.op) {
+  case NEG:
+    return -a;
+  case SQRT:
+    return sqrt(a);
+  case EXP:
+    return exp(a);
+  case LOG:
+    return log(a);
+  case LOG10:
+    return log10(a);
+  case LOG2:
+    return log2(a);
+  case SIN:
+    return sin(a);
+  case COS:
+    return cos(a);
+  case TAN:
+    return tan(a);
+  case ASIN:
+    return asin(a);
+  case ACOS:
+    return acos(a);
+  case ATAN:
+    return atan(a);
+  case SINH:
+    return sinh(a);
+  case COSH:
+    return cosh(a);
+  case TANH:
+    return tanh(a);
+  case ASINH:
+    return asinh(a);
+  case ACOSH:
+    return acosh(a);
+  case ATANH:
+    return atanh(a);
+  case ADD:
+    return a + b;
+  case SUB:
+    return a - b;
+  case MUL:
+    return a * b;
+  case DIV:
+    return a / b;
+  case ATAN2:
+    return atan2(b, a);
+  case LOGICAL_E:
+    return fabs(a - b) < 1e-5 || (a == INFINITY && b == INFINITY);
+  case LOGICAL_NE:
+    return fabs(a - b) > 1e-5 ? 1.0 : 0.0;
+  case LOGICAL_GT:
+    return a > b;
+  case LOGICAL_GTE:
+    return a >= b;
+  case LOGICAL_LT:
+    return a < b;
+  case LOGICAL_LTE:
+    return a <= b;
+  case ADD_SCALAR:
+    return a + ins.scalar;
+  case SUB_SCALAR:
+    return a - ins.scalar;
+  case RSUB_SCALAR:
+    return ins.scalar - a;
+  case MUL_SCALAR:
+    return a * ins.scalar;
+  case DIV_SCALAR:
+    return a / ins.scalar;
+  case RDIV_SCALAR:
+    return ins.scalar / a;
+  case POW_SCALAR:
+    return pow(a, ins.scalar);
+  case POW_INT:
+    return pow_int(a, (int)ins.scalar);
+  default:
+    return 0.0f;
+  }
+}
+
+kernel void __fused_elementwise__(device const float *in0 [[buffer(0)]],
+                                  device const float *in1 [[buffer(1)]],
+                                  device const float *in2 [[buffer(2)]],
+                                  device const float *in3 [[buffer(3)]],
+                                  device const float *in4 [[buffer(4)]],
+                                  device const float *in5 [[buffer(5)]],
+                                  device const float *in6 [[buffer(6)]],
+                                  device const float *in7 [[buffer(7)]],
+                                  device float *output [[buffer(8)]],
+                                  constant int *metadata [[buffer(9)]],
+                                  constant FusedInstruction *code
+                                  [[buffer(10)]],
+                                  uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  if ((int)tid >= N)
+    return;
+  int rank = metadata[1];
+  int n_inputs = metadata[2];
+  int n_code = metadata[3];
+  constant int *dims = metadata + 4;
+  constant int *output_strides = dims + rank;
+  constant int *input_strides = output_strides + rank;
+
+  // the coordinates are decoded once and shared by every input
+  int index[MAX_INPUTS] = {0};
+  int o = 0;
+  uint rest = tid;
+  for (int d = rank - 1; d >= 0; --d) {
+    int coord = rest % dims[d];
+    rest /= dims[d];
+    o += coord * output_strides[d];
+    for (int i = 0; i < n_inputs; i++)
+      index[i] += coord * input_strides[i * rank + d];
+  }
+
+  float r[MAX_INSTRUCTIONS];
+  for (int pc = 0; pc < n_code; pc++) {
+    FusedInstruction ins = code[pc];
+    if (ins.op == LOAD) {
+      switch (ins.a) {
+      case 0:
+        r[pc] = in0[index[0]];
+        break;
+      case 1:
+        r[pc] = in1[index[1]];
+        break;
+      case 2:
+        r[pc] = in2[index[2]];
+        break;
+      case 3:
+        r[pc] = in3[index[3]];
+        break;
+      case 4:
+        r[pc] = in4[index[4]];
+        break;
+      case 5:
+        r[pc] = in5[index[5]];
+        break;
+      case 6:
+        r[pc] = in6[index[6]];
+        break;
+      default:
+        r[pc] = in7[index[7]];
+        break;
+      }
+    } else if (ins.op == CONST) {
+      r[pc] = ins.scalar;
+    } else {
+      r[pc] = apply(ins, r[ins.a], r[ins.b]);
+    }
+  }
+  output[o] = r[n_code - 1];
+}
@@ -1,23 +1,30 @@
+#include "./broadcast.metal"
 #include <metal_atomic>
 #include <metal_stdlib>
 using namespace metal;
 
+// nullary metadata: [N, rank, shape, stride]
+inline int nullary_index(uint tid, constant int *metadata) {
+  int rank = metadata[1];
+  return compute_strided_index(tid, metadata + 2, metadata + 2 + rank, rank);
+}
+
 kernel void __ones__(device float *A [[buffer(0)]],
                      constant int *metadata [[buffer(1)]],
                      uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  A[tid] = 1;
+  A[nullary_index(tid, metadata)] = 1;
 }
 
-kernel void __full__(constant float *input [[buffer(0)]],
-                     device float *output [[buffer(1)]],
-                     constant int *metadata [[buffer(2)]],
+// the fill value is passed by value
+kernel void __full__(device float *A [[buffer(0)]],
+                     constant int *metadata [[buffer(1)]],
+                     constant float &value [[buffer(2)]],
                      uint tid [[thread_position_in_grid]]) {
-
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = input[0];
+  A[nullary_index(tid, metadata)] = value;
 }
 
 kernel void __eye__(device float *A [[buffer(0)]],
@@ -29,7 +36,7 @@ kernel void __eye__(device float *A [[buffer(0)]],
   uint row = tid / n;
   uint col = tid % n;
   if (row < n && col < n) {
-    A[tid] = (row == col) ? 1.0f : 0.0f;
+    A[nullary_index(tid, metadata)] = (row == col) ? 1.0f : 0.0f;
   }
 }
 kernel void __zeros__(device float *A [[buffer(0)]],
@@ -37,5 +44,5 @@ kernel void __zeros__(device float *A [[buffer(0)]],
                       uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  A[tid] = 0;
+  A[nullary_index(tid, metadata)] = 0;
 }
@@ -0,0 +1,117 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// layout kernels only move bits around, so they are instantiated per element
+// width (b1, b2, b4, b8) instead of per dtype
+
+// gathers a strided tensor into contiguous memory.
+// metadata: [N, rank, dims, strides] with dims already coalesced on the host
+template <typename T>
+kernel void __strided_copy__(device const T *input [[buffer(0)]],
+                             device T *output [[buffer(1)]],
+                             constant int *metadata [[buffer(2)]],
+                             uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  if ((int)tid >= N)
+    return;
+  int rank = metadata[1];
+  constant int *dims = metadata + 2;
+  constant int *strides = dims + rank;
+
+  int remaining = (int)tid;
+  int index = 0;
+  for (int i = rank - 1; i >= 0; i--) {
+    index += (remaining % dims[i]) * strides[i];
+    remaining /= dims[i];
+  }
+  output[tid] = input[index];
+}
+
+// scatters a strided tensor into a strided output of the same shape.
+// metadata: [N, rank, dims, input strides, output strides] with dims already
+// coalesced on the host
+template <typename T>
+kernel void __strided_assign__(device const T *input [[buffer(0)]],
+                               device T *output [[buffer(1)]],
+                               constant int *metadata [[buffer(2)]],
+                               uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  if ((int)tid >= N)
+    return;
+  int rank = metadata[1];
+  constant int *dims = metadata + 2;
+  constant int *input_strides = dims + rank;
+  constant int *output_strides = input_strides + rank;
+
+  int remaining = (int)tid;
+  int from = 0;
+  int to = 0;
+  for (int i = rank - 1; i >= 0; i--) {
+    int index = remaining % dims[i];
+    from += index * input_strides[i];
+    to += index * output_strides[i];
+    remaining /= dims[i];
+  }
+  output[to] = input[from];
+}
+
+constant int TILE = 32;
+constant int TILE_ROWS = 8;
+
+// output[r][c] = input[c][r] for a contiguous (cols x rows) input.
+// every threadgroup of 32x8 threads moves one 32x32 tile through threadgroup
+// memory so that both the reads and the writes are coalesced, the extra
+// column avoids bank conflicts on the transposed read.
+// metadata: [rows, cols] of the output
+template <typename T>
+kernel void __transpose_2d__(device const T *input [[buffer(0)]],
+                             device T *output [[buffer(1)]],
+                             constant int *metadata [[buffer(2)]],
+                             uint group [[threadgroup_position_in_grid]],
+                             uint lid [[thread_position_in_threadgroup]]) {
+  threadgroup T tile[TILE][TILE + 1];
+  int rows = metadata[0];
+  int cols = metadata[1];
+  int tiles_c = (cols + TILE - 1) / TILE;
+  int tile_r = (int)group / tiles_c;
+  int tile_c = (int)group % tiles_c;
+  int lx = (int)lid % TILE;
+  int ly = (int)lid / TILE;
+
+  for (int j = 0; j < TILE; j += TILE_ROWS) {
+    int c = tile_c * TILE + ly + j;
+    int r = tile_r * TILE + lx;
+    if (c < cols && r < rows)
+      tile[ly + j][lx] = input[c * rows + r];
+  }
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  for (int j = 0; j < TILE; j += TILE_ROWS) {
+    int r = tile_r * TILE + ly + j;
+    int c = tile_c * TILE + lx;
+    if (r < rows && c < cols)
+      output[r * cols + c] = tile[lx][ly + j];
+  }
+}
+
+#define INSTANTIATE_LAYOUT(CODE, TYPE)                                         \
+  template [[host_name("__strided_copy_" #CODE "__")]] kernel void             \
+  __strided_copy__<TYPE>(device const TYPE *input [[buffer(0)]],              \
+                         device TYPE *output [[buffer(1)]],                    \
+                         constant int *metadata [[buffer(2)]],                 \
+                         uint tid [[thread_position_in_grid]]);                \
+  template [[host_name("__strided_assign_" #CODE "__")]] kernel void           \
+  __strided_assign__<TYPE>(device const TYPE *input [[buffer(0)]],            \
+                           device TYPE *output [[buffer(1)]],                  \
+                           constant int *metadata [[buffer(2)]],               \
+                           uint tid [[thread_position_in_grid]]);              \
+  template [[host_name("__transpose_2d_" #CODE "__")]] kernel void             \
+  __transpose_2d__<TYPE>(device const TYPE *input [[buffer(0)]],               \
+                         device TYPE *output [[buffer(1)]],                    \
+                         constant int *metadata [[buffer(2)]],                 \
+                         uint group [[threadgroup_position_in_grid]],          \
+                         uint lid [[thread_position_in_threadgroup]]);
+
+INSTANTIATE_LAYOUT(b1, uchar)
+INSTANTIATE_LAYOUT(b2, ushort)
+INSTANTIATE_LAYOUT(b4, uint)
+INSTANTIATE_LAYOUT(b8, ulong)
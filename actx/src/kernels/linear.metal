@@ -0,0 +1,196 @@
+#include "./activation_functions.metal"
+#include <metal_stdlib>
+using namespace metal;
+
+// fused linear layer. every kernel is the same tiled GEMM,
+// C[r, c] = sum_j A(r, j) * B(c, j), where A and B are functors that load
+// an operand element, so a transposed operand or the activation derivative
+// of a gradient costs nothing more than the load. a threadgroup of 8x8
+// threads computes a 32x32 tile of C, every thread a 4x4 block kept in
+// registers, the operands are staged through threadgroup memory in steps of
+// 16 along j. the epilogue stores C through a functor as well, the forward
+// pass adds the bias and applies the activation there.
+//
+// matrices are dense, x: [M, K], weight: [N, K], result: [M, N]
+// metadata: [M, N, K, activation, has_bias, save_pre]
+
+constant int TILE = 32;
+constant int DEPTH = 16;
+constant int MICRO = 4;
+constant int THREADS = 8;
+// padded rows, threads reading a column of a tile hit different banks
+constant int PITCH = DEPTH + 1;
+
+// element (r, j) of a row major matrix with `cols` columns
+struct Rows {
+  device const float *data;
+  int cols;
+  float operator()(int r, int j) const { return data[r * cols + j]; }
+};
+
+// element (c, j) of the transpose of a row major matrix with `cols` columns
+struct Columns {
+  device const float *data;
+  int cols;
+  float operator()(int c, int j) const { return data[j * cols + c]; }
+};
+
+// grad * activation'(saved), read by rows or by columns of the [M, N] grad
+struct GradRows {
+  device const float *grad;
+  device const float *saved;
+  int cols;
+  int activation;
+  float operator()(int r, int j) const {
+    int i = r * cols + j;
+    return grad[i] * derivative(activation, saved[i]);
+  }
+};
+
+struct GradColumns {
+  device const float *grad;
+  device const float *saved;
+  int cols;
+  int activation;
+  float operator()(int c, int j) const {
+    int i = j * cols + c;
+    return grad[i] * derivative(activation, saved[i]);
+  }
+};
+
+struct Store {
+  device float *data;
+  int cols;
+  void operator()(int r, int c, float value) const {
+    data[r * cols + c] = value;
+  }
+};
+
+struct LinearEpilogue {
+  device float *result;
+  device float *pre;
+  device const float *bias;
+  int cols;
+  int activation;
+  bool has_bias;
+  bool save_pre;
+  void operator()(int r, int c, float value) const {
+    float z = has_bias ? value + bias[c] : value;
+    if (save_pre)
+      pre[r * cols + c] = z;
+    result[r * cols + c] = activate(activation, z);
+  }
+};
+
+template <typename A, typename B, typename Epilogue>
+inline void gemm(A load_a, B load_b, Epilogue store, int rows, int cols,
+                 int depth, uint2 group, uint2 lane,
+                 threadgroup float *a_tile, threadgroup float *b_tile) {
+  int row0 = group.y * TILE;
+  int col0 = group.x * TILE;
+  int id = lane.y * THREADS + lane.x;
+  float acc[MICRO][MICRO] = {{0.0f}};
+
+  for (int j0 = 0; j0 < depth; j0 += DEPTH) {
+    // 64 threads stage 32x16 elements of each operand, 8 each
+    for (int e = id; e < TILE * DEPTH; e += THREADS * THREADS) {
+      int r = e / DEPTH;
+      int j = e % DEPTH;
+      bool inside = j0 + j < depth;
+      a_tile[r * PITCH + j] =
+          inside && row0 + r < rows ? load_a(row0 + r, j0 + j) : 0.0f;
+      b_tile[r * PITCH + j] =
+          inside && col0 + r < cols ? load_b(col0 + r, j0 + j) : 0.0f;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    for (int j = 0; j < DEPTH; j++) {
+      float a[MICRO];
+      float b[MICRO];
+      for (int i = 0; i < MICRO; i++) {
+        a[i] = a_tile[(lane.y * MICRO + i) * PITCH + j];
+        b[i] = b_tile[(lane.x * MICRO + i) * PITCH + j];
+      }
+      for (int i = 0; i < MICRO; i++)
+        for (int k = 0; k < MICRO; k++)
+          acc[i][k] += a[i] * b[k];
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+
+  for (int i = 0; i < MICRO; i++) {
+    int r = row0 + lane.y * MICRO + i;
+    for (int k = 0; k < MICRO; k++) {
+      int c = col0 + lane.x * MICRO + k;
+      if (r < rows && c < cols)
+        store(r, c, acc[i][k]);
+    }
+  }
+}
+
+// result = activation(x @ weight^T + bias)
+kernel void __linear__(device const float *x [[buffer(0)]],
+                       device const float *weight [[buffer(1)]],
+                       device const float *bias [[buffer(2)]],
+                       device float *pre [[buffer(3)]],
+                       device float *result [[buffer(4)]],
+                       constant int *metadata [[buffer(5)]],
+                       uint2 group [[threadgroup_position_in_grid]],
+                       uint2 lane [[thread_position_in_threadgroup]]) {
+  threadgroup float a_tile[TILE * PITCH];
+  threadgroup float b_tile[TILE * PITCH];
+  int M = metadata[0], N = metadata[1], K = metadata[2];
+  LinearEpilogue epilogue = {result,      pre,
+                             bias,        N,
+                             metadata[3], metadata[4] != 0,
+                             metadata[5] != 0};
+  gemm(Rows{x, K}, Rows{weight, K}, epilogue, M, N, K, group, lane, a_tile,
+       b_tile);
+}
+
+// dx[M, K] = (grad * activation') @ weight
+kernel void __linear_grad_input__(device const float *grad [[buffer(0)]],
+                                  device const float *saved [[buffer(1)]],
+                                  device const float *weight [[buffer(2)]],
+                                  device float *result [[buffer(3)]],
+                                  constant int *metadata [[buffer(4)]],
+                                  uint2 group [[threadgroup_position_in_grid]],
+                                  uint2 lane
+                                  [[thread_position_in_threadgroup]]) {
+  threadgroup float a_tile[TILE * PITCH];
+  threadgroup float b_tile[TILE * PITCH];
+  int M = metadata[0], N = metadata[1], K = metadata[2];
+  gemm(GradRows{grad, saved, N, metadata[3]}, Columns{weight, K},
+       Store{result, K}, M, K, N, group, lane, a_tile, b_tile);
+}
+
+// dweight[N, K] = (grad * activation')^T @ x
+kernel void __linear_grad_weight__(device const float *grad [[buffer(0)]],
+                                   device const float *saved [[buffer(1)]],
+                                   device const float *x [[buffer(2)]],
+                                   device float *result [[buffer(3)]],
+                                   constant int *metadata [[buffer(4)]],
+                                   uint2 group [[threadgroup_position_in_grid]],
+                                   uint2 lane
+                                   [[thread_position_in_threadgroup]]) {
+  threadgroup float a_tile[TILE * PITCH];
+  threadgroup float b_tile[TILE * PITCH];
+  int M = metadata[0], N = metadata[1], K = metadata[2];
+  gemm(GradColumns{grad, saved, N, metadata[3]}, Columns{x, K},
+       Store{result, K}, N, K, M, group, lane, a_tile, b_tile);
+}
+
+// dbias[N] = sum over the rows of grad * activation', a thread per column
+kernel void __linear_grad_bias__(device const float *grad [[buffer(0)]],
+                                 device const float *saved [[buffer(1)]],
+                                 device float *result [[buffer(2)]],
+                                 constant int *metadata [[buffer(3)]],
+                                 uint tid [[thread_position_in_grid]]) {
+  int M = metadata[0], N = metadata[1];
+  if ((int)tid >= N)
+    return;
+  GradColumns load = {grad, saved, N, metadata[3]};
+  float sum = 0.0f;
+  for (int r = 0; r < M; r++)
+    sum += load(tid, r);
+  result[tid] = sum;
+}
@@ -2,23 +2,15 @@
 #include <metal_stdlib>
 using namespace metal;
 
-kernel void __pow__(device float *A [[buffer(0)]],
-                    device float *B [[buffer(1)]],
-                    device float *C [[buffer(2)]],
-                    constant int *metadata [[buffer(3)]],
-                    uint tid [[thread_position_in_grid]]) {
-  if ((int)tid >= metadata[0])
-    return;
-  C[tid] = pow(A[tid], B[0]);
-}
-
 kernel void __exp__(device float *input [[buffer(0)]],
                     device float *output [[buffer(1)]],
                     constant int *metadata [[buffer(2)]],
                     uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = exp(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = exp(input[i]);
 }
 
 kernel void __log__(device float *input [[buffer(0)]],
@@ -27,7 +19,9 @@ kernel void __log__(device float *input [[buffer(0)]],
                     uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = log(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = log(input[i]);
 }
 
 kernel void __log10__(device float *input [[buffer(0)]],
@@ -36,7 +30,9 @@ kernel void __log10__(device float *input [[buffer(0)]],
                       uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = log10(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = log10(input[i]);
 }
 
 kernel void __log2__(device float *input [[buffer(0)]],
@@ -45,7 +41,9 @@ kernel void __log2__(device float *input [[buffer(0)]],
                      uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = log2(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = log2(input[i]);
 }
 kernel void __sqrt__(device float *input [[buffer(0)]],
                      device float *output [[buffer(1)]],
@@ -53,5 +51,7 @@ kernel void __sqrt__(device float *input [[buffer(0)]],
                      uint tid [[thread_position_in_grid]]) {
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = sqrt(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = sqrt(input[i]);
 }
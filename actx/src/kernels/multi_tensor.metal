@@ -0,0 +1,149 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// one launch over up to MAX_TENSORS tensors per list (multi_tensor.h). every
+// threadgroup runs one chunk of one tensor, its threads stride over the
+// chunk. slot t of list k is bound to buffer k * MAX_TENSORS + t. ops with
+// an output of their own (SUM_SQUARES, CLIP) find it in y0.
+//
+// metadata: [op, chunk_size, first_chunk, sizes (MAX_TENSORS),
+//            chunks (tensor, start)], first_chunk counts the chunks of the
+//            earlier launches
+
+// keep in sync with MultiTensorOp in multi_tensor.h
+enum MultiTensorOp : int {
+  SCALE,
+  FILL,
+  AXPY,
+  SGD,
+  ADAM,
+  SUM_SQUARES,
+  CLIP,
+};
+
+constant int MAX_TENSORS = 6;
+constant int MAX_SIMDGROUPS = 32;
+
+// the whole update of one element in registers, every operand is read and
+// written once
+inline void sgd(device float *param, device float *grad, device float *buffer,
+                constant float *s, int i) {
+  float lr = s[0], momentum = s[1], weight_decay = s[2];
+  float g = grad[i] + weight_decay * param[i];
+  if (momentum != 0.0f) {
+    float b = momentum * buffer[i] + g;
+    buffer[i] = b;
+    g = s[3] != 0.0f ? g + momentum * b : b;
+  }
+  param[i] -= lr * g;
+}
+
+inline void adam(device float *param, device float *grad,
+                 device float *exp_avg, device float *exp_avg_sq,
+                 constant float *s, int i) {
+  float lr = s[0], beta1 = s[1], beta2 = s[2], eps = s[3];
+  float weight_decay = s[4];
+  float p = param[i];
+  float g = grad[i];
+  if (s[7] != 0.0f) {
+    p *= 1.0f - lr * weight_decay;
+  } else {
+    g += weight_decay * p;
+  }
+  float m = beta1 * exp_avg[i] + (1.0f - beta1) * g;
+  float v = beta2 * exp_avg_sq[i] + (1.0f - beta2) * g * g;
+  exp_avg[i] = m;
+  exp_avg_sq[i] = v;
+  param[i] = p - lr * (m / s[5]) / (sqrt(v / s[6]) + eps);
+}
+
+kernel void __multi_tensor_apply__(
+    device float *x0 [[buffer(0)]], device float *x1 [[buffer(1)]],
+    device float *x2 [[buffer(2)]], device float *x3 [[buffer(3)]],
+    device float *x4 [[buffer(4)]], device float *x5 [[buffer(5)]],
+    device float *y0 [[buffer(6)]], device float *y1 [[buffer(7)]],
+    device float *y2 [[buffer(8)]], device float *y3 [[buffer(9)]],
+    device float *y4 [[buffer(10)]], device float *y5 [[buffer(11)]],
+    device float *z0 [[buffer(12)]], device float *z1 [[buffer(13)]],
+    device float *z2 [[buffer(14)]], device float *z3 [[buffer(15)]],
+    device float *z4 [[buffer(16)]], device float *z5 [[buffer(17)]],
+    device float *w0 [[buffer(18)]], device float *w1 [[buffer(19)]],
+    device float *w2 [[buffer(20)]], device float *w3 [[buffer(21)]],
+    device float *w4 [[buffer(22)]], device float *w5 [[buffer(23)]],
+    constant int *metadata [[buffer(24)]],
+    constant float *scalars [[buffer(25)]],
+    uint group [[threadgroup_position_in_grid]],
+    uint lane [[thread_position_in_threadgroup]],
+    uint width [[threads_per_threadgroup]],
+    uint simd_lane [[thread_index_in_simdgroup]],
+    uint simd_group [[simdgroup_index_in_threadgroup]],
+    uint simd_width [[threads_per_simdgroup]]) {
+  threadgroup float simd_sums[MAX_SIMDGROUPS];
+  int op = metadata[0];
+  int chunk_size = metadata[1];
+  int first_chunk = metadata[2];
+  constant int *sizes = metadata + 3;
+  constant int *chunks = sizes + MAX_TENSORS;
+  int slot = chunks[2 * group];
+  int start = chunks[2 * group + 1];
+  int end = min(start + chunk_size, sizes[slot]);
+
+  device float *xs[MAX_TENSORS] = {x0, x1, x2, x3, x4, x5};
+  device float *ys[MAX_TENSORS] = {y0, y1, y2, y3, y4, y5};
+  device float *zs[MAX_TENSORS] = {z0, z1, z2, z3, z4, z5};
+  device float *ws[MAX_TENSORS] = {w0, w1, w2, w3, w4, w5};
+  device float *x = xs[slot];
+  device float *y = ys[slot];
+  device float *z = zs[slot];
+  device float *w = ws[slot];
+
+  // the norm is the same for every chunk, when it is small enough the
+  // tensors are left alone and not read at all
+  float clip = 1.0f;
+  if (op == CLIP) {
+    clip = scalars[0] / (y0[0] + scalars[1]);
+    if (clip >= 1.0f)
+      return;
+  }
+
+  float sum = 0.0f;
+  for (int i = start + (int)lane; i < end; i += width) {
+    switch (op) {
+    case SCALE:
+      x[i] *= scalars[0];
+      break;
+    case FILL:
+      x[i] = scalars[0];
+      break;
+    case AXPY:
+      x[i] += scalars[0] * y[i];
+      break;
+    case SGD:
+      sgd(x, y, z, scalars, i);
+      break;
+    case ADAM:
+      adam(x, y, z, w, scalars, i);
+      break;
+    case SUM_SQUARES:
+      sum += x[i] * x[i];
+      break;
+    case CLIP:
+      x[i] *= clip;
+      break;
+    }
+  }
+
+  // op is the same for the whole threadgroup, so are the barriers
+  if (op == SUM_SQUARES) {
+    sum = simd_sum(sum);
+    if (simd_lane == 0)
+      simd_sums[simd_group] = sum;
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+    if (lane == 0) {
+      float total = 0.0f;
+      for (uint s = 0; s < (width + simd_width - 1) / simd_width; s++)
+        total += simd_sums[s];
+      y0[first_chunk + group] = total;
+    }
+  }
+}
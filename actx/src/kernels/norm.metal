@@ -0,0 +1,241 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// batch norm and layer norm over x as a [rows, cols] matrix, cols is its
+// last dim. layer norm reduces every row, batch norm every column, a group
+// is the row or column that shares one mean and rstd. item i of group g is
+// x[g * group_stride + i * item_stride].
+//
+// the forward pass reads x twice: __norm_stats__ computes mean and variance
+// of a group in one pass with Welford's update, one threadgroup per group,
+// then __norm_apply__ normalizes and applies the affine transform. the
+// backward pass reduces the two sums dx needs per group, then computes dx
+// elementwise.
+
+// keep in sync with the modes in MPS::normalize
+enum NormMode : int { BATCH, UPDATE_RUNNING, FROM_RUNNING };
+
+constant int THREADS = 256;
+
+// count, mean and sum of squared deviations of a set of values
+struct Welford {
+  float n;
+  float mean;
+  float m2;
+};
+
+inline Welford push(Welford w, float value) {
+  w.n += 1.0f;
+  float delta = value - w.mean;
+  w.mean += delta / w.n;
+  w.m2 += delta * (value - w.mean);
+  return w;
+}
+
+// the statistics of the union of two sets (Chan et al.)
+inline Welford combine(Welford a, Welford b) {
+  float n = a.n + b.n;
+  if (n == 0.0f)
+    return a;
+  float delta = b.mean - a.mean;
+  float share = b.n / n;
+  return {n, a.mean + delta * share, a.m2 + b.m2 + delta * delta * a.n * share};
+}
+
+// metadata: [groups, count, group_stride, item_stride, mode]
+// scalars: [eps, momentum]
+kernel void __norm_stats__(device const float *x [[buffer(0)]],
+                           device float *mean [[buffer(1)]],
+                           device float *rstd [[buffer(2)]],
+                           device float *running_mean [[buffer(3)]],
+                           device float *running_var [[buffer(4)]],
+                           constant int *metadata [[buffer(5)]],
+                           constant float *scalars [[buffer(6)]],
+                           uint group [[threadgroup_position_in_grid]],
+                           uint lane [[thread_position_in_threadgroup]]) {
+  threadgroup float ns[THREADS];
+  threadgroup float means[THREADS];
+  threadgroup float m2s[THREADS];
+  int count = metadata[1];
+  int mode = metadata[4];
+  float eps = scalars[0], momentum = scalars[1];
+  if (mode == FROM_RUNNING) {
+    if (lane == 0) {
+      mean[group] = running_mean[group];
+      rstd[group] = rsqrt(running_var[group] + eps);
+    }
+    return;
+  }
+
+  device const float *items = x + group * metadata[2];
+  int item_stride = metadata[3];
+  Welford w = {0.0f, 0.0f, 0.0f};
+  for (int i = lane; i < count; i += THREADS)
+    w = push(w, items[i * item_stride]);
+  ns[lane] = w.n;
+  means[lane] = w.mean;
+  m2s[lane] = w.m2;
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  for (uint stride = THREADS / 2; stride > 0; stride /= 2) {
+    if (lane < stride) {
+      Welford other = {ns[lane + stride], means[lane + stride],
+                       m2s[lane + stride]};
+      w = combine(w, other);
+      ns[lane] = w.n;
+      means[lane] = w.mean;
+      m2s[lane] = w.m2;
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+
+  if (lane == 0) {
+    float var = w.m2 / w.n;
+    mean[group] = w.mean;
+    rstd[group] = rsqrt(var + eps);
+    if (mode == UPDATE_RUNNING) {
+      // the running variance is the unbiased estimate
+      float unbiased = w.n > 1.0f ? w.m2 / (w.n - 1.0f) : var;
+      running_mean[group] =
+          (1.0f - momentum) * running_mean[group] + momentum * w.mean;
+      running_var[group] =
+          (1.0f - momentum) * running_var[group] + momentum * unbiased;
+    }
+  }
+}
+
+// metadata: [size, cols, per_row, has_weight, has_bias]
+kernel void __norm_apply__(device const float *x [[buffer(0)]],
+                           device const float *mean [[buffer(1)]],
+                           device const float *rstd [[buffer(2)]],
+                           device const float *weight [[buffer(3)]],
+                           device const float *bias [[buffer(4)]],
+                           device float *result [[buffer(5)]],
+                           constant int *metadata [[buffer(6)]],
+                           uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int c = tid % metadata[1];
+  int g = metadata[2] ? tid / metadata[1] : c;
+  float y = (x[tid] - mean[g]) * rstd[g];
+  if (metadata[3])
+    y *= weight[c];
+  if (metadata[4])
+    y += bias[c];
+  result[tid] = y;
+}
+
+// the two sums of dx per group, sum(dxhat) and sum(dxhat * xhat) with
+// dxhat = grad * weight. a column shares its weight, so batch norm sums
+// grad and grad * xhat, which are the bias and weight gradients, and scales
+// them by the weight afterwards.
+//
+// metadata: [groups, count, group_stride, item_stride, cols, per_row,
+//            has_weight, write_dweight, write_dbias]
+kernel void __norm_backward_stats__(
+    device const float *grad [[buffer(0)]],
+    device const float *x [[buffer(1)]],
+    device const float *mean [[buffer(2)]],
+    device const float *rstd [[buffer(3)]],
+    device const float *weight [[buffer(4)]],
+    device float *sums [[buffer(5)]], device float *dweight [[buffer(6)]],
+    device float *dbias [[buffer(7)]], constant int *metadata [[buffer(8)]],
+    uint group [[threadgroup_position_in_grid]],
+    uint lane [[thread_position_in_threadgroup]]) {
+  threadgroup float s1s[THREADS];
+  threadgroup float s2s[THREADS];
+  int count = metadata[1];
+  int group_stride = metadata[2], item_stride = metadata[3];
+  int cols = metadata[4];
+  bool per_row = metadata[5], has_weight = metadata[6];
+  float m = mean[group], r = rstd[group];
+
+  float s1 = 0.0f, s2 = 0.0f;
+  for (int i = lane; i < count; i += THREADS) {
+    int index = group * group_stride + i * item_stride;
+    float dxhat = grad[index];
+    if (per_row && has_weight)
+      dxhat *= weight[index % cols];
+    s1 += dxhat;
+    s2 += dxhat * (x[index] - m) * r;
+  }
+  s1s[lane] = s1;
+  s2s[lane] = s2;
+  threadgroup_barrier(mem_flags::mem_threadgroup);
+  for (uint stride = THREADS / 2; stride > 0; stride /= 2) {
+    if (lane < stride) {
+      s1s[lane] += s1s[lane + stride];
+      s2s[lane] += s2s[lane + stride];
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+  }
+
+  if (lane == 0) {
+    s1 = s1s[0];
+    s2 = s2s[0];
+    if (!per_row) {
+      if (metadata[7])
+        dweight[group] = s2;
+      if (metadata[8])
+        dbias[group] = s1;
+      if (has_weight) {
+        s1 *= weight[group];
+        s2 *= weight[group];
+      }
+    }
+    sums[2 * group] = s1;
+    sums[2 * group + 1] = s2;
+  }
+}
+
+// dx = rstd * (dxhat - (sum(dxhat) + xhat * sum(dxhat * xhat)) / count),
+// with the running statistics the mean and rstd are constants and
+// dx = rstd * dxhat
+//
+// metadata: [size, cols, per_row, has_weight, count, training]
+kernel void __norm_backward_input__(device const float *grad [[buffer(0)]],
+                                    device const float *x [[buffer(1)]],
+                                    device const float *mean [[buffer(2)]],
+                                    device const float *rstd [[buffer(3)]],
+                                    device const float *weight [[buffer(4)]],
+                                    device const float *sums [[buffer(5)]],
+                                    device float *result [[buffer(6)]],
+                                    constant int *metadata [[buffer(7)]],
+                                    uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int c = tid % metadata[1];
+  int g = metadata[2] ? tid / metadata[1] : c;
+  float dxhat = metadata[3] ? grad[tid] * weight[c] : grad[tid];
+  if (metadata[5]) {
+    float xhat = (x[tid] - mean[g]) * rstd[g];
+    dxhat -= (sums[2 * g] + xhat * sums[2 * g + 1]) / metadata[4];
+  }
+  result[tid] = rstd[g] * dxhat;
+}
+
+// layer norm weight and bias gradients, a thread per column sums
+// grad * xhat and grad over the rows
+//
+// metadata: [rows, cols, has_weight, has_bias]
+kernel void __norm_backward_affine__(device const float *grad [[buffer(0)]],
+                                     device const float *x [[buffer(1)]],
+                                     device const float *mean [[buffer(2)]],
+                                     device const float *rstd [[buffer(3)]],
+                                     device float *dweight [[buffer(4)]],
+                                     device float *dbias [[buffer(5)]],
+                                     constant int *metadata [[buffer(6)]],
+                                     uint tid [[thread_position_in_grid]]) {
+  int rows = metadata[0], cols = metadata[1];
+  if ((int)tid >= cols)
+    return;
+  float dw = 0.0f, db = 0.0f;
+  for (int r = 0; r < rows; r++) {
+    int index = r * cols + tid;
+    dw += grad[index] * (x[index] - mean[r]) * rstd[r];
+    db += grad[index];
+  }
+  if (metadata[2])
+    dweight[tid] = dw;
+  if (metadata[3])
+    dbias[tid] = db;
+}
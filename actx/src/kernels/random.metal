@@ -0,0 +1,36 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// counter based random numbers, see random.h. number n of the stream `seed`
+// is a hash of the two, so any thread draws any number without state
+
+// the output permutation of PCG as a 32-bit integer hash
+inline uint hash(uint x) {
+  uint state = x * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+// uniform in [0, 1), 24 random bits
+inline float uniform(uint seed, ulong counter) {
+  uint key = hash(seed ^ hash(uint(counter >> 32)));
+  return (hash(uint(counter) ^ key) >> 8) * (1.0f / 16777216.0f);
+}
+
+// output = input * scale where number `offset + i` of the stream is at least
+// p, 0 elsewhere. the backward pass runs it on the gradient with the same
+// state, the mask is drawn again instead of kept. operands are dense
+//
+// metadata: [size, seed, offset (low word), offset (high word)]
+// scalars: [p, scale]
+kernel void __dropout__(device const float *input [[buffer(0)]],
+                        device float *output [[buffer(1)]],
+                        constant int *metadata [[buffer(2)]],
+                        constant float *scalars [[buffer(3)]],
+                        uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  ulong offset = (ulong(uint(metadata[3])) << 32) | uint(metadata[2]);
+  bool keep = uniform(uint(metadata[1]), offset + tid) >= scalars[0];
+  output[tid] = keep ? input[tid] * scalars[1] : 0.0f;
+}
@@ -0,0 +1,40 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// reduces a (possibly strided) input onto a shape it was broadcast from.
+// metadata: [N, rank, count, input_dims, input_stride, output_dims] where the
+// output dims are left padded with 1s up to the input rank and count is the
+// number of input elements folded into every output element
+kernel void __sum_to__(device const float *input [[buffer(0)]],
+                       device float *output [[buffer(1)]],
+                       constant int *metadata [[buffer(2)]],
+                       uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  if ((int)tid >= N)
+    return;
+  int rank = metadata[1];
+  int count = metadata[2];
+  constant int *input_dims = metadata + 3;
+  constant int *input_stride = input_dims + rank;
+  constant int *output_dims = input_stride + rank;
+
+  float sum = 0.0f;
+  for (int k = 0; k < count; k++) {
+    int kept = (int)tid;
+    int reduced = k;
+    int index = 0;
+    for (int i = rank - 1; i >= 0; i--) {
+      int coord;
+      if (output_dims[i] == input_dims[i]) {
+        coord = kept % output_dims[i];
+        kept /= output_dims[i];
+      } else {
+        coord = reduced % input_dims[i];
+        reduced /= input_dims[i];
+      }
+      index += coord * input_stride[i];
+    }
+    sum += input[index];
+  }
+  output[tid] = sum;
+}
@@ -0,0 +1,107 @@
+#include "./broadcast.metal"
+#include <metal_stdlib>
+using namespace metal;
+
+// ops between a tensor and a scalar that is passed by value with setBytes,
+// so no 1-element tensor has to be allocated and read per element.
+//
+// contiguous: metadata = [N], every thread handles 4 elements
+// strided:    metadata uses the unary layout from broadcast.metal
+
+struct add_op {
+  static float apply(float x, float s) { return x + s; }
+};
+struct sub_op {
+  static float apply(float x, float s) { return x - s; }
+};
+struct rsub_op {
+  static float apply(float x, float s) { return s - x; }
+};
+struct mul_op {
+  static float apply(float x, float s) { return x * s; }
+};
+struct div_op {
+  static float apply(float x, float s) { return x / s; }
+};
+struct rdiv_op {
+  static float apply(float x, float s) { return s / x; }
+};
+struct pow_op {
+  static float apply(float x, float s) { return pow(x, s); }
+};
+// pow() is undefined for negative bases, the common exponents avoid it
+struct pow_square_op {
+  static float apply(float x, float s) { return x * x; }
+};
+struct pow_sqrt_op {
+  static float apply(float x, float s) { return sqrt(x); }
+};
+struct pow_reciprocal_op {
+  static float apply(float x, float s) { return 1.0f / x; }
+};
+// integral exponents by repeated squaring
+struct pow_int_op {
+  static float apply(float x, float s) {
+    int n = (int)s;
+    float base = n < 0 ? 1.0f / x : x;
+    float result = 1.0f;
+    for (n = abs(n); n > 0; n >>= 1) {
+      if (n & 1)
+        result *= base;
+      base *= base;
+    }
+    return result;
+  }
+};
+
+template <typename Op>
+kernel void __scalar_contiguous__(device const float *input [[buffer(0)]],
+                                  device float *output [[buffer(1)]],
+                                  constant int *metadata [[buffer(2)]],
+                                  constant float &scalar [[buffer(3)]],
+                                  uint tid [[thread_position_in_grid]]) {
+  int N = metadata[0];
+  int start = (int)tid * 4;
+  int end = min(start + 4, N);
+  for (int i = start; i < end; i++)
+    output[i] = Op::apply(input[i], scalar);
+}
+
+template <typename Op>
+kernel void __scalar_strided__(device const float *input [[buffer(0)]],
+                               device float *output [[buffer(1)]],
+                               constant int *metadata [[buffer(2)]],
+                               constant float &scalar [[buffer(3)]],
+                               uint tid [[thread_position_in_grid]]) {
+  if ((int)tid >= metadata[0])
+    return;
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = Op::apply(input[i], scalar);
+}
+
+#define INSTANTIATE_SCALAR(NAME, OP)                                           \
+  template [[host_name("__scalar_" #NAME "_contiguous__")]] kernel void        \
+  __scalar_contiguous__<OP>(device const float *input [[buffer(0)]],           \
+                            device float *output [[buffer(1)]],                \
+                            constant int *metadata [[buffer(2)]],              \
+                            constant float &scalar [[buffer(3)]],              \
+                            uint tid [[thread_position_in_grid]]);             \
+  template [[host_name("__scalar_" #NAME "_strided__")]] kernel void           \
+  __scalar_strided__<OP>(device const float *input [[buffer(0)]],              \
+                         device float *output [[buffer(1)]],                   \
+                         constant int *metadata [[buffer(2)]],                 \
+                         constant float &scalar [[buffer(3)]],                 \
+                         uint tid [[thread_position_in_grid]]);
+
+INSTANTIATE_SCALAR(add, add_op)
+INSTANTIATE_SCALAR(sub, sub_op)
+INSTANTIATE_SCALAR(rsub, rsub_op)
+INSTANTIATE_SCALAR(mul, mul_op)
+INSTANTIATE_SCALAR(div, div_op)
+INSTANTIATE_SCALAR(rdiv, rdiv_op)
+INSTANTIATE_SCALAR(pow, pow_op)
+INSTANTIATE_SCALAR(pow_square, pow_square_op)
+INSTANTIATE_SCALAR(pow_sqrt, pow_sqrt_op)
+INSTANTIATE_SCALAR(pow_reciprocal, pow_reciprocal_op)
+INSTANTIATE_SCALAR(pow_int, pow_int_op)
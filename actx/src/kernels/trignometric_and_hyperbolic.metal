@@ -9,7 +9,9 @@ kernel void __sin__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = sin(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = sin(input[i]);
 }
 
 kernel void __cos__(device float *input [[buffer(0)]],
@@ -19,7 +21,9 @@ kernel void __cos__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = cos(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = cos(input[i]);
 }
 
 kernel void __tan__(device float *input [[buffer(0)]],
@@ -29,7 +33,9 @@ kernel void __tan__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = tan(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = tan(input[i]);
 }
 
 kernel void __asin__(device float *input [[buffer(0)]],
@@ -39,7 +45,9 @@ kernel void __asin__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = asin(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = asin(input[i]);
 }
 kernel void __acos__(device float *input [[buffer(0)]],
                      device float *output [[buffer(1)]],
@@ -48,7 +56,9 @@ kernel void __acos__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = acos(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = acos(input[i]);
 }
 kernel void __atan__(device float *input [[buffer(0)]],
                      device float *output [[buffer(1)]],
@@ -57,7 +67,9 @@ kernel void __atan__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = atan(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = atan(input[i]);
 }
 
 kernel void __atan2__(device const float *A [[buffer(0)]],
@@ -77,11 +89,13 @@ kernel void __atan2__(device const float *A [[buffer(0)]],
   const constant int *bshape = astride + arank;
   const constant int *bstride = bshape + brank;
   const constant int *result_shape = bstride + brank;
+  const constant int *result_stride = result_shape + rrank;
   int ai =
       compute_broadcast_index(tid, ashape, astride, result_shape, arank, rrank);
   int bi =
       compute_broadcast_index(tid, bshape, bstride, result_shape, brank, rrank);
-  C[tid] = atan2(B[bi], A[ai]);
+  int ri = compute_strided_index(tid, result_shape, result_stride, rrank);
+  C[ri] = atan2(B[bi], A[ai]);
 }
 
 kernel void __sinh__(device float *input [[buffer(0)]],
@@ -91,7 +105,9 @@ kernel void __sinh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = sinh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = sinh(input[i]);
 }
 
 kernel void __cosh__(device float *input [[buffer(0)]],
@@ -101,7 +117,9 @@ kernel void __cosh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = cosh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = cosh(input[i]);
 }
 
 kernel void __tanh__(device float *input [[buffer(0)]],
@@ -111,7 +129,9 @@ kernel void __tanh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = tanh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = tanh(input[i]);
 }
 
 kernel void __asinh__(device float *input [[buffer(0)]],
@@ -121,7 +141,9 @@ kernel void __asinh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = asinh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = asinh(input[i]);
 }
 
 kernel void __acosh__(device float *input [[buffer(0)]],
@@ -131,7 +153,9 @@ kernel void __acosh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = acosh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = acosh(input[i]);
 }
 
 kernel void __atanh__(device float *input [[buffer(0)]],
@@ -141,5 +165,7 @@ kernel void __atanh__(device float *input [[buffer(0)]],
 
   if ((int)tid >= metadata[0])
     return;
-  output[tid] = atanh(input[tid]);
+  int i = unary_input_index(tid, metadata);
+  int o = unary_output_index(tid, metadata);
+  output[o] = atanh(input[i]);
 }
@@ -8,6 +8,7 @@
 
 std::unique_ptr<MemoryPool> pool = std::make_unique<MemoryPool>();
 std::unique_ptr<MPS> mps = std::make_unique<MPS>();
+std::unique_ptr<Fuser> fuser = std::make_unique<Fuser>();
 /*std::shared_ptr<spdlog::logger> logger =*/
 /*    spdlog::basic_logger_mt("file_logger", "logs.txt");*/
 auto logger = spdlog::stdout_color_mt("console_logger");
@@ -12,6 +12,11 @@ void Memory::copy(Memory *src, Memory *dest) {
   id<MTLBuffer> bufferout = dest->storage->metal;
   assert(src->bytesize <= dest->bytesize);
   if (src->device == DeviceType::MPS && dest->device == DeviceType::MPS) {
+    pool->trace_use({src, dest});
+    fuser->flush_buffers({src->data_ptr, dest->data_ptr});
+    mps->wait_for({src->data_ptr, dest->data_ptr});
+    mps->capture_copy(buffer, bufferout, src->bytesize);
+    fuser->forget_constant(dest);
     memcpy(dest->data_ptr, src->data_ptr, src->bytesize);
   }
 };
@@ -19,6 +24,14 @@ void Memory::copy_from_vector(std::vector<type_variant> src,
                               std::shared_ptr<Memory> dest) {}
 void Memory::copy_to_vector(std::shared_ptr<Memory> src,
                             std::vector<type_variant> dest) {}
+Memory::Memory(Storage *storage, size_t bytesize, DType dtype) {
+  this->device = DeviceType::MPS;
+  this->bytesize = bytesize;
+  this->dtype = dtype;
+  this->storage = storage;
+  this->data_ptr = [this->storage->metal contents];
+}
+
 Memory::Memory(DeviceType type, size_t bytesize, DType dtype) {
   this->device = type;
   this->bytesize = bytesize;
@@ -0,0 +1,239 @@
+#include "memory_planner.h"
+#include "main.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+struct ArenaStorage {
+  __strong id<MTLHeap> heap;
+};
+
+bool is_inplace_safe(OPType op) {
+  switch (op) {
+  case OPType::NEGATE:
+  case OPType::ADD:
+  case OPType::SUB:
+  case OPType::MUL:
+  case OPType::DIV:
+  case OPType::LOGICAL_E:
+  case OPType::LOGICAL_NE:
+  case OPType::LOGICAL_GT:
+  case OPType::LOGICAL_GTE:
+  case OPType::LOGICAL_LT:
+  case OPType::LOGICAL_LTE:
+  case OPType::POW:
+  case OPType::SQRT:
+  case OPType::EXP:
+  case OPType::LOG:
+  case OPType::LOG10:
+  case OPType::LOG2:
+  case OPType::SIN:
+  case OPType::COS:
+  case OPType::TAN:
+  case OPType::ASIN:
+  case OPType::ACOS:
+  case OPType::ATAN:
+  case OPType::ATAN2:
+  case OPType::SINH:
+  case OPType::COSH:
+  case OPType::TANH:
+  case OPType::ASINH:
+  case OPType::ACOSH:
+  case OPType::ATANH:
+  case OPType::ADD_SCALAR:
+  case OPType::SUB_SCALAR:
+  case OPType::MUL_SCALAR:
+  case OPType::DIV_SCALAR:
+  case OPType::RELU:
+  case OPType::LEAKY_RELU:
+  case OPType::SIGMOID:
+  case OPType::GELU:
+  case OPType::SILU:
+  case OPType::DROPOUT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+std::string MemoryPlan::report() const {
+  return "planned arena " + std::to_string(arena_bytes) + " bytes, naive " +
+         std::to_string(naive_bytes) + " bytes, live peak " +
+         std::to_string(live_peak_bytes) + " bytes, " +
+         std::to_string(inplace_reuses) + " in-place reuses";
+}
+
+MemoryPlan plan_memory(const AllocationTrace &trace, size_t alignment) {
+  struct Block {
+    size_t bytes;
+    int first;
+    int last;
+  };
+  const std::vector<TracedAllocation> &allocations = trace.allocations;
+  int n = allocations.size();
+  auto aligned = [alignment](size_t bytes) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  };
+  auto end_of = [](const TracedAllocation &allocation) {
+    return allocation.persistent ? INT_MAX : allocation.last;
+  };
+
+  MemoryPlan plan;
+  plan.offsets.assign(n, 0);
+  std::vector<int> block(n);
+  std::iota(block.begin(), block.end(), 0);
+  std::vector<Block> blocks;
+  for (const TracedAllocation &allocation : allocations) {
+    blocks.push_back(
+        {aligned(allocation.bytes), allocation.first, end_of(allocation)});
+    plan.naive_bytes += allocation.bytes;
+  }
+
+  // an output joins its input's block when the input is the block's last
+  // tenant and dies at the op writing the output
+  for (const InplaceCandidate &candidate : trace.inplace) {
+    const TracedAllocation &input = allocations[candidate.input];
+    const TracedAllocation &output = allocations[candidate.output];
+    Block &target = blocks[block[candidate.input]];
+    if (input.persistent || input.last != candidate.step ||
+        target.last != candidate.step ||
+        block[candidate.output] != candidate.output ||
+        aligned(output.bytes) > target.bytes) {
+      continue;
+    }
+    block[candidate.output] = block[candidate.input];
+    target.last = end_of(output);
+    plan.inplace_reuses++;
+  }
+
+  std::vector<int> roots;
+  for (int i = 0; i < n; i++) {
+    if (block[i] == i)
+      roots.push_back(i);
+  }
+  std::stable_sort(roots.begin(), roots.end(), [&blocks](int a, int b) {
+    if (blocks[a].bytes != blocks[b].bytes)
+      return blocks[a].bytes > blocks[b].bytes;
+    return blocks[a].first < blocks[b].first;
+  });
+
+  std::vector<size_t> block_offsets(n, 0);
+  std::vector<int> placed;
+  for (int root : roots) {
+    const Block &current = blocks[root];
+    std::vector<int> overlapping;
+    for (int other : placed) {
+      if (blocks[other].first <= current.last &&
+          current.first <= blocks[other].last)
+        overlapping.push_back(other);
+    }
+    std::sort(overlapping.begin(), overlapping.end(),
+              [&block_offsets](int a, int b) {
+                return block_offsets[a] < block_offsets[b];
+              });
+    // best fit among the gaps, or after the last overlapping block
+    size_t end = 0;
+    size_t best = SIZE_MAX;
+    size_t best_gap = SIZE_MAX;
+    for (int other : overlapping) {
+      size_t gap = block_offsets[other] > end ? block_offsets[other] - end : 0;
+      if (gap >= current.bytes && gap < best_gap) {
+        best = end;
+        best_gap = gap;
+      }
+      end = std::max(end, block_offsets[other] + blocks[other].bytes);
+    }
+    block_offsets[root] = best == SIZE_MAX ? end : best;
+    plan.arena_bytes =
+        std::max(plan.arena_bytes, block_offsets[root] + current.bytes);
+    placed.push_back(root);
+  }
+  for (int i = 0; i < n; i++) {
+    plan.offsets[i] = block_offsets[block[i]];
+  }
+
+  // sweep over the steps for the most bytes live at once
+  std::vector<std::pair<int, long long>> events;
+  for (const TracedAllocation &allocation : allocations) {
+    events.push_back({allocation.first, (long long)allocation.bytes});
+    if (!allocation.persistent)
+      events.push_back({allocation.last + 1, -(long long)allocation.bytes});
+  }
+  std::sort(events.begin(), events.end());
+  long long live = 0;
+  for (const auto &event : events) {
+    live += event.second;
+    plan.live_peak_bytes = std::max(plan.live_peak_bytes, (size_t)live);
+  }
+  return plan;
+}
+
+MemoryPlanner::~MemoryPlanner() { delete _arena; }
+
+std::vector<Tensor *> MemoryPlanner::trace(const Step &step) {
+  if (fuser->enabled()) {
+    throw std::logic_error("the memory planner needs eager mode");
+  }
+  _trace = AllocationTrace();
+  _ready = false;
+  std::vector<Tensor *> outputs;
+  pool->begin_trace(&_trace);
+  try {
+    outputs = step();
+  } catch (...) {
+    pool->end_trace();
+    throw;
+  }
+  for (const Tensor *output : outputs) {
+    int index = pool->traced_index(output->memory);
+    if (index >= 0)
+      _trace.allocations[index].persistent = true;
+  }
+  pool->end_trace();
+
+  size_t alignment = 1;
+  for (const TracedAllocation &allocation : _trace.allocations) {
+    alignment = std::max(alignment, mps->arena_alignment(allocation.bytes));
+  }
+  _plan = plan_memory(_trace, alignment);
+
+  delete _arena;
+  _arena = nullptr;
+  _memories.clear();
+  if (_plan.arena_bytes > 0) {
+    _arena = new ArenaStorage{mps->create_arena(_plan.arena_bytes)};
+  }
+  for (int i = 0; i < _trace.allocations.size(); i++) {
+    const TracedAllocation &allocation = _trace.allocations[i];
+    Storage *storage = new Storage;
+    mps->create_placed_buffer(_arena->heap, _plan.offsets[i],
+                              allocation.bytes, storage);
+    _memories.push_back(
+        new Memory(storage, allocation.bytes, allocation.dtype));
+  }
+  _ready = true;
+  logger->info(_plan.report());
+  return outputs;
+}
+
+std::vector<Tensor *> MemoryPlanner::run(const Step &step) {
+  if (!_ready) {
+    throw std::logic_error("trace() the step before running it");
+  }
+  if (fuser->enabled()) {
+    throw std::logic_error("the memory planner needs eager mode");
+  }
+  std::vector<Tensor *> outputs;
+  pool->begin_replay(&_memories, &_trace);
+  try {
+    outputs = step();
+  } catch (...) {
+    pool->end_replay();
+    throw;
+  }
+  if (pool->end_replay() != _memories.size()) {
+    throw std::logic_error(
+        "the step made fewer allocations than planned, the graph changed");
+  }
+  return outputs;
+}
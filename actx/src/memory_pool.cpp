@@ -24,6 +24,17 @@ Memory *MemoryPool::request_memory(DeviceType device, size_t length,
   // std::cout << length << std::endl;
   int required_block_size = this->_compute_pool_size(length);
   int required_block_byte_size = required_block_size * getDTypeSize(dtype);
+  if (this->_planned) {
+    const AllocationTrace *trace = this->_replay_trace;
+    if (this->_next_planned >= this->_planned->size() ||
+        trace->allocations[this->_next_planned].bytes !=
+            required_block_byte_size ||
+        trace->allocations[this->_next_planned].dtype != dtype) {
+      throw std::logic_error(
+          "allocation does not match the plan, the graph changed");
+    }
+    return this->_record_region((*this->_planned)[this->_next_planned++]);
+  }
   Memory *suitable_block =
       this->find_suitable_block(device, dtype, required_block_byte_size);
   if (nullptr == suitable_block) {
@@ -38,7 +49,8 @@ Memory *MemoryPool::request_memory(DeviceType device, size_t length,
                      COLOR("{} bytes", BOLD_WHITE),
                  this->used_pool.size(), this->available_pool.size(),
                  required_block_byte_size, length * getDTypeSize(dtype));
-    return memory;
+    this->_record_allocation(memory, required_block_byte_size);
+    return this->_record_region(memory);
   }
   this->used_pool.insert(suitable_block);
   this->available_pool.erase(suitable_block);
@@ -51,7 +63,8 @@ Memory *MemoryPool::request_memory(DeviceType device, size_t length,
       this->used_pool.size(), this->available_pool.size(),
       required_block_byte_size, length * getDTypeSize(dtype));
 
-  return suitable_block;
+  this->_record_allocation(suitable_block, required_block_byte_size);
+  return this->_record_region(suitable_block);
 }
 
 Memory *MemoryPool::find_suitable_block(DeviceType device, DType dtype,
@@ -80,6 +93,11 @@ void MemoryPool::return_memory(Memory *memory) {
   if (it != used_pool.end()) {
     this->used_pool.erase(it);
     this->available_pool.insert(memory);
+    // its next owner writes it without going through the dispatcher
+    if (fuser) {
+      fuser->forget_constant(memory);
+      fuser->discard(memory);
+    }
   } else {
     logger->warn(
         COLOR("Tried to return memory that wasn't in used_pool!", BOLD_RED));
@@ -91,3 +109,116 @@ void MemoryPool::return_memory(Memory *memory) {
           COLOR("Pool size: ", BOLD_CYAN) + COLOR("{} bytes ", BOLD_WHITE),
       this->used_pool.size(), this->available_pool.size(), memory->bytesize);
 }
+
+bool MemoryPool::in_use(const Memory *memory) const {
+  return std::any_of(used_pool.begin(), used_pool.end(),
+                     [memory](const Memory *m) { return m == memory; });
+}
+
+Memory *MemoryPool::_record_region(Memory *memory) {
+  for (std::vector<Memory *> &region : this->_regions)
+    region.push_back(memory);
+  return memory;
+}
+
+void MemoryPool::begin_region() { this->_regions.emplace_back(); }
+
+std::vector<Memory *> MemoryPool::end_region() {
+  std::vector<Memory *> requested = std::move(this->_regions.back());
+  this->_regions.pop_back();
+  return requested;
+}
+
+void MemoryPool::return_region(const std::vector<Memory *> &requested,
+                               const std::unordered_set<const Memory *> &keep) {
+  std::unordered_set<const Memory *> returned;
+  for (Memory *memory : requested) {
+    if (keep.count(memory) || returned.count(memory) || !this->in_use(memory))
+      continue;
+    this->return_memory(memory);
+    returned.insert(memory);
+  }
+}
+
+void MemoryPool::_record_allocation(Memory *memory, size_t bytes) {
+  if (!this->_trace)
+    return;
+  this->_traced[memory] = this->_trace->allocations.size();
+  this->_trace->allocations.push_back(
+      {bytes, memory->dtype, this->_trace->steps, this->_trace->steps});
+}
+
+void MemoryPool::begin_trace(AllocationTrace *trace) {
+  this->_trace = trace;
+  this->_traced.clear();
+}
+
+void MemoryPool::end_trace() {
+  this->_trace = nullptr;
+  this->_traced.clear();
+}
+
+int MemoryPool::traced_index(const Memory *memory) const {
+  auto it = this->_traced.find(memory);
+  return it == this->_traced.end() ? -1 : it->second;
+}
+
+void MemoryPool::trace_use(const std::vector<const Memory *> &memories) {
+  if (!this->_trace)
+    return;
+  int step = ++this->_trace->steps;
+  for (const Memory *memory : memories) {
+    int index = this->traced_index(memory);
+    if (index >= 0)
+      this->_trace->allocations[index].last = step;
+  }
+}
+
+void MemoryPool::trace_op(OPType op, const std::vector<Tensor *> &tensors) {
+  if (!this->_trace || tensors.empty())
+    return;
+  std::vector<const Memory *> memories;
+  for (const Tensor *tensor : tensors) {
+    memories.push_back(tensor->memory);
+  }
+  const Tensor *result = tensors.back();
+  int output = this->traced_index(result->memory);
+  // only a result allocated for this op and never used yet
+  bool fresh = output >= 0 &&
+               this->_trace->allocations[output].last ==
+                   this->_trace->allocations[output].first &&
+               this->_trace->allocations[output].first == this->_trace->steps;
+  this->trace_use(memories);
+  if (!fresh || !is_inplace_safe(op) || !result->is_contigous ||
+      result->offset() != 0)
+    return;
+  // every read of the input's buffer has to see element i at index i
+  auto same_layout = [result](const Tensor *input) {
+    return input->dims == result->dims && input->dtype == result->dtype &&
+           input->is_contigous && input->offset() == 0;
+  };
+  std::vector<Tensor *> inputs(tensors.begin(), tensors.end() - 1);
+  for (const Tensor *input : inputs) {
+    int index = this->traced_index(input->memory);
+    bool aligned = std::all_of(
+        inputs.begin(), inputs.end(), [&](const Tensor *other) {
+          return other->memory != input->memory || same_layout(other);
+        });
+    if (index >= 0 && index != output && aligned) {
+      this->_trace->inplace.push_back({index, output, this->_trace->steps});
+    }
+  }
+}
+
+void MemoryPool::begin_replay(const std::vector<Memory *> *planned,
+                              const AllocationTrace *trace) {
+  this->_planned = planned;
+  this->_replay_trace = trace;
+  this->_next_planned = 0;
+}
+
+size_t MemoryPool::end_replay() {
+  this->_planned = nullptr;
+  this->_replay_trace = nullptr;
+  return this->_next_planned;
+}
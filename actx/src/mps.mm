@@ -1,29 +1,58 @@
 #include "mps.h"
+#include "codegen.h"
 #include "device_type.h"
 #include "main.h"
+#include "multi_tensor.h"
 #include "types.h"
 #include "utility.h"
 #include <Foundation/Foundation.h>
 #include <Metal/Metal.h>
 #include <any>
 #include <cassert>
+#include <cerrno>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <limits.h>
 #include <memory>
 #include <objc/runtime.h>
 #include <optional>
+#include <spawn.h>
+#include <sstream>
 #include <string>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+// kernel metadata is a handful of ints, so it is built on the stack and handed
+// to the encoder with setBytes instead of a pooled MTLBuffer per call
+struct KernelMetadata {
+  static constexpr int CAPACITY = 128;
+  int values[CAPACITY];
+  int count = 0;
+
+  void push(int value) {
+    if (count == CAPACITY) {
+      throw std::invalid_argument("too many dims for a kernel call");
+    }
+    values[count++] = value;
+  }
+  void push(const std::vector<int> &list) {
+    for (int value : list)
+      push(value);
+  }
+  size_t bytes() const { return count * sizeof(int); }
+};
+
 template <typename T>
 void print_buffer(id<MTLBuffer> buffer, DType dtype, const char *label = "") {
   size_t count = buffer.length / getDTypeSize(dtype);
@@ -74,6 +103,9 @@ MPS::MPS() {
       4096 * 10; // total heap size in bytes (align to resource size)
   heapDesc.cpuCacheMode = MTLCPUCacheModeDefaultCache;
   heapDesc.type = MTLHeapTypeAutomatic;
+  // launches do not wait for each other, Metal orders kernels sharing a
+  // buffer
+  heapDesc.hazardTrackingMode = MTLHazardTrackingModeTracked;
   this->heap = [device newHeapWithDescriptor:heapDesc];
   if (!this->commandQueue) {
     std::cerr << "command queue creation failed" << std::endl;
@@ -106,13 +138,48 @@ void MPS::_init_pipeline(std::string metal_function_name) {
   pipelines[metal_function_name] = pipelineState;
 }
 
-void MPS::execute_kernel_nullary(std::string func, id<MTLBuffer> A,
-                                 id<MTLBuffer> meta, int N) {
-  std::string metal_function_name = func;
-  if (!pipelines[metal_function_name]) {
-    this->_init_pipeline(metal_function_name);
+id<MTLComputePipelineState> MPS::_pipeline(const std::string &func) {
+  if (!pipelines[func]) {
+    this->_init_pipeline(func);
+  }
+  return pipelines[func];
+}
+
+void MPS::_encode(id<MTLComputeCommandEncoder> encoder,
+                  const KernelBinding *bindings, int count,
+                  const uint8_t *data) {
+  for (int i = 0; i < count; i++) {
+    const KernelBinding &binding = bindings[i];
+    if (binding.buffer) {
+      [encoder setBuffer:binding.buffer
+                  offset:binding.offset
+                 atIndex:binding.index];
+    } else {
+      // captured bytes live in `data`, at the binding's offset
+      const void *bytes = data ? data + binding.offset : binding.bytes;
+      [encoder setBytes:bytes length:binding.size atIndex:binding.index];
+    }
+  }
+}
+
+void MPS::_launch(const KernelLaunch &launch) {
+  if (this->_capture) {
+    CapturedCommand command;
+    command.pipeline = launch.pipeline;
+    command.groups = launch.groups;
+    command.threads = launch.threads;
+    for (int i = 0; i < launch.count; i++) {
+      KernelBinding binding = launch.bindings[i];
+      if (!binding.buffer) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(binding.bytes);
+        binding.offset = command.data.size();
+        binding.bytes = nullptr;
+        command.data.insert(command.data.end(), bytes, bytes + binding.size);
+      }
+      command.bindings.push_back(binding);
+    }
+    this->_capture->push_back(std::move(command));
   }
-  id<MTLComputePipelineState> pipelineState = pipelines[metal_function_name];
   id<MTLCommandBuffer> commandBuffer = [this->commandQueue commandBuffer];
   if (!commandBuffer) {
     std::cerr << "Failed to create command buffer." << std::endl;
@@ -125,135 +192,435 @@ void MPS::execute_kernel_nullary(std::string func, id<MTLBuffer> A,
     std::cerr << "Failed to create compute command encoder." << std::endl;
     exit(1);
   }
-  [computeEncoder setComputePipelineState:pipelineState];
-  [computeEncoder setBuffer:A offset:0 atIndex:0];
-  [computeEncoder setBuffer:meta offset:0 atIndex:1];
-
-  std::pair<size_t, size_t> threadinfo =
-      this->compute_threads(N, pipelineState.maxTotalThreadsPerThreadgroup);
-  [computeEncoder dispatchThreadgroups:MTLSizeMake(threadinfo.second, 1, 1)
-                 threadsPerThreadgroup:MTLSizeMake(threadinfo.first, 1, 1)];
-
+  [computeEncoder setComputePipelineState:launch.pipeline];
+  this->_encode(computeEncoder, launch.bindings, launch.count, nullptr);
+  [computeEncoder dispatchThreadgroups:launch.groups
+                 threadsPerThreadgroup:launch.threads];
   [computeEncoder endEncoding];
-  [commandBuffer commit];
-  [commandBuffer waitUntilCompleted];
-}
-void MPS::execute_kernel_unary(std::string func, id<MTLBuffer> input,
-                               id<MTLBuffer> output, id<MTLBuffer> metadata,
-                               int N) {
-  std::string metal_function_name = func;
-  if (!pipelines[metal_function_name]) {
-    this->_init_pipeline(metal_function_name);
+  std::vector<id<MTLBuffer>> buffers;
+  for (int i = 0; i < launch.count; i++) {
+    if (launch.bindings[i].buffer)
+      buffers.push_back(launch.bindings[i].buffer);
   }
-  id<MTLComputePipelineState> pipelineState = pipelines[metal_function_name];
-  id<MTLCommandBuffer> commandBuffer = [this->commandQueue commandBuffer];
-  if (!commandBuffer) {
-    std::cerr << "Failed to create command buffer." << std::endl;
-    exit(1);
+  this->_commit(commandBuffer, buffers);
+}
+
+void MPS::execute_kernel_nullary(std::string func, id<MTLBuffer> A,
+                                 const void *meta, size_t meta_size, int N,
+                                 int offset, std::optional<float> scalar) {
+  fuser->flush_buffers({[A contents]});
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  launch.buffer(0, A, offset);
+  launch.bytes(1, meta, meta_size);
+  if (scalar) {
+    launch.bytes(2, &*scalar, sizeof(float));
   }
 
-  id<MTLComputeCommandEncoder> computeEncoder =
-      [commandBuffer computeCommandEncoder];
-  if (!computeEncoder) {
-    std::cerr << "Failed to create compute command encoder." << std::endl;
-    exit(1);
+  std::pair<size_t, size_t> threadinfo = this->compute_threads(
+      N, launch.pipeline.maxTotalThreadsPerThreadgroup);
+  launch.groups = MTLSizeMake(threadinfo.second, 1, 1);
+  launch.threads = MTLSizeMake(threadinfo.first, 1, 1);
+  this->_launch(launch);
+}
+void MPS::execute_kernel_unary(std::string func, id<MTLBuffer> input,
+                               id<MTLBuffer> output, const void *metadata,
+                               size_t metadata_size, int N, int offset_input,
+                               int offset_output, std::optional<float> scalar) {
+  fuser->flush_buffers({[input contents], [output contents]});
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  launch.buffer(0, input, offset_input);
+  launch.buffer(1, output, offset_output);
+  launch.bytes(2, metadata, metadata_size);
+  if (scalar) {
+    launch.bytes(3, &*scalar, sizeof(float));
   }
-  [computeEncoder setComputePipelineState:pipelineState];
-  [computeEncoder setBuffer:input offset:0 atIndex:0];
-  [computeEncoder setBuffer:output offset:0 atIndex:1];
-  [computeEncoder setBuffer:metadata offset:0 atIndex:2];
   std::pair<size_t, size_t> threadinfo =
-      this->compute_threads(N, pipelineState.threadExecutionWidth);
-  [computeEncoder dispatchThreadgroups:MTLSizeMake(threadinfo.second, 1, 1)
-                 threadsPerThreadgroup:MTLSizeMake(threadinfo.first, 1, 1)];
-  [computeEncoder endEncoding];
-  [commandBuffer commit];
-  [commandBuffer waitUntilCompleted];
+      this->compute_threads(N, launch.pipeline.threadExecutionWidth);
+  launch.groups = MTLSizeMake(threadinfo.second, 1, 1);
+  launch.threads = MTLSizeMake(threadinfo.first, 1, 1);
+  this->_launch(launch);
+}
+void MPS::execute_kernel_tiled(std::string func, id<MTLBuffer> input,
+                               id<MTLBuffer> output, const void *metadata,
+                               size_t metadata_size, int groups,
+                               int threads_per_group, int offset_input,
+                               int offset_output) {
+  fuser->flush_buffers({[input contents], [output contents]});
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  launch.buffer(0, input, offset_input);
+  launch.buffer(1, output, offset_output);
+  launch.bytes(2, metadata, metadata_size);
+  launch.groups = MTLSizeMake(groups, 1, 1);
+  launch.threads = MTLSizeMake(threads_per_group, 1, 1);
+  this->_launch(launch);
 }
 void MPS::execute_kernel_binary(std::string func, id<MTLBuffer> A,
                                 id<MTLBuffer> B, id<MTLBuffer> result,
-                                id<MTLBuffer> meta, int N, int offset_a,
-                                int offset_b, int offset_result) {
-  std::string metal_function_name = func;
-  if (!pipelines[metal_function_name]) {
-    this->_init_pipeline(metal_function_name);
+                                const void *meta, size_t meta_size, int N,
+                                int offset_a, int offset_b, int offset_result) {
+  fuser->flush_buffers({[A contents], [B contents], [result contents]});
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  launch.buffer(0, A, offset_a);
+  launch.buffer(1, B, offset_b);
+  launch.buffer(2, result, offset_result);
+  launch.bytes(3, meta, meta_size);
+
+  std::pair<uint32_t, uint32_t> threadinfo = this->compute_threads(
+      N, launch.pipeline.maxTotalThreadsPerThreadgroup);
+  launch.groups = MTLSizeMake(threadinfo.second, 1, 1);
+  launch.threads = MTLSizeMake(threadinfo.first, 1, 1);
+  this->_launch(launch);
+}
+
+void MPS::execute_kernel_fused(std::string func,
+                               const std::vector<id<MTLBuffer>> &inputs,
+                               const std::vector<int> &offsets,
+                               id<MTLBuffer> output, const void *meta,
+                               size_t meta_size, const void *code,
+                               size_t code_size, int N) {
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  // every slot needs a binding, the unused ones are never read
+  for (int i = 0; i < Fuser::MAX_INPUTS; i++) {
+    if (i < inputs.size()) {
+      launch.buffer(i, inputs[i], offsets[i]);
+    } else {
+      launch.buffer(i, output);
+    }
+  }
+  launch.buffer(Fuser::MAX_INPUTS, output);
+  launch.bytes(Fuser::MAX_INPUTS + 1, meta, meta_size);
+  launch.bytes(Fuser::MAX_INPUTS + 2, code, code_size);
+
+  std::pair<size_t, size_t> threadinfo =
+      this->compute_threads(N, launch.pipeline.threadExecutionWidth);
+  launch.groups = MTLSizeMake(threadinfo.second, 1, 1);
+  launch.threads = MTLSizeMake(threadinfo.first, 1, 1);
+  this->_launch(launch);
+}
+
+void MPS::execute_kernel_multi_tensor(
+    const std::vector<std::vector<const Tensor *>> &tensors, const int *meta,
+    size_t meta_size, const float *scalars, size_t scalars_size, int groups,
+    int threads_per_group) {
+  std::vector<const void *> contents;
+  for (const std::vector<const Tensor *> &list : tensors) {
+    for (const Tensor *tensor : list)
+      contents.push_back(tensor->memory->data_ptr);
+  }
+  fuser->flush_buffers(contents);
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline("__multi_tensor_apply__");
+  // every slot needs a binding, the unused ones are never read
+  id<MTLBuffer> unused = tensors[0][0]->memory->storage->metal;
+  for (int k = 0; k < MultiTensorLimits::MAX_LISTS; k++) {
+    for (int t = 0; t < MultiTensorLimits::MAX_TENSORS; t++) {
+      int index = k * MultiTensorLimits::MAX_TENSORS + t;
+      if (k < tensors.size() && t < tensors[k].size()) {
+        const Tensor *tensor = tensors[k][t];
+        launch.buffer(index, tensor->memory->storage->metal,
+                      tensor->offset() * getDTypeSize(tensor->dtype));
+      } else {
+        launch.buffer(index, unused);
+      }
+    }
+  }
+  int slots = MultiTensorLimits::MAX_LISTS * MultiTensorLimits::MAX_TENSORS;
+  launch.bytes(slots, meta, meta_size);
+  launch.bytes(slots + 1, scalars, scalars_size);
+  launch.groups = MTLSizeMake(groups, 1, 1);
+  launch.threads = MTLSizeMake(threads_per_group, 1, 1);
+  this->_launch(launch);
+}
+
+void MPS::_dispatch_tensors(const std::string &func,
+                            const std::vector<const Tensor *> &operands,
+                            const void *meta, size_t meta_size,
+                            MTLSize groups, MTLSize threads,
+                            const float *scalars, size_t scalars_size) {
+  std::vector<const void *> contents;
+  for (const Tensor *operand : operands) {
+    if (operand->device != DeviceType::MPS) {
+      throw std::runtime_error("All the tensor must live in Metal Buffers");
+    }
+    contents.push_back(operand->memory->data_ptr);
+  }
+  fuser->flush_buffers(contents);
+  KernelLaunch launch;
+  launch.pipeline = this->_pipeline(func);
+  for (int i = 0; i < operands.size(); i++) {
+    launch.buffer(i, operands[i]->memory->storage->metal,
+                  operands[i]->offset() * getDTypeSize(operands[i]->dtype));
+  }
+  launch.bytes(operands.size(), meta, meta_size);
+  if (scalars) {
+    launch.bytes(operands.size() + 1, scalars, scalars_size);
   }
-  id<MTLComputePipelineState> pipelineState = pipelines[metal_function_name];
+  launch.groups = groups;
+  launch.threads = threads;
+  this->_launch(launch);
+}
+
+void MPS::begin_capture(std::vector<CapturedCommand> *commands) {
+  if (this->_capture) {
+    throw std::logic_error("a graph is already being captured");
+  }
+  this->_capture = commands;
+}
+
+void MPS::end_capture() { this->_capture = nullptr; }
+
+void MPS::capture_copy(id<MTLBuffer> source, id<MTLBuffer> destination,
+                       size_t size) {
+  if (!this->_capture)
+    return;
+  CapturedCommand command;
+  command.pipeline = nil;
+  command.source = source;
+  command.destination = destination;
+  command.size = size;
+  this->_capture->push_back(std::move(command));
+}
+
+void MPS::replay(const std::vector<CapturedCommand> &commands) {
   id<MTLCommandBuffer> commandBuffer = [this->commandQueue commandBuffer];
   if (!commandBuffer) {
     std::cerr << "Failed to create command buffer." << std::endl;
     exit(1);
   }
+  // a serial encoder runs each dispatch after the previous one finished, so
+  // consecutive launches share one encoder. copies need a blit encoder
+  id<MTLComputeCommandEncoder> computeEncoder = nil;
+  std::vector<id<MTLBuffer>> buffers;
+  for (const CapturedCommand &command : commands) {
+    for (const KernelBinding &binding : command.bindings) {
+      if (binding.buffer)
+        buffers.push_back(binding.buffer);
+    }
+    if (!command.pipeline) {
+      buffers.push_back(command.source);
+      buffers.push_back(command.destination);
+      if (computeEncoder) {
+        [computeEncoder endEncoding];
+        computeEncoder = nil;
+      }
+      id<MTLBlitCommandEncoder> blitEncoder = [commandBuffer blitCommandEncoder];
+      [blitEncoder copyFromBuffer:command.source
+                     sourceOffset:0
+                         toBuffer:command.destination
+                destinationOffset:0
+                             size:command.size];
+      [blitEncoder endEncoding];
+      continue;
+    }
+    if (!computeEncoder) {
+      computeEncoder = [commandBuffer computeCommandEncoder];
+      if (!computeEncoder) {
+        std::cerr << "Failed to create compute command encoder." << std::endl;
+        exit(1);
+      }
+    }
+    [computeEncoder setComputePipelineState:command.pipeline];
+    this->_encode(computeEncoder, command.bindings.data(),
+                  command.bindings.size(), command.data.data());
+    [computeEncoder dispatchThreadgroups:command.groups
+                   threadsPerThreadgroup:command.threads];
+  }
+  if (computeEncoder) {
+    [computeEncoder endEncoding];
+  }
+  this->_commit(commandBuffer, buffers);
+}
 
-  id<MTLComputeCommandEncoder> computeEncoder =
-      [commandBuffer computeCommandEncoder];
-  if (!computeEncoder) {
-    std::cerr << "Failed to create compute command encoder." << std::endl;
-    exit(1);
+void MPS::_commit(id<MTLCommandBuffer> commandBuffer,
+                  const std::vector<id<MTLBuffer>> &buffers) {
+  auto completion = std::make_shared<Completion>();
+  [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> completed) {
+    std::vector<std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> guard(completion->lock);
+      completion->done = true;
+      callbacks.swap(completion->callbacks);
+    }
+    completion->promise.set_value();
+    for (std::function<void()> &callback : callbacks) {
+      callback();
+    }
+  }];
+  [commandBuffer commit];
+  uint64_t ticket = ++this->_submitted;
+  for (id<MTLBuffer> buffer : buffers) {
+    this->_last_use[[buffer contents]] = ticket;
+  }
+  this->_in_flight.push_back({ticket, commandBuffer, completion});
+  if (!this->_async) {
+    this->_wait(ticket);
+    return;
+  }
+  // drop what already finished, the queue completes in order
+  while (!this->_in_flight.empty() &&
+         this->_in_flight.front().commands.status >=
+             MTLCommandBufferStatusCompleted) {
+    this->_completed = this->_in_flight.front().ticket;
+    this->_in_flight.pop_front();
+  }
+}
+
+void MPS::_wait(uint64_t ticket) {
+  while (!this->_in_flight.empty() &&
+         this->_in_flight.front().ticket <= ticket) {
+    id<MTLCommandBuffer> commandBuffer = this->_in_flight.front().commands;
+    [commandBuffer waitUntilCompleted];
+    this->_completed = this->_in_flight.front().ticket;
+    this->_in_flight.pop_front();
+    if (commandBuffer.status == MTLCommandBufferStatusError) {
+      throw std::runtime_error(
+          "kernel failed: " +
+          std::string([[commandBuffer.error localizedDescription] UTF8String]));
+    }
   }
+}
 
-  [computeEncoder setComputePipelineState:pipelineState];
-  [computeEncoder setBuffer:A offset:offset_a atIndex:0];
-  [computeEncoder setBuffer:B offset:offset_b atIndex:1];
-  [computeEncoder setBuffer:result offset:offset_result atIndex:2];
-  [computeEncoder setBuffer:meta offset:0 atIndex:3];
+void MPS::sync() { this->_wait(this->_submitted); }
+
+void MPS::wait_for(const std::vector<const void *> &buffers) {
+  uint64_t last = 0;
+  for (const void *buffer : buffers) {
+    auto use = this->_last_use.find(buffer);
+    if (use != this->_last_use.end())
+      last = std::max(last, use->second);
+  }
+  if (last > this->_completed)
+    this->_wait(last);
+}
+
+std::shared_ptr<MPS::Completion>
+MPS::_completion(const std::vector<const void *> &buffers) {
+  uint64_t last = 0;
+  for (const void *buffer : buffers) {
+    auto use = this->_last_use.find(buffer);
+    if (use != this->_last_use.end())
+      last = std::max(last, use->second);
+  }
+  for (const InFlight &in_flight : this->_in_flight) {
+    if (in_flight.ticket == last)
+      return in_flight.completion;
+  }
+  return nullptr;
+}
 
-  std::pair<uint32_t, uint32_t> threadinfo =
-      this->compute_threads(N, pipelineState.maxTotalThreadsPerThreadgroup);
+std::shared_future<void>
+MPS::ready(const std::vector<const void *> &buffers) {
+  std::shared_ptr<Completion> completion = this->_completion(buffers);
+  if (completion)
+    return completion->future;
+  std::promise<void> done;
+  done.set_value();
+  return done.get_future().share();
+}
 
-  [computeEncoder dispatchThreadgroups:MTLSizeMake(threadinfo.second, 1, 1)
+void MPS::on_ready(const std::vector<const void *> &buffers,
+                   std::function<void()> callback) {
+  std::shared_ptr<Completion> completion = this->_completion(buffers);
+  if (completion) {
+    std::lock_guard<std::mutex> guard(completion->lock);
+    if (!completion->done) {
+      completion->callbacks.push_back(std::move(callback));
+      return;
+    }
+  }
+  callback();
+}
 
-                 threadsPerThreadgroup:MTLSizeMake(threadinfo.first, 1, 1)];
-  [computeEncoder endEncoding];
-  [commandBuffer commit];
-  [commandBuffer waitUntilCompleted];
+void MPS::set_async(bool async) {
+  if (!async)
+    this->sync();
+  this->_async = async;
 }
 
-void MPS::initiate_dispatch_nullary(std::string kernel_method, Tensor *input) {
+void MPS::initiate_dispatch_nullary(std::string kernel_method, Tensor *input,
+                                    std::optional<float> scalar) {
   if (input->device != DeviceType::MPS) {
     throw std::runtime_error("All the tensor must live in Metal Buffers");
   }
-  std::vector<int> _ranks = {static_cast<int>(input->size),
-                             static_cast<int>(input->dims.size())};
-  std::vector<int> meta_data;
-  meta_data.reserve(input->dims.size() + 2);
-  meta_data.insert(meta_data.end(), _ranks.begin(), _ranks.end());
-  meta_data.insert(meta_data.end(), input->dims.begin(), input->dims.end());
-  Memory *meta_data_memory =
-      pool->request_memory(DeviceType::MPS, meta_data.size(), DType::int32);
-  this->copy_vector_to_buffer((void *)meta_data.data(), *meta_data_memory,
-                              meta_data.size() * getDTypeSize(DType::int32));
+  // not coalesced, __eye__ reads the row length from the dims
+  KernelMetadata meta_data;
+  meta_data.push(input->size);
+  meta_data.push(input->dims.size());
+  meta_data.push(input->dims);
+  meta_data.push(input->stride);
   this->execute_kernel_nullary(kernel_method, input->memory->storage->metal,
-                               *reinterpret_cast<id<MTLBuffer> __strong *>(
-                                   &meta_data_memory->storage->metal),
-                               input->size);
-  pool->return_memory(meta_data_memory);
+                               meta_data.values, meta_data.bytes(),
+                               input->size,
+                               input->offset() * getDTypeSize(input->dtype),
+                               scalar);
 };
+// [N, input_rank, output_rank, input_dims, input_strides, output_dims,
+//  output_strides], see broadcast.metal
+static KernelMetadata unary_metadata(const Tensor *input,
+                                     const Tensor *output) {
+  std::vector<int> input_dims = input->dims, output_dims = output->dims;
+  std::vector<int> input_strides = input->stride;
+  std::vector<int> output_strides = output->stride;
+  if (input_dims == output_dims) {
+    coalesce_dims(output_dims, {&input_strides, &output_strides});
+    input_dims = output_dims;
+  } else {
+    // same size but a different shape, each side is indexed on its own
+    coalesce_dims(input_dims, input_strides);
+    coalesce_dims(output_dims, output_strides);
+  }
+  KernelMetadata meta_data;
+  meta_data.push(output->size);
+  meta_data.push(input_dims.size());
+  meta_data.push(output_dims.size());
+  meta_data.push(input_dims);
+  meta_data.push(input_strides);
+  meta_data.push(output_dims);
+  meta_data.push(output_strides);
+  return meta_data;
+}
+
+// __add__ -> __add_contiguous__, logical_e -> logical_e_contiguous
+static std::string fast_path_kernel(const std::string &kernel_method,
+                                    const std::string &path) {
+  size_t n = kernel_method.size();
+  if (n > 2 && kernel_method.compare(n - 2, 2, "__") == 0) {
+    return kernel_method.substr(0, n - 2) + "_" + path + "__";
+  }
+  return kernel_method + "_" + path;
+}
+
 void MPS::initiate_dispatch_unary(std::string kernel_method,
                                   const Tensor *input, Tensor *output) {
   if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
     throw std::runtime_error("All the tensor must live in Metal Buffers");
   }
-  std::vector<int> _ranks = {static_cast<int>(output->size),
-                             static_cast<int>(input->dims.size()),
-                             static_cast<int>(output->dims.size())};
-  std::vector<int> meta_data;
-  meta_data.reserve(input->dims.size() + output->dims.size() + 3);
-  meta_data.insert(meta_data.end(), _ranks.begin(), _ranks.end());
-  meta_data.insert(meta_data.end(), input->dims.begin(), input->dims.end());
-  meta_data.insert(meta_data.end(), output->dims.begin(), output->dims.end());
-  Memory *meta_data_memory =
-      pool->request_memory(DeviceType::MPS, meta_data.size(), DType::int32);
-  this->copy_vector_to_buffer((void *)meta_data.data(), *meta_data_memory,
-                              meta_data.size() * getDTypeSize(DType::int32));
-
+  if (fuser->record(kernel_method, {input}, output)) {
+    return;
+  }
+  int offset_input = input->offset() * getDTypeSize(input->dtype);
+  int offset_output = output->offset() * getDTypeSize(output->dtype);
+  if (dispatcher->classify(input, output) == DispatchPath::CONTIGUOUS) {
+    int params[1] = {static_cast<int>(output->size)};
+    this->execute_kernel_unary(fast_path_kernel(kernel_method, "contiguous"),
+                               input->memory->storage->metal,
+                               output->memory->storage->metal, params,
+                               sizeof(params), (output->size + 3) / 4,
+                               offset_input, offset_output);
+    return;
+  }
+  KernelMetadata meta_data = unary_metadata(input, output);
   this->execute_kernel_unary(kernel_method, input->memory->storage->metal,
-                             output->memory->storage->metal,
-                             *reinterpret_cast<id<MTLBuffer> __strong *>(
-                                 &meta_data_memory->storage->metal),
-                             output->size);
-  pool->return_memory(meta_data_memory);
+                             output->memory->storage->metal, meta_data.values,
+                             meta_data.bytes(), output->size, offset_input,
+                             offset_output);
 };
+
 void MPS::initiate_dispatch_binary(std::string kernel_method, const Tensor *a,
                                    const Tensor *b, Tensor *result) {
 
@@ -261,35 +628,240 @@ void MPS::initiate_dispatch_binary(std::string kernel_method, const Tensor *a,
       result->device != DeviceType::MPS) {
     throw std::runtime_error("All the tensor must live in Metal Buffers");
   }
-  std::vector<int> _ranks = {
-      (int)result->size, static_cast<int>(a->dims.size()),
-      static_cast<int>(b->dims.size()), static_cast<int>(result->dims.size())};
-  std::vector<int> meta_data;
-  meta_data.reserve(
-      (a->dims.size() + b->dims.size() + result->dims.size()) * 2 + 4);
-  meta_data.insert(meta_data.end(), _ranks.begin(), _ranks.end());
-  meta_data.insert(meta_data.end(), a->dims.begin(), a->dims.end());
-  meta_data.insert(meta_data.end(), a->stride.begin(), a->stride.end());
-  meta_data.insert(meta_data.end(), b->dims.begin(), b->dims.end());
-  meta_data.insert(meta_data.end(), b->stride.begin(), b->stride.end());
-  meta_data.insert(meta_data.end(), result->dims.begin(), result->dims.end());
-  meta_data.insert(meta_data.end(), result->stride.begin(),
-                   result->stride.end());
-  Memory *meta_data_memory =
-      pool->request_memory(DeviceType::MPS, meta_data.size(), DType::int32);
-  this->copy_vector_to_buffer((void *)meta_data.data(), *meta_data_memory,
-                              meta_data.size() * getDTypeSize(DType::int32));
+  if (fuser->record(kernel_method, {a, b}, result)) {
+    return;
+  }
+  int offset_a = a->offset() * getDTypeSize(a->dtype);
+  int offset_b = b->offset() * getDTypeSize(b->dtype);
+  int offset_result = result->offset() * getDTypeSize(result->dtype);
+  int n = result->size;
+
+  DispatchPath path = dispatcher->classify(a, b, result);
+  if (path != DispatchPath::STRIDED) {
+    // fast paths index linearly and handle 4 elements per thread
+    int params[3] = {n, 0, 0};
+    std::string kernel = fast_path_kernel(kernel_method, "contiguous");
+    if (path == DispatchPath::SCALAR) {
+      kernel = fast_path_kernel(kernel_method, "scalar");
+      params[2] = a->size == 1;
+    } else if (path == DispatchPath::ROW) {
+      kernel = fast_path_kernel(kernel_method, "row");
+      params[1] = result->dims.back();
+      params[2] = a->size != n;
+    }
+    this->execute_kernel_binary(kernel, a->memory->storage->metal,
+                                b->memory->storage->metal,
+                                result->memory->storage->metal, params,
+                                sizeof(params), (n + 3) / 4, offset_a,
+                                offset_b, offset_result);
+    return;
+  }
+
+  // align both operands to the result's rank (broadcast dims get stride 0)
+  // and coalesce all three together, the kernels then see one shared shape
+  std::vector<int> dims = result->dims;
+  std::vector<int> a_strides = broadcast_strides(a, dims);
+  std::vector<int> b_strides = broadcast_strides(b, dims);
+  std::vector<int> result_strides = result->stride;
+  coalesce_dims(dims, {&a_strides, &b_strides, &result_strides});
+  int rank = dims.size();
+
+  KernelMetadata meta_data;
+  meta_data.push(n);
+  meta_data.push(rank);
+  meta_data.push(rank);
+  meta_data.push(rank);
+  meta_data.push(dims);
+  meta_data.push(a_strides);
+  meta_data.push(dims);
+  meta_data.push(b_strides);
+  meta_data.push(dims);
+  meta_data.push(result_strides);
   this->execute_kernel_binary(
       kernel_method, a->memory->storage->metal, b->memory->storage->metal,
-      result->memory->storage->metal,
-      *reinterpret_cast<id<MTLBuffer> __strong *>(
-          &meta_data_memory->storage->metal),
-      result->size, a->offset() * getDTypeSize(a->dtype),
-      b->offset() * getDTypeSize(b->dtype),
-      result->offset() * getDTypeSize(result->dtype));
-  pool->return_memory(meta_data_memory);
+      result->memory->storage->metal, meta_data.values, meta_data.bytes(), n,
+      offset_a, offset_b, offset_result);
 };
 
+void MPS::initiate_dispatch_scalar(std::string op, const Tensor *input,
+                                   float scalar, Tensor *output) {
+  if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
+    throw std::runtime_error("All the tensor must live in Metal Buffers");
+  }
+  if (fuser->record("__scalar_" + op + "__", {input}, output, scalar)) {
+    return;
+  }
+  int offset_input = input->offset() * getDTypeSize(input->dtype);
+  int offset_output = output->offset() * getDTypeSize(output->dtype);
+  if (dispatcher->classify(input, output) == DispatchPath::CONTIGUOUS) {
+    int params[1] = {static_cast<int>(output->size)};
+    this->execute_kernel_unary(
+        "__scalar_" + op + "_contiguous__", input->memory->storage->metal,
+        output->memory->storage->metal, params, sizeof(params),
+        (output->size + 3) / 4, offset_input, offset_output, scalar);
+    return;
+  }
+  KernelMetadata meta_data = unary_metadata(input, output);
+  this->execute_kernel_unary(
+      "__scalar_" + op + "_strided__", input->memory->storage->metal,
+      output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+      output->size, offset_input, offset_output, scalar);
+}
+
+extern char **environ;
+
+// runs `xcrun args...` without a shell, so paths are passed as they are.
+// true when it exits with 0, its output is discarded
+static bool run_xcrun(const std::vector<std::string> &args) {
+  std::vector<char *> argv = {const_cast<char *>("xcrun")};
+  for (const std::string &arg : args)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  pid_t pid;
+  int spawned =
+      posix_spawnp(&pid, "xcrun", &actions, nullptr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (spawned != 0)
+    return false;
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      return false;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// a cached library is reused when the source it was built from matches,
+// which also rules out hash collisions. without xcrun (no command line
+// tools) the source is compiled in process and only cached in memory
+id<MTLLibrary> MPS::_load_cached_library(const std::string &name,
+                                         const std::string &source) {
+  namespace fs = std::filesystem;
+  NSError *error = nil;
+  std::error_code error_code;
+  fs::path dir = kernel_cache_dir();
+  fs::path metal = dir / (name + ".metal");
+  fs::path metallib = dir / (name + ".metallib");
+
+  std::ifstream cached_file(metal);
+  std::stringstream cached;
+  cached << cached_file.rdbuf();
+  bool hit = cached_file && cached.str() == source &&
+             fs::exists(metallib, error_code);
+  if (!hit) {
+    fs::create_directories(dir, error_code);
+    // written under a unique name and renamed, concurrent processes never
+    // read a partial source or load a partial library. the library is moved
+    // first, a source that matches always comes with its library
+    std::string unique = name + "." + std::to_string(getpid());
+    fs::path written = dir / (unique + ".metal");
+    fs::path air = dir / (unique + ".air");
+    fs::path built = dir / (unique + ".metallib");
+    {
+      std::ofstream file(written);
+      file << source;
+      hit = static_cast<bool>(file);
+    }
+    hit = hit &&
+          run_xcrun({"-sdk", "macosx", "metal", "-c", written.string(), "-o",
+                     air.string()}) &&
+          run_xcrun({"-sdk", "macosx", "metallib", air.string(), "-o",
+                     built.string()});
+    if (hit) {
+      fs::rename(built, metallib, error_code);
+      hit = !error_code;
+    }
+    if (hit) {
+      fs::rename(written, metal, error_code);
+      hit = !error_code;
+    }
+    fs::remove(written, error_code);
+    fs::remove(air, error_code);
+    fs::remove(built, error_code);
+  }
+  if (hit) {
+    NSURL *url = [NSURL
+        fileURLWithPath:[NSString stringWithUTF8String:metallib.c_str()]];
+    id<MTLLibrary> library = [this->device newLibraryWithURL:url
+                                                        error:&error];
+    if (library)
+      return library;
+  }
+
+  id<MTLLibrary> library = [this->device
+      newLibraryWithSource:[NSString stringWithUTF8String:source.c_str()]
+                   options:nil
+                     error:&error];
+  if (!library) {
+    throw std::runtime_error(
+        "failed to compile " + name + ": " +
+        std::string([[error localizedDescription] UTF8String]));
+  }
+  return library;
+}
+
+// returns the name the specialized pipeline is registered under
+std::string MPS::_jit_kernel(const FusedProgram &program,
+                             const FusedLayout &layout) {
+  std::string name =
+      fused_kernel_name(fused_hash(fused_signature(program, layout)));
+  if (pipelines[name]) {
+    return name;
+  }
+  std::string source = generate_fused_source(name, program, layout);
+  id<MTLLibrary> library = this->_load_cached_library(name, source);
+  NSError *error = nil;
+  id<MTLFunction> function = [library
+      newFunctionWithName:[NSString stringWithUTF8String:name.c_str()]];
+  id<MTLComputePipelineState> pipelineState =
+      [this->device newComputePipelineStateWithFunction:function error:&error];
+  if (!pipelineState) {
+    throw std::runtime_error(
+        "failed to create compute pipeline state for " + name + ": " +
+        std::string([[error localizedDescription] UTF8String]));
+  }
+  pipelines[name] = pipelineState;
+  return name;
+}
+
+void MPS::fused_elementwise(const FusedProgram &program, Tensor *output) {
+  // inputs are broadcast against the output, then every operand is coalesced
+  // with the same shape so the kernel decodes one set of coordinates
+  FusedLayout layout = fused_layout(program, output);
+
+  KernelMetadata meta_data;
+  meta_data.push(layout.size);
+  meta_data.push(layout.dims.size());
+  meta_data.push(program.inputs.size());
+  meta_data.push(program.code.size());
+  meta_data.push(layout.dims);
+  meta_data.push(layout.output_strides);
+  for (const std::vector<int> &input_strides : layout.input_strides) {
+    meta_data.push(input_strides);
+  }
+
+  std::string kernel = "__fused_elementwise__";
+  if (fuser->codegen()) {
+    kernel = this->_jit_kernel(program, layout);
+  }
+  std::vector<id<MTLBuffer>> buffers;
+  std::vector<int> offsets;
+  for (const Tensor *input : program.inputs) {
+    buffers.push_back(input->memory->storage->metal);
+    offsets.push_back(input->offset() * getDTypeSize(input->dtype));
+  }
+  this->execute_kernel_fused(
+      kernel, buffers, offsets, output->memory->storage->metal,
+      meta_data.values, meta_data.bytes(), program.code.data(),
+      program.code.size() * sizeof(FusedInstruction), layout.size);
+}
+
 void MPS::createEmptyBuffer(int bytesize, DType type, Storage *storage) {
   if (bytesize <= 0) {
     throw std::runtime_error("invalid buffer size");
@@ -304,7 +876,41 @@ void MPS::createEmptyBuffer(int bytesize, DType type, Storage *storage) {
   }
 }
 
+id<MTLHeap> MPS::create_arena(size_t bytesize) {
+  MTLHeapDescriptor *descriptor = [[MTLHeapDescriptor alloc] init];
+  descriptor.type = MTLHeapTypePlacement;
+  descriptor.storageMode = MTLStorageModeShared;
+  descriptor.cpuCacheMode = MTLCPUCacheModeDefaultCache;
+  descriptor.size = bytesize;
+  // aliased buffers are ordered by tracking the heap as a whole
+  descriptor.hazardTrackingMode = MTLHazardTrackingModeTracked;
+  id<MTLHeap> arena = [this->device newHeapWithDescriptor:descriptor];
+  if (!arena) {
+    throw std::runtime_error("failed to allocate an arena of " +
+                             std::to_string(bytesize) + " bytes");
+  }
+  return arena;
+}
+
+size_t MPS::arena_alignment(size_t bytesize) {
+  MTLSizeAndAlign size_and_align = [this->device
+      heapBufferSizeAndAlignWithLength:bytesize
+                               options:MTLResourceStorageModeShared];
+  return size_and_align.align;
+}
+
+void MPS::create_placed_buffer(id<MTLHeap> arena, size_t offset,
+                               size_t bytesize, Storage *storage) {
+  storage->metal = [arena newBufferWithLength:bytesize
+                                      options:MTLResourceStorageModeShared
+                                       offset:offset];
+  if (!storage->metal) {
+    throw std::runtime_error("failed to place a buffer in the arena");
+  }
+}
+
 id<MTLBuffer> MPS::clone(id<MTLBuffer> buffer) {
+  this->wait_for({[buffer contents]});
   NSUInteger bufferSize = buffer.length;
   id<MTLBuffer> newBuffer =
       [device newBufferWithLength:bufferSize
@@ -317,6 +923,8 @@ id<MTLBuffer> MPS::clone(id<MTLBuffer> buffer) {
 
 void MPS::copy_vector_to_buffer(void *ptr, Memory &memory, int buffer_size) {
   assert(memory.does_live_on(DeviceType::MPS));
+  this->wait_for({memory.data_ptr});
+  fuser->forget_constant(&memory);
   memcpy([memory.storage->metal contents], ptr, buffer_size);
 }
 // ==================================================
@@ -343,8 +951,34 @@ void MPS::matmul(const Tensor *a, const Tensor *b, Tensor *result) {
   throw std::logic_error("not implemented");
   this->initiate_dispatch_binary("__matmul__", a, b, result);
 };
-void MPS::pow(const Tensor *a, const Tensor *b, Tensor *result) {
-  this->initiate_dispatch_binary("__pow__", a, b, result);
+void MPS::pow(const Tensor *a, float exponent, Tensor *result) {
+  // the common exponents skip pow(), which is also undefined for negative
+  // bases
+  std::string op = "pow";
+  if (exponent == 2.0f) {
+    op = "pow_square";
+  } else if (exponent == 0.5f) {
+    op = "pow_sqrt";
+  } else if (exponent == -1.0f) {
+    op = "pow_reciprocal";
+  } else if (exponent == std::trunc(exponent) && std::fabs(exponent) <= 16) {
+    op = "pow_int";
+  }
+  this->initiate_dispatch_scalar(op, a, exponent, result);
+}
+void MPS::add_scalar(const Tensor *a, float b, Tensor *result) {
+  this->initiate_dispatch_scalar("add", a, b, result);
+}
+void MPS::sub_scalar(const Tensor *a, float b, bool reflected,
+                     Tensor *result) {
+  this->initiate_dispatch_scalar(reflected ? "rsub" : "sub", a, b, result);
+}
+void MPS::mul_scalar(const Tensor *a, float b, Tensor *result) {
+  this->initiate_dispatch_scalar("mul", a, b, result);
+}
+void MPS::div_scalar(const Tensor *a, float b, bool reflected,
+                     Tensor *result) {
+  this->initiate_dispatch_scalar(reflected ? "rdiv" : "div", a, b, result);
 }
 // ==================================================
 //                      INIT
@@ -355,9 +989,351 @@ void MPS::zeros(Tensor *a) { this->initiate_dispatch_nullary("__zeros__", a); }
 
 void MPS::eye(Tensor *a) { this->initiate_dispatch_nullary("__eye__", a); }
 
-void MPS::full(Tensor *n, Tensor *result) {
-  assert(n->size == 1);
-  initiate_dispatch_unary("__full__", n, result);
+void MPS::full(float n, Tensor *result) {
+  this->initiate_dispatch_nullary("__full__", result, n);
+}
+
+// ==================================================
+//                      CAST
+// ==================================================
+void MPS::cast(const Tensor *input, Tensor *output, RoundingMode rounding,
+               bool saturate) {
+  if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
+    throw std::runtime_error("All the tensor must live in Metal Buffers");
+  }
+  assert(input->size == output->size);
+  // kernels are instantiated per (source, destination) pair, e.g.
+  // __cast_u8_f32__, and convert 4 elements per thread
+  std::string kernel_method = "__cast_" + getTypeCode(input->dtype) + "_" +
+                              getTypeCode(output->dtype) + "__";
+  KernelMetadata meta_data;
+  meta_data.push(output->size);
+  meta_data.push(static_cast<int>(rounding));
+  meta_data.push(saturate);
+  if (input->is_contigous && output->is_contigous) {
+    meta_data.push(0);
+  } else {
+    if (input->dims != output->dims) {
+      throw std::invalid_argument("strided cast needs matching shapes");
+    }
+    std::vector<int> dims = output->dims;
+    std::vector<int> input_strides = input->stride;
+    std::vector<int> output_strides = output->stride;
+    coalesce_dims(dims, {&input_strides, &output_strides});
+    meta_data.push(dims.size());
+    meta_data.push(dims);
+    meta_data.push(input_strides);
+    meta_data.push(output_strides);
+  }
+  this->execute_kernel_unary(
+      kernel_method, input->memory->storage->metal,
+      output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+      (output->size + 3) / 4, input->offset() * getDTypeSize(input->dtype),
+      output->offset() * getDTypeSize(output->dtype));
+}
+
+// ==================================================
+//                      LAYOUT
+// ==================================================
+void MPS::contiguous(const Tensor *input, Tensor *output) {
+  if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
+    throw std::runtime_error("All the tensor must live in Metal Buffers");
+  }
+  assert(input->size == output->size && input->dtype == output->dtype);
+  std::string width = "b" + std::to_string(getDTypeSize(input->dtype));
+  std::vector<int> dims = input->dims;
+  std::vector<int> strides = input->stride;
+  coalesce_dims(dims, strides);
+
+  KernelMetadata meta_data;
+  bool transpose = dims.size() == 2 && strides[0] == 1 && strides[1] == dims[0];
+  if (transpose) {
+    // a transposed matrix: both the gather and a naive scatter would walk
+    // memory with a stride of a full row, so move 32x32 tiles instead
+    meta_data.push(dims);
+  } else {
+    meta_data.push(output->size);
+    meta_data.push(dims.size());
+    meta_data.push(dims);
+    meta_data.push(strides);
+  }
+  int offset_input = input->offset() * getDTypeSize(input->dtype);
+  int offset_output = output->offset() * getDTypeSize(output->dtype);
+  if (transpose) {
+    int tiles = ((dims[0] + 31) / 32) * ((dims[1] + 31) / 32);
+    this->execute_kernel_tiled(
+        "__transpose_2d_" + width + "__", input->memory->storage->metal,
+        output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+        tiles, 32 * 8, offset_input, offset_output);
+  } else {
+    this->execute_kernel_unary(
+        "__strided_copy_" + width + "__", input->memory->storage->metal,
+        output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+        output->size, offset_input, offset_output);
+  }
+}
+
+void MPS::copy(const Tensor *input, Tensor *output) {
+  if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
+    throw std::runtime_error("All the tensor must live in Metal Buffers");
+  }
+  assert(input->dims == output->dims && input->dtype == output->dtype);
+  std::string width = "b" + std::to_string(getDTypeSize(input->dtype));
+  std::vector<int> dims = output->dims;
+  std::vector<int> input_strides = input->stride;
+  std::vector<int> output_strides = output->stride;
+  coalesce_dims(dims, {&output_strides, &input_strides});
+
+  KernelMetadata meta_data;
+  meta_data.push(output->size);
+  meta_data.push(dims.size());
+  meta_data.push(dims);
+  meta_data.push(input_strides);
+  meta_data.push(output_strides);
+  this->execute_kernel_unary(
+      "__strided_assign_" + width + "__", input->memory->storage->metal,
+      output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+      output->size, input->offset() * getDTypeSize(input->dtype),
+      output->offset() * getDTypeSize(output->dtype));
+}
+
+// ==================================================
+//                     REDUCTIONS
+// ==================================================
+void MPS::sum_to(const Tensor *input, Tensor *output) {
+  if (input->device != DeviceType::MPS || output->device != DeviceType::MPS) {
+    throw std::runtime_error("All the tensor must live in Metal Buffers");
+  }
+  int rank = static_cast<int>(input->dims.size());
+  std::vector<int> output_dims(rank - output->dims.size(), 1);
+  output_dims.insert(output_dims.end(), output->dims.begin(),
+                     output->dims.end());
+  KernelMetadata meta_data;
+  meta_data.push(output->size);
+  meta_data.push(rank);
+  meta_data.push(input->size / output->size);
+  meta_data.push(input->dims);
+  meta_data.push(input->stride);
+  meta_data.push(output_dims);
+  this->execute_kernel_unary(
+      "__sum_to__", input->memory->storage->metal,
+      output->memory->storage->metal, meta_data.values, meta_data.bytes(),
+      output->size, input->offset() * getDTypeSize(input->dtype),
+      output->offset() * getDTypeSize(output->dtype));
+}
+
+// ==================================================
+//                     ACTIVATIONS
+// ==================================================
+void MPS::relu(const Tensor *input, float negative_slope, Tensor *mask,
+               Tensor *output) {
+  KernelMetadata meta_data = unary_metadata(input, output);
+  float scalars[] = {negative_slope, mask ? 1.0f : 0.0f};
+  // threadgroups of 256 threads or a single one, the mask words are filled
+  // by whole simdgroups
+  std::pair<size_t, size_t> threadinfo =
+      this->compute_threads(output->size, 256);
+  this->_dispatch_tensors("__relu__", {input, output, mask ? mask : output},
+                          meta_data.values, meta_data.bytes(),
+                          MTLSizeMake(threadinfo.second, 1, 1),
+                          MTLSizeMake(threadinfo.first, 1, 1), scalars,
+                          sizeof(scalars));
+}
+void MPS::sigmoid(const Tensor *input, Tensor *output) {
+  this->initiate_dispatch_unary("__sigmoid__", input, output);
+}
+void MPS::gelu(const Tensor *input, Tensor *output) {
+  this->initiate_dispatch_unary("__gelu__", input, output);
+}
+void MPS::silu(const Tensor *input, Tensor *output) {
+  this->initiate_dispatch_unary("__silu__", input, output);
+}
+
+void MPS::activation_grad(const Tensor *grad, const Tensor *saved,
+                          Activation activation, Tensor *result) {
+  int meta[] = {result->size, static_cast<int>(activation)};
+  std::pair<size_t, size_t> threadinfo =
+      this->compute_threads(result->size, 256);
+  this->_dispatch_tensors("__activation_grad__", {grad, saved, result}, meta,
+                          sizeof(meta), MTLSizeMake(threadinfo.second, 1, 1),
+                          MTLSizeMake(threadinfo.first, 1, 1));
+}
+
+void MPS::mask_grad(const Tensor *grad, const Tensor *mask,
+                    float negative_slope, Tensor *result) {
+  int meta[] = {result->size};
+  float scalars[] = {negative_slope};
+  std::pair<size_t, size_t> threadinfo =
+      this->compute_threads(result->size, 256);
+  this->_dispatch_tensors("__mask_grad__", {grad, mask, result}, meta,
+                          sizeof(meta), MTLSizeMake(threadinfo.second, 1, 1),
+                          MTLSizeMake(threadinfo.first, 1, 1), scalars,
+                          sizeof(scalars));
+}
+
+void MPS::dropout(const Tensor *input, float p, RandomState state,
+                  Tensor *output) {
+  int meta[] = {static_cast<int>(output->size), static_cast<int>(state.seed),
+                static_cast<int>(state.offset & 0xffffffffu),
+                static_cast<int>(state.offset >> 32)};
+  float scalars[] = {p, 1.0f / (1.0f - p)};
+  std::pair<size_t, size_t> threadinfo =
+      this->compute_threads(output->size, 256);
+  this->_dispatch_tensors("__dropout__", {input, output}, meta, sizeof(meta),
+                          MTLSizeMake(threadinfo.second, 1, 1),
+                          MTLSizeMake(threadinfo.first, 1, 1), scalars,
+                          sizeof(scalars));
+}
+
+// ==================================================
+//                     LINEAR
+// ==================================================
+// a 32x32 tile of the result per threadgroup of 8x8 threads, see linear.metal
+static MTLSize gemm_groups(int rows, int cols) {
+  return MTLSizeMake((cols + 31) / 32, (rows + 31) / 32, 1);
+}
+
+void MPS::linear(const Tensor *x, const Tensor *weight, const Tensor *bias,
+                 Activation activation, Tensor *pre, Tensor *result) {
+  int K = weight->dims[1];
+  int N = weight->dims[0];
+  int M = x->size / K;
+  int meta[] = {M, N, K, static_cast<int>(activation), bias != nullptr,
+                pre != nullptr};
+  // unused slots are bound to the result and never read
+  this->_dispatch_tensors(
+      "__linear__",
+      {x, weight, bias ? bias : result, pre ? pre : result, result}, meta,
+      sizeof(meta), gemm_groups(M, N), MTLSizeMake(8, 8, 1));
+}
+
+void MPS::linear_grad_input(const Tensor *grad, const Tensor *saved,
+                            const Tensor *weight, Activation activation,
+                            Tensor *result) {
+  int K = weight->dims[1];
+  int N = weight->dims[0];
+  int M = grad->size / N;
+  int meta[] = {M, N, K, static_cast<int>(activation)};
+  this->_dispatch_tensors("__linear_grad_input__",
+                          {grad, saved, weight, result}, meta, sizeof(meta),
+                          gemm_groups(M, K), MTLSizeMake(8, 8, 1));
+}
+
+void MPS::linear_grad_weight(const Tensor *grad, const Tensor *saved,
+                             const Tensor *x, Activation activation,
+                             Tensor *result) {
+  int K = result->dims[1];
+  int N = result->dims[0];
+  int M = grad->size / N;
+  int meta[] = {M, N, K, static_cast<int>(activation)};
+  this->_dispatch_tensors("__linear_grad_weight__", {grad, saved, x, result},
+                          meta, sizeof(meta), gemm_groups(N, K),
+                          MTLSizeMake(8, 8, 1));
+}
+
+void MPS::linear_grad_bias(const Tensor *grad, const Tensor *saved,
+                           Activation activation, Tensor *result) {
+  int N = result->size;
+  int M = grad->size / N;
+  int meta[] = {M, N, 0, static_cast<int>(activation)};
+  std::pair<size_t, size_t> threadinfo = this->compute_threads(N, 256);
+  this->_dispatch_tensors("__linear_grad_bias__", {grad, saved, result}, meta,
+                          sizeof(meta), MTLSizeMake(threadinfo.second, 1, 1),
+                          MTLSizeMake(threadinfo.first, 1, 1));
+}
+
+// ==================================================
+//                     NORMALIZATION
+// ==================================================
+// keep in sync with NormMode in norm.metal
+enum NormMode { NORM_BATCH, NORM_UPDATE_RUNNING, NORM_FROM_RUNNING };
+
+// a threadgroup reduces every row or column, see norm.metal
+static const int NORM_THREADS = 256;
+
+void MPS::normalize(const Tensor *x, const Tensor *weight, const Tensor *bias,
+                    Tensor *running_mean, Tensor *running_var, bool per_row,
+                    bool training, float eps, float momentum, Tensor *mean,
+                    Tensor *rstd, Tensor *result) {
+  int cols = x->dims.back();
+  int rows = x->size / cols;
+  int groups = per_row ? rows : cols;
+  int mode = NORM_BATCH;
+  if (!training) {
+    mode = NORM_FROM_RUNNING;
+  } else if (running_mean) {
+    mode = NORM_UPDATE_RUNNING;
+  }
+  int stats_meta[] = {groups, per_row ? cols : rows, per_row ? cols : 1,
+                      per_row ? 1 : cols, mode};
+  float scalars[] = {eps, momentum};
+  // unused slots are bound to the statistics and never touched
+  this->_dispatch_tensors(
+      "__norm_stats__",
+      {x, mean, rstd, running_mean ? running_mean : mean,
+       running_var ? running_var : rstd},
+      stats_meta, sizeof(stats_meta), MTLSizeMake(groups, 1, 1),
+      MTLSizeMake(NORM_THREADS, 1, 1), scalars, sizeof(scalars));
+
+  int apply_meta[] = {x->size, cols, per_row, weight != nullptr,
+                      bias != nullptr};
+  std::pair<size_t, size_t> threadinfo = this->compute_threads(x->size, 256);
+  this->_dispatch_tensors(
+      "__norm_apply__",
+      {x, mean, rstd, weight ? weight : result, bias ? bias : result, result},
+      apply_meta, sizeof(apply_meta), MTLSizeMake(threadinfo.second, 1, 1),
+      MTLSizeMake(threadinfo.first, 1, 1));
+}
+
+void MPS::normalize_backward(const Tensor *grad, const Tensor *x,
+                             const Tensor *weight, const Tensor *mean,
+                             const Tensor *rstd, bool per_row, bool training,
+                             Tensor *sums, Tensor *grad_weight,
+                             Tensor *grad_bias, Tensor *grad_input) {
+  int cols = x->dims.back();
+  int rows = x->size / cols;
+  int groups = per_row ? rows : cols;
+  int count = per_row ? cols : rows;
+  // batch norm gets its weight and bias gradients from the same pass
+  if (training || (!per_row && (grad_weight || grad_bias))) {
+    int stats_meta[] = {groups,
+                        count,
+                        per_row ? cols : 1,
+                        per_row ? 1 : cols,
+                        cols,
+                        per_row,
+                        weight != nullptr,
+                        grad_weight != nullptr,
+                        grad_bias != nullptr};
+    this->_dispatch_tensors(
+        "__norm_backward_stats__",
+        {grad, x, mean, rstd, weight ? weight : sums, sums,
+         grad_weight ? grad_weight : sums, grad_bias ? grad_bias : sums},
+        stats_meta, sizeof(stats_meta), MTLSizeMake(groups, 1, 1),
+        MTLSizeMake(NORM_THREADS, 1, 1));
+  }
+
+  int input_meta[] = {x->size,           cols,  per_row,
+                      weight != nullptr, count, training};
+  std::pair<size_t, size_t> threadinfo = this->compute_threads(x->size, 256);
+  this->_dispatch_tensors(
+      "__norm_backward_input__",
+      {grad, x, mean, rstd, weight ? weight : sums, sums, grad_input},
+      input_meta, sizeof(input_meta), MTLSizeMake(threadinfo.second, 1, 1),
+      MTLSizeMake(threadinfo.first, 1, 1));
+
+  if (per_row && (grad_weight || grad_bias)) {
+    int affine_meta[] = {rows, cols, grad_weight != nullptr,
+                         grad_bias != nullptr};
+    threadinfo = this->compute_threads(cols, 256);
+    this->_dispatch_tensors("__norm_backward_affine__",
+                            {grad, x, mean, rstd,
+                             grad_weight ? grad_weight : grad_input,
+                             grad_bias ? grad_bias : grad_input},
+                            affine_meta, sizeof(affine_meta),
+                            MTLSizeMake(threadinfo.second, 1, 1),
+                            MTLSizeMake(threadinfo.first, 1, 1));
+  }
 }
 
 // ==================================================
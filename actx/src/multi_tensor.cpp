@@ -0,0 +1,195 @@
+#include "multi_tensor.h"
+#include "main.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int multi_tensor_depth(MultiTensorOp op) {
+  switch (op) {
+  case MultiTensorOp::SCALE:
+  case MultiTensorOp::FILL:
+  case MultiTensorOp::SUM_SQUARES:
+  case MultiTensorOp::CLIP:
+    return 1;
+  case MultiTensorOp::AXPY:
+    return 2;
+  case MultiTensorOp::SGD:
+    return 3;
+  case MultiTensorOp::ADAM:
+    return 4;
+  }
+  throw std::invalid_argument("unknown multi tensor op");
+}
+
+int multi_tensor_scalars(MultiTensorOp op) {
+  switch (op) {
+  case MultiTensorOp::SUM_SQUARES:
+    return 0;
+  case MultiTensorOp::CLIP:
+    return 2;
+  case MultiTensorOp::SCALE:
+  case MultiTensorOp::FILL:
+  case MultiTensorOp::AXPY:
+    return 1;
+  case MultiTensorOp::SGD:
+    return 4;
+  case MultiTensorOp::ADAM:
+    return 8;
+  }
+  throw std::invalid_argument("unknown multi tensor op");
+}
+
+static void check_operands(MultiTensorOp op,
+                           const std::vector<std::vector<Tensor *>> &lists,
+                           const std::vector<float> &scalars) {
+  if (lists.size() != multi_tensor_depth(op)) {
+    throw std::invalid_argument(
+        "multi_tensor_apply expects " +
+        std::to_string(multi_tensor_depth(op)) + " tensor lists, got " +
+        std::to_string(lists.size()));
+  }
+  if (scalars.size() != multi_tensor_scalars(op)) {
+    throw std::invalid_argument(
+        "multi_tensor_apply expects " +
+        std::to_string(multi_tensor_scalars(op)) + " scalars, got " +
+        std::to_string(scalars.size()));
+  }
+  for (const std::vector<Tensor *> &list : lists) {
+    if (list.size() != lists[0].size()) {
+      throw std::invalid_argument("tensor lists have different lengths");
+    }
+    for (int i = 0; i < list.size(); i++) {
+      const Tensor *tensor = list[i];
+      if (tensor->dtype != DType::float32 || !tensor->is_contigous ||
+          tensor->device != DeviceType::MPS) {
+        throw std::invalid_argument(
+            "multi_tensor_apply needs dense float32 tensors");
+      }
+      if (tensor->size != lists[0][i]->size) {
+        throw std::invalid_argument("operands of tensor " + std::to_string(i) +
+                                    " have different sizes");
+      }
+    }
+  }
+}
+
+// runs `op` over checked operands, `out` is bound to slot 0 of the list
+// after the operands in every launch
+static void apply(MultiTensorOp op,
+                  const std::vector<std::vector<Tensor *>> &lists,
+                  const std::vector<float> &scalars, Tensor *out) {
+  int depth = lists.size();
+  int count = lists[0].size();
+
+  std::vector<const Memory *> memories;
+  for (const std::vector<Tensor *> &list : lists) {
+    for (const Tensor *tensor : list) {
+      memories.push_back(tensor->memory);
+      // written without the dispatcher
+      fuser->forget_constant(tensor->memory);
+    }
+  }
+  if (out) {
+    memories.push_back(out->memory);
+    fuser->forget_constant(out->memory);
+    out->memory->version++;
+  }
+  // x, z and w are written, y and the x of SUM_SQUARES are only read
+  for (int k = 0; k < depth; k++) {
+    if (k == 1 || op == MultiTensorOp::SUM_SQUARES)
+      continue;
+    for (Tensor *tensor : lists[k])
+      tensor->memory->version++;
+  }
+  pool->trace_use(memories);
+  // setBytes needs at least one byte
+  std::vector<float> bound_scalars = scalars;
+  if (bound_scalars.empty())
+    bound_scalars.push_back(0.0f);
+
+  // metadata: [op, chunk_size, first_chunk, sizes, chunks (tensor, start)]
+  std::vector<std::vector<const Tensor *>> slots(depth);
+  std::vector<int> sizes;
+  std::vector<int> chunks;
+  int launched = 0;
+  auto launch = [&]() {
+    if (chunks.empty())
+      return;
+    std::vector<int> meta = {static_cast<int>(op),
+                             MultiTensorLimits::CHUNK_SIZE, launched};
+    sizes.resize(MultiTensorLimits::MAX_TENSORS, 0);
+    meta.insert(meta.end(), sizes.begin(), sizes.end());
+    meta.insert(meta.end(), chunks.begin(), chunks.end());
+    std::vector<std::vector<const Tensor *>> bound = slots;
+    if (out)
+      bound.push_back({out});
+    mps->execute_kernel_multi_tensor(
+        bound, meta.data(), meta.size() * sizeof(int), bound_scalars.data(),
+        bound_scalars.size() * sizeof(float), chunks.size() / 2,
+        MultiTensorLimits::THREADS);
+    launched += chunks.size() / 2;
+    for (std::vector<const Tensor *> &slot : slots)
+      slot.clear();
+    sizes.clear();
+    chunks.clear();
+  };
+
+  for (int i = 0; i < count; i++) {
+    int size = lists[0][i]->size;
+    if (size == 0)
+      continue;
+    if (slots[0].size() == MultiTensorLimits::MAX_TENSORS)
+      launch();
+    for (int k = 0; k < depth; k++)
+      slots[k].push_back(lists[k][i]);
+    sizes.push_back(size);
+    // a tensor larger than what is left of the launch carries over
+    for (int start = 0; start < size; start += MultiTensorLimits::CHUNK_SIZE) {
+      if (chunks.size() / 2 == MultiTensorLimits::MAX_CHUNKS) {
+        launch();
+        for (int k = 0; k < depth; k++)
+          slots[k].push_back(lists[k][i]);
+        sizes.push_back(size);
+      }
+      chunks.push_back(slots[0].size() - 1);
+      chunks.push_back(start);
+    }
+  }
+  launch();
+}
+
+void multi_tensor_apply(MultiTensorOp op,
+                        const std::vector<std::vector<Tensor *>> &lists,
+                        const std::vector<float> &scalars) {
+  if (op == MultiTensorOp::SUM_SQUARES || op == MultiTensorOp::CLIP) {
+    throw std::invalid_argument(
+        "SUM_SQUARES and CLIP run through multi_tensor_l2_norm and "
+        "multi_tensor_clip");
+  }
+  check_operands(op, lists, scalars);
+  apply(op, lists, scalars, nullptr);
+}
+
+Tensor *multi_tensor_l2_norm(const std::vector<Tensor *> &tensors) {
+  check_operands(MultiTensorOp::SUM_SQUARES, {tensors}, {});
+  int partials = 0;
+  for (const Tensor *tensor : tensors) {
+    partials += (tensor->size + MultiTensorLimits::CHUNK_SIZE - 1) /
+                MultiTensorLimits::CHUNK_SIZE;
+  }
+  if (partials == 0)
+    return Tensor::zeros({1});
+  Tensor *sums = Tensor::empty({partials});
+  apply(MultiTensorOp::SUM_SQUARES, {tensors}, {}, sums);
+  return sums->sum_to({1})->sqrt(true);
+}
+
+void multi_tensor_clip(const std::vector<Tensor *> &tensors, Tensor *norm,
+                       float max_norm, float eps) {
+  check_operands(MultiTensorOp::CLIP, {tensors}, {max_norm, eps});
+  if (norm->size != 1 || norm->dtype != DType::float32 ||
+      norm->device != DeviceType::MPS) {
+    throw std::invalid_argument("the norm must be a 1-element float32 tensor");
+  }
+  apply(MultiTensorOp::CLIP, {tensors}, {max_norm, eps}, norm);
+}
@@ -0,0 +1,206 @@
+#include "optimizer.h"
+#include "main.h"
+#include "multi_tensor.h"
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+Optimizer::Optimizer(std::vector<Tensor *> params, float lr)
+    : _params(std::move(params)), lr(lr) {
+  for (const Tensor *param : _params) {
+    if (param->dtype != DType::float32 || !param->is_contigous) {
+      throw std::invalid_argument(
+          "optimizers update dense float32 parameters");
+    }
+  }
+}
+
+void Optimizer::_collect(const std::vector<Tensor *> &grads,
+                         std::vector<Tensor *> &params,
+                         std::vector<Tensor *> &used_grads,
+                         std::vector<int> &indexes) const {
+  if (!grads.empty() && grads.size() != _params.size()) {
+    throw std::invalid_argument(
+        "expected " + std::to_string(_params.size()) + " gradients, got " +
+        std::to_string(grads.size()));
+  }
+  for (int i = 0; i < _params.size(); i++) {
+    Tensor *grad = grads.empty() ? _params[i]->grad : grads[i];
+    if (!grad)
+      continue;
+    if (grad->size != _params[i]->size) {
+      throw std::invalid_argument("gradient " + std::to_string(i) +
+                                  " does not match its parameter");
+    }
+    if (grad->dtype != DType::float32)
+      grad = grad->to(DType::float32);
+    params.push_back(_params[i]);
+    used_grads.push_back(grad->contiguous());
+    indexes.push_back(i);
+  }
+}
+
+void Optimizer::zero_grad(bool set_to_none) {
+  std::vector<Tensor *> grads;
+  for (Tensor *param : _params) {
+    if (set_to_none) {
+      param->grad = nullptr;
+    } else if (param->grad && param->grad->is_contigous &&
+               param->grad->dtype == DType::float32) {
+      grads.push_back(param->grad);
+    } else if (param->grad) {
+      param->grad->fill(0.0f);
+    }
+  }
+  if (!grads.empty())
+    multi_tensor_apply(MultiTensorOp::FILL, {grads}, {0.0f});
+}
+
+// the state buffer of parameter `index`, zeros on first use
+static Tensor *state(std::vector<Tensor *> &buffers, const Tensor *param,
+                     int index) {
+  if (!buffers[index])
+    buffers[index] = Tensor::zeros(param->dims);
+  return buffers[index];
+}
+
+SGD::SGD(std::vector<Tensor *> params, float lr, float momentum,
+         float weight_decay, bool nesterov)
+    : Optimizer(std::move(params), lr), momentum(momentum),
+      weight_decay(weight_decay), nesterov(nesterov) {
+  if (nesterov && momentum <= 0.0f) {
+    throw std::invalid_argument("nesterov needs a positive momentum");
+  }
+  _momentum_buffers.assign(_params.size(), nullptr);
+}
+
+void SGD::step(const std::vector<Tensor *> &grads) {
+  std::vector<Tensor *> params, used_grads, buffers;
+  std::vector<int> indexes;
+  this->_collect(grads, params, used_grads, indexes);
+  if (params.empty())
+    return;
+  if (momentum == 0.0f) {
+    // the kernel never reads the buffers without momentum
+    buffers = params;
+  } else {
+    for (int i = 0; i < params.size(); i++) {
+      buffers.push_back(state(_momentum_buffers, params[i], indexes[i]));
+    }
+  }
+  multi_tensor_apply(MultiTensorOp::SGD, {params, used_grads, buffers},
+                     {lr, momentum, weight_decay, nesterov ? 1.0f : 0.0f});
+}
+
+Adam::Adam(std::vector<Tensor *> params, float lr, float beta1, float beta2,
+           float eps, float weight_decay)
+    : Optimizer(std::move(params), lr), beta1(beta1), beta2(beta2), eps(eps),
+      weight_decay(weight_decay) {
+  if (beta1 < 0.0f || beta1 >= 1.0f || beta2 < 0.0f || beta2 >= 1.0f) {
+    throw std::invalid_argument("betas must be in [0, 1)");
+  }
+  _exp_avg.assign(_params.size(), nullptr);
+  _exp_avg_sq.assign(_params.size(), nullptr);
+}
+
+void Adam::step(const std::vector<Tensor *> &grads) {
+  std::vector<Tensor *> params, used_grads, exp_avg, exp_avg_sq;
+  std::vector<int> indexes;
+  this->_collect(grads, params, used_grads, indexes);
+  if (params.empty())
+    return;
+  for (int i = 0; i < params.size(); i++) {
+    exp_avg.push_back(state(_exp_avg, params[i], indexes[i]));
+    exp_avg_sq.push_back(state(_exp_avg_sq, params[i], indexes[i]));
+  }
+  steps++;
+  float bias_correction1 = 1.0f - std::pow(beta1, steps);
+  float bias_correction2 = 1.0f - std::pow(beta2, steps);
+  multi_tensor_apply(MultiTensorOp::ADAM,
+                     {params, used_grads, exp_avg, exp_avg_sq},
+                     {lr, beta1, beta2, eps, weight_decay, bias_correction1,
+                      bias_correction2, _decoupled ? 1.0f : 0.0f});
+}
+
+AdamW::AdamW(std::vector<Tensor *> params, float lr, float beta1, float beta2,
+             float eps, float weight_decay)
+    : Adam(std::move(params), lr, beta1, beta2, eps, weight_decay) {
+  _decoupled = true;
+}
+
+Tensor *clip_grad_norm(const std::vector<Tensor *> &params, float max_norm,
+                       float eps) {
+  if (!(max_norm > 0.0f)) {
+    throw std::invalid_argument("max_norm must be positive");
+  }
+  std::vector<Tensor *> grads;
+  for (const Tensor *param : params) {
+    if (!param->grad)
+      continue;
+    if (param->grad->dtype != DType::float32 || !param->grad->is_contigous) {
+      throw std::invalid_argument(
+          "clip_grad_norm scales dense float32 gradients in place");
+    }
+    grads.push_back(param->grad);
+  }
+  Tensor *norm = multi_tensor_l2_norm(grads);
+  if (!grads.empty())
+    multi_tensor_clip(grads, norm, max_norm, eps);
+  return norm;
+}
+
+// what a micro-batch leaves behind: the running total and the gradients of
+// `params` and of every leaf its graph reads, which may have adopted a
+// temporary of the micro-batch
+static std::unordered_set<const Memory *>
+micro_batch_keep(const std::vector<Tensor *> &params, Tensor *value,
+                 const Tensor *total) {
+  std::unordered_set<const Memory *> keep;
+  if (total)
+    keep.insert(total->memory);
+  std::vector<Tensor *> leaves = params;
+  if (value) {
+    std::vector<Tensor *> read = Tensor::graph_leaves({value});
+    leaves.insert(leaves.end(), read.begin(), read.end());
+  }
+  for (const Tensor *leaf : leaves) {
+    if (leaf->grad)
+      keep.insert(leaf->grad->memory);
+  }
+  return keep;
+}
+
+Tensor *accumulate_gradients(const std::vector<Tensor *> &params,
+                             int micro_batches, const MicroBatchLoss &loss) {
+  if (micro_batches < 1) {
+    throw std::invalid_argument("micro_batches must be positive");
+  }
+  float scale = 1.0f / micro_batches;
+  Tensor *total = nullptr;
+  for (int i = 0; i < micro_batches; i++) {
+    pool->begin_region();
+    Tensor *value = nullptr;
+    try {
+      value = loss(i);
+      if (!total)
+        total = Tensor::zeros({1}, value->dtype, false, value->device);
+      // the seed scales every gradient the pass computes, there is nothing
+      // left to scale when it is added to the buffers
+      Tensor *seed =
+          Tensor::full({1}, scale, value->dtype, false, value->device);
+      Tensor::backward({value}, {seed->expand(value->dims)});
+      total->add(value->detach()->sum_to({1})->mul(scale), true);
+    } catch (...) {
+      // only the gradients stay, the total is never returned
+      pool->return_region(pool->end_region(),
+                          micro_batch_keep(params, value, nullptr));
+      if (total && pool->in_use(total->memory))
+        pool->return_memory(total->memory);
+      throw;
+    }
+    pool->return_region(pool->end_region(),
+                        micro_batch_keep(params, value, total));
+  }
+  return total;
+}
@@ -0,0 +1,16 @@
+#include "random.h"
+#include <random>
+
+static RandomState state = {std::random_device{}(), 0};
+
+void manual_seed(uint32_t seed) { state = {seed, 0}; }
+
+RandomState get_rng_state() { return state; }
+
+void set_rng_state(RandomState saved) { state = saved; }
+
+RandomState next_random(uint64_t count) {
+  RandomState reserved = state;
+  state.offset += count;
+  return reserved;
+}
@@ -1,6 +1,7 @@
 #include "tensor.h"
 #include "main.h"
 #include "opnode.h"
+#include "random.h"
 #include "types.h"
 #include "utility.h"
 #include <cassert>
@@ -9,6 +10,7 @@
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <numeric>
 #include <stdexcept>
@@ -23,6 +25,8 @@
 Tensor *Tensor::view(std::vector<Slice> &slices) const {
   assert(slices.size() <= this->ndim);
 
+  // a pending tensor is dropped once it is deleted, its views need the values
+  fuser->materialize(this->memory);
   std::vector<int> view_dims = {1, 1};
   Tensor *view_tensor = new Tensor(this->memory, view_dims);
 
@@ -60,11 +64,93 @@ Tensor *Tensor::view(std::vector<Slice> &slices) const {
     new_offset_elements += start * this->stride[d];
   }
   view_tensor->offset_elements = new_offset_elements;
+  view_tensor->is_contigous = view_tensor->_compute_contiguity();
   view_tensor->size =
       std::accumulate(view_tensor->dims.begin(), view_tensor->dims.end(), 1,
                       std::multiplies<int>());
   return view_tensor;
 }
+bool Tensor::_compute_contiguity() const {
+  // dims of length 1 never move the offset, so their stride does not matter
+  int expected = 1;
+  for (int i = this->ndim - 1; i >= 0; i--) {
+    if (this->dims[i] != 1 && this->stride[i] != expected)
+      return false;
+    expected *= this->dims[i];
+  }
+  return true;
+}
+
+int Tensor::_normalize_dim(int dim, int rank) const {
+  if (dim < 0)
+    dim += rank;
+  if (dim < 0 || dim >= rank) {
+    throw std::out_of_range("dimension out of range");
+  }
+  return dim;
+}
+
+std::vector<int> Tensor::_infer_shape(std::vector<int> shape) const {
+  int inferred = -1;
+  int known = 1;
+  for (int i = 0; i < shape.size(); i++) {
+    if (shape[i] == -1) {
+      if (inferred != -1)
+        throw std::invalid_argument("only one dimension can be inferred");
+      inferred = i;
+    } else if (shape[i] <= 0) {
+      throw std::invalid_argument("dims must be positive integers");
+    } else {
+      known *= shape[i];
+    }
+  }
+  if (inferred != -1) {
+    if (this->size % known != 0)
+      throw std::invalid_argument("shape is invalid for the tensor size");
+    shape[inferred] = this->size / known;
+    known *= shape[inferred];
+  }
+  if (known != this->size)
+    throw std::invalid_argument("shape is invalid for the tensor size");
+  return shape;
+}
+
+// strides that let `shape` address the same elements as the current layout,
+// empty when no such strides exist (e.g. flattening a transposed matrix).
+// consecutive dims that are contiguous with each other form a chunk that can
+// be split or merged freely, the chunks themselves have to be kept.
+std::vector<int>
+Tensor::_compute_view_stride(const std::vector<int> &shape) const {
+  std::vector<int> new_stride(shape.size());
+  int view_d = static_cast<int>(shape.size()) - 1;
+  int chunk_base_stride = this->stride.back();
+  int tensor_numel = 1;
+  int view_numel = 1;
+  for (int tensor_d = this->ndim - 1; tensor_d >= 0; tensor_d--) {
+    tensor_numel *= this->dims[tensor_d];
+    if (tensor_d == 0 ||
+        (this->dims[tensor_d - 1] != 1 &&
+         this->stride[tensor_d - 1] != tensor_numel * chunk_base_stride)) {
+      while (view_d >= 0 &&
+             (view_numel < tensor_numel || shape[view_d] == 1)) {
+        new_stride[view_d] = view_numel * chunk_base_stride;
+        view_numel *= shape[view_d];
+        view_d--;
+      }
+      if (view_numel != tensor_numel)
+        return {};
+      if (tensor_d > 0) {
+        chunk_base_stride = this->stride[tensor_d - 1];
+        tensor_numel = 1;
+        view_numel = 1;
+      }
+    }
+  }
+  if (view_d != -1)
+    return {};
+  return new_stride;
+}
+
 void Tensor::_compte_stride() {
   /*strides[i] = (j=i+1 ∏ len(dims) - 1){shape[j]}*/
   if (this->ndim == 0 || this->dims.empty()) {
@@ -97,6 +183,16 @@ int Tensor::_compute_offset(std::vector<int> indexes) const {
   }
   return offset;
 }
+
+// physical offset of the flat_index-th element in row major order
+int Tensor::_compute_offset(int flat_index) const {
+  int offset = 0;
+  for (int i = this->ndim - 1; i >= 0; i--) {
+    offset += (flat_index % this->dims[i]) * this->stride[i];
+    flat_index /= this->dims[i];
+  }
+  return offset;
+}
 // ================================================================================================================================
 
 void Tensor::throw_out_of_bound(std::vector<int> indexes) const {
@@ -110,8 +206,9 @@ void Tensor::throw_out_of_bound(std::vector<int> indexes) const {
 void Tensor::reinterpret_pointer(void *ptr) {
   switch (this->dtype) {
   case DType::int8:
-    break;
+  case DType::uint8:
   case DType::float16:
+  case DType::bfloat16:
   case DType::int16:
     this->data_ptr = ptr;
     break;
@@ -202,22 +299,199 @@ Tensor::Tensor(std::vector<float> &values, std::vector<int> dims, DType dtype,
   }
 }
 
+Tensor::~Tensor() {
+  if (fuser) {
+    fuser->release(this);
+  }
+}
+
+// ================================================================================================================================
+// VIEWS
+// ================================================================================================================================
+Tensor *Tensor::make_view(std::vector<int> dims, std::vector<int> stride,
+                          int offset_elements, OPType op,
+                          std::vector<int> params) {
+  fuser->materialize(this->memory);
+  Tensor *view_tensor = new Tensor(this->memory, dims, this->dtype,
+                                   this->requires_grad, this->device);
+  view_tensor->stride = stride;
+  view_tensor->offset_elements = offset_elements;
+  view_tensor->is_view = true;
+  view_tensor->is_contigous = view_tensor->_compute_contiguity();
+  if (view_tensor->requires_grad) {
+    view_tensor->node->inputs = {this};
+    view_tensor->node->outputs = {view_tensor};
+    view_tensor->node->type = op;
+    view_tensor->node->op = dispatcher->get(op, this->device);
+    view_tensor->node->attributes.ints = params;
+    record_versions(view_tensor->node);
+  }
+  return view_tensor;
+}
+
+Tensor *Tensor::transpose(int dim0, int dim1) {
+  std::vector<int> order(this->ndim);
+  std::iota(order.begin(), order.end(), 0);
+  std::swap(order[this->_normalize_dim(dim0, this->ndim)],
+            order[this->_normalize_dim(dim1, this->ndim)]);
+  return this->permute(order);
+}
+
+Tensor *Tensor::permute(std::vector<int> order) {
+  if (order.size() != this->ndim) {
+    throw std::invalid_argument("permutation must list every dimension");
+  }
+  std::vector<bool> seen(this->ndim, false);
+  std::vector<int> new_dims(this->ndim), new_stride(this->ndim);
+  for (int i = 0; i < this->ndim; i++) {
+    order[i] = this->_normalize_dim(order[i], this->ndim);
+    if (seen[order[i]]) {
+      throw std::invalid_argument("repeated dimension in permutation");
+    }
+    seen[order[i]] = true;
+    new_dims[i] = this->dims[order[i]];
+    new_stride[i] = this->stride[order[i]];
+  }
+  return this->make_view(new_dims, new_stride, this->offset_elements,
+                         OPType::PERMUTE, order);
+}
+
+Tensor *Tensor::view(std::vector<int> shape) {
+  shape = this->_infer_shape(shape);
+  std::vector<int> new_stride = this->_compute_view_stride(shape);
+  if (new_stride.empty()) {
+    throw std::runtime_error(
+        "view shape is not compatible with the tensor strides");
+  }
+  return this->make_view(shape, new_stride, this->offset_elements,
+                         OPType::RESHAPE, {});
+}
+
+Tensor *Tensor::reshape(std::vector<int> shape) {
+  shape = this->_infer_shape(shape);
+  if (this->_compute_view_stride(shape).empty()) {
+    return this->contiguous()->view(shape);
+  }
+  return this->view(shape);
+}
+
+Tensor *Tensor::contiguous() {
+  if (this->is_contigous) {
+    return this;
+  }
+  Tensor *result =
+      new Tensor(this->dims, this->dtype, this->requires_grad, this->device);
+  dispatcher->call(OPType::CONTIGUOUS, this->device, {this, result});
+  return result;
+}
+
+Tensor *Tensor::expand(std::vector<int> shape) {
+  if (shape.size() < this->ndim) {
+    throw std::invalid_argument("expand can not reduce the number of dims");
+  }
+  int leading = shape.size() - this->ndim;
+  std::vector<int> new_stride(shape.size(), 0);
+  for (int i = 0; i < shape.size(); i++) {
+    if (i < leading) {
+      // new leading dims repeat the whole tensor
+      if (shape[i] <= 0)
+        throw std::invalid_argument("expanded dims must be positive");
+      continue;
+    }
+    int d = i - leading;
+    if (shape[i] == -1 || shape[i] == this->dims[d]) {
+      shape[i] = this->dims[d];
+      new_stride[i] = this->stride[d];
+    } else if (this->dims[d] != 1) {
+      throw std::invalid_argument("only dims of length 1 can be expanded");
+    }
+  }
+  return this->make_view(shape, new_stride, this->offset_elements,
+                         OPType::EXPAND, {});
+}
+
+Tensor *Tensor::squeeze() {
+  std::vector<int> new_dims, new_stride;
+  for (int i = 0; i < this->ndim; i++) {
+    if (this->dims[i] != 1) {
+      new_dims.push_back(this->dims[i]);
+      new_stride.push_back(this->stride[i]);
+    }
+  }
+  // tensors always keep at least one dim
+  if (new_dims.empty()) {
+    new_dims.push_back(1);
+    new_stride.push_back(1);
+  }
+  return this->make_view(new_dims, new_stride, this->offset_elements,
+                         OPType::RESHAPE, {});
+}
+
+Tensor *Tensor::squeeze(int dim) {
+  dim = this->_normalize_dim(dim, this->ndim);
+  std::vector<int> new_dims = this->dims;
+  std::vector<int> new_stride = this->stride;
+  if (this->dims[dim] == 1 && this->ndim > 1) {
+    new_dims.erase(new_dims.begin() + dim);
+    new_stride.erase(new_stride.begin() + dim);
+  }
+  return this->make_view(new_dims, new_stride, this->offset_elements,
+                         OPType::RESHAPE, {});
+}
+
+Tensor *Tensor::unsqueeze(int dim) {
+  dim = this->_normalize_dim(dim, this->ndim + 1);
+  std::vector<int> new_dims = this->dims;
+  std::vector<int> new_stride = this->stride;
+  int stride = dim < this->ndim ? this->dims[dim] * this->stride[dim] : 1;
+  new_dims.insert(new_dims.begin() + dim, 1);
+  new_stride.insert(new_stride.begin() + dim, stride);
+  return this->make_view(new_dims, new_stride, this->offset_elements,
+                         OPType::RESHAPE, {});
+}
+
+Tensor *Tensor::sum_to(std::vector<int> shape) {
+  if (shape.size() > this->ndim) {
+    throw std::invalid_argument("sum_to can not add dims");
+  }
+  int leading = this->ndim - shape.size();
+  for (int i = 0; i < shape.size(); i++) {
+    if (shape[i] != 1 && shape[i] != this->dims[i + leading]) {
+      throw std::invalid_argument("shape is not broadcastable to the tensor");
+    }
+  }
+  Tensor *result =
+      new Tensor(shape, this->dtype, this->requires_grad, this->device);
+  dispatcher->call(OPType::SUM_TO, this->device, {this, result});
+  return result;
+}
+
 // ================================================================================================================================
 // GETTERS & SETTERS
 // ================================================================================================================================
 
 std::vector<int> Tensor::strides() { return this->stride; }
 
+void Tensor::materialize() const {
+  fuser->materialize(this->memory);
+  pool->trace_use({this->memory});
+  mps->wait_for({this->memory->data_ptr});
+}
+
+std::shared_future<void> Tensor::ready() const {
+  fuser->materialize(this->memory);
+  return mps->ready({this->memory->data_ptr});
+}
+
+void Tensor::on_ready(std::function<void()> callback) const {
+  fuser->materialize(this->memory);
+  mps->on_ready({this->memory->data_ptr}, std::move(callback));
+}
+
 float Tensor::_get_element(int offset) const {
+  this->materialize();
   int total_offset = (offset + offset_elements);
-  if (std::holds_alternative<int *>(this->data_ptr)) {
-    return std::get<int *>(this->data_ptr)[total_offset];
-  } else if (std::holds_alternative<float *>(this->data_ptr)) {
-    return std::get<float *>(this->data_ptr)[total_offset];
-  } else if (std::holds_alternative<void *>(this->data_ptr)) {
-    // return std::get<void *>(this->data_ptr)[offset];
-  }
-  return -1;
+  return load_element(this->memory->data_ptr, this->dtype, total_offset);
 }
 
 // TODO: fix the type float for value and make it dynamic
@@ -225,6 +499,12 @@ template <typename... Args>
 void Tensor::setElement(float value, Args... indexes) {
   int indices[] = {indexes...};
   this->throw_out_of_bound(indices);
+  // the host write must not be seen by programs recorded before it
+  fuser->flush_buffers({this->memory->data_ptr});
+  fuser->forget_constant(this->memory);
+  // kernels still reading the old value run first
+  mps->wait_for({this->memory->data_ptr});
+  this->memory->version++;
   int offset = this->_compute_offset(indices);
   if (std::holds_alternative<int *>(this->data_ptr)) {
     std::get<int *>(this->data_ptr)[offset] = value;
@@ -235,8 +515,6 @@ void Tensor::setElement(float value, Args... indexes) {
   }
 }
 
-// TODO: impelement this
-Tensor Tensor::transpose() const { throw std::logic_error("not implemented"); }
 void Tensor::print(int dim, int offset) const {
   std::string builder;
   builder.append("Tensor(");
@@ -275,7 +553,7 @@ void Tensor::tensor__repr__(int depth, int offset, int indent,
         i = this->dims[depth] - k;
       }
       int index = offset + i * this->stride[depth];
-      if (this->dtype == DType::float16 || this->dtype == DType::float32) {
+      if (isFloatingDType(this->dtype)) {
         char buffer[32];
         snprintf(buffer, sizeof(buffer), "%.6e", this->_get_element(index));
         builder.append(buffer);
@@ -315,7 +593,7 @@ void Tensor::tensor__repr__(int depth, int offset, int indent,
 
 void Tensor::print_buffer() const {
   for (int i = 0; i < this->size; i++) {
-    std::cout << this->_get_element(i) << " ";
+    std::cout << this->_get_element(this->_compute_offset(i)) << " ";
   }
   std::cout << std::endl;
 }
@@ -324,9 +602,6 @@ int Tensor::offset() const { return this->offset_elements; }
 Tensor *Tensor::execute_broadcastable_operation(OPType op, Tensor *other,
                                                 bool inplace) {
   if (inplace) {
-    // TODO: recheck this return null logic
-    if (this->requires_grad && other->requires_grad)
-      return NULL;
     dispatcher->call(op, this->device, {this, other, this});
     return this;
   }
@@ -369,10 +644,23 @@ Tensor *Tensor::execute_binary_operation(OPType op, Tensor *other) {
   return result;
 }
 
+Tensor *Tensor::execute_scalar_operation(OPType op, float scalar, bool inplace,
+                                         bool reflected) {
+  OpAttributes attributes = {{reflected ? 1 : 0}, {scalar}};
+  if (inplace) {
+    dispatcher->call(op, this->device, {this, this}, attributes);
+    return this;
+  }
+  Tensor *result =
+      new Tensor(this->dims, this->dtype, this->requires_grad, this->device);
+  dispatcher->call(op, this->device, {this, result}, attributes);
+  return result;
+}
+
 bool Tensor::all() {
   bool allTrue = true;
   for (int i = 0; i < this->size; i++) {
-    if (false == this->_get_element(i)) {
+    if (false == this->_get_element(this->_compute_offset(i))) {
       allTrue = false;
     }
   }
@@ -381,20 +669,36 @@ bool Tensor::all() {
 bool Tensor::any() {
   bool anyTrue = false;
   for (int i = 0; i < this->size; i++) {
-    if (this->_get_element(i)) {
+    if (this->_get_element(this->_compute_offset(i))) {
       anyTrue = true;
     }
   }
   return anyTrue;
 }
 
-std::vector<OpNode *> Tensor::topo_sort() {
+// an input written in place after `node` read it passes the gradient on to
+// the graph it had then, which moved to an alias
+static void reroute_overwritten(OpNode *node) {
+  if (node->input_versions.size() != node->inputs.size())
+    return;
+  for (int i = 0; i < node->inputs.size(); i++) {
+    for (const auto &[version, alias] : node->inputs[i]->overwritten) {
+      if (node->input_versions[i] <= version) {
+        node->inputs[i] = alias;
+        break;
+      }
+    }
+  }
+}
+
+std::vector<OpNode *> Tensor::topo_sort(const std::vector<Tensor *> &roots) {
   std::vector<OpNode *> topo;
   std::unordered_set<OpNode *> visited;
 
   std::function<void(OpNode *)> dfs = [&](OpNode *node) {
     if (visited.find(node) == visited.end()) {
       visited.insert(node);
+      reroute_overwritten(node);
       for (Tensor *parent : node->inputs) {
         if (parent->node)
           dfs(parent->node);
@@ -402,46 +706,145 @@ std::vector<OpNode *> Tensor::topo_sort() {
       topo.push_back(node);
     }
   };
-  dfs(this->node);
+  for (Tensor *root : roots) {
+    if (root->node)
+      dfs(root->node);
+  }
   return topo;
 }
 
-void Tensor::backward() {
-  if (!this->requires_grad)
-    return;
-  this->grad = Tensor::ones(this->dims, this->dtype, false, this->device);
+void Tensor::backward() { Tensor::backward({this}, {nullptr}); }
+
+// the ones a root is seeded with when no gradient is given, one element per
+// dtype and device that every such root views. it lives outside the pool,
+// so regions and memory plans never see it
+static std::map<std::pair<DType, DeviceType>, Tensor *> implicit_ones;
+
+static Tensor *implicit_grad(Tensor *root) {
+  Tensor *&one = implicit_ones[{root->dtype, root->device}];
+  if (!one) {
+    Memory *memory =
+        new Memory(root->device, getDTypeSize(root->dtype), root->dtype);
+    one = (new Tensor(memory, {1}, root->dtype, false, root->device))
+              ->fill(1.0f);
+  }
+  return one->expand(root->dims);
+}
 
-  std::vector<OpNode *> sorted = this->topo_sort();
-  OpNode *current_node;
+// implicit ones are only read, a gradient that accumulates gets a buffer
+static bool is_implicit_grad(const Tensor *grad) {
+  for (const auto &[key, one] : implicit_ones) {
+    if (grad->memory == one->memory)
+      return true;
+  }
+  return false;
+}
+
+static bool is_leaf_node(const OpNode *node) {
+  return !node || node->type == OPType::NO_OP;
+}
+
+void Tensor::backward(const std::vector<Tensor *> &roots,
+                      const std::vector<Tensor *> &grads) {
+  if (roots.size() != grads.size()) {
+    throw std::invalid_argument("expected one gradient per root");
+  }
+  std::vector<Tensor *> used;
+  for (int i = 0; i < roots.size(); i++) {
+    if (!roots[i]->requires_grad)
+      continue;
+    Tensor *grad = grads[i] ? grads[i] : implicit_grad(roots[i]);
+    // a leaf keeps its buffer like any other gradient it gets
+    if (is_leaf_node(roots[i]->node)) {
+      roots[i]->accumulate_grad(grad);
+    } else {
+      roots[i]->grad = grad;
+    }
+    used.push_back(roots[i]);
+  }
+  std::vector<OpNode *> sorted = Tensor::topo_sort(used);
+  // only leaves keep their buffers, an intermediate that outlives a pass
+  // starts the next one without a gradient. what it held may have gone
+  // back to the pool
+  std::unordered_set<const Tensor *> seeded(used.begin(), used.end());
+  for (OpNode *node : sorted) {
+    if (node->type == OPType::NO_OP)
+      continue;
+    for (Tensor *output : node->outputs) {
+      if (!seeded.count(output))
+        output->grad = nullptr;
+    }
+  }
   for (auto it = sorted.rbegin(); it != sorted.rend(); ++it) {
-    current_node = *it;
     if ((*it)->type == OPType::NO_OP)
       continue;
+    dispatcher->check_versions(*it);
     (*it)->op->backward(*it);
-    // bool has_nonleaf = false;
-    // for (Tensor *tensor = current_node->inputs.begin();
-    //      tensor != current_node->inputs.end(); ++tensor) {
-    //   if (tensor->requires_grad) {
-    //     if (tensor->node->type == OPType::NO_OP) {
-    //       Tensor *accumulated_grad = current_node->outputs[0]->grad;
-    //       if (!tensor->grad) {
-    //         tensor->grad = Tensor::clone(accumulated_grad);
-    //       } else {
-    //         tensor->grad->add(accumulated_grad, true);
-    //       }
-    //     } else {
-    //       has_nonleaf = true;
-    //     }
-    //   }
-    // }
-    // if (has_nonleaf) {
-    //   current_node->op->backward(current_node);
-    // }
-    // for (auto x : (*it)->outputs) {
-    //   x->print();
-    // }
   }
 }
+
+std::vector<Tensor *>
+Tensor::graph_leaves(const std::vector<Tensor *> &roots) {
+  std::vector<Tensor *> leaves;
+  std::unordered_set<OpNode *> visited;
+  std::vector<OpNode *> stack;
+  for (Tensor *root : roots) {
+    if (is_leaf_node(root->node)) {
+      leaves.push_back(root);
+    } else {
+      stack.push_back(root->node);
+    }
+  }
+  while (!stack.empty()) {
+    OpNode *node = stack.back();
+    stack.pop_back();
+    if (!visited.insert(node).second)
+      continue;
+    for (Tensor *input : node->inputs) {
+      if (is_leaf_node(input->node)) {
+        leaves.push_back(input);
+      } else {
+        stack.push_back(input->node);
+      }
+    }
+  }
+  return leaves;
+}
+
+void Tensor::accumulate_grad(Tensor *grad, bool owned, bool subtract) {
+  if (!grad)
+    return;
+  if (this->grad && !is_implicit_grad(this->grad)) {
+    if (subtract) {
+      this->grad->sub(grad, true);
+    } else {
+      this->grad->add(grad, true);
+    }
+    return;
+  }
+  if (!this->grad && owned && !subtract && grad->dims == this->dims &&
+      grad->dtype == this->dtype && grad->is_contigous &&
+      grad->offset() == 0) {
+    grad->requires_grad = false;
+    this->grad = grad;
+    return;
+  }
+  Tensor *buffer =
+      this->grad ? Tensor::ones(this->dims, this->dtype, false, this->device)
+                 : Tensor::zeros(this->dims, this->dtype, false, this->device);
+  this->grad = subtract ? buffer->sub(grad, true) : buffer->add(grad, true);
+}
+
+Tensor *Tensor::detach() {
+  fuser->materialize(this->memory);
+  Tensor *detached =
+      new Tensor(this->memory, this->dims, this->dtype, false, this->device);
+  detached->stride = this->stride;
+  detached->offset_elements = this->offset_elements;
+  detached->is_view = this->is_view;
+  detached->is_contigous = this->is_contigous;
+  return detached;
+}
 // ================================================================================================================================
 // Arithemetic
 // ================================================================================================================================
@@ -475,10 +878,27 @@ Tensor *Tensor::div(Tensor *other, bool inplace) {
   return execute_broadcastable_operation(OPType::DIV, other, inplace);
 }
 
+Tensor *Tensor::add(float other, bool inplace) {
+  return execute_scalar_operation(OPType::ADD_SCALAR, other, inplace);
+}
+Tensor *Tensor::sub(float other, bool inplace) {
+  return execute_scalar_operation(OPType::SUB_SCALAR, other, inplace);
+}
+Tensor *Tensor::mul(float other, bool inplace) {
+  return execute_scalar_operation(OPType::MUL_SCALAR, other, inplace);
+}
+Tensor *Tensor::div(float other, bool inplace) {
+  return execute_scalar_operation(OPType::DIV_SCALAR, other, inplace);
+}
+Tensor *Tensor::rsub(float other) {
+  return execute_scalar_operation(OPType::SUB_SCALAR, other, false, true);
+}
+Tensor *Tensor::rdiv(float other) {
+  return execute_scalar_operation(OPType::DIV_SCALAR, other, false, true);
+}
+
 Tensor *Tensor::pow(float exp, bool inplace) {
-  std::vector<float> val = {exp};
-  Tensor *other = new Tensor(val, {1});
-  return execute_binary_operation(OPType::POW, other);
+  return execute_scalar_operation(OPType::POW, exp, inplace);
 }
 
 // Comparison operators
@@ -515,6 +935,121 @@ Tensor Tensor::matmul(Tensor *other) const {
 }
 */
 
+Tensor *Tensor::linear(Tensor *weight, Tensor *bias, Activation activation) {
+  if (weight->ndim != 2 || this->ndim == 0 ||
+      this->dims.back() != weight->dims[1]) {
+    throw std::invalid_argument(
+        "linear expects a [out, in] weight and an input ending with in");
+  }
+  if (bias && (bias->ndim != 1 || bias->dims[0] != weight->dims[0])) {
+    throw std::invalid_argument("linear expects a bias of shape [out]");
+  }
+  if (this->dtype != DType::float32 || weight->dtype != DType::float32 ||
+      (bias && bias->dtype != DType::float32)) {
+    throw std::invalid_argument("linear is only implemented for float32");
+  }
+  Tensor *x = this->contiguous();
+  weight = weight->contiguous();
+  std::vector<Tensor *> inputs = {x, weight};
+  if (bias) {
+    bias = bias->contiguous();
+    inputs.push_back(bias);
+  }
+  bool requires_grad = x->requires_grad || weight->requires_grad ||
+                       (bias && bias->requires_grad);
+  std::vector<int> dims = this->dims;
+  dims.back() = weight->dims[0];
+  // the derivatives of GELU and SiLU need their input, the others use
+  // their result
+  bool save_pre = requires_grad && (activation == Activation::GELU ||
+                                    activation == Activation::SILU);
+  if (save_pre) {
+    inputs.push_back(new Tensor(dims, DType::float32, false, this->device));
+  }
+  Tensor *result =
+      new Tensor(dims, DType::float32, requires_grad, this->device);
+  inputs.push_back(result);
+  dispatcher->call(OPType::LINEAR, this->device, inputs,
+                   {{static_cast<int>(activation), bias != nullptr, save_pre},
+                    {}});
+  return result;
+}
+
+// checks a [C] parameter of a normalization over C features
+static void check_norm_parameter(const Tensor *tensor, int features,
+                                 const char *name) {
+  if (tensor && (tensor->ndim != 1 || tensor->dims[0] != features ||
+                 tensor->dtype != DType::float32)) {
+    throw std::invalid_argument(std::string(name) +
+                                " must be a float32 tensor of shape [C]");
+  }
+}
+
+// LAYER_NORM and BATCH_NORM share their inputs, see dispatcher.cpp
+static Tensor *normalize(OPType op, Tensor *x, Tensor *weight, Tensor *bias,
+                         Tensor *running_mean, Tensor *running_var,
+                         bool training, float momentum, float eps) {
+  if (x->ndim == 0 || x->dtype != DType::float32) {
+    throw std::invalid_argument("normalization expects a float32 tensor");
+  }
+  int features = x->dims.back();
+  check_norm_parameter(weight, features, "weight");
+  check_norm_parameter(bias, features, "bias");
+  x = x->contiguous();
+  std::vector<Tensor *> inputs = {x};
+  if (weight) {
+    weight = weight->contiguous();
+    inputs.push_back(weight);
+  }
+  if (bias) {
+    bias = bias->contiguous();
+    inputs.push_back(bias);
+  }
+  if (running_mean) {
+    // updated in place by the kernel, outside of the lazy programs
+    fuser->forget_constant(running_mean->memory);
+    fuser->forget_constant(running_var->memory);
+    inputs.push_back(running_mean);
+    inputs.push_back(running_var);
+  }
+  bool requires_grad = x->requires_grad || (weight && weight->requires_grad) ||
+                       (bias && bias->requires_grad);
+  int groups = op == OPType::LAYER_NORM ? x->size / features : features;
+  inputs.push_back(new Tensor({groups}, DType::float32, false, x->device));
+  inputs.push_back(new Tensor({groups}, DType::float32, false, x->device));
+  Tensor *result =
+      new Tensor(x->dims, DType::float32, requires_grad, x->device);
+  inputs.push_back(result);
+  dispatcher->call(op, x->device, inputs,
+                   {{weight != nullptr, bias != nullptr,
+                     running_mean != nullptr, training},
+                    {eps, momentum}});
+  return result;
+}
+
+Tensor *Tensor::layer_norm(Tensor *weight, Tensor *bias, float eps) {
+  return normalize(OPType::LAYER_NORM, this, weight, bias, nullptr, nullptr,
+                   true, 0.0f, eps);
+}
+
+Tensor *Tensor::batch_norm(Tensor *running_mean, Tensor *running_var,
+                           Tensor *weight, Tensor *bias, bool training,
+                           float momentum, float eps) {
+  if ((running_mean == nullptr) != (running_var == nullptr)) {
+    throw std::invalid_argument(
+        "running_mean and running_var must be given together");
+  }
+  int features = this->ndim ? this->dims.back() : 0;
+  check_norm_parameter(running_mean, features, "running_mean");
+  check_norm_parameter(running_var, features, "running_var");
+  if (running_mean &&
+      (!running_mean->is_contigous || !running_var->is_contigous)) {
+    throw std::invalid_argument("running stats must be contiguous");
+  }
+  return normalize(OPType::BATCH_NORM, this, weight, bias, running_mean,
+                   running_var, training || !running_mean, momentum, eps);
+}
+
 // Mathematical operations
 Tensor *Tensor::exp(bool inplace) {
   if (inplace) {
@@ -721,6 +1256,77 @@ Tensor *Tensor::atanh(bool inplace) {
     return result;
   }
 }
+
+static void check_activation_input(const Tensor *x) {
+  if (x->dtype != DType::float32) {
+    throw std::invalid_argument(
+        "activations are only implemented for float32");
+  }
+}
+
+// RELU and LEAKY_RELU, the mask is only written when a gradient is needed
+static Tensor *rectify(Tensor *x, OPType op, float negative_slope,
+                       bool inplace) {
+  check_activation_input(x);
+  std::vector<Tensor *> inputs = {x};
+  if (x->requires_grad) {
+    inputs.push_back(new Tensor({static_cast<int>((x->size + 31) / 32)},
+                                DType::int32, false, x->device));
+  }
+  Tensor *result =
+      inplace ? x : new Tensor(x->dims, x->dtype, x->requires_grad, x->device);
+  inputs.push_back(result);
+  dispatcher->call(op, x->device, inputs, {{}, {negative_slope}});
+  return result;
+}
+
+static Tensor *activate(Tensor *x, OPType op, bool inplace) {
+  check_activation_input(x);
+  Tensor *result =
+      inplace ? x : new Tensor(x->dims, x->dtype, x->requires_grad, x->device);
+  dispatcher->call(op, x->device, {x, result});
+  return result;
+}
+
+Tensor *Tensor::relu(bool inplace) {
+  return rectify(this, OPType::RELU, 0.0f, inplace);
+}
+
+Tensor *Tensor::leaky_relu(float negative_slope, bool inplace) {
+  return rectify(this, OPType::LEAKY_RELU, negative_slope, inplace);
+}
+
+Tensor *Tensor::sigmoid(bool inplace) {
+  return activate(this, OPType::SIGMOID, inplace);
+}
+
+// gelu and silu read their input in the backward pass, they are never in
+// place
+Tensor *Tensor::gelu() { return activate(this, OPType::GELU, false); }
+
+Tensor *Tensor::silu() { return activate(this, OPType::SILU, false); }
+
+Tensor *Tensor::dropout(float p, bool training) {
+  check_activation_input(this);
+  if (!(p >= 0.0f && p <= 1.0f)) {
+    throw std::invalid_argument("dropout probability must be in [0, 1]");
+  }
+  if (!training || p == 0.0f)
+    return this;
+  if (p == 1.0f)
+    return this->mul(0.0f);
+  Tensor *input = this->contiguous();
+  Tensor *result =
+      new Tensor(this->dims, this->dtype, this->requires_grad, this->device);
+  RandomState state = next_random(this->size);
+  dispatcher->call(OPType::DROPOUT, this->device, {input, result},
+                   {{static_cast<int>(state.seed),
+                     static_cast<int>(state.offset & 0xffffffffu),
+                     static_cast<int>(state.offset >> 32)},
+                    {p}});
+  return result;
+}
+
 // ================================================================================================================================
 //                            INIT
 // ================================================================================================================================
@@ -760,18 +1366,33 @@ Tensor *Tensor::eye(int n, DType dtype, bool requires_grad, DeviceType device) {
 // FIX: use varient for n
 Tensor *Tensor::full(std::vector<int> shape, float n, DType dtype,
                      bool requires_grad, DeviceType device) {
-  std::vector<float> val = {n};
-  Tensor *other = new Tensor(val, {1});
   Memory *result_memory = pool->request_memory(
       device,
       std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<int>()),
       dtype);
 
   Tensor *result = new Tensor(result_memory, shape, dtype, requires_grad);
-  dispatcher->call(OPType::FULL_INIT, device, {other, result});
-  free(other);
+  dispatcher->call(OPType::FULL_INIT, device, {result}, {{}, {n}});
   return result;
 }
+Tensor *Tensor::fill(float value) {
+  dispatcher->call(OPType::FULL_INIT, this->device, {this}, {{}, {value}});
+  return this;
+}
+Tensor *Tensor::assign(Tensor *source) {
+  if (source->dtype != this->dtype)
+    source = source->to(this->dtype);
+  if (source->dims != this->dims)
+    source = source->expand(this->dims);
+  if (source->memory == this->memory) {
+    Tensor *copy = new Tensor(source->dims, source->dtype,
+                              source->requires_grad, source->device);
+    dispatcher->call(OPType::CONTIGUOUS, source->device, {source, copy});
+    source = copy;
+  }
+  dispatcher->call(OPType::COPY, this->device, {this, source, this});
+  return this;
+}
 Tensor *Tensor::empty_like(Tensor *a) {
   return Tensor::empty(a->dims, a->dtype, a->requires_grad, a->device);
 }
@@ -788,12 +1409,14 @@ Tensor *Tensor::full_like(Tensor *a, float n) {
 Tensor *Tensor::clone(Tensor *other) {
   Memory *new_buffer =
       pool->request_memory(other->device, other->size, other->dtype);
+  other->materialize();
   Memory::copy(other->memory, new_buffer);
   Tensor *cloned = new Tensor(new_buffer, other->dims, other->dtype,
                               other->requires_grad, other->device);
   if (other->grad) {
     Memory *new_grad_buffer = pool->request_memory(
         other->grad->device, other->grad->memory->bytesize, other->grad->dtype);
+    other->grad->materialize();
     Memory::copy(other->grad->memory, new_grad_buffer);
     Tensor *grad_tensor =
         new Tensor(new_grad_buffer, other->grad->dims, other->grad->dtype,
@@ -805,10 +1428,35 @@ Tensor *Tensor::clone(Tensor *other) {
     cloned->node->inputs = {other};
     cloned->node->type = OPType::CLONE;
     cloned->node->op = dispatcher->get(OPType::CLONE, cloned->device);
+    record_versions(cloned->node);
   }
   return cloned;
 }
 
+// ================================================================================================================================
+//                            CAST
+// ================================================================================================================================
+Tensor *Tensor::to(DType dtype, RoundingMode rounding, bool saturate,
+                   Tensor *out) {
+  Tensor *result = out;
+  if (result) {
+    if (result->size != this->size || result->dtype != dtype) {
+      throw std::invalid_argument(
+          "output tensor does not match the size/dtype of the cast");
+    }
+  } else {
+    Memory *result_memory =
+        pool->request_memory(this->device, this->size, dtype);
+    // integer tensors can not carry gradients
+    result = new Tensor(result_memory, this->dims, dtype,
+                        this->requires_grad && isFloatingDType(dtype),
+                        this->device);
+  }
+  dispatcher->call(OPType::CAST, this->device, {this, result},
+                   {{static_cast<int>(rounding), saturate ? 1 : 0}, {}});
+  return result;
+}
+
 /*
 // TODO: configure the seed && change vector type from float to dynamic;
 Tensor Tensor::rand(std::vector<int> shape, DType dtype) {
@@ -3,6 +3,7 @@
 #include "types.h"
 #include <any>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <random>
 #include <variant>
@@ -86,9 +87,11 @@ int __bernoulli(float p, int seed) {
 int getDTypeSize(DType dtype) {
   switch (dtype) {
   case DType::int8:
+  case DType::uint8:
     return 1;
     break;
   case DType::float16:
+  case DType::bfloat16:
   case DType::int16:
     return 2;
     break;
@@ -131,17 +134,82 @@ std::string getTypeName(DType dtype) {
     return "float16";
   case DType::float32:
     return "float32";
+  case DType::uint8:
+    return "uint8";
+  case DType::bfloat16:
+    return "bfloat16";
   default:
     return "unknown type";
   }
 }
+// short names shared by the python dtype module and the metal kernel names
+std::string getTypeCode(DType dtype) {
+  switch (dtype) {
+  case DType::int8:
+    return "i8";
+  case DType::uint8:
+    return "u8";
+  case DType::int16:
+    return "i16";
+  case DType::int32:
+    return "i32";
+  case DType::int64:
+    return "i64";
+  case DType::float16:
+    return "f16";
+  case DType::bfloat16:
+    return "bf16";
+  case DType::float32:
+    return "f32";
+  default:
+    throw std::invalid_argument("not implemented");
+  }
+}
+bool isFloatingDType(DType dtype) {
+  return dtype == DType::float16 || dtype == DType::bfloat16 ||
+         dtype == DType::float32;
+}
+
+double load_element(const void *data, DType dtype, int index) {
+  switch (dtype) {
+  case DType::int8:
+    return static_cast<const int8_t *>(data)[index];
+  case DType::uint8:
+    return static_cast<const uint8_t *>(data)[index];
+  case DType::int16:
+    return static_cast<const int16_t *>(data)[index];
+  case DType::int32:
+    return static_cast<const int32_t *>(data)[index];
+  case DType::int64:
+    return static_cast<double>(static_cast<const int64_t *>(data)[index]);
+  case DType::float16:
+    return static_cast<double>(static_cast<const _Float16 *>(data)[index]);
+  case DType::bfloat16: {
+    // bfloat16 is the upper half of an ieee float32
+    uint32_t bits =
+        static_cast<uint32_t>(static_cast<const uint16_t *>(data)[index]) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+  case DType::float32:
+    return static_cast<const float *>(data)[index];
+  default:
+    throw std::invalid_argument("not implemented");
+  }
+}
 // TODO: complete remaining data types
 std::vector<int> compute_broadcast_shape(const Tensor *a, const Tensor *b) {
-  int max_rank = std::max(b->dims.size(), a->dims.size());
+  return compute_broadcast_shape(a->dims, b->dims);
+}
+
+std::vector<int> compute_broadcast_shape(const std::vector<int> &a,
+                                         const std::vector<int> &b) {
+  int max_rank = std::max(b.size(), a.size());
   std::vector<int> result(max_rank);
   for (int i = 0; i < max_rank; ++i) {
-    int dim1 = (i < a->dims.size()) ? a->dims[(a->dims.size() - 1) - i] : 1;
-    int dim2 = (i < b->dims.size()) ? b->dims[(b->dims.size() - 1) - i] : 1;
+    int dim1 = (i < a.size()) ? a[(a.size() - 1) - i] : 1;
+    int dim2 = (i < b.size()) ? b[(b.size() - 1) - i] : 1;
     if (dim1 == dim2 || dim1 == 1 || dim2 == 1)
       result[(max_rank - 1) - i] = std::max(dim1, dim2);
     else
@@ -149,3 +217,51 @@ std::vector<int> compute_broadcast_shape(const Tensor *a, const Tensor *b) {
   }
   return result;
 }
+
+void coalesce_dims(std::vector<int> &dims, std::vector<int> &strides) {
+  coalesce_dims(dims, std::vector<std::vector<int> *>{&strides});
+}
+
+void coalesce_dims(std::vector<int> &dims,
+                   std::vector<std::vector<int> *> strides) {
+  std::vector<int> new_dims;
+  std::vector<std::vector<int>> new_strides(strides.size());
+  for (int i = 0; i < dims.size(); i++) {
+    if (dims[i] == 1)
+      continue;
+    // merge with the previous dim when stepping over it is the same as
+    // stepping over this dim dims[i] times
+    bool mergeable = !new_dims.empty();
+    for (int k = 0; k < strides.size() && mergeable; k++) {
+      mergeable = new_strides[k].back() == (*strides[k])[i] * dims[i];
+    }
+    if (mergeable) {
+      new_dims.back() *= dims[i];
+      for (int k = 0; k < strides.size(); k++)
+        new_strides[k].back() = (*strides[k])[i];
+    } else {
+      new_dims.push_back(dims[i]);
+      for (int k = 0; k < strides.size(); k++)
+        new_strides[k].push_back((*strides[k])[i]);
+    }
+  }
+  if (new_dims.empty()) {
+    new_dims.push_back(1);
+    for (auto &s : new_strides)
+      s.push_back(1);
+  }
+  dims = new_dims;
+  for (int k = 0; k < strides.size(); k++)
+    *strides[k] = new_strides[k];
+}
+
+std::vector<int> broadcast_strides(const Tensor *t,
+                                   const std::vector<int> &shape) {
+  int offset = shape.size() - t->dims.size();
+  std::vector<int> strides(shape.size(), 0);
+  for (int i = 0; i < t->dims.size(); i++) {
+    if (t->dims[i] != 1)
+      strides[offset + i] = t->stride[i];
+  }
+  return strides;
+}
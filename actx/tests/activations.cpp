@@ -0,0 +1,122 @@
+#include "opnode.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <functional>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+// more than one threadgroup and a partial mask word at the end
+static const int SIZE = 1037;
+
+static float gelu(float x) {
+  return 0.5f * x *
+         (1.0f + std::tanh(0.7978845608f * (x + 0.044715f * x * x * x)));
+}
+
+static float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+
+struct Case {
+  const char *name;
+  std::function<Tensor *(Tensor *)> apply;
+  std::function<float(float)> reference;
+};
+
+static std::vector<Case> cases() {
+  return {
+      {"relu", [](Tensor *x) { return x->relu(); },
+       [](float x) { return x > 0.0f ? x : 0.0f; }},
+      {"leaky_relu", [](Tensor *x) { return x->leaky_relu(0.1f); },
+       [](float x) { return x > 0.0f ? x : 0.1f * x; }},
+      {"sigmoid", [](Tensor *x) { return x->sigmoid(); }, sigmoid},
+      {"tanh", [](Tensor *x) { return x->tanh(); },
+       [](float x) { return std::tanh(x); }},
+      {"gelu", [](Tensor *x) { return x->gelu(); }, gelu},
+      {"silu", [](Tensor *x) { return x->silu(); },
+       [](float x) { return x * sigmoid(x); }},
+  };
+}
+
+TEST(Activations, ForwardMatchesTheReference) {
+  std::vector<float> x = wave(SIZE, 3.0f, 0.0f, 0.0f, 0.7f);
+  for (const Case &c : cases()) {
+    std::vector<float> result = values_of(c.apply(new Tensor(x, {SIZE})));
+    for (int i = 0; i < SIZE; i++)
+      ASSERT_NEAR(result[i], c.reference(x[i]), 1e-5) << c.name << " " << i;
+  }
+}
+
+TEST(Activations, ForwardOnAStridedView) {
+  std::vector<float> x = wave(6 * 7, 3.0f, 0.0f, 0.0f, 0.7f);
+  Tensor *transposed = (new Tensor(x, {6, 7}))->transpose();
+  for (const Case &c : cases()) {
+    Tensor *out = c.apply(transposed);
+    ASSERT_EQ(out->dims, std::vector<int>({7, 6}));
+    for (int i = 0; i < 7; i++)
+      for (int j = 0; j < 6; j++)
+        ASSERT_NEAR(out->getElement(i, j), c.reference(x[j * 7 + i]), 1e-5)
+            << c.name;
+  }
+}
+
+TEST(Activations, BackwardMatchesTheReference) {
+  std::vector<float> x = wave(SIZE, 3.0f, 0.0f, 0.0f, 0.7f);
+  std::vector<float> scale(SIZE);
+  for (int i = 0; i < SIZE; i++)
+    scale[i] = 0.5f + 0.001f * i;
+  for (const Case &c : cases()) {
+    Tensor *input = new Tensor(x, {SIZE}, DType::float32, true);
+    c.apply(input)->mul(new Tensor(scale, {SIZE}))->backward();
+    std::vector<float> grad = values_of(input->grad);
+    float h = 1e-3f;
+    for (int i = 0; i < SIZE; i++) {
+      // the difference quotient is meaningless at the kink of relu
+      if (std::fabs(x[i]) < 2 * h)
+        continue;
+      float expected =
+          scale[i] * (c.reference(x[i] + h) - c.reference(x[i] - h)) / (2 * h);
+      ASSERT_NEAR(grad[i], expected, 2e-3) << c.name << " " << i;
+    }
+  }
+}
+
+TEST(Activations, ReluKeepsOneBitPerElement) {
+  std::vector<float> x = wave(SIZE, 3.0f, 0.0f, 0.0f, 0.7f);
+  Tensor *input = new Tensor(x, {SIZE}, DType::float32, true);
+  Tensor *out = input->relu();
+  ASSERT_EQ(out->node->outputs.size(), 2);
+  Tensor *mask = out->node->outputs[1];
+  EXPECT_EQ(mask->dtype, DType::int32);
+  EXPECT_EQ(mask->size, (SIZE + 31) / 32);
+
+  // nothing is kept without a gradient
+  Tensor *plain = (new Tensor(x, {SIZE}))->relu();
+  EXPECT_EQ(plain->node->outputs.size(), 1);
+}
+
+TEST(Activations, InPlaceReluAndSigmoid) {
+  std::vector<float> x = wave(SIZE, 3.0f, 0.0f, 0.0f, 0.7f);
+  Tensor *input = new Tensor(x, {SIZE}, DType::float32, true);
+  // a leaf that requires grad can not be written in place
+  Tensor *hidden = input->mul(1.0f);
+  Tensor *out = hidden->relu(true);
+  EXPECT_EQ(out, hidden);
+  out->backward();
+  std::vector<float> values = values_of(hidden);
+  std::vector<float> grad = values_of(input->grad);
+  for (int i = 0; i < SIZE; i++) {
+    ASSERT_EQ(values[i], x[i] > 0.0f ? x[i] : 0.0f);
+    ASSERT_EQ(grad[i], x[i] > 0.0f ? 1.0f : 0.0f);
+  }
+
+  Tensor *s = new Tensor(x, {SIZE});
+  EXPECT_EQ(s->sigmoid(true), s);
+  EXPECT_NEAR(s->getElement(5), sigmoid(x[5]), 1e-6);
+}
+
+TEST(Activations, RejectsNonFloatInputs) {
+  Tensor *x = Tensor::ones({4})->to(DType::int32);
+  EXPECT_THROW(x->relu(), std::invalid_argument);
+  EXPECT_THROW(x->gelu(), std::invalid_argument);
+}
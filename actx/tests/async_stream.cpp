@@ -0,0 +1,57 @@
+#include "main.h"
+#include "tensor.h"
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(AsyncStream, ReadsWaitForQueuedKernels) {
+  std::vector<float> data = {0.5f, 1, 2, 4};
+  Tensor *x = new Tensor(data, {4});
+  Tensor *y = x;
+  for (int i = 0; i < 32; i++) {
+    y = y->add(1.0f)->mul(0.5f);
+  }
+  for (int i = 0; i < 4; i++) {
+    float expected = data[i];
+    for (int j = 0; j < 32; j++)
+      expected = (expected + 1.0f) * 0.5f;
+    EXPECT_NEAR(y->getElement(i), expected, 1e-5);
+  }
+}
+
+TEST(AsyncStream, HostWritesWaitForReaders) {
+  std::vector<float> data = {1, 2, 3};
+  Tensor *x = new Tensor(data, {3});
+  Tensor *doubled = x->mul(2.0f);
+  // the queued kernel has to read the old value
+  x->setElement(100, 0);
+  EXPECT_EQ(doubled->getElement(0), 2.0f);
+  EXPECT_EQ(x->getElement(0), 100.0f);
+}
+
+TEST(AsyncStream, ReadyCompletesWithTheKernels) {
+  std::vector<float> data = {1, 4, 9};
+  Tensor *x = new Tensor(data, {3});
+  Tensor *root = x->sqrt()->exp();
+  std::shared_future<void> ready = root->ready();
+  ready.wait();
+  EXPECT_NEAR(root->getElement(1), std::exp(2.0f), 1e-4);
+
+  Tensor *more = root->log();
+  mps->sync();
+  EXPECT_EQ(more->ready().wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  EXPECT_NEAR(more->getElement(2), 3.0f, 1e-4);
+}
+
+TEST(AsyncStream, SynchronousModeGivesTheSameResults) {
+  std::vector<float> data = {-1, 0.5f, 3};
+  Tensor *x = new Tensor(data, {3});
+  Tensor *async_result = x->tanh()->mul(x)->add(1.0f);
+  mps->set_async(false);
+  Tensor *sync_result = x->tanh()->mul(x)->add(1.0f);
+  mps->set_async(true);
+  EXPECT_TRUE(async_result->logical_e(sync_result)->all());
+}
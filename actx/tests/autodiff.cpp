@@ -439,7 +439,7 @@ TEST(TensorAutodiff, FullComputeGraphWorks) {
   Tensor *d2 = d1->add(b);
   Tensor *d3 = d2->sub(Tensor::zeros_like(a));
   Tensor *d4 = d3->mul(a);
-  Tensor *d5 = d4->div(b->add(epsilon, true));
+  Tensor *d5 = d4->div(b->add(epsilon));
   Tensor *d6 = d5->pow(2.0f);
   // TODO: enable this matmul
   // Tensor *d7 = d6->matmul(c);
@@ -0,0 +1,74 @@
+#include "tensor.h"
+#include <gtest/gtest.h>
+
+TEST(TensorCast, Float32ToInt32Rounding) {
+  std::vector<int> shape = {2, 2};
+  std::vector<float> data = {1.5f, 2.5f, -1.5f, -0.7f};
+  Tensor *a = new Tensor(data, shape);
+
+  Tensor *truncated = a->to(DType::int32);
+  Tensor *nearest = a->to(DType::int32, RoundingMode::NEAREST_EVEN);
+  Tensor *floored = a->to(DType::int32, RoundingMode::FLOOR);
+  Tensor *ceiled = a->to(DType::int32, RoundingMode::CEIL);
+
+  EXPECT_EQ(truncated->dtype, DType::int32);
+  EXPECT_EQ(truncated->getElement(0, 0), 1);
+  EXPECT_EQ(truncated->getElement(1, 0), -1);
+  EXPECT_EQ(truncated->getElement(1, 1), 0);
+  EXPECT_EQ(nearest->getElement(0, 0), 2);
+  EXPECT_EQ(nearest->getElement(0, 1), 2);
+  EXPECT_EQ(nearest->getElement(1, 0), -2);
+  EXPECT_EQ(floored->getElement(1, 1), -1);
+  EXPECT_EQ(ceiled->getElement(0, 0), 2);
+  EXPECT_EQ(ceiled->getElement(1, 1), 0);
+}
+
+TEST(TensorCast, SaturateToInt8) {
+  std::vector<int> shape = {4};
+  std::vector<float> data = {300.0f, -300.0f, 12.0f, NAN};
+  Tensor *a = new Tensor(data, shape);
+  Tensor *b = a->to(DType::int8, RoundingMode::TRUNCATE, true);
+
+  EXPECT_EQ(b->getElement(0), 127);
+  EXPECT_EQ(b->getElement(1), -128);
+  EXPECT_EQ(b->getElement(2), 12);
+  EXPECT_EQ(b->getElement(3), 0) << "nan should saturate to zero";
+}
+
+TEST(TensorCast, Uint8RoundTrip) {
+  std::vector<int> shape = {2, 3};
+  std::vector<float> data = {0.0f, 1.0f, 127.0f, 128.0f, 200.0f, 255.0f};
+  Tensor *a = new Tensor(data, shape);
+  Tensor *pixels = a->to(DType::uint8);
+  Tensor *back = pixels->to(DType::float32);
+
+  EXPECT_EQ(pixels->getElement(1, 2), 255);
+  EXPECT_TRUE(back->logical_e(a)->all()) << "uint8 round trip failed";
+}
+
+TEST(TensorCast, HalfPrecisionRoundTrip) {
+  std::vector<int> shape = {3};
+  std::vector<float> data = {1.0f, -2.5f, 0.125f};
+  Tensor *a = new Tensor(data, shape);
+
+  Tensor *half = a->to(DType::float16)->to(DType::float32);
+  Tensor *bfloat = a->to(DType::bfloat16)->to(DType::float32);
+
+  EXPECT_TRUE(half->logical_e(a)->all()) << "float16 round trip failed";
+  EXPECT_TRUE(bfloat->logical_e(a)->all()) << "bfloat16 round trip failed";
+}
+
+TEST(TensorCast, PreallocatedOutput) {
+  std::vector<int> shape = {2, 2};
+  std::vector<float> data = {1.0f, 2.0f, 3.0f, 4.0f};
+  Tensor *a = new Tensor(data, shape);
+  Tensor *out = Tensor::empty(shape, DType::int16);
+
+  Tensor *result = a->to(DType::int16, RoundingMode::TRUNCATE, false, out);
+  EXPECT_EQ(result, out);
+  EXPECT_EQ(out->getElement(1, 1), 4);
+
+  Tensor *wrong = Tensor::empty(shape, DType::int32);
+  EXPECT_THROW(a->to(DType::int16, RoundingMode::TRUNCATE, false, wrong),
+               std::invalid_argument);
+}
@@ -0,0 +1,120 @@
+#include "checkpoint.h"
+#include "main.h"
+#include "opnode.h"
+#include "random.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+// two layers of an MLP with dropout between them
+struct Block {
+  std::vector<float> w1_values = wave(32 * 16, 0.3f, 0.0f);
+  std::vector<float> b1_values = wave(32, 0.1f, 1.0f);
+  std::vector<float> w2_values = wave(16 * 32, 0.3f, 2.0f);
+  Tensor *w1 = new Tensor(w1_values, {32, 16}, DType::float32, true);
+  Tensor *b1 = new Tensor(b1_values, {32}, DType::float32, true);
+  Tensor *w2 = new Tensor(w2_values, {16, 32}, DType::float32, true);
+
+  Tensor *operator()(Tensor *x) const {
+    return x->linear(w1, b1, Activation::RELU)->dropout(0.3f)->linear(w2);
+  }
+};
+
+TEST(Checkpoint, GradientsMatchThePlainGraph) {
+  std::vector<float> x_values = wave(8 * 16, 1.0f, 0.5f);
+  std::vector<float> scale = wave(8 * 16, 1.0f, 3.0f);
+  Block block;
+
+  manual_seed(3);
+  Tensor *x = new Tensor(x_values, {8, 16}, DType::float32, true);
+  Tensor *plain = block(block(x));
+  plain->mul(new Tensor(scale, {8, 16}))->backward();
+  std::vector<std::vector<float>> expected = {
+      values_of(x->grad), values_of(block.w1->grad), values_of(block.b1->grad),
+      values_of(block.w2->grad)};
+  block.w1->grad = block.b1->grad = block.w2->grad = nullptr;
+
+  manual_seed(3);
+  Tensor *y = new Tensor(x_values, {8, 16}, DType::float32, true);
+  CheckpointFunction fn = [&](const std::vector<Tensor *> &inputs) {
+    return std::vector<Tensor *>{block(inputs[0])};
+  };
+  Tensor *hidden = checkpoint(fn, {y})[0];
+  Tensor *out = checkpoint(fn, {hidden})[0];
+  EXPECT_EQ(values_of(out), values_of(plain));
+  // the recomputation draws its masks again whatever ran in between
+  (new Tensor(x_values, {8, 16}))->dropout(0.5f);
+  out->mul(new Tensor(scale, {8, 16}))->backward();
+
+  std::vector<std::vector<float>> grads = {
+      values_of(y->grad), values_of(block.w1->grad), values_of(block.b1->grad),
+      values_of(block.w2->grad)};
+  for (int k = 0; k < grads.size(); k++) {
+    ASSERT_EQ(grads[k].size(), expected[k].size());
+    for (int i = 0; i < grads[k].size(); i++)
+      ASSERT_NEAR(grads[k][i], expected[k][i], 1e-5) << k << " " << i;
+  }
+}
+
+TEST(Checkpoint, ReleasesTheIntermediates) {
+  std::vector<float> x_values = wave(64, 1.0f, 0.0f);
+  Tensor *x = new Tensor(x_values, {64}, DType::float32, true);
+  Memory *intermediate = nullptr;
+  std::vector<Tensor *> outputs = checkpoint(
+      [&](const std::vector<Tensor *> &inputs) {
+        Tensor *hidden = inputs[0]->mul(2.0f);
+        intermediate = hidden->memory;
+        return std::vector<Tensor *>{hidden->sigmoid()};
+      },
+      {x});
+
+  EXPECT_FALSE(pool->in_use(intermediate));
+  EXPECT_TRUE(pool->in_use(outputs[0]->memory));
+  // only the inputs are referenced until the backward pass
+  ASSERT_EQ(outputs[0]->node->type, OPType::CHECKPOINT);
+  EXPECT_EQ(outputs[0]->node->inputs, std::vector<Tensor *>{x});
+
+  outputs[0]->backward();
+  for (int i = 0; i < 64; i++) {
+    float s = 1.0f / (1.0f + std::exp(-2.0f * x_values[i]));
+    ASSERT_NEAR(x->grad->getElement(i), 2.0f * s * (1.0f - s), 1e-5);
+  }
+}
+
+TEST(Checkpoint, FailedPassesReturnTheirMemory) {
+  std::vector<float> x_values = wave(64, 1.0f, 0.0f);
+  Tensor *x = new Tensor(x_values, {64}, DType::float32, true);
+  int calls = 0;
+  Memory *intermediate = nullptr;
+  std::vector<Tensor *> outputs = checkpoint(
+      [&](const std::vector<Tensor *> &inputs) {
+        Tensor *hidden = inputs[0]->mul(2.0f);
+        if (++calls == 2) {
+          intermediate = hidden->memory;
+          throw std::runtime_error("recompute failed");
+        }
+        return std::vector<Tensor *>{hidden->sigmoid()};
+      },
+      {x});
+  EXPECT_THROW(outputs[0]->backward(), std::runtime_error);
+  EXPECT_FALSE(pool->in_use(intermediate));
+
+  // the recomputed graph fails its version check, log saved hidden
+  calls = 0;
+  outputs = checkpoint(
+      [&](const std::vector<Tensor *> &inputs) {
+        Tensor *hidden = inputs[0]->mul(2.0f)->add(3.0f);
+        Tensor *output = hidden->log();
+        if (++calls == 2) {
+          intermediate = hidden->memory;
+          hidden->add(1.0f, true);
+        }
+        return std::vector<Tensor *>{output};
+      },
+      {x});
+  EXPECT_THROW(outputs[0]->backward(), std::runtime_error);
+  EXPECT_FALSE(pool->in_use(intermediate));
+}
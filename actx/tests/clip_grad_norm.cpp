@@ -0,0 +1,102 @@
+#include "graph.h"
+#include "multi_tensor.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+// parameters whose gradients span several chunks and launches
+struct Params {
+  std::vector<int> sizes = {3, 4096, 9000, 1, 700, 5000, 17, 4097};
+  std::vector<std::vector<float>> grads;
+  std::vector<Tensor *> params;
+  double norm = 0.0;
+
+  explicit Params(float scale) {
+    for (int size : sizes) {
+      grads.push_back(wave(size, scale, 1.0f, 0.0f, 0.3f));
+      Tensor *param = Tensor::zeros({size});
+      param->grad = new Tensor(grads.back(), {size});
+      params.push_back(param);
+      for (float g : grads.back())
+        norm += g * g;
+    }
+    norm = std::sqrt(norm);
+  }
+};
+
+TEST(ClipGradNorm, ComputesTheGlobalNorm) {
+  Params p(0.5f);
+  Tensor *norm = multi_tensor_l2_norm(
+      {p.params[0]->grad, p.params[1]->grad, p.params[2]->grad});
+  double expected = 0.0;
+  for (int i = 0; i < 3; i++)
+    for (float g : p.grads[i])
+      expected += g * g;
+  ASSERT_EQ(norm->size, 1);
+  EXPECT_NEAR(norm->getElement(0), std::sqrt(expected),
+              1e-4 * std::sqrt(expected));
+}
+
+TEST(ClipGradNorm, ScalesDownToMaxNorm) {
+  Params p(2.0f);
+  float max_norm = 1.0f;
+  Tensor *norm = clip_grad_norm(p.params, max_norm);
+  EXPECT_NEAR(norm->getElement(0), p.norm, 1e-4 * p.norm);
+
+  float coef = max_norm / (p.norm + 1e-6);
+  double clipped = 0.0;
+  for (int t = 0; t < p.params.size(); t++) {
+    Tensor *grad = p.params[t]->grad;
+    for (int i = 0; i < grad->size; i++) {
+      ASSERT_NEAR(grad->getElement(i), p.grads[t][i] * coef, 1e-5)
+          << "gradient " << t << " element " << i;
+      clipped += grad->getElement(i) * grad->getElement(i);
+    }
+  }
+  EXPECT_NEAR(std::sqrt(clipped), max_norm, 1e-4);
+}
+
+TEST(ClipGradNorm, LeavesSmallGradientsAlone) {
+  Params p(0.01f);
+  Tensor *norm = clip_grad_norm(p.params, 100.0f);
+  EXPECT_NEAR(norm->getElement(0), p.norm, 1e-4 * p.norm);
+  for (int t = 0; t < p.params.size(); t++)
+    for (int i : {0, p.sizes[t] - 1})
+      EXPECT_EQ(p.params[t]->grad->getElement(i), p.grads[t][i]);
+}
+
+TEST(ClipGradNorm, DecidesOnTheDevice) {
+  Params p(2.0f);
+  Graph graph;
+  Tensor *norm;
+  {
+    // a replay has no host branches, whether to clip is up to the kernel
+    GraphCapture capture(graph);
+    norm = clip_grad_norm(p.params, 1.0f);
+  }
+  int total = 0;
+  for (Tensor *param : p.params) {
+    param->grad->fill(1e-3f)->materialize();
+    total += param->grad->size;
+  }
+  graph.replay();
+  EXPECT_NEAR(norm->getElement(0), 1e-3 * std::sqrt(total), 1e-5);
+  for (Tensor *param : p.params) {
+    int last = static_cast<int>(param->grad->size - 1);
+    EXPECT_EQ(param->grad->getElement(last), 1e-3f);
+  }
+}
+
+TEST(ClipGradNorm, SkipsParametersWithoutGradients) {
+  Tensor *param = Tensor::zeros({4});
+  EXPECT_EQ(clip_grad_norm({param}, 1.0f)->getElement(0), 0.0f);
+
+  Params p(1.0f);
+  p.params[0]->grad = p.params[0]->grad->to(DType::int32);
+  EXPECT_THROW(clip_grad_norm(p.params, 1.0f), std::invalid_argument);
+  EXPECT_THROW(clip_grad_norm({param}, 0.0f), std::invalid_argument);
+}
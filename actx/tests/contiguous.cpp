@@ -0,0 +1,81 @@
+#include "tensor.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(TensorContiguous, NoOpOnContiguousTensor) {
+  std::vector<float> data = {1, 2, 3, 4};
+  Tensor *a = new Tensor(data, {2, 2});
+  EXPECT_TRUE(a->is_contigous);
+  EXPECT_EQ(a->contiguous(), a) << "contiguous tensor should not be copied";
+
+  std::vector<Slice> rows = {Slice(1, 2), Slice(0, 2)};
+  Tensor *row = a->view(rows);
+  EXPECT_EQ(row->contiguous(), row) << "a single row is already contiguous";
+}
+
+TEST(TensorContiguous, TransposeCopy) {
+  // not a multiple of the 32x32 tile in either direction
+  int rows = 37, cols = 70;
+  std::vector<float> data(rows * cols);
+  for (int i = 0; i < rows * cols; i++)
+    data[i] = i;
+  Tensor *a = new Tensor(data, {rows, cols});
+  Tensor *t = a->transpose()->contiguous();
+
+  EXPECT_TRUE(t->is_contigous);
+  EXPECT_NE(t->memory, a->memory);
+  EXPECT_EQ(t->dims, std::vector<int>({cols, rows}));
+  EXPECT_EQ(t->stride, std::vector<int>({rows, 1}));
+  for (int r = 0; r < rows; r += 5) {
+    for (int c = 0; c < cols; c += 3) {
+      EXPECT_EQ(t->getElement(c, r), a->getElement(r, c));
+    }
+  }
+  EXPECT_EQ(t->getElement(cols - 1, rows - 1), rows * cols - 1);
+}
+
+TEST(TensorContiguous, StridedCopy) {
+  std::vector<float> data(24);
+  for (int i = 0; i < 24; i++)
+    data[i] = i;
+  Tensor *a = new Tensor(data, {2, 3, 4});
+  Tensor *p = a->permute({1, 2, 0})->contiguous();
+
+  EXPECT_TRUE(p->is_contigous);
+  for (int i = 0; i < 2; i++)
+    for (int j = 0; j < 3; j++)
+      for (int k = 0; k < 4; k++)
+        EXPECT_EQ(p->getElement(j, k, i), a->getElement(i, j, k));
+
+  std::vector<Slice> every_other = {Slice(0, 2), Slice(0, 3), Slice(0, 4, 2)};
+  Tensor *s = a->view(every_other)->contiguous();
+  std::vector<float> expected_data = {0,  2,  4,  6,  8,  10,
+                                      12, 14, 16, 18, 20, 22};
+  Tensor *expected = new Tensor(expected_data, {2, 3, 2});
+  EXPECT_TRUE(s->logical_e(expected)->all()) << "strided copy failed";
+}
+
+TEST(TensorContiguous, ReshapeFallsBackToCopy) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  Tensor *flat = a->transpose()->reshape({6});
+
+  std::vector<float> expected_data = {1, 4, 2, 5, 3, 6};
+  Tensor *expected = new Tensor(expected_data, {6});
+  EXPECT_TRUE(flat->logical_e(expected)->all()) << "reshape copy failed";
+}
+
+TEST(TensorContiguous, Backward) {
+  std::vector<float> x_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> w_data = {1, 2, 3, 4, 5, 6};
+  Tensor *x = new Tensor(x_data, {2, 3}, DType::float32, true);
+  Tensor *w = new Tensor(w_data, {6});
+
+  Tensor *z = x->transpose()->reshape({6})->mul(w);
+  z->backward();
+
+  // x^T flattened is {1, 4, 2, 5, 3, 6}, w maps back through the transpose
+  std::vector<float> expected_data = {1, 3, 5, 2, 4, 6};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(x->grad->logical_e(expected)->all()) << "x grad incorrect";
+}
@@ -0,0 +1,74 @@
+#include "coroutine.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+using namespace actx::async;
+
+static Task<void> request(Tensor *x, Tensor *w, std::vector<float> *out) {
+  Tensor *y = co_await mul_async(x, w);
+  for (int i = 0; i < 8; i++) {
+    y = co_await add_async(y, x);
+  }
+  y = co_await div_async(y, w);
+  *out = co_await read(y);
+}
+
+TEST(Coroutines, OneThreadDrivesManyRequests) {
+  std::vector<float> weights = {1, 2, 4, 8};
+  Tensor *w = new Tensor(weights, {4});
+  Scheduler scheduler;
+  std::vector<std::vector<float>> outputs(16);
+  for (int r = 0; r < 16; r++) {
+    std::vector<float> data = {float(r), r + 0.5f, r - 1.0f, 2.0f * r};
+    scheduler.spawn(request(new Tensor(data, {4}), w, &outputs[r]));
+  }
+  scheduler.run();
+  for (int r = 0; r < 16; r++) {
+    std::vector<float> data = {float(r), r + 0.5f, r - 1.0f, 2.0f * r};
+    ASSERT_EQ(outputs[r].size(), 4);
+    for (int i = 0; i < 4; i++) {
+      EXPECT_NEAR(outputs[r][i], (data[i] * weights[i] + 8 * data[i]) /
+                                     weights[i],
+                  1e-4);
+    }
+  }
+}
+
+TEST(Coroutines, RunReturnsTheResult) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *x = new Tensor(data, {2, 3});
+  Scheduler scheduler;
+  // the transpose is a view, read() makes it dense first
+  std::vector<float> values = scheduler.run(read(x->transpose()->exp()));
+  std::vector<float> expected = {1, 4, 2, 5, 3, 6};
+  ASSERT_EQ(values.size(), expected.size());
+  for (int i = 0; i < 6; i++) {
+    EXPECT_NEAR(values[i], std::exp(expected[i]), 1e-3);
+  }
+}
+
+TEST(Coroutines, ReadyValuesDoNotSuspend) {
+  std::vector<float> data = {2, 3};
+  Tensor *x = new Tensor(data, {2});
+  mps->sync();
+  EXPECT_TRUE(ready(x).await_ready());
+}
+
+static Task<void> mismatched(Tensor *a, Tensor *b) {
+  co_await add_async(a, b);
+}
+
+TEST(Coroutines, FailuresReachTheCaller) {
+  std::vector<float> data = {1, 2, 3};
+  std::vector<float> other = {1, 2};
+  Tensor *a = new Tensor(data, {3});
+  Tensor *b = new Tensor(other, {2});
+  Scheduler scheduler;
+  scheduler.spawn(mismatched(a, b));
+  EXPECT_ANY_THROW(scheduler.run());
+  EXPECT_THROW(Scheduler::current(), std::logic_error);
+}
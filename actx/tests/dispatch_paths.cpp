@@ -0,0 +1,129 @@
+#include "main.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(DispatchPaths, SameShapeIsContiguous) {
+  std::vector<float> a_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> b_data = {6, 5, 4, 3, 2, 1};
+  Tensor *a = new Tensor(a_data, {2, 3});
+  Tensor *b = new Tensor(b_data, {2, 3});
+
+  dispatcher->reset_stats();
+  Tensor *result = a->sub(b);
+  EXPECT_EQ(dispatcher->stats().contiguous.load(), 1);
+  EXPECT_EQ(dispatcher->stats().strided.load(), 0);
+
+  std::vector<float> expected_data = {-5, -3, -1, 1, 3, 5};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(result->logical_e(expected)->all()) << "contiguous sub failed";
+}
+
+TEST(DispatchPaths, ScalarOnEitherSide) {
+  // odd length so the last thread handles a partial group of 4
+  std::vector<float> a_data = {2, 4, 8, 16, 32};
+  Tensor *a = new Tensor(a_data, {5});
+  std::vector<float> s_data = {64};
+  Tensor *s = new Tensor(s_data, {1});
+
+  dispatcher->reset_stats();
+  Tensor *left = s->div(a);
+  Tensor *right = a->div(s);
+  EXPECT_EQ(dispatcher->stats().scalar.load(), 2);
+
+  std::vector<float> left_data = {32, 16, 8, 4, 2};
+  std::vector<float> right_data = {1.0f / 32, 1.0f / 16, 1.0f / 8, 1.0f / 4,
+                                   1.0f / 2};
+  EXPECT_TRUE(left->logical_e(new Tensor(left_data, {5}))->all())
+      << "scalar / tensor failed";
+  EXPECT_TRUE(right->logical_e(new Tensor(right_data, {5}))->all())
+      << "tensor / scalar failed";
+}
+
+TEST(DispatchPaths, RowBroadcast) {
+  std::vector<float> m_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> r_data = {10, 20, 30};
+  Tensor *m = new Tensor(m_data, {2, 3});
+  Tensor *row = new Tensor(r_data, {1, 3});
+
+  dispatcher->reset_stats();
+  Tensor *left = row->sub(m);
+  Tensor *right = m->sub(row);
+  EXPECT_EQ(dispatcher->stats().row.load(), 2);
+
+  std::vector<float> left_data = {9, 18, 27, 6, 15, 24};
+  std::vector<float> right_data = {-9, -18, -27, -6, -15, -24};
+  EXPECT_TRUE(left->logical_e(new Tensor(left_data, {2, 3}))->all())
+      << "row - matrix failed";
+  EXPECT_TRUE(right->logical_e(new Tensor(right_data, {2, 3}))->all())
+      << "matrix - row failed";
+}
+
+TEST(DispatchPaths, StridedFallback) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  Tensor *b = new Tensor(data, {3, 2});
+  std::vector<float> c_data = {1, 2};
+  Tensor *column = new Tensor(c_data, {2, 1});
+
+  dispatcher->reset_stats();
+  Tensor *sum = a->transpose()->add(b);
+  Tensor *scaled = a->mul(column);
+  EXPECT_EQ(dispatcher->stats().strided.load(), 2);
+
+  std::vector<float> sum_data = {2, 6, 5, 9, 8, 12};
+  std::vector<float> scaled_data = {1, 2, 3, 8, 10, 12};
+  EXPECT_TRUE(sum->logical_e(new Tensor(sum_data, {3, 2}))->all())
+      << "transposed add failed";
+  EXPECT_TRUE(scaled->logical_e(new Tensor(scaled_data, {2, 3}))->all())
+      << "column broadcast failed";
+}
+
+TEST(DispatchPaths, CoalescedViewBroadcast) {
+  // the view keeps its last two dims contiguous, so the strided kernel only
+  // iterates over two coalesced dims
+  std::vector<float> data(24);
+  for (int i = 0; i < 24; i++)
+    data[i] = i;
+  Tensor *a = new Tensor(data, {2, 3, 4});
+  std::vector<Slice> slice = {Slice(1, 2), Slice(0, 3), Slice(0, 4)};
+  Tensor *view = a->view(slice);
+  Tensor *ones = Tensor::ones({2, 1, 3, 4});
+
+  Tensor *result = ones->add(view);
+  EXPECT_EQ(result->dims, std::vector<int>({2, 1, 3, 4}));
+  EXPECT_EQ(result->getElement(0, 0, 0, 0), 13);
+  EXPECT_EQ(result->getElement(1, 0, 2, 3), 24);
+}
+
+TEST(DispatchPaths, UnaryOpsTakeTheContiguousKernel) {
+  // 7 elements, the last thread of the fast path handles a partial group
+  std::vector<float> data = wave(7, 2.0f);
+  Tensor *a = new Tensor(data, {7});
+
+  dispatcher->reset_stats();
+  Tensor *exp = a->exp();
+  Tensor *sigmoid = a->sigmoid();
+  EXPECT_EQ(dispatcher->stats().contiguous.load(), 2);
+  EXPECT_EQ(dispatcher->stats().strided.load(), 0);
+
+  for (int i = 0; i < 7; i++) {
+    EXPECT_NEAR(exp->getElement(i), std::exp(data[i]), 1e-4);
+    EXPECT_NEAR(sigmoid->getElement(i), 1.0f / (1.0f + std::exp(-data[i])),
+                1e-5);
+  }
+}
+
+TEST(DispatchPaths, UnaryOpsOnViewsAreStrided) {
+  std::vector<float> data = wave(6, 1.0f);
+  Tensor *a = new Tensor(data, {2, 3});
+
+  dispatcher->reset_stats();
+  Tensor *result = a->transpose()->sin();
+  EXPECT_EQ(dispatcher->stats().contiguous.load(), 0);
+  EXPECT_EQ(dispatcher->stats().strided.load(), 1);
+  EXPECT_NEAR(result->getElement(2, 1), std::sin(data[5]), 1e-5);
+  EXPECT_NEAR(result->getElement(1, 0), std::sin(data[1]), 1e-5);
+}
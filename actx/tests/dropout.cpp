@@ -0,0 +1,67 @@
+#include "random.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+static const int SIZE = 10000;
+
+static std::vector<float> ramp(int size) {
+  std::vector<float> values(size);
+  for (int i = 0; i < size; i++)
+    values[i] = 1.0f + (i % 13);
+  return values;
+}
+
+TEST(Dropout, KeepsAndScalesAFraction) {
+  std::vector<float> x = ramp(SIZE);
+  std::vector<float> y = values_of((new Tensor(x, {SIZE}))->dropout(0.25f));
+  int kept = 0;
+  for (int i = 0; i < SIZE; i++) {
+    if (y[i] == 0.0f)
+      continue;
+    kept++;
+    ASSERT_FLOAT_EQ(y[i], x[i] / 0.75f);
+  }
+  // 7500 expected, the standard deviation is about 43
+  EXPECT_NEAR(kept, 0.75 * SIZE, 300);
+}
+
+TEST(Dropout, SeedReplaysTheMask) {
+  std::vector<float> x = ramp(SIZE);
+  Tensor *input = new Tensor(x, {SIZE});
+  manual_seed(42);
+  std::vector<float> first = values_of(input->dropout(0.5f));
+  std::vector<float> second = values_of(input->dropout(0.5f));
+  manual_seed(42);
+  std::vector<float> replay = values_of(input->dropout(0.5f));
+  EXPECT_EQ(first, replay);
+  // the stream moved on between two calls
+  EXPECT_NE(first, second);
+
+  RandomState state = get_rng_state();
+  std::vector<float> third = values_of(input->dropout(0.5f));
+  set_rng_state(state);
+  EXPECT_EQ(values_of(input->dropout(0.5f)), third);
+}
+
+TEST(Dropout, BackwardDrawsTheSameMask) {
+  std::vector<float> x = ramp(SIZE);
+  Tensor *input = new Tensor(x, {SIZE}, DType::float32, true);
+  Tensor *out = input->dropout(0.3f);
+  out->backward();
+  std::vector<float> y = values_of(out);
+  std::vector<float> grad = values_of(input->grad);
+  for (int i = 0; i < SIZE; i++)
+    ASSERT_FLOAT_EQ(grad[i], y[i] == 0.0f ? 0.0f : 1.0f / 0.7f) << i;
+}
+
+TEST(Dropout, IdentityOutsideTraining) {
+  Tensor *x = Tensor::ones({4, 3});
+  EXPECT_EQ(x->dropout(0.5f, false), x);
+  EXPECT_EQ(x->dropout(0.0f), x);
+  EXPECT_EQ(x->dropout(1.0f)->getElement(2, 1), 0.0f);
+  EXPECT_THROW(x->dropout(1.5f), std::invalid_argument);
+  EXPECT_THROW(x->to(DType::int32)->dropout(0.5f), std::invalid_argument);
+}
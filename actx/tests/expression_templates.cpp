@@ -0,0 +1,80 @@
+#include "expr.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <type_traits>
+#include <vector>
+
+using namespace actx::expr;
+
+TEST(ExpressionTemplates, EvaluatesOnAssignment) {
+  std::vector<float> a_data = {1, 2, 3, 4};
+  std::vector<float> b_data = {0.5f, -1, 2, 0};
+  std::vector<float> c_data = {1, 1, -1, 3};
+  Tensor *a = new Tensor(a_data, {2, 2});
+  Tensor *b = new Tensor(b_data, {2, 2});
+  Tensor *c = new Tensor(c_data, {2, 2});
+
+  auto e = of(a) * b + c;
+  static_assert(std::is_same_v<decltype(e),
+                               Binary<FusedOp::ADD,
+                                      Binary<FusedOp::MUL, Leaf, Leaf>, Leaf>>,
+                "the tree is encoded in the type");
+  Tensor *y = e;
+  EXPECT_EQ(y->dims, std::vector<int>({2, 2}));
+  std::vector<float> expected_data = {1.5f, -1, 5, 3};
+  EXPECT_TRUE(y->logical_e(new Tensor(expected_data, {2, 2}))->all());
+}
+
+TEST(ExpressionTemplates, ScalarsAndFunctions) {
+  std::vector<float> data = {0.25f, 1, 4};
+  Tensor *x = new Tensor(data, {3});
+
+  Tensor *y = eval(2 - tanh(sqrt(x) * 0.5f) / 4 + pow(of(x), 2));
+  for (int i = 0; i < 3; i++) {
+    float expected =
+        2 - std::tanh(std::sqrt(data[i]) * 0.5f) / 4 + data[i] * data[i];
+    EXPECT_NEAR(y->getElement(i), expected, 1e-5);
+  }
+}
+
+TEST(ExpressionTemplates, BroadcastCheckedAtConstruction) {
+  std::vector<float> m_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> r_data = {10, 20, 30};
+  std::vector<float> bad_data = {1, 2};
+  Tensor *m = new Tensor(m_data, {2, 3});
+  Tensor *row = new Tensor(r_data, {3});
+  Tensor *bad = new Tensor(bad_data, {2});
+
+  auto e = of(m) + row;
+  EXPECT_EQ(e.shape, std::vector<int>({2, 3}));
+  EXPECT_THROW(of(m) + bad, std::invalid_argument);
+
+  std::vector<float> expected_data = {11, 22, 33, 14, 25, 36};
+  Tensor *y = eval(e);
+  EXPECT_TRUE(y->logical_e(new Tensor(expected_data, {2, 3}))->all());
+}
+
+TEST(ExpressionTemplates, AssignInPlace) {
+  std::vector<float> x_data = {1, 2, 3};
+  std::vector<float> g_data = {10, 20, 30};
+  Tensor *x = new Tensor(x_data, {3});
+  Tensor *g = new Tensor(g_data, {3});
+
+  // x -= 0.1 * g without a temporary
+  assign(x, of(x) - of(g) * 0.1f);
+  EXPECT_NEAR(x->getElement(0), 0.0f, 1e-6);
+  EXPECT_NEAR(x->getElement(2), 0.0f, 1e-6);
+
+  // broadcasts to (2, 3), which does not fit into x
+  std::vector<float> column_data = {1, 2};
+  Tensor *column = new Tensor(column_data, {2, 1});
+  EXPECT_THROW(assign(x, of(g) + column), std::invalid_argument);
+}
+
+TEST(ExpressionTemplates, RejectsGradients) {
+  std::vector<float> data = {1, 2};
+  Tensor *w = new Tensor(data, {2}, DType::float32, true);
+  EXPECT_THROW(of(w), std::invalid_argument);
+}
@@ -0,0 +1,85 @@
+#include "codegen.h"
+#include "fusion.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <vector>
+
+static FusedProgram scaled_sum(Tensor *a, Tensor *b) {
+  FusedProgram program;
+  program.inputs = {a, b};
+  program.code = {{static_cast<int>(FusedOp::LOAD), 0, 0, 0},
+                  {static_cast<int>(FusedOp::LOAD), 1, 0, 0},
+                  {static_cast<int>(FusedOp::ADD), 0, 1, 0},
+                  {static_cast<int>(FusedOp::MUL_SCALAR), 2, 0, 0.5f}};
+  return program;
+}
+
+TEST(FusedCodegen, SignatureFollowsLayout) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  Tensor *b = new Tensor(data, {2, 3});
+  Tensor *out = new Tensor(std::vector<int>{2, 3});
+  Tensor *transposed_out = new Tensor(std::vector<int>{3, 2});
+
+  FusedProgram same = scaled_sum(a, b);
+  FusedProgram strided = scaled_sum(a->transpose(), b->transpose());
+  std::string contiguous_signature =
+      fused_signature(same, fused_layout(same, out));
+  // same program and layout on other tensors shares the kernel
+  FusedProgram other = scaled_sum(b, a);
+  EXPECT_EQ(fused_signature(other, fused_layout(other, out)),
+            contiguous_signature);
+  EXPECT_NE(fused_signature(strided, fused_layout(strided, transposed_out)),
+            contiguous_signature);
+
+  FusedProgram scaled = same;
+  scaled.code[3].scalar = 0.25f;
+  EXPECT_NE(fused_signature(scaled, fused_layout(scaled, out)),
+            contiguous_signature);
+}
+
+TEST(FusedCodegen, SourceBakesLayout) {
+  std::vector<float> m_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> r_data = {10, 20};
+  Tensor *m = new Tensor(m_data, {2, 3});
+  Tensor *row = new Tensor(r_data, {1, 2});
+  Tensor *out = new Tensor(std::vector<int>{3, 2});
+
+  FusedProgram program = scaled_sum(m->transpose(), row);
+  std::string source =
+      generate_fused_source("__k__", program, fused_layout(program, out));
+  EXPECT_NE(source.find("kernel void __k__("), std::string::npos);
+  EXPECT_NE(source.find("if (tid >= 6)"), std::string::npos);
+  EXPECT_NE(source.find("int index0 = c0 + c1 * 3;"), std::string::npos);
+  // the row is broadcast over dim 0
+  EXPECT_NE(source.find("int index1 = c1;"), std::string::npos);
+  EXPECT_NE(source.find("as_type<float>(1056964608u)"), std::string::npos)
+      << "0.5f should be baked in bit exact";
+}
+
+TEST(FusedCodegen, MatchesInterpreter) {
+  std::filesystem::path cache =
+      std::filesystem::temp_directory_path() / "actx_codegen_test";
+  std::filesystem::remove_all(cache);
+  setenv("ACTX_KERNEL_CACHE", cache.c_str(), 1);
+
+  std::vector<float> a_data = {0.5f, 1, 2, 4};
+  std::vector<float> b_data = {1, -2, 3, -4};
+  Tensor *a = new Tensor(a_data, {4});
+  Tensor *b = new Tensor(b_data, {4});
+
+  LazyMode lazy;
+  fuser->set_codegen(true);
+  Tensor *result = a->log()->add(b)->pow(2.0f);
+  for (int i = 0; i < 4; i++) {
+    float expected = std::pow(std::log(a_data[i]) + b_data[i], 2.0f);
+    EXPECT_NEAR(result->getElement(i), expected, 1e-4);
+  }
+  fuser->set_codegen(false);
+  EXPECT_TRUE(std::filesystem::exists(cache))
+      << "generated source should be written to the cache";
+}
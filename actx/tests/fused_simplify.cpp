@@ -0,0 +1,153 @@
+#include "fusion.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+static FusedInstruction ins(FusedOp op, int a = 0, int b = 0,
+                            float scalar = 0.0f) {
+  return {static_cast<int>(op), a, b, scalar};
+}
+
+// runs a program on the host for one element of every input
+static float run(const FusedProgram &program,
+                 const std::vector<float> &values) {
+  std::vector<float> r;
+  for (const FusedInstruction &instruction : program.code) {
+    if (instruction.op == static_cast<int>(FusedOp::LOAD)) {
+      r.push_back(values[instruction.a]);
+    } else if (instruction.op == static_cast<int>(FusedOp::CONST)) {
+      r.push_back(instruction.scalar);
+    } else {
+      r.push_back(
+          evaluate_fused(instruction, r[instruction.a], r[instruction.b]));
+    }
+  }
+  return r.back();
+}
+
+static int count(const FusedProgram &program, FusedOp op) {
+  int n = 0;
+  for (const FusedInstruction &instruction : program.code)
+    n += instruction.op == static_cast<int>(op);
+  return n;
+}
+
+TEST(FusedSimplify, FoldsConstants) {
+  FusedProgram program;
+  program.code = {ins(FusedOp::CONST, 0, 0, 2), ins(FusedOp::CONST, 0, 0, 3),
+                  ins(FusedOp::ADD, 0, 1), ins(FusedOp::POW_INT, 2, 0, 2)};
+  simplify(program);
+  ASSERT_EQ(program.code.size(), 1);
+  EXPECT_EQ(program.code[0].op, static_cast<int>(FusedOp::CONST));
+  EXPECT_EQ(program.code[0].scalar, 25.0f);
+}
+
+TEST(FusedSimplify, ConstantOperandsBecomeScalarOps) {
+  FusedProgram program;
+  Tensor *x = new Tensor({4});
+  program.inputs = {x};
+  // 2 - x, then (2 - x) / 4
+  program.code = {ins(FusedOp::CONST, 0, 0, 2), ins(FusedOp::LOAD, 0),
+                  ins(FusedOp::SUB, 0, 1), ins(FusedOp::CONST, 0, 0, 4),
+                  ins(FusedOp::DIV, 2, 3)};
+  simplify(program);
+  ASSERT_EQ(program.code.size(), 3);
+  EXPECT_EQ(program.code[1].op, static_cast<int>(FusedOp::RSUB_SCALAR));
+  EXPECT_EQ(program.code[1].scalar, 2.0f);
+  EXPECT_EQ(program.code[2].op, static_cast<int>(FusedOp::DIV_SCALAR));
+  EXPECT_EQ(run(program, {1.0f}), 0.25f);
+}
+
+TEST(FusedSimplify, CancelsIdentities) {
+  FusedProgram program;
+  Tensor *x = new Tensor({4});
+  program.inputs = {x};
+  program.code = {ins(FusedOp::LOAD, 0),
+                  ins(FusedOp::NEG, 0),
+                  ins(FusedOp::MUL_SCALAR, 1, 0, -1),
+                  ins(FusedOp::CONST, 0, 0, 1),
+                  ins(FusedOp::MUL, 3, 2),
+                  ins(FusedOp::ADD_SCALAR, 4, 0, 0),
+                  ins(FusedOp::POW_INT, 5, 0, 1)};
+  simplify(program);
+  ASSERT_EQ(program.code.size(), 1);
+  EXPECT_EQ(program.code[0].op, static_cast<int>(FusedOp::LOAD));
+}
+
+TEST(FusedSimplify, ComputesIdenticalInstructionsOnce) {
+  FusedProgram program;
+  Tensor *a = new Tensor({4});
+  Tensor *b = new Tensor({4});
+  program.inputs = {a, b};
+  // the div backward pattern, a / b^2 + (b^2 * a) * (a * b^2)
+  program.code = {ins(FusedOp::LOAD, 0),         ins(FusedOp::LOAD, 1),
+                  ins(FusedOp::POW_INT, 1, 0, 2), ins(FusedOp::DIV, 0, 2),
+                  ins(FusedOp::POW_INT, 1, 0, 2), ins(FusedOp::MUL, 4, 0),
+                  ins(FusedOp::MUL, 0, 2),        ins(FusedOp::MUL, 5, 6),
+                  ins(FusedOp::ADD, 3, 7)};
+  FusedProgram original = program;
+  simplify(program);
+  EXPECT_EQ(count(program, FusedOp::POW_INT), 1);
+  // b^2 * a and a * b^2 are the same product
+  EXPECT_EQ(count(program, FusedOp::MUL), 2);
+  EXPECT_EQ(program.code.size(), 7);
+  EXPECT_FLOAT_EQ(run(program, {3, 2}), run(original, {3, 2}));
+}
+
+TEST(FusedSimplify, DropsUnusedCodeAndInputs) {
+  FusedProgram program;
+  Tensor *a = new Tensor({4});
+  Tensor *b = new Tensor({4});
+  program.inputs = {a, b};
+  program.code = {ins(FusedOp::LOAD, 0), ins(FusedOp::LOAD, 1),
+                  ins(FusedOp::EXP, 0), ins(FusedOp::MUL, 1, 1),
+                  ins(FusedOp::SQRT, 3)};
+  simplify(program);
+  ASSERT_EQ(program.inputs.size(), 1);
+  EXPECT_EQ(program.inputs[0], b);
+  EXPECT_EQ(count(program, FusedOp::EXP), 0);
+  EXPECT_EQ(program.code.size(), 3);
+  EXPECT_FLOAT_EQ(run(program, {9}), 9.0f);
+}
+
+TEST(FusedSimplify, LazyProgramsReadFilledTensorsAsConstants) {
+  std::vector<float> data = {1, -2, 3};
+  Tensor *x = new Tensor(data, {3});
+  Tensor *ones = Tensor::ones({3});
+  Tensor *zeros = Tensor::zeros({3});
+  Tensor *twos = Tensor::full({3}, 2.0f);
+
+  LazyMode lazy;
+  fuser->reset_stats();
+  Tensor *same = x->mul(ones)->add(zeros);
+  Tensor *doubled = x->mul(twos);
+  // the value at record time is used, like an eager kernel would
+  twos->fill(5.0f);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(same->getElement(i), data[i]);
+    EXPECT_EQ(doubled->getElement(i), 2 * data[i]);
+  }
+  EXPECT_EQ(fuser->launches(), 2);
+  // x * 1 + 0 is a copy of x, x * 2 is one scalar op
+  EXPECT_EQ(fuser->fused_ops(), 1);
+}
+
+TEST(FusedSimplify, AFilledViewIsOnlyConstantWhereItWasFilled) {
+  Tensor *m = Tensor::ones({2, 3});
+  std::vector<Slice> first_row = {Slice(0, 1), Slice(0, 3)};
+  m->view(first_row)->fill(5.0f);
+
+  LazyMode lazy;
+  fuser->reset_stats();
+  Tensor *shifted = m->add(0.5f);
+  Tensor *row = m->view(first_row)->mul(2.0f);
+  for (int j = 0; j < 3; j++) {
+    EXPECT_EQ(shifted->getElement(0, j), 5.5f);
+    EXPECT_EQ(shifted->getElement(1, j), 1.5f);
+    EXPECT_EQ(row->getElement(0, j), 10.0f);
+  }
+  // the whole buffer is loaded, the filled row folds into a constant
+  EXPECT_EQ(fuser->fused_ops(), 1);
+}
@@ -0,0 +1,118 @@
+#include "main.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+static const int ROWS = 16;
+static const int COLS = 8;
+
+struct Model {
+  std::vector<float> x_values = wave(ROWS * COLS, 1.0f, 0.0f);
+  std::vector<float> w_values = wave(COLS, 0.5f, 1.0f);
+  std::vector<float> b_values = wave(COLS, 0.2f, 2.0f);
+  Tensor *w = new Tensor(w_values, {COLS}, DType::float32, true);
+  Tensor *b = new Tensor(b_values, {COLS}, DType::float32, true);
+
+  // the summed loss of `rows` rows from `first`
+  Tensor *loss(int first, int rows) const {
+    std::vector<float> x(x_values.begin() + first * COLS,
+                         x_values.begin() + (first + rows) * COLS);
+    Tensor *input = new Tensor(x, {rows, COLS});
+    return input->mul(w)->add(b)->sigmoid()->sum_to({1});
+  }
+};
+
+TEST(GradAccumulation, MatchesTheFullBatch) {
+  Model model;
+  Tensor *full = model.loss(0, ROWS)->mul(0.25f);
+  full->backward();
+  std::vector<float> w_grad = values_of(model.w->grad);
+  std::vector<float> b_grad = values_of(model.b->grad);
+  model.w->grad = model.b->grad = nullptr;
+
+  Tensor *mean = accumulate_gradients({model.w, model.b}, 4, [&](int i) {
+    return model.loss(i * ROWS / 4, ROWS / 4);
+  });
+  EXPECT_NEAR(mean->getElement(0), full->getElement(0), 1e-5);
+  for (int i = 0; i < COLS; i++) {
+    ASSERT_NEAR(model.w->grad->getElement(i), w_grad[i], 1e-5) << i;
+    ASSERT_NEAR(model.b->grad->getElement(i), b_grad[i], 1e-5) << i;
+  }
+}
+
+TEST(GradAccumulation, KeepsOnlyTheGradientBuffers) {
+  Model model;
+  SGD sgd({model.w, model.b}, 0.1f);
+  std::vector<Memory *> intermediates;
+  auto loss = [&](int i) {
+    Tensor *value = model.loss(i * 2, 2);
+    intermediates.push_back(value->memory);
+    return value;
+  };
+  accumulate_gradients(sgd.params(), 8, loss);
+  Memory *w_grad = model.w->grad->memory;
+  std::vector<float> first = values_of(model.w->grad);
+
+  sgd.zero_grad();
+  accumulate_gradients(sgd.params(), 8, loss);
+  EXPECT_EQ(model.w->grad->memory, w_grad);
+  EXPECT_TRUE(pool->in_use(w_grad));
+  EXPECT_EQ(values_of(model.w->grad), first);
+  // the graph of a micro-batch is back in the pool
+  EXPECT_FALSE(pool->in_use(intermediates.back()));
+}
+
+TEST(GradAccumulation, KeepsTheGradientsOfLeavesOutsideParams) {
+  Model model;
+  model.loss(0, ROWS)->mul(0.25f)->backward();
+  std::vector<float> b_grad = values_of(model.b->grad);
+  model.w->grad = model.b->grad = nullptr;
+
+  // b adopts the gradient the first micro-batch computed for it
+  accumulate_gradients({model.w}, 4, [&](int i) {
+    return model.loss(i * ROWS / 4, ROWS / 4);
+  });
+  EXPECT_TRUE(pool->in_use(model.b->grad->memory));
+  for (int i = 0; i < COLS; i++)
+    ASSERT_NEAR(model.b->grad->getElement(i), b_grad[i], 1e-5) << i;
+}
+
+TEST(GradAccumulation, RejectsInvalidArguments) {
+  Model model;
+  auto loss = [&](int i) { return model.loss(i, 1); };
+  EXPECT_THROW(accumulate_gradients({model.w, model.b}, 0, loss),
+               std::invalid_argument);
+  auto failing = [&](int i) -> Tensor * {
+    if (i == 1)
+      throw std::runtime_error("bad batch");
+    return model.loss(i, 1);
+  };
+  EXPECT_THROW(accumulate_gradients({model.w, model.b}, 2, failing),
+               std::runtime_error);
+}
+
+TEST(GradAccumulation, AFailingMicroBatchReturnsItsMemory) {
+  Model model;
+  Memory *value = nullptr;
+  auto failing = [&](int i) -> Tensor * {
+    Tensor *loss = model.loss(i, 1);
+    if (i == 1) {
+      value = loss->memory;
+      throw std::runtime_error("bad batch");
+    }
+    return loss;
+  };
+  EXPECT_THROW(accumulate_gradients({model.w, model.b}, 2, failing),
+               std::runtime_error);
+  EXPECT_FALSE(pool->in_use(value));
+  // the first micro-batch has already added its gradients
+  EXPECT_TRUE(pool->in_use(model.w->grad->memory));
+  std::vector<float> w_grad = values_of(model.w->grad);
+  model.w->grad = model.b->grad = nullptr;
+  model.loss(0, 1)->mul(0.5f)->backward();
+  for (int i = 0; i < COLS; i++)
+    ASSERT_NEAR(w_grad[i], model.w->grad->getElement(i), 1e-5) << i;
+}
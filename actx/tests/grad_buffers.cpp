@@ -0,0 +1,95 @@
+#include "optimizer.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+static const int SIZE = 500;
+
+TEST(GradBuffers, ZeroGradKeepsTheBuffers) {
+  std::vector<float> x_values = wave(SIZE, 1.0f, 1.0f);
+  Tensor *x = new Tensor(x_values, {SIZE});
+  Tensor *w = Tensor::full({SIZE}, 0.5f, DType::float32, true);
+  Tensor *b = Tensor::zeros({SIZE}, DType::float32, true);
+  SGD sgd({w, b}, 0.1f);
+
+  x->mul(w)->add(b)->backward();
+  Memory *w_grad = w->grad->memory;
+  Memory *b_grad = b->grad->memory;
+  for (int step = 0; step < 3; step++) {
+    sgd.zero_grad();
+    EXPECT_EQ(w->grad->getElement(7), 0.0f);
+    x->mul(w)->add(b)->mul(2.0f)->backward();
+    EXPECT_EQ(w->grad->memory, w_grad);
+    EXPECT_EQ(b->grad->memory, b_grad);
+    for (int i = 0; i < SIZE; i++) {
+      ASSERT_FLOAT_EQ(w->grad->getElement(i), 2.0f * x_values[i]) << i;
+      ASSERT_FLOAT_EQ(b->grad->getElement(i), 2.0f) << i;
+    }
+  }
+
+  // without zeroing the passes accumulate into the same buffer
+  x->mul(w)->backward();
+  EXPECT_EQ(w->grad->memory, w_grad);
+  EXPECT_FLOAT_EQ(w->grad->getElement(3), 3.0f * x_values[3]);
+
+  sgd.zero_grad(true);
+  EXPECT_EQ(w->grad, nullptr);
+  EXPECT_EQ(b->grad, nullptr);
+  x->mul(w)->backward();
+  EXPECT_FLOAT_EQ(w->grad->getElement(3), x_values[3]);
+}
+
+TEST(GradBuffers, RootsAreSeededWithoutAFilledTensor) {
+  Tensor *x = Tensor::full({64, 32}, 3.0f, DType::float32, true);
+  Tensor *y = x->mul(2.0f);
+  y->backward();
+  // a broadcast view of one element
+  EXPECT_EQ(y->grad->dims, y->dims);
+  EXPECT_EQ(y->grad->stride, std::vector<int>({0, 0}));
+  EXPECT_EQ(y->grad->memory->bytesize, sizeof(float));
+  EXPECT_FLOAT_EQ(y->grad->getElement(63, 31), 1.0f);
+  EXPECT_FLOAT_EQ(x->grad->getElement(63, 31), 2.0f);
+
+  Tensor *z = x->sigmoid();
+  z->backward();
+  EXPECT_EQ(z->grad->memory, y->grad->memory);
+
+  // a leaf root gets a buffer of its own, the seed is never written
+  Tensor *leaf = Tensor::zeros({4}, DType::float32, true);
+  leaf->backward();
+  leaf->backward();
+  EXPECT_NE(leaf->grad->memory, y->grad->memory);
+  EXPECT_FLOAT_EQ(leaf->grad->getElement(2), 2.0f);
+  EXPECT_FLOAT_EQ(y->grad->getElement(0, 0), 1.0f);
+}
+
+TEST(GradBuffers, EveryFormulaAccumulates) {
+  std::vector<float> values = wave(SIZE, 0.5f, 1.0f);
+  Tensor *x = new Tensor(values, {SIZE}, DType::float32, true);
+  x->sin()->backward();
+  x->atan()->backward();
+  x->sinh()->backward();
+  for (int i = 0; i < SIZE; i++) {
+    float expected = std::cos(values[i]) +
+                     1.0f / (1.0f + values[i] * values[i]) +
+                     std::cosh(values[i]);
+    ASSERT_NEAR(x->grad->getElement(i), expected, 1e-5) << i;
+  }
+}
+
+TEST(GradBuffers, IntermediatesStartEveryPassWithoutAGradient) {
+  std::vector<float> values = wave(SIZE, 0.5f, 1.0f);
+  Tensor *x = new Tensor(values, {SIZE}, DType::float32, true);
+  Tensor *h = x->mul(3.0f);
+  h->sin()->backward();
+  h->cos()->backward();
+  for (int i = 0; i < SIZE; i++) {
+    float expected =
+        3.0f * (std::cos(3.0f * values[i]) - std::sin(3.0f * values[i]));
+    ASSERT_NEAR(x->grad->getElement(i), expected, 1e-5) << i;
+  }
+  // the last pass is all h holds
+  EXPECT_FLOAT_EQ(h->grad->getElement(5), -std::sin(3.0f * values[5]));
+}
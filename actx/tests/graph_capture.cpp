@@ -0,0 +1,95 @@
+#include "fusion.h"
+#include "graph.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(GraphCapture, ReplaysWithNewInputs) {
+  std::vector<float> a_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> b_data = {0.5f, -1, 0.25f, 0, 2, -0.5f};
+  std::vector<float> r_data = {-1, 0, 1};
+  Tensor *a = new Tensor(a_data, {2, 3});
+  Tensor *b = new Tensor(b_data, {2, 3});
+  Tensor *row = new Tensor(r_data, {1, 3});
+
+  Graph graph;
+  Tensor *result;
+  {
+    GraphCapture capture(graph);
+    result = a->mul(b)->add(row)->tanh();
+  }
+  EXPECT_EQ(graph.size(), 3);
+
+  for (int i = 0; i < 6; i++) {
+    a_data[i] = -a_data[i] / 4;
+    a->setElement(a_data[i], i / 3, i % 3);
+  }
+  dispatcher->reset_stats();
+  graph.replay();
+  const DispatchStats &stats = dispatcher->stats();
+  EXPECT_EQ(stats.contiguous + stats.row + stats.strided + stats.scalar, 0)
+      << "replay must not go through the dispatcher";
+  for (int i = 0; i < 6; i++) {
+    float expected = std::tanh(a_data[i] * b_data[i] + r_data[i % 3]);
+    EXPECT_NEAR(result->getElement(i / 3, i % 3), expected, 1e-5);
+  }
+}
+
+TEST(GraphCapture, ReplaysBackward) {
+  std::vector<float> x_data = {0.5f, 1, 2};
+  Tensor *x = new Tensor(x_data, {3}, DType::float32, true);
+
+  Graph graph;
+  graph.begin();
+  // z = exp(x) * x, dz/dx = exp(x) * (x + 1)
+  Tensor *z = x->exp()->mul(x);
+  z->backward();
+  graph.end();
+  Tensor *grad = x->grad;
+
+  x_data = {-1, 0.25f, 3};
+  for (int i = 0; i < 3; i++) {
+    x->setElement(x_data[i], i);
+  }
+  graph.replay();
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(z->getElement(i), std::exp(x_data[i]) * x_data[i], 1e-4);
+    float expected = std::exp(x_data[i]) * (x_data[i] + 1);
+    EXPECT_NEAR(grad->getElement(i), expected, 1e-4);
+  }
+}
+
+TEST(GraphCapture, LazyProgramsAreCaptured) {
+  std::vector<float> data = {1, 4, 9};
+  Tensor *x = new Tensor(data, {3});
+
+  Graph graph;
+  Tensor *root;
+  Tensor *result;
+  {
+    LazyMode lazy;
+    Tensor *before = x->mul(3.0f);
+    before->add(1.0f);
+    GraphCapture capture(graph);
+    root = x->sqrt();
+    result = root->add(1.0f)->mul(2.0f);
+  }
+  // the chain was still pending when the capture ended, it is one launch.
+  // the programs recorded before it and the intermediates are not captured
+  EXPECT_EQ(graph.size(), 1);
+  x->setElement(16, 2);
+  graph.replay();
+  EXPECT_NEAR(result->getElement(2), 10.0f, 1e-5);
+  // the write ran it first, with the value x had outside the graph
+  EXPECT_NEAR(root->getElement(2), 3.0f, 1e-5);
+}
+
+TEST(GraphCapture, OneCaptureAtATime) {
+  Graph outer;
+  Graph inner;
+  GraphCapture capture(outer);
+  EXPECT_THROW(inner.begin(), std::logic_error);
+  EXPECT_THROW(outer.replay(), std::logic_error);
+}
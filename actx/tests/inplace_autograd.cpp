@@ -0,0 +1,123 @@
+#include "opnode.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+static const int SIZE = 300;
+
+// elementwise ops on x * w, in place or not. a result kept for the backward
+// pass (exp, sqrt, sigmoid and div) is not written again
+static Tensor *chain(Tensor *x, Tensor *w, Tensor *d, bool inplace) {
+  Tensor *h = x->mul(w);
+  h = h->add(w, inplace);
+  h = h->mul(2.0f, inplace);
+  h = h->relu(inplace);
+  h = h->div(d, inplace);
+  Tensor *e = h->mul(0.1f)->exp(inplace);
+  Tensor *s = e->add(1.0f)->sqrt(inplace);
+  return s->sub(1.0f)->sigmoid(inplace);
+}
+
+TEST(InPlaceAutograd, MatchesTheOutOfPlaceGraph) {
+  std::vector<float> x_values = wave(SIZE, 1.0f);
+  std::vector<float> w_values = wave(SIZE, 0.5f, 0.0f, 0.2f);
+  // the divisor stays away from zero
+  std::vector<float> d_values = wave(SIZE, 0.5f, 0.0f, 1.5f);
+  std::vector<float> scale = wave(SIZE, 1.0f, 0.0f, 0.5f);
+  std::vector<std::vector<float>> expected;
+  for (bool inplace : {false, true}) {
+    Tensor *x = new Tensor(x_values, {SIZE}, DType::float32, true);
+    Tensor *w = new Tensor(w_values, {SIZE}, DType::float32, true);
+    Tensor *d = new Tensor(d_values, {SIZE}, DType::float32, true);
+    Tensor *out = chain(x, w, d, inplace);
+    out->mul(new Tensor(scale, {SIZE}))->backward();
+    std::vector<std::vector<float>> grads = {values_of(out), values_of(x->grad),
+                                             values_of(w->grad),
+                                             values_of(d->grad)};
+    if (!inplace) {
+      expected = grads;
+      continue;
+    }
+    for (int k = 0; k < grads.size(); k++)
+      for (int i = 0; i < SIZE; i++)
+        ASSERT_NEAR(grads[k][i], expected[k][i], 1e-5) << k << " " << i;
+  }
+}
+
+TEST(InPlaceAutograd, EarlierReadersKeepTheOldValue) {
+  Tensor *x = Tensor::ones({8}, DType::float32, true);
+  Tensor *h = x->mul(2.0f);
+  Tensor *y = h->mul(3.0f);
+  h->mul(5.0f, true);
+  // d(6x + 10x) / dx
+  h->add(y)->backward();
+  for (int i = 0; i < 8; i++)
+    EXPECT_FLOAT_EQ(x->grad->getElement(i), 16.0f);
+
+  // a residual update reads the tensor it writes
+  Tensor *z = Tensor::ones({8}, DType::float32, true);
+  Tensor *r = z->mul(1.0f);
+  r->add(r->mul(3.0f), true);
+  r->backward();
+  for (int i = 0; i < 8; i++)
+    EXPECT_FLOAT_EQ(z->grad->getElement(i), 4.0f);
+}
+
+TEST(InPlaceAutograd, OverwritingASavedTensorFailsTheBackwardPass) {
+  Tensor *x = Tensor::ones({8}, DType::float32, true);
+  Tensor *w = Tensor::ones({8}, DType::float32, true);
+
+  // exp keeps its result
+  Tensor *e = x->mul(1.0f)->exp();
+  Tensor *loss = e->mul(2.0f);
+  e->add(1.0f, true);
+  EXPECT_THROW(loss->backward(), std::runtime_error);
+
+  // the gradient of w reads a
+  Tensor *a = x->mul(1.0f);
+  Tensor *product = a->mul(w);
+  a->add(1.0f, true);
+  EXPECT_THROW(product->backward(), std::runtime_error);
+
+  // add reads neither operand
+  Tensor *b = x->mul(1.0f);
+  Tensor *sum = b->add(w);
+  b->mul(4.0f, true);
+  x->grad = nullptr;
+  sum->backward();
+  EXPECT_FLOAT_EQ(x->grad->getElement(0), 1.0f);
+}
+
+TEST(InPlaceAutograd, VersionsCountTheWrites) {
+  Tensor *t = Tensor::zeros({4});
+  int version = t->memory->version;
+  t->add(1.0f, true);
+  t->relu(true);
+  t->setElement(3.0f, 2);
+  EXPECT_EQ(t->memory->version, version + 3);
+
+  // a node remembers what it saw
+  Tensor *x = Tensor::ones({4}, DType::float32, true);
+  Tensor *h = x->mul(1.0f);
+  Tensor *s = h->sigmoid();
+  ASSERT_EQ(s->node->input_versions.size(), 1);
+  EXPECT_EQ(s->node->input_versions[0], h->memory->version);
+  EXPECT_EQ(s->node->output_versions[0], s->memory->version);
+}
+
+TEST(InPlaceAutograd, RejectsLeavesAndViews) {
+  Tensor *leaf = Tensor::ones({4, 2}, DType::float32, true);
+  EXPECT_THROW(leaf->add(1.0f, true), std::runtime_error);
+  EXPECT_THROW(leaf->relu(true), std::runtime_error);
+  EXPECT_THROW(leaf->mul(Tensor::ones({4, 2}), true), std::runtime_error);
+  EXPECT_THROW(leaf->mul(1.0f)->transpose()->exp(true), std::runtime_error);
+
+  // without grad the tensor stays out of the graph
+  Tensor *plain = Tensor::ones({4, 2});
+  plain->add(leaf, true);
+  EXPECT_FALSE(plain->requires_grad);
+  EXPECT_EQ(plain->node, nullptr);
+  EXPECT_FLOAT_EQ(plain->getElement(1, 1), 2.0f);
+}
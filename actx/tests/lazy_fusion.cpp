@@ -0,0 +1,124 @@
+#include "fusion.h"
+#include "main.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(LazyFusion, ChainRunsAsOneKernel) {
+  std::vector<float> a_data = {1, 2, 3, 4};
+  std::vector<float> b_data = {0.5f, -1, 0.25f, 0};
+  std::vector<float> c_data = {-1, 1, 0, 2};
+  Tensor *a = new Tensor(a_data, {2, 2});
+  Tensor *b = new Tensor(b_data, {2, 2});
+  Tensor *c = new Tensor(c_data, {2, 2});
+
+  Tensor *result;
+  {
+    LazyMode lazy;
+    fuser->reset_stats();
+    result = a->mul(b)->add(c)->tanh();
+    EXPECT_EQ(fuser->launches(), 0);
+    EXPECT_TRUE(fuser->is_pending(result));
+
+    EXPECT_NEAR(result->getElement(0, 1), std::tanh(-1.0f), 1e-5);
+    EXPECT_EQ(fuser->launches(), 1);
+    EXPECT_EQ(fuser->fused_ops(), 3);
+  }
+  for (int i = 0; i < 4; i++) {
+    float expected = std::tanh(a_data[i] * b_data[i] + c_data[i]);
+    EXPECT_NEAR(result->getElement(i / 2, i % 2), expected, 1e-5);
+  }
+}
+
+TEST(LazyFusion, IntermediatesStayReadable) {
+  std::vector<float> data = {1, 4, 9};
+  Tensor *x = new Tensor(data, {3});
+
+  LazyMode lazy;
+  Tensor *root = x->sqrt();
+  Tensor *shifted = root->add(1.0f)->mul(2.0f);
+  EXPECT_EQ(shifted->getElement(2), 8.0f);
+  // root was inlined into shifted but still computes on its own when read
+  EXPECT_EQ(root->getElement(1), 2.0f);
+}
+
+TEST(LazyFusion, InPlaceWriteFlushesReaders) {
+  std::vector<float> data = {1, 2, 3};
+  Tensor *x = new Tensor(data, {3});
+
+  LazyMode lazy;
+  Tensor *doubled = x->mul(2.0f);
+  // the in-place op runs now, doubled has to see the old values of x
+  x->add(10.0f, true);
+  EXPECT_EQ(doubled->getElement(2), 6.0f);
+  EXPECT_EQ(x->getElement(2), 13.0f);
+}
+
+TEST(LazyFusion, BroadcastAndStridedLeaves) {
+  std::vector<float> m_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> r_data = {10, 20};
+  Tensor *m = new Tensor(m_data, {2, 3});
+  Tensor *row = new Tensor(r_data, {1, 2});
+
+  LazyMode lazy;
+  fuser->reset_stats();
+  // transposed view (3, 2) plus a broadcast row, then a scalar op
+  Tensor *result = m->transpose()->add(row)->sub(1.0f);
+  EXPECT_EQ(result->dims, std::vector<int>({3, 2}));
+
+  std::vector<float> expected_data = {10, 23, 11, 24, 12, 25};
+  Tensor *expected = new Tensor(expected_data, {3, 2});
+  EXPECT_TRUE(result->logical_e(expected)->all());
+  EXPECT_EQ(fuser->launches(), 1) << "compare should fuse with the chain";
+}
+
+TEST(LazyFusion, Backward) {
+  std::vector<float> x_data = {0.5f, 1, 2};
+  Tensor *x = new Tensor(x_data, {3}, DType::float32, true);
+
+  LazyMode lazy;
+  // z = exp(x) * x, dz/dx = exp(x) * (x + 1)
+  Tensor *z = x->exp()->mul(x);
+  z->backward();
+
+  for (int i = 0; i < 3; i++) {
+    float expected = std::exp(x_data[i]) * (x_data[i] + 1);
+    EXPECT_NEAR(x->grad->getElement(i), expected, 1e-4);
+  }
+}
+
+TEST(LazyFusion, InlinedIntermediatesRunOnlyWhenRead) {
+  std::vector<float> data = {1, 4, 9};
+  Tensor *x = new Tensor(data, {3});
+
+  fuser->reset_stats();
+  Tensor *root;
+  Tensor *result;
+  {
+    LazyMode lazy;
+    root = x->sqrt();
+    result = root->add(1.0f)->mul(2.0f)->sub(3.0f);
+  }
+  // leaving lazy mode launches the chain once, not every step of it
+  EXPECT_EQ(fuser->launches(), 1);
+  EXPECT_EQ(fuser->fused_ops(), 4);
+  EXPECT_EQ(result->getElement(2), 5.0f);
+  EXPECT_EQ(root->getElement(1), 2.0f);
+  EXPECT_EQ(fuser->launches(), 2);
+}
+
+TEST(LazyFusion, DeletedIntermediatesAreDropped) {
+  std::vector<float> data = {1, 2, 3};
+  Tensor *x = new Tensor(data, {3});
+
+  fuser->reset_stats();
+  LazyMode lazy;
+  Tensor *doubled = x->mul(2.0f);
+  Tensor *result = doubled->add(1.0f);
+  delete doubled;
+  EXPECT_EQ(result->getElement(2), 7.0f);
+  // nothing that reads x is left to run before the write
+  x->setElement(10.0f, 0);
+  EXPECT_EQ(fuser->launches(), 1);
+}
@@ -0,0 +1,132 @@
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+// sizes that are not multiples of the 32x32 tiles or the 16 deep steps
+static const int M = 37, N = 45, K = 70;
+
+static float activate(Activation activation, float z) {
+  switch (activation) {
+  case Activation::RELU:
+    return z > 0.0f ? z : 0.0f;
+  case Activation::SIGMOID:
+    return 1.0f / (1.0f + std::exp(-z));
+  case Activation::TANH:
+    return std::tanh(z);
+  case Activation::GELU:
+    return 0.5f * z *
+           (1.0f + std::tanh(0.7978845608f * (z + 0.044715f * z * z * z)));
+  case Activation::SILU:
+    return z / (1.0f + std::exp(-z));
+  default:
+    return z;
+  }
+}
+
+static float derivative(Activation activation, float z) {
+  float h = 1e-3f;
+  if (activation == Activation::RELU)
+    return z > 0.0f ? 1.0f : 0.0f;
+  return (activate(activation, z + h) - activate(activation, z - h)) /
+         (2.0f * h);
+}
+
+struct Reference {
+  std::vector<float> x, w, b, pre;
+
+  Reference()
+      : x(wave(M * K, 0.5f, 0.0f)), w(wave(N * K, 0.2f, 1.0f)),
+        b(wave(N, 0.3f, 2.0f)), pre(M * N) {
+    for (int m = 0; m < M; m++)
+      for (int n = 0; n < N; n++) {
+        float z = b[n];
+        for (int k = 0; k < K; k++)
+          z += x[m * K + k] * w[n * K + k];
+        pre[m * N + n] = z;
+      }
+  }
+};
+
+static const Activation ACTIVATIONS[] = {
+    Activation::NONE, Activation::RELU, Activation::SIGMOID, Activation::TANH,
+    Activation::GELU, Activation::SILU};
+
+TEST(Linear, ForwardMatchesTheReference) {
+  Reference ref;
+  Tensor *x = new Tensor(ref.x, {M, K});
+  Tensor *w = new Tensor(ref.w, {N, K});
+  Tensor *b = new Tensor(ref.b, {N});
+  for (Activation activation : ACTIVATIONS) {
+    Tensor *out = x->linear(w, b, activation);
+    ASSERT_EQ(out->dims, std::vector<int>({M, N}));
+    std::vector<float> result = values_of(out);
+    for (int i = 0; i < M * N; i++)
+      ASSERT_NEAR(result[i], activate(activation, ref.pre[i]), 1e-4)
+          << "activation " << static_cast<int>(activation) << " at " << i;
+  }
+}
+
+TEST(Linear, WithoutBiasAndWithLeadingDims) {
+  Reference ref;
+  Tensor *x = new Tensor(ref.x, {M, K});
+  Tensor *w = new Tensor(ref.w, {N, K});
+  // x as [1, M, K], the bias is left out of the reference
+  Tensor *out = x->unsqueeze(0)->linear(w);
+  ASSERT_EQ(out->dims, std::vector<int>({1, M, N}));
+  std::vector<float> result = values_of(out);
+  for (int i = 0; i < M * N; i++)
+    ASSERT_NEAR(result[i], ref.pre[i] - ref.b[i % N], 1e-4);
+}
+
+TEST(Linear, BackwardMatchesTheReference) {
+  Reference ref;
+  // the upstream gradient is `scale`, so every element is weighted
+  std::vector<float> scale = wave(M * N, 1.0f, 0.5f);
+  for (Activation activation : ACTIVATIONS) {
+    Tensor *x = new Tensor(ref.x, {M, K}, DType::float32, true);
+    Tensor *w = new Tensor(ref.w, {N, K}, DType::float32, true);
+    Tensor *b = new Tensor(ref.b, {N}, DType::float32, true);
+    Tensor *loss = x->linear(w, b, activation)->mul(new Tensor(scale, {M, N}));
+    loss->backward();
+
+    std::vector<float> g(M * N);
+    for (int i = 0; i < M * N; i++)
+      g[i] = scale[i] * derivative(activation, ref.pre[i]);
+    std::vector<float> dx(M * K, 0.0f), dw(N * K, 0.0f), db(N, 0.0f);
+    for (int m = 0; m < M; m++)
+      for (int n = 0; n < N; n++) {
+        db[n] += g[m * N + n];
+        for (int k = 0; k < K; k++) {
+          dx[m * K + k] += g[m * N + n] * ref.w[n * K + k];
+          dw[n * K + k] += g[m * N + n] * ref.x[m * K + k];
+        }
+      }
+
+    // the finite difference derivatives are good to about 1e-3
+    std::vector<float> x_grad = values_of(x->grad);
+    std::vector<float> w_grad = values_of(w->grad);
+    std::vector<float> b_grad = values_of(b->grad);
+    for (int i = 0; i < M * K; i++)
+      ASSERT_NEAR(x_grad[i], dx[i], 1e-2)
+          << "activation " << static_cast<int>(activation) << " dx " << i;
+    for (int i = 0; i < N * K; i++)
+      ASSERT_NEAR(w_grad[i], dw[i], 1e-2)
+          << "activation " << static_cast<int>(activation) << " dw " << i;
+    for (int i = 0; i < N; i++)
+      ASSERT_NEAR(b_grad[i], db[i], 1e-2)
+          << "activation " << static_cast<int>(activation) << " db " << i;
+  }
+}
+
+TEST(Linear, RejectsInvalidShapes) {
+  Tensor *x = Tensor::ones({4, 3});
+  EXPECT_THROW(x->linear(Tensor::ones({5, 4})), std::invalid_argument);
+  EXPECT_THROW(x->linear(Tensor::ones({3})), std::invalid_argument);
+  EXPECT_THROW(x->linear(Tensor::ones({5, 3}), Tensor::ones({4})),
+               std::invalid_argument);
+  EXPECT_THROW(x->to(DType::int32)->linear(Tensor::ones({5, 3})),
+               std::invalid_argument);
+}
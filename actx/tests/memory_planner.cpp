@@ -0,0 +1,119 @@
+#include "main.h"
+#include "memory_planner.h"
+#include "tensor.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <vector>
+
+// allocations whose lifetimes overlap must not share bytes, unless an
+// in-place chain hands the block from one to the next
+static bool plan_is_valid(const AllocationTrace &trace,
+                          const MemoryPlan &plan) {
+  const std::vector<TracedAllocation> &a = trace.allocations;
+  std::vector<int> chain(a.size());
+  std::iota(chain.begin(), chain.end(), 0);
+  for (const InplaceCandidate &c : trace.inplace) {
+    if (!a[c.input].persistent && a[c.input].last == c.step)
+      chain[c.output] = chain[c.input];
+  }
+  for (int i = 0; i < a.size(); i++) {
+    for (int j = i + 1; j < a.size(); j++) {
+      int last_i = a[i].persistent ? INT_MAX : a[i].last;
+      int last_j = a[j].persistent ? INT_MAX : a[j].last;
+      bool live_together = a[i].first <= last_j && a[j].first <= last_i;
+      bool share = plan.offsets[i] < plan.offsets[j] + a[j].bytes &&
+                   plan.offsets[j] < plan.offsets[i] + a[i].bytes;
+      if (live_together && share && chain[i] != chain[j])
+        return false;
+    }
+  }
+  return true;
+}
+
+// x0 -> x1 -> x2 -> x3, each op reads the previous tensor and allocates the
+// next one before it runs
+static AllocationTrace chain_trace() {
+  AllocationTrace trace;
+  for (int i = 0; i < 4; i++) {
+    trace.allocations.push_back({1024, DType::float32, i, i + 2});
+  }
+  trace.steps = 5;
+  return trace;
+}
+
+TEST(MemoryPlanner, ReusesDeadIntermediates) {
+  AllocationTrace trace = chain_trace();
+  MemoryPlan plan = plan_memory(trace, 256);
+  EXPECT_TRUE(plan_is_valid(trace, plan));
+  EXPECT_EQ(plan.naive_bytes, 4096);
+  // x0 and x2 overlap at step 2, three blocks are live at once
+  EXPECT_EQ(plan.arena_bytes, 3072);
+  EXPECT_EQ(plan.live_peak_bytes, 3072);
+}
+
+TEST(MemoryPlanner, InPlaceChainsShareOneBlock) {
+  AllocationTrace trace = chain_trace();
+  for (int i = 0; i < 3; i++) {
+    trace.inplace.push_back({i, i + 1, i + 2});
+  }
+  MemoryPlan plan = plan_memory(trace, 256);
+  EXPECT_TRUE(plan_is_valid(trace, plan));
+  EXPECT_EQ(plan.inplace_reuses, 3);
+  EXPECT_EQ(plan.arena_bytes, 1024);
+}
+
+TEST(MemoryPlanner, PersistentAllocationsAreNotReused) {
+  AllocationTrace trace = chain_trace();
+  trace.allocations[0].persistent = true;
+  trace.inplace.push_back({0, 1, 2});
+  MemoryPlan plan = plan_memory(trace, 256);
+  EXPECT_TRUE(plan_is_valid(trace, plan));
+  EXPECT_EQ(plan.inplace_reuses, 0);
+  for (int i = 1; i < 4; i++) {
+    EXPECT_NE(plan.offsets[i], plan.offsets[0]);
+  }
+}
+
+TEST(MemoryPlanner, ReplaysTrainingStep) {
+  std::vector<float> x_data = {0.5f, -1, 2, 0.25f};
+  std::vector<float> w_data = {1, 2, -0.5f, 3};
+  Tensor *x = new Tensor(x_data, {4});
+  Tensor *w = new Tensor(w_data, {4}, DType::float32, true);
+
+  // forward and backward of a small elementwise model
+  auto step = [&]() -> std::vector<Tensor *> {
+    w->grad = nullptr;
+    Tensor *h = x->mul(w)->add(1.0f)->tanh();
+    Tensor *y = h->mul(h)->mul(0.5f);
+    y->backward();
+    return {y, w->grad};
+  };
+
+  MemoryPlanner planner;
+  std::vector<Tensor *> eager = planner.trace(step);
+  std::vector<float> expected_y, expected_grad;
+  for (int i = 0; i < 4; i++) {
+    expected_y.push_back(eager[0]->getElement(i));
+    expected_grad.push_back(eager[1]->getElement(i));
+  }
+  const MemoryPlan &plan = planner.plan();
+  EXPECT_TRUE(plan_is_valid(planner.allocations(), plan));
+  EXPECT_LT(plan.arena_bytes, plan.naive_bytes) << plan.report();
+  EXPECT_GT(plan.inplace_reuses, 0);
+
+  for (int run = 0; run < 2; run++) {
+    std::vector<Tensor *> planned = planner.run(step);
+    for (int i = 0; i < 4; i++) {
+      EXPECT_NEAR(planned[0]->getElement(i), expected_y[i], 1e-6);
+      EXPECT_NEAR(planned[1]->getElement(i), expected_grad[i], 1e-6);
+    }
+  }
+
+  auto longer = [&]() -> std::vector<Tensor *> {
+    std::vector<Tensor *> outputs = step();
+    outputs.push_back(x->exp());
+    return outputs;
+  };
+  EXPECT_THROW(planner.run(longer), std::logic_error);
+}
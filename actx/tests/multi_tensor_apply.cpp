@@ -0,0 +1,85 @@
+#include "graph.h"
+#include "main.h"
+#include "multi_tensor.h"
+#include "tensor.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+static Tensor *filled(int size, float start) {
+  std::vector<float> data(size);
+  for (int i = 0; i < size; i++)
+    data[i] = start + (i % 97) * 0.25f;
+  return new Tensor(data, {size});
+}
+
+TEST(MultiTensorApply, ScalesMixedSizes) {
+  std::vector<int> sizes = {1, 5, 4096, 4097, 33, 10000, 7, 2, 8192, 3};
+  std::vector<Tensor *> tensors;
+  for (int i = 0; i < sizes.size(); i++)
+    tensors.push_back(filled(sizes[i], i));
+  multi_tensor_apply(MultiTensorOp::SCALE, {tensors}, {-2.0f});
+  for (int i = 0; i < sizes.size(); i++) {
+    for (int j : {0, sizes[i] / 2, sizes[i] - 1}) {
+      EXPECT_FLOAT_EQ(tensors[i]->getElement(j), -2.0f * (i + (j % 97) * 0.25f))
+          << "tensor " << i << " element " << j;
+    }
+  }
+}
+
+TEST(MultiTensorApply, AxpyReadsTheSecondList) {
+  std::vector<Tensor *> x;
+  std::vector<Tensor *> y;
+  for (int i = 0; i < 9; i++) {
+    x.push_back(filled(100 + i, 1));
+    y.push_back(filled(100 + i, i));
+  }
+  multi_tensor_apply(MultiTensorOp::AXPY, {x, y}, {0.5f});
+  for (int i = 0; i < 9; i++) {
+    for (int j : {0, 50, 99 + i}) {
+      float expected = (1 + (j % 97) * 0.25f) + 0.5f * (i + (j % 97) * 0.25f);
+      EXPECT_FLOAT_EQ(x[i]->getElement(j), expected);
+      EXPECT_FLOAT_EQ(y[i]->getElement(j), i + (j % 97) * 0.25f);
+    }
+  }
+}
+
+TEST(MultiTensorApply, BatchesTensorsIntoFewLaunches) {
+  std::vector<Tensor *> tensors;
+  for (int i = 0; i < 12; i++)
+    tensors.push_back(Tensor::ones({16}));
+  Graph graph;
+  {
+    GraphCapture capture(graph);
+    multi_tensor_apply(MultiTensorOp::FILL, {tensors}, {3.0f});
+  }
+  // MAX_TENSORS tensors per launch
+  EXPECT_EQ(graph.size(), 12 / MultiTensorLimits::MAX_TENSORS);
+  for (Tensor *tensor : tensors)
+    EXPECT_EQ(tensor->getElement(15), 3.0f);
+}
+
+TEST(MultiTensorApply, LargeTensorsSpanLaunches) {
+  int size = MultiTensorLimits::MAX_CHUNKS * MultiTensorLimits::CHUNK_SIZE + 10;
+  Tensor *large = Tensor::ones({size});
+  Tensor *small = Tensor::ones({3});
+  multi_tensor_apply(MultiTensorOp::SCALE, {{small, large}}, {4.0f});
+  EXPECT_EQ(small->getElement(2), 4.0f);
+  EXPECT_EQ(large->getElement(0), 4.0f);
+  EXPECT_EQ(large->getElement(size - 1), 4.0f);
+  EXPECT_EQ(large->getElement(size - 11), 4.0f);
+}
+
+TEST(MultiTensorApply, RejectsInvalidOperands) {
+  Tensor *a = Tensor::ones({4});
+  Tensor *b = Tensor::ones({5});
+  EXPECT_THROW(multi_tensor_apply(MultiTensorOp::AXPY, {{a}}, {1.0f}),
+               std::invalid_argument);
+  EXPECT_THROW(multi_tensor_apply(MultiTensorOp::AXPY, {{a}, {b}}, {1.0f}),
+               std::invalid_argument);
+  EXPECT_THROW(multi_tensor_apply(MultiTensorOp::SCALE, {{a}}, {}),
+               std::invalid_argument);
+  Tensor *t = Tensor::ones({2, 3})->transpose();
+  EXPECT_THROW(multi_tensor_apply(MultiTensorOp::SCALE, {{t}}, {1.0f}),
+               std::invalid_argument);
+}
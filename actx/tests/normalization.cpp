@@ -0,0 +1,169 @@
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+// unlike wave(), not periodic in the row or column length
+static std::vector<float> uneven_wave(int size, float scale, float offset) {
+  std::vector<float> values(size);
+  for (int i = 0; i < size; i++)
+    values[i] = offset + scale * std::sin(0.61f * i + 0.3f * (i % 7));
+  return values;
+}
+
+// normalization of x as [rows, cols] over every row or every column, with
+// the gradients for an upstream gradient `grad`
+struct Reference {
+  int rows, cols;
+  bool per_row;
+  std::vector<float> mean, var, y, dx, dw, db;
+
+  Reference(const std::vector<float> &x, const std::vector<float> &w,
+            const std::vector<float> &b, const std::vector<float> &grad,
+            int rows, int cols, bool per_row, float eps = 1e-5f)
+      : rows(rows), cols(cols), per_row(per_row) {
+    int groups = per_row ? rows : cols;
+    int count = per_row ? cols : rows;
+    mean.assign(groups, 0.0f);
+    var.assign(groups, 0.0f);
+    for (int i = 0; i < rows * cols; i++)
+      mean[group(i)] += x[i] / count;
+    for (int i = 0; i < rows * cols; i++)
+      var[group(i)] += (x[i] - mean[group(i)]) * (x[i] - mean[group(i)]) /
+                       count;
+
+    std::vector<float> xhat(rows * cols), s1(groups, 0.0f), s2(groups, 0.0f);
+    y.resize(rows * cols);
+    dw.assign(cols, 0.0f);
+    db.assign(cols, 0.0f);
+    for (int i = 0; i < rows * cols; i++) {
+      int g = group(i), c = i % cols;
+      xhat[i] = (x[i] - mean[g]) / std::sqrt(var[g] + eps);
+      y[i] = xhat[i] * w[c] + b[c];
+      dw[c] += grad[i] * xhat[i];
+      db[c] += grad[i];
+      s1[g] += grad[i] * w[c];
+      s2[g] += grad[i] * w[c] * xhat[i];
+    }
+    dx.resize(rows * cols);
+    for (int i = 0; i < rows * cols; i++) {
+      int g = group(i);
+      float dxhat = grad[i] * w[i % cols];
+      dx[i] = (dxhat - (s1[g] + xhat[i] * s2[g]) / count) /
+              std::sqrt(var[g] + eps);
+    }
+  }
+
+  int group(int i) const { return per_row ? i / cols : i % cols; }
+};
+
+static void expect_near(const std::vector<float> &result,
+                        const std::vector<float> &expected, float tolerance,
+                        const char *what) {
+  ASSERT_EQ(result.size(), expected.size()) << what;
+  for (int i = 0; i < result.size(); i++)
+    ASSERT_NEAR(result[i], expected[i], tolerance) << what << " at " << i;
+}
+
+TEST(Normalization, LayerNormMatchesTheReference) {
+  // 300 features is more than the 256 threads that reduce a row
+  int rows = 3 * 37, cols = 300;
+  std::vector<float> x = uneven_wave(rows * cols, 2.0f, 5.0f);
+  std::vector<float> w = uneven_wave(cols, 0.5f, 1.0f);
+  std::vector<float> b = uneven_wave(cols, 0.3f, 0.0f);
+  std::vector<float> g = uneven_wave(rows * cols, 1.0f, 0.1f);
+  Reference ref(x, w, b, g, rows, cols, true);
+
+  Tensor *input = new Tensor(x, {3, 37, cols}, DType::float32, true);
+  Tensor *weight = new Tensor(w, {cols}, DType::float32, true);
+  Tensor *bias = new Tensor(b, {cols}, DType::float32, true);
+  Tensor *out = input->layer_norm(weight, bias);
+  ASSERT_EQ(out->dims, std::vector<int>({3, 37, cols}));
+  expect_near(values_of(out), ref.y, 1e-4, "y");
+
+  out->mul(new Tensor(g, {3, 37, cols}))->backward();
+  expect_near(values_of(input->grad), ref.dx, 1e-3, "dx");
+  expect_near(values_of(weight->grad), ref.dw, 1e-2, "dweight");
+  expect_near(values_of(bias->grad), ref.db, 1e-2, "dbias");
+}
+
+TEST(Normalization, LayerNormWithoutAffine) {
+  int rows = 5, cols = 9;
+  std::vector<float> x = uneven_wave(rows * cols, 3.0f, -1.0f);
+  std::vector<float> ones(cols, 1.0f), zeros(cols, 0.0f);
+  Reference ref(x, ones, zeros, std::vector<float>(rows * cols, 1.0f), rows,
+                cols, true);
+  Tensor *out = (new Tensor(x, {rows, cols}))->layer_norm();
+  expect_near(values_of(out), ref.y, 1e-4, "y");
+}
+
+TEST(Normalization, BatchNormTrainingMatchesTheReference) {
+  // 600 rows is more than the 256 threads that reduce a column
+  int rows = 600, cols = 7;
+  std::vector<float> x = uneven_wave(rows * cols, 1.5f, 3.0f);
+  std::vector<float> w = uneven_wave(cols, 0.5f, 1.0f);
+  std::vector<float> b = uneven_wave(cols, 0.3f, 0.0f);
+  std::vector<float> g = uneven_wave(rows * cols, 1.0f, -0.2f);
+  Reference ref(x, w, b, g, rows, cols, false);
+
+  Tensor *input = new Tensor(x, {rows, cols}, DType::float32, true);
+  Tensor *weight = new Tensor(w, {cols}, DType::float32, true);
+  Tensor *bias = new Tensor(b, {cols}, DType::float32, true);
+  Tensor *running_mean = Tensor::zeros({cols});
+  Tensor *running_var = Tensor::ones({cols});
+  Tensor *out = input->batch_norm(running_mean, running_var, weight, bias,
+                                  true, 0.1f);
+  expect_near(values_of(out), ref.y, 1e-4, "y");
+
+  std::vector<float> expected_mean(cols), expected_var(cols);
+  for (int c = 0; c < cols; c++) {
+    expected_mean[c] = 0.1f * ref.mean[c];
+    expected_var[c] = 0.9f + 0.1f * ref.var[c] * rows / (rows - 1);
+  }
+  expect_near(values_of(running_mean), expected_mean, 1e-5, "running mean");
+  expect_near(values_of(running_var), expected_var, 1e-5, "running var");
+
+  out->mul(new Tensor(g, {rows, cols}))->backward();
+  expect_near(values_of(input->grad), ref.dx, 1e-3, "dx");
+  expect_near(values_of(weight->grad), ref.dw, 1e-2, "dweight");
+  expect_near(values_of(bias->grad), ref.db, 1e-2, "dbias");
+}
+
+TEST(Normalization, BatchNormInferenceUsesTheRunningStats) {
+  int rows = 4, cols = 3;
+  std::vector<float> x = uneven_wave(rows * cols, 1.0f, 0.5f);
+  std::vector<float> mean = {0.5f, -1.0f, 2.0f};
+  std::vector<float> var = {4.0f, 0.25f, 1.0f};
+  std::vector<float> w = {2.0f, 1.0f, -1.0f};
+  Tensor *input = new Tensor(x, {rows, cols}, DType::float32, true);
+  Tensor *running_mean = new Tensor(mean, {cols});
+  Tensor *running_var = new Tensor(var, {cols});
+  Tensor *out = input->batch_norm(running_mean, running_var,
+                                  new Tensor(w, {cols}), nullptr, false);
+
+  std::vector<float> y(rows * cols), dx(rows * cols);
+  for (int i = 0; i < rows * cols; i++) {
+    int c = i % cols;
+    float rstd = 1.0f / std::sqrt(var[c] + 1e-5f);
+    y[i] = (x[i] - mean[c]) * rstd * w[c];
+    dx[i] = w[c] * rstd;
+  }
+  expect_near(values_of(out), y, 1e-5, "y");
+  // the running stats are left alone and are constants for the gradient
+  expect_near(values_of(running_mean), mean, 0.0f, "running mean");
+  out->backward();
+  expect_near(values_of(input->grad), dx, 1e-5, "dx");
+}
+
+TEST(Normalization, RejectsInvalidArguments) {
+  Tensor *x = Tensor::ones({4, 3});
+  EXPECT_THROW(x->layer_norm(Tensor::ones({4})), std::invalid_argument);
+  EXPECT_THROW(x->layer_norm(nullptr, Tensor::ones({3, 1})),
+               std::invalid_argument);
+  EXPECT_THROW(x->batch_norm(Tensor::zeros({3})), std::invalid_argument);
+  EXPECT_THROW(x->batch_norm(Tensor::zeros({4}), Tensor::ones({4})),
+               std::invalid_argument);
+  EXPECT_THROW(x->to(DType::int32)->layer_norm(), std::invalid_argument);
+}
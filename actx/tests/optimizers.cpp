@@ -0,0 +1,110 @@
+#include "main.h"
+#include "optimizer.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+static std::vector<float> ramp(int size, float start, float step) {
+  std::vector<float> values(size);
+  for (int i = 0; i < size; i++)
+    values[i] = start + i * step;
+  return values;
+}
+
+TEST(Optimizers, SGDMomentumMatchesTheReference) {
+  std::vector<float> p = ramp(50, -1.0f, 0.05f);
+  std::vector<float> g = ramp(50, 0.5f, -0.02f);
+  Tensor *param = new Tensor(p, {50});
+  Tensor *grad = new Tensor(g, {50});
+  SGD sgd({param}, 0.1f, 0.9f, 0.01f, true);
+
+  std::vector<float> buffer(50, 0.0f);
+  for (int step = 0; step < 3; step++) {
+    sgd.step({grad});
+    for (int i = 0; i < 50; i++) {
+      float d = g[i] + 0.01f * p[i];
+      buffer[i] = 0.9f * buffer[i] + d;
+      p[i] -= 0.1f * (d + 0.9f * buffer[i]);
+    }
+  }
+  std::vector<float> result = values_of(param);
+  for (int i = 0; i < 50; i++)
+    EXPECT_NEAR(result[i], p[i], 1e-5);
+}
+
+static void adam_reference(std::vector<float> &p, const std::vector<float> &g,
+                           int steps, float lr, float weight_decay,
+                           bool decoupled) {
+  std::vector<float> m(p.size(), 0.0f), v(p.size(), 0.0f);
+  for (int t = 1; t <= steps; t++) {
+    for (int i = 0; i < p.size(); i++) {
+      float grad = g[i];
+      if (decoupled)
+        p[i] *= 1.0f - lr * weight_decay;
+      else
+        grad += weight_decay * p[i];
+      m[i] = 0.9f * m[i] + 0.1f * grad;
+      v[i] = 0.999f * v[i] + 0.001f * grad * grad;
+      float m_hat = m[i] / (1.0f - std::pow(0.9f, t));
+      float v_hat = v[i] / (1.0f - std::pow(0.999f, t));
+      p[i] -= lr * m_hat / (std::sqrt(v_hat) + 1e-8f);
+    }
+  }
+}
+
+TEST(Optimizers, AdamAndAdamWMatchTheReference) {
+  for (bool decoupled : {false, true}) {
+    std::vector<Tensor *> params;
+    std::vector<std::vector<float>> expected;
+    for (int size : {3, 700, 5000}) {
+      std::vector<float> p = ramp(size, 0.25f, 0.001f);
+      std::vector<float> g = ramp(size, -0.3f, 0.0007f);
+      Tensor *param = new Tensor(p, {size}, DType::float32, true);
+      param->grad = new Tensor(g, {size});
+      params.push_back(param);
+      adam_reference(p, g, 4, 0.01f, 0.1f, decoupled);
+      expected.push_back(p);
+    }
+    Optimizer *optimizer =
+        decoupled ? new AdamW(params, 0.01f, 0.9f, 0.999f, 1e-8f, 0.1f)
+                  : new Adam(params, 0.01f, 0.9f, 0.999f, 1e-8f, 0.1f);
+    for (int step = 0; step < 4; step++)
+      optimizer->step();
+    for (int k = 0; k < params.size(); k++) {
+      std::vector<float> result = values_of(params[k]);
+      for (int i = 0; i < result.size(); i += 37)
+        EXPECT_NEAR(result[i], expected[k][i], 1e-5)
+            << (decoupled ? "AdamW" : "Adam") << " tensor " << k;
+    }
+    delete optimizer;
+  }
+}
+
+TEST(Optimizers, ParametersWithoutGradientsAreSkipped) {
+  std::vector<float> data = {1, 2, 3};
+  Tensor *with_grad = new Tensor(data, {3}, DType::float32, true);
+  Tensor *without_grad = new Tensor(data, {3}, DType::float32, true);
+  with_grad->grad = Tensor::ones({3});
+  SGD sgd({with_grad, without_grad}, 0.5f);
+  sgd.step();
+  EXPECT_EQ(with_grad->getElement(2), 2.5f);
+  EXPECT_EQ(without_grad->getElement(2), 3.0f);
+
+  sgd.zero_grad();
+  EXPECT_EQ(with_grad->grad->getElement(0), 0.0f);
+  sgd.step();
+  EXPECT_EQ(with_grad->getElement(2), 2.5f);
+}
+
+TEST(Optimizers, RejectsInvalidArguments) {
+  Tensor *param = Tensor::ones({2, 3});
+  EXPECT_THROW(SGD({param->transpose()}), std::invalid_argument);
+  EXPECT_THROW(SGD({param}, 0.1f, 0.0f, 0.0f, true), std::invalid_argument);
+  EXPECT_THROW(Adam({param}, 0.1f, 1.0f), std::invalid_argument);
+  SGD sgd({param});
+  EXPECT_THROW(sgd.step({Tensor::ones({4})}), std::invalid_argument);
+  EXPECT_THROW(sgd.step({param, param}), std::invalid_argument);
+}
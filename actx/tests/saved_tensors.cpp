@@ -0,0 +1,112 @@
+#include "main.h"
+#include "opnode.h"
+#include "tensor.h"
+#include "test_data.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <gtest/gtest.h>
+#include <vector>
+
+static const int SIZE = 200;
+
+static std::vector<Tensor *> saved(Tensor *result) {
+  return dispatcher->saved_tensors(result->node);
+}
+
+TEST(SavedTensors, OpsDeclareWhatTheyRead) {
+  Tensor *x = Tensor::full({4}, 2.0f, DType::float32, true);
+  Tensor *w = Tensor::full({4}, 3.0f, DType::float32, true);
+  Tensor *c = Tensor::full({4}, 3.0f);
+
+  Tensor *squared = x->pow(2.0f);
+  EXPECT_EQ(saved(squared), std::vector<Tensor *>({x}));
+  Tensor *root = x->pow(0.5f);
+  EXPECT_EQ(saved(root), std::vector<Tensor *>({root}));
+  Tensor *inverse = x->pow(-1.0f);
+  EXPECT_EQ(saved(inverse), std::vector<Tensor *>({inverse}));
+  Tensor *tangent = x->tan();
+  EXPECT_EQ(saved(tangent), std::vector<Tensor *>({tangent}));
+  EXPECT_EQ(saved(x->log()), std::vector<Tensor *>({x}));
+  EXPECT_TRUE(saved(x->add(w)).empty());
+
+  // only what the gradients that are needed read
+  EXPECT_EQ(saved(x->mul(c)), std::vector<Tensor *>({c}));
+  Tensor *quotient = x->div(c);
+  EXPECT_EQ(saved(quotient), std::vector<Tensor *>({c}));
+  quotient = x->div(w);
+  EXPECT_EQ(saved(quotient), std::vector<Tensor *>({w, quotient}));
+}
+
+// the gradient of f(x) * weights against the host derivative
+static void expect_gradient(const std::function<Tensor *(Tensor *)> &f,
+                            const std::function<float(float)> &derivative,
+                            float scale, float shift) {
+  std::vector<float> values = wave(SIZE, scale, 0.0f, shift);
+  std::vector<float> weights = wave(SIZE, 1.0f, 0.0f, 0.5f);
+  Tensor *x = new Tensor(values, {SIZE}, DType::float32, true);
+  f(x)->mul(new Tensor(weights, {SIZE}))->backward();
+  for (int i = 0; i < SIZE; i++) {
+    float expected = derivative(values[i]) * weights[i];
+    ASSERT_NEAR(x->grad->getElement(i), expected,
+                1e-4f * std::max(1.0f, std::fabs(expected)))
+        << i;
+  }
+}
+
+TEST(SavedTensors, DerivativesFromTheResult) {
+  for (float exponent : {2.0f, 0.5f, -1.0f, 3.0f, -1.5f}) {
+    SCOPED_TRACE(exponent);
+    expect_gradient([=](Tensor *x) { return x->pow(exponent); },
+                    [=](float v) {
+                      return exponent * std::pow(v, exponent - 1.0f);
+                    },
+                    1.0f, 2.0f);
+  }
+  expect_gradient([](Tensor *x) { return x->tan(); },
+                  [](float v) { return 1.0f / std::pow(std::cos(v), 2.0f); },
+                  1.0f, 0.0f);
+  expect_gradient([](Tensor *x) { return x->log(); },
+                  [](float v) { return 1.0f / v; }, 1.0f, 2.0f);
+  expect_gradient([](Tensor *x) { return x->atan(); },
+                  [](float v) { return 1.0f / (1.0f + v * v); }, 2.0f, 0.0f);
+  expect_gradient([](Tensor *x) { return x->atanh(); },
+                  [](float v) { return 1.0f / (1.0f - v * v); }, 0.8f, 0.0f);
+
+  // both gradients of a division share g / b
+  std::vector<float> a_values = wave(SIZE, 1.0f);
+  std::vector<float> b_values = wave(SIZE, 0.5f, 0.0f, 1.5f);
+  Tensor *a = new Tensor(a_values, {SIZE}, DType::float32, true);
+  Tensor *b = new Tensor(b_values, {SIZE}, DType::float32, true);
+  a->div(b)->backward();
+  for (int i = 0; i < SIZE; i++) {
+    float expected = -a_values[i] / (b_values[i] * b_values[i]);
+    ASSERT_NEAR(a->grad->getElement(i), 1.0f / b_values[i], 1e-5f) << i;
+    ASSERT_NEAR(b->grad->getElement(i), expected,
+                1e-5f * std::max(1.0f, std::fabs(expected)))
+        << i;
+  }
+}
+
+TEST(SavedTensors, InputsThatAreNotSavedCanBeOverwritten) {
+  std::vector<float> values = wave(SIZE, 1.0f, 0.0f, 2.0f);
+  Tensor *x = new Tensor(values, {SIZE}, DType::float32, true);
+
+  // the root is computed from its result, its input may change
+  Tensor *h = x->mul(1.0f);
+  Tensor *root = h->pow(0.5f);
+  h->add(1.0f, true);
+  root->backward();
+  for (int i = 0; i < SIZE; i++)
+    ASSERT_NEAR(x->grad->getElement(i), 0.5f / std::sqrt(values[i]), 1e-5f);
+
+  // and tan can run in place
+  std::vector<float> angles = wave(SIZE, 1.0f);
+  Tensor *y = new Tensor(angles, {SIZE}, DType::float32, true);
+  y->mul(1.0f)->tan(true)->backward();
+  for (int i = 0; i < SIZE; i++) {
+    float t = std::tan(angles[i]);
+    ASSERT_NEAR(y->grad->getElement(i), 1.0f + t * t,
+                1e-4f * (1.0f + t * t));
+  }
+}
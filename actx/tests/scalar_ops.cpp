@@ -0,0 +1,91 @@
+#include "main.h"
+#include "tensor.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(TensorScalarOps, ArithmeticWithScalar) {
+  std::vector<float> data = {1, 2, 4, 8, -2};
+  Tensor *a = new Tensor(data, {5});
+
+  std::vector<float> add_data = {3, 4, 6, 10, 0};
+  std::vector<float> sub_data = {-1, 0, 2, 6, -4};
+  std::vector<float> rsub_data = {1, 0, -2, -6, 4};
+  std::vector<float> mul_data = {0.5f, 1, 2, 4, -1};
+  std::vector<float> rdiv_data = {8, 4, 2, 1, -4};
+  EXPECT_TRUE(a->add(2.0f)->logical_e(new Tensor(add_data, {5}))->all());
+  EXPECT_TRUE(a->sub(2.0f)->logical_e(new Tensor(sub_data, {5}))->all());
+  EXPECT_TRUE(a->rsub(2.0f)->logical_e(new Tensor(rsub_data, {5}))->all());
+  EXPECT_TRUE(a->mul(0.5f)->logical_e(new Tensor(mul_data, {5}))->all());
+  EXPECT_TRUE(a->div(2.0f)->logical_e(new Tensor(mul_data, {5}))->all());
+  EXPECT_TRUE(a->rdiv(8.0f)->logical_e(new Tensor(rdiv_data, {5}))->all());
+}
+
+TEST(TensorScalarOps, InPlaceThroughView) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *parent = new Tensor(data, {2, 3});
+  std::vector<Slice> slice = {Slice(0, 2), Slice(1, 2)};
+
+  dispatcher->reset_stats();
+  parent->view(slice)->mul(10.0f, true);
+  EXPECT_EQ(dispatcher->stats().strided.load(), 1);
+
+  std::vector<float> expected_data = {1, 20, 3, 4, 50, 6};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all()) << "scalar mul on view";
+}
+
+TEST(TensorScalarOps, PowSpecialExponents) {
+  std::vector<float> data = {-3, -2, 1, 4};
+  Tensor *a = new Tensor(data, {4});
+
+  // pow() is undefined for negative bases, integral exponents must not use it
+  std::vector<float> square = {9, 4, 1, 16};
+  std::vector<float> cube = {-27, -8, 1, 64};
+  std::vector<float> reciprocal = {-1.0f / 3, -0.5f, 1, 0.25f};
+  std::vector<float> inverse_square = {1.0f / 9, 0.25f, 1, 1.0f / 16};
+  EXPECT_TRUE(a->pow(2.0f)->logical_e(new Tensor(square, {4}))->all());
+  EXPECT_TRUE(a->pow(3.0f)->logical_e(new Tensor(cube, {4}))->all());
+  EXPECT_TRUE(a->pow(-1.0f)->logical_e(new Tensor(reciprocal, {4}))->all());
+  EXPECT_TRUE(
+      a->pow(-2.0f)->logical_e(new Tensor(inverse_square, {4}))->all());
+
+  std::vector<float> positive = {1, 4, 9, 16};
+  Tensor *b = new Tensor(positive, {4});
+  std::vector<float> root = {1, 2, 3, 4};
+  EXPECT_TRUE(b->pow(0.5f)->logical_e(new Tensor(root, {4}))->all());
+
+  // no special case, goes through pow()
+  Tensor *general = b->pow(1.5f);
+  EXPECT_NEAR(general->getElement(1), 8.0f, 1e-4);
+  EXPECT_NEAR(general->getElement(3), 64.0f, 1e-4);
+}
+
+TEST(TensorScalarOps, FullAndFill) {
+  Tensor *a = Tensor::full({2, 3}, 1.5f);
+  EXPECT_EQ(a->getElement(1, 2), 1.5f);
+  a->fill(-4.0f);
+  EXPECT_EQ(a->getElement(0, 0), -4.0f);
+  EXPECT_EQ(a->getElement(1, 2), -4.0f);
+}
+
+TEST(TensorScalarOps, Backward) {
+  std::vector<float> x_data = {1, 2, 4};
+  Tensor *x = new Tensor(x_data, {3}, DType::float32, true);
+
+  // z = 3x + 4 / x, dz/dx = 3 - 4 / x^2
+  Tensor *z = x->mul(3.0f)->add(x->rdiv(4.0f));
+  z->backward();
+
+  std::vector<float> expected_data = {-1, 2, 2.75f};
+  Tensor *expected = new Tensor(expected_data, {3});
+  EXPECT_TRUE(x->grad->logical_e(expected)->all()) << "x grad incorrect";
+}
+
+TEST(TensorScalarOps, ZeroOverTensorBackward) {
+  std::vector<float> x_data = {1, 2, 4};
+  Tensor *x = new Tensor(x_data, {3}, DType::float32, true);
+  x->rdiv(0.0f)->backward();
+  for (int i = 0; i < 3; i++)
+    EXPECT_EQ(x->grad->getElement(i), 0.0f) << i;
+  EXPECT_TRUE(dispatcher->saved_tensors(x->rdiv(0.0f)->node).empty());
+}
@@ -0,0 +1,116 @@
+#include "tensor.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+TEST(TensorShapeViews, TransposeSharesMemory) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  Tensor *t = a->transpose();
+
+  std::vector<float> expected_data = {1, 4, 2, 5, 3, 6};
+  Tensor *expected = new Tensor(expected_data, {3, 2});
+
+  EXPECT_EQ(t->memory, a->memory) << "transpose should not copy";
+  EXPECT_FALSE(t->is_contigous);
+  EXPECT_EQ(t->dims, std::vector<int>({3, 2}));
+  EXPECT_TRUE(t->logical_e(expected)->all()) << "transpose failed";
+}
+
+TEST(TensorShapeViews, PermuteThreeDims) {
+  std::vector<float> data(24);
+  for (int i = 0; i < 24; i++)
+    data[i] = i;
+  Tensor *a = new Tensor(data, {2, 3, 4});
+  Tensor *p = a->permute({2, 0, 1});
+
+  EXPECT_EQ(p->dims, std::vector<int>({4, 2, 3}));
+  EXPECT_EQ(p->getElement(3, 1, 2), a->getElement(1, 2, 3));
+  EXPECT_THROW(a->permute({0, 0, 1}), std::invalid_argument);
+}
+
+TEST(TensorShapeViews, ReshapeInfersDim) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  Tensor *r = a->reshape({-1, 2});
+
+  Tensor *expected = new Tensor(data, {3, 2});
+  EXPECT_EQ(r->dims, std::vector<int>({3, 2}));
+  EXPECT_TRUE(r->is_contigous);
+  EXPECT_TRUE(r->logical_e(expected)->all()) << "reshape failed";
+  EXPECT_THROW(a->reshape({4, 2}), std::invalid_argument);
+}
+
+TEST(TensorShapeViews, ViewOfTransposeNeedsCompatibleStrides) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *a = new Tensor(data, {2, 3});
+  // splitting a dim of a transposed tensor is fine, flattening it is not
+  Tensor *split = a->transpose()->view({3, 2, 1});
+  EXPECT_EQ(split->getElement(2, 1, 0), 6);
+  EXPECT_THROW(a->transpose()->view({6}), std::runtime_error);
+}
+
+TEST(TensorShapeViews, ExpandUsesZeroStride) {
+  std::vector<float> row = {1, 2, 3};
+  Tensor *a = new Tensor(row, {3});
+  Tensor *e = a->expand({2, 3});
+
+  EXPECT_EQ(e->stride[0], 0);
+  std::vector<float> expected_data = {2, 3, 4, 2, 3, 4};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  Tensor *sum = e->add(Tensor::ones({2, 3}));
+  EXPECT_TRUE(sum->logical_e(expected)->all()) << "expand failed";
+  EXPECT_THROW(e->expand({4, 3}), std::invalid_argument);
+}
+
+TEST(TensorShapeViews, SqueezeAndUnsqueeze) {
+  std::vector<float> data = {1, 2, 3};
+  Tensor *a = new Tensor(data, {1, 3, 1});
+
+  EXPECT_EQ(a->squeeze()->dims, std::vector<int>({3}));
+  EXPECT_EQ(a->squeeze(0)->dims, std::vector<int>({3, 1}));
+  EXPECT_EQ(a->squeeze(1)->dims, std::vector<int>({1, 3, 1}));
+  EXPECT_EQ(a->unsqueeze(-1)->dims, std::vector<int>({1, 3, 1, 1}));
+  EXPECT_EQ(a->squeeze()->unsqueeze(0)->getElement(0, 2), 3);
+}
+
+TEST(TensorShapeViews, TransposeBackward) {
+  std::vector<float> x_data = {1, 2, 3, 4, 5, 6};
+  std::vector<float> w_data = {1, 2, 3, 4, 5, 6};
+  Tensor *x = new Tensor(x_data, {2, 3}, DType::float32, true);
+  Tensor *w = new Tensor(w_data, {3, 2});
+
+  Tensor *z = x->transpose()->mul(w);
+  z->backward();
+
+  // d(x^T * w)/dx = w^T
+  std::vector<float> expected_data = {1, 3, 5, 2, 4, 6};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(x->grad->logical_e(expected)->all()) << "x grad incorrect";
+}
+
+TEST(TensorShapeViews, ExpandBackwardSumsBroadcastDims) {
+  std::vector<float> x_data = {1, 2, 3};
+  std::vector<float> c_data = {1, 2, 3, 4, 5, 6};
+  Tensor *x = new Tensor(x_data, {3}, DType::float32, true);
+  Tensor *c = new Tensor(c_data, {2, 3});
+
+  Tensor *z = x->expand({2, 3})->mul(c);
+  z->backward();
+
+  std::vector<float> expected_data = {5, 7, 9};
+  Tensor *expected = new Tensor(expected_data, {3});
+  EXPECT_TRUE(x->grad->logical_e(expected)->all()) << "x grad incorrect";
+}
+
+TEST(TensorShapeViews, ReshapeBackward) {
+  std::vector<float> x_data = {1, 2, 3, 4};
+  Tensor *x = new Tensor(x_data, {2, 2}, DType::float32, true);
+
+  Tensor *z = x->reshape({4})->unsqueeze(0)->mul(Tensor::full({1, 4}, 2.0f));
+  z->backward();
+
+  Tensor *expected = Tensor::full({2, 2}, 2.0f);
+  EXPECT_EQ(x->grad->dims, std::vector<int>({2, 2}));
+  EXPECT_TRUE(x->grad->logical_e(expected)->all()) << "x grad incorrect";
+}
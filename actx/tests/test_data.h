@@ -0,0 +1,22 @@
+#pragma once
+
+#include "tensor.h"
+#include <cmath>
+#include <vector>
+
+// shift + scale * sin(frequency * i + phase) for i = 0 .. size - 1, inputs
+// that are not constant and the same on every run
+inline std::vector<float> wave(int size, float scale, float phase = 0.0f,
+                               float shift = 0.0f, float frequency = 0.37f) {
+  std::vector<float> values(size);
+  for (int i = 0; i < size; i++)
+    values[i] = shift + scale * std::sin(frequency * i + phase);
+  return values;
+}
+
+inline std::vector<float> values_of(Tensor *tensor) {
+  std::vector<float> values(tensor->size);
+  for (int i = 0; i < tensor->size; i++)
+    values[i] = tensor->getElement(i);
+  return values;
+}
@@ -2,7 +2,6 @@
 #include <gtest/gtest.h>
 #include <vector>
 
-/*
 TEST(TensorView, InPlaceAddModifiesOnlyView) {
   std::vector<float> data = {1, 2, 3, 4, 5, 6};
   Tensor *parent = new Tensor(data, {2, 3});
@@ -11,18 +10,17 @@ TEST(TensorView, InPlaceAddModifiesOnlyView) {
   std::vector<Slice> view_slice = {Slice(0, 2), Slice(1, 2)};
   Tensor *view = parent->view(view_slice);
 
-  Tensor *adder = new Tensor({10, 20}, {2, 1});
+  std::vector<float> adder_data = {10, 20};
+  Tensor *adder = new Tensor(adder_data, {2, 1});
   view->add(adder, true); // In-place add
 
   // Expected: only column 1 modified
   std::vector<float> expected_data = {1, 12, 3, 4, 25, 6};
-  EXPECT_EQ(parent->get_data(), expected_data)
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all())
       << "In-place add on view modified data outside the view.";
-
-  delete parent;
-  delete view;
-  delete adder;
 }
+
 TEST(TensorView, MulDoesNotAffectParentIfNotInplace) {
   std::vector<float> data = {2, 4, 6, 8};
   Tensor *parent = new Tensor(data, {2, 2});
@@ -33,7 +31,7 @@ TEST(TensorView, MulDoesNotAffectParentIfNotInplace) {
   Tensor *mul = new Tensor(data2, {2, 1});
   Tensor *result = view->mul(mul, false); // not in-place
 
-  std::vector<float> expected_result = {4, 12};
+  std::vector<float> expected_result = {4, 18};
   Tensor *expected = new Tensor(expected_result, {2, 1});
   EXPECT_TRUE(result->logical_e(expected)->all())
       << "Mul result on view is incorrect.";
@@ -44,12 +42,8 @@ TEST(TensorView, MulDoesNotAffectParentIfNotInplace) {
   Tensor *expectedp = new Tensor(expected_parent, {2, 2});
   EXPECT_TRUE(parent->logical_e(expectedp)->all())
       << "Non-inplace mul on view altered the parent.";
-
-  delete parent;
-  delete view;
-  delete mul;
-  delete result;
 }
+
 TEST(TensorView, SubtractionFromViewWorksCorrectly) {
   std::vector<float> data = {10, 20, 30, 40};
   Tensor *parent = new Tensor(data, {2, 2});
@@ -57,18 +51,14 @@ TEST(TensorView, SubtractionFromViewWorksCorrectly) {
   std::vector<Slice> slice = {Slice(0, 2), Slice(1, 2)}; // Second column
   Tensor *view = parent->view(slice);
 
-  Tensor *sub_tensor = new Tensor({5, 15}, {2, 1});
+  std::vector<float> sub_data = {5, 15};
+  Tensor *sub_tensor = new Tensor(sub_data, {2, 1});
   Tensor *result = view->sub(sub_tensor, false);
 
-  Tensor *expected = new Tensor({15, 25}, {2, 1});
+  std::vector<float> expected_data = {15, 25};
+  Tensor *expected = new Tensor(expected_data, {2, 1});
   EXPECT_TRUE(result->logical_e(expected)->all())
       << "View subtraction returned incorrect result.";
-
-  delete parent;
-  delete view;
-  delete sub_tensor;
-  delete result;
-  delete expected;
 }
 
 TEST(TensorView, DivisionOnViewIsLocalised) {
@@ -78,15 +68,103 @@ TEST(TensorView, DivisionOnViewIsLocalised) {
   std::vector<Slice> slice = {Slice(0, 2), Slice(1, 2)}; // Second column
   Tensor *view = parent->view(slice);
 
-  Tensor *div_tensor = new Tensor({2, 4}, {2, 1});
+  std::vector<float> div_data = {2, 4};
+  Tensor *div_tensor = new Tensor(div_data, {2, 1});
   view->div(div_tensor, true); // in-place
 
   std::vector<float> expected_parent = {8, 8, 24, 8};
-
-  EXPECT_EQ(parent->get_data(), expected_parent)
+  Tensor *expected = new Tensor(expected_parent, {2, 2});
+  EXPECT_TRUE(parent->logical_e(expected)->all())
       << "In-place division on view affected wrong elements.";
+}
+
+TEST(TensorView, UnaryOpReadsThroughStrides) {
+  std::vector<float> data = {1, 4, 9, 16, 25, 36};
+  Tensor *parent = new Tensor(data, {2, 3});
+
+  Tensor *result = parent->transpose()->sqrt();
+  std::vector<float> expected_data = {1, 4, 2, 5, 3, 6};
+  Tensor *expected = new Tensor(expected_data, {3, 2});
+  EXPECT_TRUE(result->logical_e(expected)->all())
+      << "sqrt of a transposed view is incorrect.";
+}
+
+TEST(TensorView, InPlaceUnaryWritesThroughView) {
+  std::vector<float> data = {1, 2, 3, 4, 5, 6};
+  Tensor *parent = new Tensor(data, {2, 3});
+
+  std::vector<Slice> slice = {Slice(0, 2), Slice(1, 3)};
+  parent->view(slice)->negate(true);
+
+  std::vector<float> expected_data = {1, -2, -3, 4, -5, -6};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all())
+      << "in-place negate leaked outside the view.";
+}
+
+TEST(TensorView, FillWritesThroughView) {
+  Tensor *parent = Tensor::zeros({3, 3});
+  std::vector<Slice> slice = {Slice(0, 3), Slice(2, 3)};
+  parent->view(slice)->fill(7.0f);
 
-  delete parent;
-  delete view;
-  delete div_tensor;
-}*/
+  std::vector<float> expected_data = {0, 0, 7, 0, 0, 7, 0, 0, 7};
+  Tensor *expected = new Tensor(expected_data, {3, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all()) << "fill on view failed";
+}
+
+TEST(TensorView, ReductionsUseLogicalOrder) {
+  std::vector<float> data = {1, 0, 1, 0, 1, 0};
+  Tensor *parent = new Tensor(data, {3, 2});
+
+  std::vector<Slice> first = {Slice(0, 3), Slice(0, 1)};
+  std::vector<Slice> second = {Slice(0, 3), Slice(1, 2)};
+  EXPECT_TRUE(parent->view(first)->all());
+  EXPECT_FALSE(parent->view(second)->any());
+  EXPECT_EQ(parent->view(second)->getElement(2, 0), 0);
+  EXPECT_EQ(parent->view(first)->getElement(2, 0), 1);
+}
+
+TEST(TensorView, CastOfStridedView) {
+  std::vector<float> data = {1.5f, 2.5f, 3.5f, 4.5f};
+  Tensor *parent = new Tensor(data, {2, 2});
+
+  Tensor *result = parent->transpose()->to(DType::int32);
+  EXPECT_EQ(result->getElement(0, 1), 3);
+  EXPECT_EQ(result->getElement(1, 0), 2);
+}
+
+TEST(TensorView, AssignWritesThroughStrides) {
+  Tensor *parent = Tensor::zeros({3, 3});
+  std::vector<float> data = {1, 2, 3};
+  std::vector<Slice> column = {Slice(0, 3), Slice(1, 2)};
+  parent->view(column)->assign((new Tensor(data, {3}))->view({3, 1}));
+
+  std::vector<float> expected_data = {0, 1, 0, 0, 2, 0, 0, 3, 0};
+  Tensor *expected = new Tensor(expected_data, {3, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all()) << "assign on view failed";
+}
+
+TEST(TensorView, AssignBetweenOverlappingViews) {
+  std::vector<float> data = {1, 2, 3, 4, 5};
+  Tensor *parent = new Tensor(data, {5});
+
+  // t[1:] = t[:-1] reads every element before it is overwritten
+  std::vector<Slice> tail = {Slice(1, 5)};
+  std::vector<Slice> head = {Slice(0, 4)};
+  parent->view(tail)->assign(parent->view(head));
+
+  std::vector<float> expected_data = {1, 1, 2, 3, 4};
+  Tensor *expected = new Tensor(expected_data, {5});
+  EXPECT_TRUE(parent->logical_e(expected)->all())
+      << "overlapping assign read elements it had already written.";
+}
+
+TEST(TensorView, AssignBroadcastsTheSource) {
+  Tensor *parent = Tensor::zeros({2, 3});
+  std::vector<float> data = {4, 5, 6};
+  parent->assign(new Tensor(data, {3}));
+
+  std::vector<float> expected_data = {4, 5, 6, 4, 5, 6};
+  Tensor *expected = new Tensor(expected_data, {2, 3});
+  EXPECT_TRUE(parent->logical_e(expected)->all()) << "assign did not broadcast";
+}